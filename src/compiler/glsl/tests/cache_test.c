@@ -493,6 +493,205 @@ test_put_key_and_get_key(void)
 
    disk_cache_destroy(cache);
 }
+
+static void
+fill_random(uint8_t *data, size_t size)
+{
+   for (size_t i = 0; i < size; i++)
+      data[i] = rand();
+}
+
+static void
+test_pack_put_and_get(void)
+{
+   struct disk_cache *cache;
+   char blob[] = "This is a blob of thirty-seven bytes";
+   uint8_t blob_key[20];
+   uint8_t *zeros, *random_data;
+   uint8_t zeros_key[20], random_keys[8][20];
+   char *result;
+   size_t size;
+   struct stat sb;
+   int count;
+
+   setenv("MESA_GLSL_CACHE_PACK", "true", 1);
+   setenv("MESA_GLSL_CACHE_MAX_SIZE", "1M", 1);
+   cache = disk_cache_create("test", "make_check", 0);
+
+   disk_cache_compute_key(cache, blob, sizeof(blob), blob_key);
+
+   result = disk_cache_get(cache, blob_key, &size);
+   expect_null(result, "pack: disk_cache_get with non-existent item (pointer)");
+   expect_equal(size, 0, "pack: disk_cache_get with non-existent item (size)");
+
+   /* An entry too small to be worth compressing. */
+   disk_cache_put(cache, blob_key, blob, sizeof(blob), NULL);
+   wait_until_file_written(cache, blob_key);
+
+   result = disk_cache_get(cache, blob_key, &size);
+   expect_equal_str(blob, result, "pack: disk_cache_get of existing item "
+                    "(pointer)");
+   expect_equal(size, sizeof(blob), "pack: disk_cache_get of existing item "
+                "(size)");
+   free(result);
+
+   /* A compressed entry. */
+   zeros = calloc(1, 64 * 1024);
+   disk_cache_compute_key(cache, zeros, 64 * 1024, zeros_key);
+   disk_cache_put(cache, zeros_key, zeros, 64 * 1024, NULL);
+   wait_until_file_written(cache, zeros_key);
+
+   result = disk_cache_get(cache, zeros_key, &size);
+   expect_non_null(result, "pack: disk_cache_get of compressed item");
+   expect_equal(size, 64 * 1024, "pack: disk_cache_get of compressed item "
+                "(size)");
+   expect_true(result && memcmp(result, zeros, 64 * 1024) == 0,
+               "pack: disk_cache_get of compressed item (data)");
+   free(result);
+   free(zeros);
+
+   expect_true(stat(CACHE_TEST_TMP "/mesa-glsl-cache-dir/" CACHE_DIR_NAME
+                    "/pack", &sb) == 0 && sb.st_size < 64 * 1024,
+               "pack: entries are stored compressed in the pack file");
+
+   /* The entries persist across caches. */
+   disk_cache_destroy(cache);
+   cache = disk_cache_create("test", "make_check", 0);
+
+   expect_true(does_cache_contain(cache, blob_key),
+               "pack: entry still there after reopening the cache");
+
+   /* But not for another driver. */
+   disk_cache_destroy(cache);
+   cache = disk_cache_create("test", "other_timestamp", 0);
+
+   expect_true(!does_cache_contain(cache, blob_key),
+               "pack: entry of another driver not returned");
+
+   disk_cache_destroy(cache);
+   cache = disk_cache_create("test", "make_check", 0);
+
+   disk_cache_remove(cache, blob_key);
+   expect_true(!does_cache_contain(cache, blob_key),
+               "pack: disk_cache_get of removed item");
+
+   /* Add incompressible entries totalling twice the maximum size, while
+    * keeping the first one in use, to force compactions.
+    */
+   random_data = malloc(128 * 1024);
+   for (unsigned i = 0; i < 8; i++) {
+      fill_random(random_data, 128 * 1024);
+      disk_cache_compute_key(cache, random_data, 128 * 1024, random_keys[i]);
+      disk_cache_put(cache, random_keys[i], random_data, 128 * 1024, NULL);
+      wait_until_file_written(cache, random_keys[i]);
+
+      expect_true(does_cache_contain(cache, random_keys[0]),
+                  "pack: recently used entry kept by compaction");
+   }
+   free(random_data);
+
+   count = 0;
+   for (unsigned i = 0; i < 8; i++) {
+      if (does_cache_contain(cache, random_keys[i]))
+         count++;
+   }
+
+   expect_true(does_cache_contain(cache, random_keys[7]),
+               "pack: last entry kept by compaction");
+   expect_true(count < 8, "pack: compaction evicted old entries");
+   expect_true(stat(CACHE_TEST_TMP "/mesa-glsl-cache-dir/" CACHE_DIR_NAME
+                    "/pack", &sb) == 0 && sb.st_size <= 1024 * 1024,
+               "pack: pack file within MAX_SIZE");
+
+   disk_cache_destroy(cache);
+
+   unsetenv("MESA_GLSL_CACHE_PACK");
+}
+
+static void
+test_mem_cache(void)
+{
+   struct disk_cache *cache, *other_cache;
+   char blob[] = "This is a blob of thirty-seven bytes";
+   uint8_t blob_key[20], missing_key[20];
+   uint8_t prefetch_keys[2][20];
+   uint8_t *random_data;
+   uint8_t random_keys[3][20];
+   char *result;
+   size_t size;
+
+   setenv("MESA_GLSL_CACHE_MEM_SIZE", "64K", 1);
+   setenv("MESA_GLSL_CACHE_MAX_SIZE", "1M", 1);
+   cache = disk_cache_create("test", "make_check", 0);
+
+   /* A second cache on the same directory, to change the disk contents
+    * behind the back of the first one.
+    */
+   other_cache = disk_cache_create("test", "make_check", 0);
+
+   disk_cache_compute_key(cache, blob, sizeof(blob), blob_key);
+   disk_cache_put(cache, blob_key, blob, sizeof(blob), NULL);
+   disk_cache_wait_for_idle(cache);
+
+   disk_cache_remove(other_cache, blob_key);
+   expect_true(!does_cache_contain(other_cache, blob_key),
+               "mem: entry removed from disk");
+
+   result = disk_cache_get(cache, blob_key, &size);
+   expect_equal_str(blob, result, "mem: disk_cache_get of item stored by "
+                    "this cache (pointer)");
+   expect_equal(size, sizeof(blob), "mem: disk_cache_get of item stored by "
+                "this cache (size)");
+   free(result);
+
+   disk_cache_remove(cache, blob_key);
+   expect_true(!does_cache_contain(cache, blob_key),
+               "mem: disk_cache_get of removed item");
+
+   /* Entries past the maximum size evict the least recently used ones. */
+   random_data = malloc(32 * 1024);
+   for (unsigned i = 0; i < 3; i++) {
+      fill_random(random_data, 32 * 1024);
+      disk_cache_compute_key(cache, random_data, 32 * 1024, random_keys[i]);
+      disk_cache_put(cache, random_keys[i], random_data, 32 * 1024, NULL);
+   }
+   free(random_data);
+   disk_cache_wait_for_idle(cache);
+
+   for (unsigned i = 0; i < 3; i++)
+      disk_cache_remove(other_cache, random_keys[i]);
+
+   expect_true(!does_cache_contain(cache, random_keys[0]),
+               "mem: least recently used entry evicted");
+   expect_true(does_cache_contain(cache, random_keys[1]) &&
+               does_cache_contain(cache, random_keys[2]),
+               "mem: most recently used entries kept");
+
+   /* Prefetching from the disk into a new cache. */
+   disk_cache_put(cache, blob_key, blob, sizeof(blob), NULL);
+   disk_cache_wait_for_idle(cache);
+   disk_cache_destroy(cache);
+   cache = disk_cache_create("test", "make_check", 0);
+
+   disk_cache_compute_key(cache, "missing", 7, missing_key);
+   memcpy(prefetch_keys[0], missing_key, sizeof(missing_key));
+   memcpy(prefetch_keys[1], blob_key, sizeof(blob_key));
+   disk_cache_prefetch(cache, prefetch_keys, 2);
+   disk_cache_wait_for_idle(cache);
+
+   disk_cache_remove(other_cache, blob_key);
+
+   result = disk_cache_get(cache, blob_key, &size);
+   expect_equal_str(blob, result, "mem: disk_cache_get of prefetched item");
+   free(result);
+   expect_true(!does_cache_contain(cache, missing_key),
+               "mem: disk_cache_get of missing prefetched item");
+
+   disk_cache_destroy(other_cache);
+   disk_cache_destroy(cache);
+
+   unsetenv("MESA_GLSL_CACHE_MEM_SIZE");
+}
 #endif /* ENABLE_SHADER_CACHE */
 
 int
@@ -501,12 +700,21 @@ main(void)
 #ifdef ENABLE_SHADER_CACHE
    int err;
 
+   /* Only check the disk storage, not the in-memory cache in front of it,
+    * until test_mem_cache().
+    */
+   setenv("MESA_GLSL_CACHE_MEM_SIZE", "0", 1);
+
    test_disk_cache_create();
 
    test_put_and_get();
 
    test_put_key_and_get_key();
 
+   test_pack_put_and_get();
+
+   test_mem_cache();
+
    err = rmrf_local(CACHE_TEST_TMP);
    expect_equal(err, 0, "Removing " CACHE_TEST_TMP " again");
 #endif /* ENABLE_SHADER_CACHE */
@@ -1086,6 +1086,23 @@ draw_collect_pipeline_statistics(struct draw_context *draw,
    draw->collect_statistics = enable;
 }
 
+/**
+ * Let the driver provide storage for the machine code of the vertex shader
+ * variants generated by the LLVM path, so that they need not be recompiled
+ * in every process.  find_shader fills in the lp_cached_code on a hit,
+ * insert_shader is called with the freshly compiled code on a miss.
+ */
+void
+draw_set_disk_cache_callbacks(struct draw_context *draw,
+                              void *data_cookie,
+                              draw_disk_cache_cb find_shader,
+                              draw_disk_cache_cb insert_shader)
+{
+   draw->disk_cache_cookie = data_cookie;
+   draw->disk_cache_find_shader = find_shader;
+   draw->disk_cache_insert_shader = insert_shader;
+}
+
 /**
  * Computes clipper invocation statistics.
  *
@@ -49,6 +49,7 @@ struct draw_fragment_shader;
 struct tgsi_sampler;
 struct tgsi_image;
 struct tgsi_buffer;
+struct lp_cached_code;
 
 /*
  * structure to contain driver internal information 
@@ -291,6 +292,18 @@ void draw_set_force_passthrough( struct draw_context *draw,
 void draw_collect_pipeline_statistics(struct draw_context *draw,
                                       boolean enable);
 
+/*******************************************************************************
+ * Shader cache
+ */
+typedef void (*draw_disk_cache_cb)(void *cookie,
+                                   struct lp_cached_code *cache,
+                                   const unsigned char ir_sha1_cache_key[20]);
+
+void draw_set_disk_cache_callbacks(struct draw_context *draw,
+                                   void *data_cookie,
+                                   draw_disk_cache_cb find_shader,
+                                   draw_disk_cache_cb insert_shader);
+
 /*******************************************************************************
  * Draw pipeline 
  */
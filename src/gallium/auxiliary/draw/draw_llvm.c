@@ -52,11 +52,13 @@
 
 #include "tgsi/tgsi_exec.h"
 #include "tgsi/tgsi_dump.h"
+#include "tgsi/tgsi_parse.h"
 
 #include "util/u_math.h"
 #include "util/u_pointer.h"
 #include "util/u_string.h"
 #include "util/simple_list.h"
+#include "util/mesa-sha1.h"
 
 
 #define DEBUG_STORE 0
@@ -539,6 +541,33 @@ draw_llvm_destroy(struct draw_llvm *llvm)
 }
 
 
+/**
+ * Compute the hash of everything the generated vertex shader code depends
+ * on, for looking it up in the driver's shader cache.
+ */
+static void
+draw_get_ir_cache_key(struct draw_llvm *llvm,
+                      struct llvm_vertex_shader *shader,
+                      const struct draw_llvm_variant_key *key,
+                      unsigned num_inputs,
+                      unsigned char ir_sha1_cache_key[20])
+{
+   const struct tgsi_token *tokens = shader->base.state.tokens;
+   struct mesa_sha1 ctx;
+
+   _mesa_sha1_init(&ctx);
+   _mesa_sha1_update(&ctx, tokens,
+                     tgsi_num_tokens(tokens) * sizeof(struct tgsi_token));
+   _mesa_sha1_update(&ctx, key, shader->variant_key_size);
+   _mesa_sha1_update(&ctx, &num_inputs, sizeof(num_inputs));
+   _mesa_sha1_update(&ctx, &llvm->draw->vs.position_output,
+                     sizeof(llvm->draw->vs.position_output));
+   _mesa_sha1_update(&ctx, &llvm->draw->vs.clipvertex_output,
+                     sizeof(llvm->draw->vs.clipvertex_output));
+   _mesa_sha1_final(&ctx, ir_sha1_cache_key);
+}
+
+
 /**
  * Create LLVM-generated code for a vertex shader.
  */
@@ -550,8 +579,12 @@ draw_llvm_create_variant(struct draw_llvm *llvm,
    struct draw_llvm_variant *variant;
    struct llvm_vertex_shader *shader =
       llvm_vertex_shader(llvm->draw->vs.vertex_shader);
+   struct draw_context *draw = llvm->draw;
    LLVMTypeRef vertex_header;
    char module_name[64];
+   unsigned char ir_sha1_cache_key[20];
+   struct lp_cached_code cached = { 0 };
+   boolean needs_caching = FALSE;
 
    variant = MALLOC(sizeof *variant +
                     shader->variant_key_size -
@@ -565,7 +598,15 @@ draw_llvm_create_variant(struct draw_llvm *llvm,
    util_snprintf(module_name, sizeof(module_name), "draw_llvm_vs_variant%u",
                  variant->shader->variants_cached);
 
-   variant->gallivm = gallivm_create(module_name, llvm->context);
+   if (draw->disk_cache_cookie) {
+      draw_get_ir_cache_key(llvm, shader, key, num_inputs, ir_sha1_cache_key);
+      draw->disk_cache_find_shader(draw->disk_cache_cookie,
+                                   &cached, ir_sha1_cache_key);
+      if (!cached.data_size)
+         needs_caching = TRUE;
+   }
+
+   variant->gallivm = gallivm_create(module_name, llvm->context, &cached);
 
    create_jit_types(variant);
 
@@ -587,7 +628,12 @@ draw_llvm_create_variant(struct draw_llvm *llvm,
    variant->jit_func = (draw_jit_vert_func)
          gallivm_jit_function(variant->gallivm, variant->function);
 
+   if (needs_caching)
+      draw->disk_cache_insert_shader(draw->disk_cache_cookie,
+                                     &cached, ir_sha1_cache_key);
+
    gallivm_free_ir(variant->gallivm);
+   free(cached.data);
 
    variant->list_item_global.base = variant;
    variant->list_item_local.base = variant;
@@ -629,6 +675,7 @@ generate_vs(struct draw_llvm_variant *variant,
                      NULL,
                      draw_sampler,
                      &llvm->draw->vs.vertex_shader->info,
+                     NULL,
                      NULL);
 
    {
@@ -1529,7 +1576,6 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant)
    LLVMValueRef context_ptr;
    LLVMBasicBlockRef block;
    LLVMBuilderRef builder;
-   char func_name[64];
    struct lp_type vs_type;
    LLVMValueRef count, fetch_elts, start_or_maxelt;
    LLVMValueRef vertex_id_offset, start_instance;
@@ -1574,9 +1620,6 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant)
 
    memset(&system_values, 0, sizeof(system_values));
 
-   util_snprintf(func_name, sizeof(func_name), "draw_llvm_vs_variant%u",
-                 variant->shader->variants_cached);
-
    i = 0;
    arg_types[i++] = get_context_ptr_type(variant);       /* context */
    arg_types[i++] = get_vertex_header_ptr_type(variant); /* vertex_header */
@@ -1593,7 +1636,9 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant)
    func_type = LLVMFunctionType(LLVMInt8TypeInContext(context),
                                 arg_types, num_arg_types, 0);
 
-   variant_func = LLVMAddFunction(gallivm->module, func_name, func_type);
+   /* Same name in every variant, cached code is looked up by it. */
+   variant_func = LLVMAddFunction(gallivm->module, "draw_llvm_vs_variant",
+                                  func_type);
    variant->function = variant_func;
 
    LLVMSetFunctionCallConv(variant_func, LLVMCCallConv);
@@ -2356,7 +2401,8 @@ draw_gs_llvm_generate(struct draw_llvm *llvm,
                      NULL,
                      sampler,
                      &llvm->draw->gs.geometry_shader->info,
-                     (const struct lp_build_tgsi_gs_iface *)&gs_iface);
+                     (const struct lp_build_tgsi_gs_iface *)&gs_iface,
+                     NULL);
 
    sampler->destroy(sampler);
 
@@ -2391,7 +2437,7 @@ draw_gs_llvm_create_variant(struct draw_llvm *llvm,
    util_snprintf(module_name, sizeof(module_name), "draw_llvm_gs_variant%u",
                  variant->shader->variants_cached);
 
-   variant->gallivm = gallivm_create(module_name, llvm->context);
+   variant->gallivm = gallivm_create(module_name, llvm->context, NULL);
 
    create_gs_jit_types(variant);
 
@@ -46,6 +46,8 @@
 
 #include "tgsi/tgsi_scan.h"
 
+#include "draw_context.h"
+
 #ifdef HAVE_LLVM
 struct gallivm_state;
 #endif
@@ -339,6 +341,11 @@ struct draw_context
    struct pipe_query_data_pipeline_statistics statistics;
    boolean collect_statistics;
 
+   /** Optional driver-provided cache for the JIT'ed vertex shaders */
+   void *disk_cache_cookie;
+   draw_disk_cache_cb disk_cache_find_shader;
+   draw_disk_cache_cb disk_cache_insert_shader;
+
    struct draw_assembler *ia;
 
    void *driver_private;
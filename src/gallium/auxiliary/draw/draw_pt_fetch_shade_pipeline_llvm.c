@@ -28,6 +28,8 @@
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_prim.h"
+#include "util/u_queue.h"
+#include "util/u_debug.h"
 #include "draw/draw_context.h"
 #include "draw/draw_gs.h"
 #include "draw/draw_vbuf.h"
@@ -40,6 +42,31 @@
 #include "gallivm/lp_bld_debug.h"
 
 
+/**
+ * Don't split vertex shading below this many vertices per thread, the
+ * cost of waking up a worker outweighs the shading work.
+ */
+#define LLVM_VS_MIN_VERTICES_PER_THREAD 128
+
+#define LLVM_VS_MAX_THREADS 16
+
+struct llvm_middle_end;
+
+/**
+ * A slice of the vertices of a single middle end run, shaded on one of
+ * the vertex shader threads.
+ */
+struct llvm_vs_job {
+   struct llvm_middle_end *fpme;
+   struct vertex_header *verts;
+   const unsigned *elts;
+   unsigned count;
+   unsigned start_or_maxelt;
+   unsigned vid_base;
+   boolean clipped;
+   struct util_queue_fence fence;
+};
+
 struct llvm_middle_end {
    struct draw_pt_middle_end base;
    struct draw_context *draw;
@@ -57,6 +84,11 @@ struct llvm_middle_end {
 
    struct draw_llvm *llvm;
    struct draw_llvm_variant *current_variant;
+
+   /* Optional pool running fetch/shade/clip of large runs in parallel */
+   unsigned num_vs_threads;
+   struct util_queue vs_queue;
+   struct llvm_vs_job vs_jobs[LLVM_VS_MAX_THREADS];
 };
 
 
@@ -347,6 +379,108 @@ emit(struct pt_emit *emit,
 }
 
 
+static boolean
+llvm_run_vs_slice(struct llvm_middle_end *fpme,
+                  struct vertex_header *verts,
+                  unsigned count,
+                  unsigned start_or_maxelt,
+                  unsigned vid_base,
+                  const unsigned *elts)
+{
+   struct draw_context *draw = fpme->draw;
+
+   return fpme->current_variant->jit_func(&fpme->llvm->jit_context,
+                                          verts,
+                                          draw->pt.user.vbuffer,
+                                          count,
+                                          start_or_maxelt,
+                                          fpme->vertex_size,
+                                          draw->pt.vertex_buffer,
+                                          draw->instance_id,
+                                          vid_base,
+                                          draw->start_instance,
+                                          elts);
+}
+
+
+static void
+llvm_vs_job_execute(void *data, int thread_index)
+{
+   struct llvm_vs_job *job = (struct llvm_vs_job *) data;
+
+   job->clipped = llvm_run_vs_slice(job->fpme, job->verts, job->count,
+                                    job->start_or_maxelt, job->vid_base,
+                                    job->elts);
+}
+
+
+/**
+ * Run fetch, vertex shading and clip testing for a run of vertices.
+ *
+ * Large runs are cut into slices which are shaded concurrently on the
+ * vertex shader threads.  Slices start on a multiple of the shader's
+ * vector length and each writes its own range of the output buffer, so
+ * the post-VS vertices come out in the same order as with a single call
+ * and nothing downstream needs to know about the split.
+ */
+static boolean
+llvm_middle_end_run_vs(struct llvm_middle_end *fpme,
+                       struct vertex_header *verts,
+                       unsigned count,
+                       boolean linear,
+                       unsigned start_or_maxelt,
+                       unsigned vid_base,
+                       const unsigned *elts)
+{
+   const unsigned vector_length = lp_native_vector_width / 32;
+   unsigned num_slices, slice_size, offset, i;
+   boolean clipped;
+
+   num_slices = MIN2(fpme->num_vs_threads,
+                     count / LLVM_VS_MIN_VERTICES_PER_THREAD);
+   if (num_slices < 2) {
+      return llvm_run_vs_slice(fpme, verts, count, start_or_maxelt,
+                               vid_base, elts);
+   }
+
+   slice_size = align(DIV_ROUND_UP(count, num_slices), vector_length);
+   num_slices = DIV_ROUND_UP(count, slice_size);
+
+   /* The first slice is shaded on the calling thread */
+   for (i = 1, offset = slice_size; i < num_slices; i++, offset += slice_size) {
+      struct llvm_vs_job *job = &fpme->vs_jobs[i];
+
+      job->fpme = fpme;
+      job->verts = (struct vertex_header *)
+         ((char *) verts + offset * fpme->vertex_size);
+      job->count = MIN2(slice_size, count - offset);
+      job->vid_base = vid_base;
+      if (linear) {
+         job->start_or_maxelt = start_or_maxelt + offset;
+         job->elts = NULL;
+      }
+      else {
+         job->start_or_maxelt = start_or_maxelt;
+         job->elts = elts + offset;
+      }
+      job->clipped = FALSE;
+
+      util_queue_add_job(&fpme->vs_queue, job, &job->fence,
+                         llvm_vs_job_execute, NULL);
+   }
+
+   clipped = llvm_run_vs_slice(fpme, verts, slice_size, start_or_maxelt,
+                               vid_base, elts);
+
+   for (i = 1; i < num_slices; i++) {
+      util_queue_fence_wait(&fpme->vs_jobs[i].fence);
+      clipped |= fpme->vs_jobs[i].clipped;
+   }
+
+   return clipped;
+}
+
+
 static void
 llvm_pipeline_generic(struct draw_pt_middle_end *middle,
                       const struct draw_fetch_info *fetch_info,
@@ -397,17 +531,9 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
       vid_base = draw->pt.user.eltBias;
       elts = fetch_info->elts;
    }
-   clipped = fpme->current_variant->jit_func(&fpme->llvm->jit_context,
-                                             llvm_vert_info.verts,
-                                             draw->pt.user.vbuffer,
-                                             fetch_info->count,
-                                             start_or_maxelt,
-                                             fpme->vertex_size,
-                                             draw->pt.vertex_buffer,
-                                             draw->instance_id,
-                                             vid_base,
-                                             draw->start_instance,
-                                             elts);
+   clipped = llvm_middle_end_run_vs(fpme, llvm_vert_info.verts,
+                                    fetch_info->count, fetch_info->linear,
+                                    start_or_maxelt, vid_base, elts);
 
    /* Finished with fetch and vs:
     */
@@ -610,6 +736,14 @@ llvm_middle_end_destroy(struct draw_pt_middle_end *middle)
    if (fpme->post_vs)
       draw_pt_post_vs_destroy( fpme->post_vs );
 
+   if (fpme->num_vs_threads > 1) {
+      unsigned i;
+
+      util_queue_destroy(&fpme->vs_queue);
+      for (i = 0; i < fpme->num_vs_threads; i++)
+         util_queue_fence_destroy(&fpme->vs_jobs[i].fence);
+   }
+
    FREE(middle);
 }
 
@@ -618,6 +752,7 @@ struct draw_pt_middle_end *
 draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
 {
    struct llvm_middle_end *fpme = 0;
+   long num_vs_threads;
 
    if (!draw->llvm)
       return NULL;
@@ -658,6 +793,22 @@ draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
 
    fpme->current_variant = NULL;
 
+   num_vs_threads = debug_get_num_option("DRAW_VS_THREADS", 0);
+   fpme->num_vs_threads = CLAMP(num_vs_threads, 0, LLVM_VS_MAX_THREADS);
+   if (fpme->num_vs_threads > 1) {
+      unsigned i;
+
+      /* The calling thread shades a slice too */
+      if (!util_queue_init(&fpme->vs_queue, "draw_vs", LLVM_VS_MAX_THREADS,
+                           fpme->num_vs_threads - 1, 0)) {
+         fpme->num_vs_threads = 0;
+      }
+      else {
+         for (i = 0; i < fpme->num_vs_threads; i++)
+            util_queue_fence_init(&fpme->vs_jobs[i].fence);
+      }
+   }
+
    return &fpme->base;
 
  fail:
@@ -2841,7 +2841,8 @@ lp_build_fast_rsqrt_available(struct lp_type type)
    assert(type.floating);
 
    if ((util_cpu_caps.has_sse && type.width == 32 && type.length == 4) ||
-       (util_cpu_caps.has_avx && type.width == 32 && type.length == 8)) {
+       (util_cpu_caps.has_avx && type.width == 32 && type.length == 8) ||
+       (util_cpu_caps.has_avx512f && type.width == 32 && type.length == 16)) {
       return true;
    }
    return false;
@@ -2869,9 +2870,19 @@ lp_build_fast_rsqrt(struct lp_build_context *bld,
       if (type.length == 4) {
          intrinsic = "llvm.x86.sse.rsqrt.ps";
       }
-      else {
+      else if (type.length == 8) {
          intrinsic = "llvm.x86.avx.rsqrt.ps.256";
       }
+      else {
+         /* rsqrt14 with all lanes enabled (source, passthrough, mask) */
+         LLVMValueRef args[3];
+
+         args[0] = a;
+         args[1] = bld->undef;
+         args[2] = LLVMConstAllOnes(LLVMInt16TypeInContext(bld->gallivm->context));
+         return lp_build_intrinsic(builder, "llvm.x86.avx512.rsqrt14.ps.512",
+                                   bld->vec_type, args, 3, 0);
+      }
       return lp_build_intrinsic_unary(builder, intrinsic, bld->vec_type, a);
    }
    else {
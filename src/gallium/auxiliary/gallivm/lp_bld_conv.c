@@ -491,6 +491,17 @@ int lp_build_conv_auto(struct gallivm_state *gallivm,
          lp_build_conv(gallivm, src_type, *dst_type, src, num_srcs, dst, num_dsts);
          return num_dsts;
       }
+
+      /* Special case 1x16x32 --> 1x16x8 */
+      if (src_type.length == 16 &&
+          util_cpu_caps.has_avx512f)
+      {
+         num_dsts = num_srcs;
+         dst_type->length = 16;
+
+         lp_build_conv(gallivm, src_type, *dst_type, src, num_srcs, dst, num_dsts);
+         return num_dsts;
+      }
    }
 
    /* lp_build_resize does not support M:N */
@@ -759,6 +770,69 @@ lp_build_conv(struct gallivm_state *gallivm,
       return;
    }
 
+   /* Special case 1x16x32 --> 1x16x8
+    *
+    * AVX-512 has no pack instructions crossing the 128 bit lanes, but it can
+    * truncate 16 dwords to bytes directly (vpmovdb), so clamp in the 32 bit
+    * domain first.
+    */
+   else if (src_type.norm     == 0 &&
+       src_type.width    == 32 &&
+       src_type.length   == 16 &&
+       src_type.fixed    == 0 &&
+
+       dst_type.floating == 0 &&
+       dst_type.fixed    == 0 &&
+       dst_type.width    == 8 &&
+       dst_type.length   == 16 &&
+
+       ((src_type.floating == 1 && src_type.sign == 1 && dst_type.norm == 1) ||
+        (src_type.floating == 0 && dst_type.floating == 0 &&
+         src_type.sign == dst_type.sign && dst_type.norm == 0)) &&
+
+       num_srcs == num_dsts &&
+       util_cpu_caps.has_avx512f) {
+
+      struct lp_build_context bld, int_bld;
+      struct lp_type int32_type = lp_int_type(src_type);
+      LLVMTypeRef dst_vec_type = lp_build_vec_type(gallivm, dst_type);
+      LLVMValueRef const_scale, lo, hi;
+
+      int32_type.sign = src_type.floating ? 1 : src_type.sign;
+
+      lp_build_context_init(&bld, gallivm, src_type);
+      lp_build_context_init(&int_bld, gallivm, int32_type);
+
+      const_scale = lp_build_const_vec(gallivm, src_type, lp_const_scale(dst_type));
+      if (dst_type.sign) {
+         lo = lp_build_const_int_vec(gallivm, int32_type, -128);
+         hi = lp_build_const_int_vec(gallivm, int32_type, 127);
+      }
+      else {
+         lo = int_bld.zero;
+         hi = lp_build_const_int_vec(gallivm, int32_type, 255);
+      }
+
+      for (i = 0; i < num_dsts; ++i) {
+         LLVMValueRef a = src[i];
+
+         if (src_type.floating) {
+            if (dst_type.sign) {
+               a = lp_build_min(&bld, bld.one, a);
+            }
+            a = LLVMBuildFMul(builder, a, const_scale, "");
+            a = lp_build_iround(&bld, a);
+         }
+         if (int32_type.sign) {
+            a = lp_build_max(&int_bld, a, lo);
+         }
+         a = lp_build_min(&int_bld, a, hi);
+         dst[i] = LLVMBuildTrunc(builder, a, dst_vec_type, "");
+      }
+
+      return;
+   }
+
    /* Special case -> 16bit half-float
     */
    else if (dst_type.floating && dst_type.width == 16)
@@ -31,6 +31,7 @@
  * @author Jose Fonseca <jfonseca@vmware.com>
  */
 
+#include "util/u_cpu_detect.h"
 #include "util/u_debug.h"
 #include "util/u_memory.h"
 
@@ -140,12 +141,31 @@ lp_build_mask_check(struct lp_build_mask_context *mask)
     * Not sure if llvm could figure that out on its own.
     */
 
-   /* cond = (mask == 0) */
-   cond = LLVMBuildICmp(builder,
-                        LLVMIntEQ,
-                        LLVMBuildBitCast(builder, value, mask->reg_type, ""),
-                        LLVMConstNull(mask->reg_type),
-                        "");
+   if (util_cpu_caps.has_avx512f &&
+       LLVMGetIntTypeWidth(mask->reg_type) == 512) {
+      /*
+       * Gather the sign bits into a mask register and test that (kortest),
+       * instead of comparing the full 512 bits.
+       */
+      LLVMTypeRef vec_type = LLVMTypeOf(value);
+      unsigned length = LLVMGetVectorSize(vec_type);
+      LLVMTypeRef bits_type = LLVMIntTypeInContext(mask->skip.gallivm->context,
+                                                   length);
+
+      value = LLVMBuildICmp(builder, LLVMIntSLT, value,
+                            LLVMConstNull(vec_type), "");
+      value = LLVMBuildBitCast(builder, value, bits_type, "");
+      cond = LLVMBuildICmp(builder, LLVMIntEQ, value,
+                           LLVMConstNull(bits_type), "");
+   }
+   else {
+      /* cond = (mask == 0) */
+      cond = LLVMBuildICmp(builder,
+                           LLVMIntEQ,
+                           LLVMBuildBitCast(builder, value, mask->reg_type, ""),
+                           LLVMConstNull(mask->reg_type),
+                           "");
+   }
 
    /* if cond, goto end of block */
    lp_build_flow_skip_cond_break(&mask->skip, cond);
@@ -667,8 +667,9 @@ lp_build_fetch_rgba_soa(struct gallivm_state *gallivm,
          }
       }
       else {
+         /* the transpose above leaves the channels as ints */
          for (i = 0; i < format_desc->nr_channels; i++)  {
-            output[i] = dst[i];
+            output[i] = LLVMBuildBitCast(builder, dst[i], bld.vec_type, "");
          }
       }
 
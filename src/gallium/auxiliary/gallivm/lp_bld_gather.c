@@ -31,6 +31,7 @@
 #include "util/u_math.h"
 #include "lp_bld_debug.h"
 #include "lp_bld_const.h"
+#include "lp_bld_flow.h"
 #include "lp_bld_format.h"
 #include "lp_bld_gather.h"
 #include "lp_bld_swizzle.h"
@@ -599,3 +600,135 @@ lp_build_gather_values(struct gallivm_state * gallivm,
    }
    return vec;
 }
+
+
+/**
+ * Store the elements of a vector to scattered positions in memory, skipping
+ * the elements whose mask is zero.
+ *
+ * Disabled elements are never read nor written, so this is safe to use on
+ * memory other threads may be writing to at the same time.
+ *
+ * @param length     length of the vectors
+ * @param dst_width  width of the stored elements in bits, values are
+ *                   truncated to it
+ * @param base_ptr   base pointer, should be a i8 pointer type.
+ * @param offsets    vector with offsets in bytes
+ * @param values     integer vector of the values to store
+ * @param mask       integer vector, elements are stored where it is non-zero
+ */
+void
+lp_build_masked_scatter(struct gallivm_state *gallivm,
+                        unsigned length,
+                        unsigned dst_width,
+                        LLVMValueRef base_ptr,
+                        LLVMValueRef offsets,
+                        LLVMValueRef values,
+                        LLVMValueRef mask)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef dst_type = LLVMIntTypeInContext(gallivm->context, dst_width);
+   unsigned i;
+
+   for (i = 0; i < length; i++) {
+      LLVMValueRef ii = lp_build_const_int32(gallivm, i);
+      LLVMValueRef elem_mask, ptr, value;
+      struct lp_build_if_state ifthen;
+
+      elem_mask = LLVMBuildExtractElement(builder, mask, ii, "");
+      elem_mask = LLVMBuildICmp(builder, LLVMIntNE, elem_mask,
+                                LLVMConstNull(LLVMTypeOf(elem_mask)), "");
+
+      lp_build_if(&ifthen, gallivm, elem_mask);
+      {
+         ptr = lp_build_gather_elem_ptr(gallivm, length, base_ptr, offsets, i);
+         ptr = LLVMBuildBitCast(builder, ptr,
+                                LLVMPointerType(dst_type, 0), "");
+         value = LLVMBuildExtractElement(builder, values, ii, "");
+         if (LLVMGetIntTypeWidth(LLVMTypeOf(value)) > dst_width) {
+            value = LLVMBuildTrunc(builder, value, dst_type, "");
+         }
+         LLVMBuildStore(builder, value, ptr);
+      }
+      lp_build_endif(&ifthen);
+   }
+}
+
+
+/**
+ * Perform a 32-bit atomic operation on scattered positions in memory for
+ * the elements whose mask is non-zero.
+ *
+ * @param op          the read-modify-write operation, unused for cas
+ * @param is_cas      do a compare and swap with cmp_values instead
+ * @param base_ptr    base pointer, should be a i8 pointer type.
+ * @param offsets     vector with offsets in bytes
+ * @param values      int32 vector of the operands
+ * @param cmp_values  int32 vector of the values to compare with for cas
+ * @param mask        integer vector of the enabled elements
+ *
+ * Returns the previous memory contents, zero for disabled elements.
+ */
+LLVMValueRef
+lp_build_masked_atomic(struct gallivm_state *gallivm,
+                       unsigned length,
+                       LLVMAtomicRMWBinOp op,
+                       boolean is_cas,
+                       LLVMValueRef base_ptr,
+                       LLVMValueRef offsets,
+                       LLVMValueRef values,
+                       LLVMValueRef cmp_values,
+                       LLVMValueRef mask)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef i32t = LLVMInt32TypeInContext(gallivm->context);
+   LLVMTypeRef vec_type = LLVMVectorType(i32t, length);
+   LLVMValueRef res_ptr;
+   unsigned i;
+
+   res_ptr = lp_build_alloca(gallivm, vec_type, "atomic_res");
+
+   for (i = 0; i < length; i++) {
+      LLVMValueRef ii = lp_build_const_int32(gallivm, i);
+      LLVMValueRef elem_mask, ptr, value, res;
+      struct lp_build_if_state ifthen;
+
+      elem_mask = LLVMBuildExtractElement(builder, mask, ii, "");
+      elem_mask = LLVMBuildICmp(builder, LLVMIntNE, elem_mask,
+                                LLVMConstNull(LLVMTypeOf(elem_mask)), "");
+
+      lp_build_if(&ifthen, gallivm, elem_mask);
+      {
+         ptr = lp_build_gather_elem_ptr(gallivm, length, base_ptr, offsets, i);
+         ptr = LLVMBuildBitCast(builder, ptr, LLVMPointerType(i32t, 0), "");
+         value = LLVMBuildExtractElement(builder, values, ii, "");
+
+         if (is_cas) {
+#if HAVE_LLVM >= 0x0309
+            LLVMValueRef cmp = LLVMBuildExtractElement(builder, cmp_values,
+                                                       ii, "");
+            res = LLVMBuildAtomicCmpXchg(builder, ptr, cmp, value,
+                                         LLVMAtomicOrderingSequentiallyConsistent,
+                                         LLVMAtomicOrderingSequentiallyConsistent,
+                                         FALSE);
+            res = LLVMBuildExtractValue(builder, res, 0, "");
+#else
+            assert(!"compare and swap requires LLVM 3.9");
+            res = LLVMConstNull(i32t);
+#endif
+         }
+         else {
+            res = LLVMBuildAtomicRMW(builder, op, ptr, value,
+                                     LLVMAtomicOrderingSequentiallyConsistent,
+                                     FALSE);
+         }
+
+         value = LLVMBuildLoad(builder, res_ptr, "");
+         value = LLVMBuildInsertElement(builder, value, res, ii, "");
+         LLVMBuildStore(builder, value, res_ptr);
+      }
+      lp_build_endif(&ifthen);
+   }
+
+   return LLVMBuildLoad(builder, res_ptr, "");
+}
@@ -66,4 +66,24 @@ lp_build_gather_values(struct gallivm_state * gallivm,
                        LLVMValueRef * values,
                        unsigned value_count);
 
+void
+lp_build_masked_scatter(struct gallivm_state *gallivm,
+                        unsigned length,
+                        unsigned dst_width,
+                        LLVMValueRef base_ptr,
+                        LLVMValueRef offsets,
+                        LLVMValueRef values,
+                        LLVMValueRef mask);
+
+LLVMValueRef
+lp_build_masked_atomic(struct gallivm_state *gallivm,
+                       unsigned length,
+                       LLVMAtomicRMWBinOp op,
+                       boolean is_cas,
+                       LLVMValueRef base_ptr,
+                       LLVMValueRef offsets,
+                       LLVMValueRef values,
+                       LLVMValueRef cmp_values,
+                       LLVMValueRef mask);
+
 #endif /* LP_BLD_GATHER_H_ */
@@ -133,7 +133,7 @@ create_pass_manager(struct gallivm_state *gallivm)
       free(td_str);
    }
 
-   if ((gallivm_debug & GALLIVM_DEBUG_NO_OPT) == 0) {
+   if ((gallivm_debug & GALLIVM_DEBUG_NO_OPT) == 0 && !gallivm->no_opt) {
       /* These are the passes currently listed in llvm-c/Transforms/Scalar.h,
        * but there are more on SVN.
        * TODO: Add more passes.
@@ -176,6 +176,14 @@ gallivm_free_ir(struct gallivm_state *gallivm)
       LLVMDisposeModule(gallivm->module);
    }
 
+   /* The object cache is only referenced by the engine, and the
+    * lp_cached_code it fills in usually lives on the caller's stack.
+    */
+   if (gallivm->cache) {
+      lp_free_objcache(gallivm->cache->jit_obj);
+      gallivm->cache->jit_obj = NULL;
+   }
+
    FREE(gallivm->module_name);
 
    if (!use_mcjit) {
@@ -198,6 +206,7 @@ gallivm_free_ir(struct gallivm_state *gallivm)
    gallivm->passmgr = NULL;
    gallivm->context = NULL;
    gallivm->builder = NULL;
+   gallivm->cache = NULL;
 }
 
 
@@ -224,7 +233,7 @@ init_gallivm_engine(struct gallivm_state *gallivm)
       char *error = NULL;
       int ret;
 
-      if (gallivm_debug & GALLIVM_DEBUG_NO_OPT) {
+      if ((gallivm_debug & GALLIVM_DEBUG_NO_OPT) || gallivm->no_opt) {
          optlevel = None;
       }
       else {
@@ -233,6 +242,7 @@ init_gallivm_engine(struct gallivm_state *gallivm)
 
       ret = lp_build_create_jit_compiler_for_module(&gallivm->engine,
                                                     &gallivm->code,
+                                                    gallivm->cache,
                                                     gallivm->module,
                                                     gallivm->memorymgr,
                                                     (unsigned) optlevel,
@@ -285,7 +295,7 @@ fail:
  */
 static boolean
 init_gallivm_state(struct gallivm_state *gallivm, const char *name,
-                   LLVMContextRef context)
+                   LLVMContextRef context, struct lp_cached_code *cache)
 {
    assert(!gallivm->context);
    assert(!gallivm->module);
@@ -294,6 +304,7 @@ init_gallivm_state(struct gallivm_state *gallivm, const char *name,
       return FALSE;
 
    gallivm->context = context;
+   gallivm->cache = cache;
 
    if (!gallivm->context)
       goto fail;
@@ -420,6 +431,8 @@ lp_build_init(void)
       util_cpu_caps.has_avx2 = 0;
       util_cpu_caps.has_f16c = 0;
       util_cpu_caps.has_fma = 0;
+      util_cpu_caps.has_avx512f = 0;
+      util_cpu_caps.has_avx512bw = 0;
    }
 #endif
 
@@ -443,6 +456,22 @@ lp_build_init(void)
    lp_native_vector_width = debug_get_num_option("LP_NATIVE_VECTOR_WIDTH",
                                                  lp_native_vector_width);
 
+   /* AVX-512 code generation has only been tested with LLVM 4.0 and MCJIT,
+    * and needs the byte/word instructions for the 8 bit color paths.
+    */
+   if (HAVE_LLVM < 0x0400 || !use_mcjit ||
+       !util_cpu_caps.has_avx512f || !util_cpu_caps.has_avx512bw) {
+      util_cpu_caps.has_avx512f = 0;
+      util_cpu_caps.has_avx512bw = 0;
+   }
+
+   /* 512 bits wide vectors are opt-in: on many parts the clock drops while
+    * executing them, so it depends on the workload whether they pay off.
+    */
+   if (lp_native_vector_width > 256) {
+      lp_native_vector_width = util_cpu_caps.has_avx512f ? 512 : 256;
+   }
+
    if (lp_native_vector_width <= 128) {
       /* Hide AVX support, as often LLVM AVX intrinsics are only guarded by
        * "util_cpu_caps.has_avx" predicate, and lack the
@@ -456,6 +485,11 @@ lp_build_init(void)
       util_cpu_caps.has_f16c = 0;
       util_cpu_caps.has_fma = 0;
    }
+   if (lp_native_vector_width < 512) {
+      /* same as above, keep the narrower modes free of AVX-512 */
+      util_cpu_caps.has_avx512f = 0;
+      util_cpu_caps.has_avx512bw = 0;
+   }
    if (HAVE_LLVM < 0x0304 || !use_mcjit) {
       /* AVX2 support has only been tested with LLVM 3.4, and it requires
        * MCJIT. */
@@ -493,15 +527,44 @@ lp_build_init(void)
 
 /**
  * Create a new gallivm_state object.
+ *
+ * \param cache  optional; if it holds object code the module is not
+ *               recompiled, otherwise it receives the generated code.
+ *               Must stay valid until gallivm_free_ir() is called.
+ */
+struct gallivm_state *
+gallivm_create(const char *name, LLVMContextRef context,
+               struct lp_cached_code *cache)
+{
+   struct gallivm_state *gallivm;
+
+   gallivm = CALLOC_STRUCT(gallivm_state);
+   if (gallivm) {
+      if (!init_gallivm_state(gallivm, name, context, cache)) {
+         FREE(gallivm);
+         gallivm = NULL;
+      }
+   }
+
+   return gallivm;
+}
+
+
+/**
+ * Create a new gallivm_state object whose module is compiled as quickly as
+ * possible, at the expense of the generated code's quality (as with
+ * GALLIVM_DEBUG=nopt).  Meant for code which is only needed until a
+ * properly optimized version becomes available.
  */
 struct gallivm_state *
-gallivm_create(const char *name, LLVMContextRef context)
+gallivm_create_unoptimized(const char *name, LLVMContextRef context)
 {
    struct gallivm_state *gallivm;
 
    gallivm = CALLOC_STRUCT(gallivm_state);
    if (gallivm) {
-      if (!init_gallivm_state(gallivm, name, context)) {
+      gallivm->no_opt = TRUE;
+      if (!init_gallivm_state(gallivm, name, context, NULL)) {
          FREE(gallivm);
          gallivm = NULL;
       }
@@ -565,6 +628,12 @@ gallivm_compile_module(struct gallivm_state *gallivm)
       gallivm->builder = NULL;
    }
 
+   /* The cached object code is loaded in place of the IR, so there is no
+    * point in optimizing the latter.
+    */
+   if (use_mcjit && gallivm->cache && gallivm->cache->data_size)
+      goto skip_cached;
+
    if (gallivm_debug & GALLIVM_DEBUG_PERF)
       time_begin = os_time_get();
 
@@ -611,6 +680,7 @@ gallivm_compile_module(struct gallivm_state *gallivm)
                    filename);
    }
 
+skip_cached:
    if (use_mcjit) {
       /* Setting the module's DataLayout to an empty string will cause the
        * ExecutionEngine to copy to the DataLayout string from its target
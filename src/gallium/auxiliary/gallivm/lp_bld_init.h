@@ -39,6 +39,22 @@
 extern "C" {
 #endif
 
+/**
+ * Machine code of a compiled module, as handed to/from a shader cache.
+ *
+ * When data_size is non-zero on compilation, the object code in data is
+ * loaded instead of optimizing and code-generating the module's IR.
+ * Otherwise the freshly generated object code is returned in data, unless
+ * dont_cache got set because the IR embeds process-specific addresses.
+ */
+struct lp_cached_code
+{
+   void *data;
+   size_t data_size;
+   boolean dont_cache;
+   void *jit_obj;
+};
+
 struct gallivm_state
 {
    char *module_name;
@@ -50,6 +66,8 @@ struct gallivm_state
    LLVMBuilderRef builder;
    LLVMMCJITMemoryManagerRef memorymgr;
    struct lp_generated_code *code;
+   struct lp_cached_code *cache;
+   boolean no_opt;
    unsigned compiled;
 };
 
@@ -59,7 +77,11 @@ lp_build_init(void);
 
 
 struct gallivm_state *
-gallivm_create(const char *name, LLVMContextRef context);
+gallivm_create(const char *name, LLVMContextRef context,
+               struct lp_cached_code *cache);
+
+struct gallivm_state *
+gallivm_create_unoptimized(const char *name, LLVMContextRef context);
 
 void
 gallivm_destroy(struct gallivm_state *gallivm);
@@ -41,6 +41,7 @@
 
 
 #include <stddef.h>
+#include <map>
 
 // Workaround http://llvm.org/PR23628
 #if HAVE_LLVM >= 0x0307
@@ -65,6 +66,8 @@
 #include <llvm/ExecutionEngine/JITMemoryManager.h>
 #else
 #include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/Support/MemoryBuffer.h>
 #endif
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/Host.h>
@@ -97,6 +100,7 @@
 
 #include "lp_bld_misc.h"
 #include "lp_bld_debug.h"
+#include "lp_bld_init.h"
 
 namespace {
 
@@ -473,6 +477,44 @@ class ShaderMemoryManager : public DelegatingJITMemoryManager {
 };
 
 
+#if HAVE_LLVM >= 0x0306
+/*
+ * MCJIT object cache backed by a single lp_cached_code.
+ *
+ * Each engine only ever compiles one module, so there is at most one object
+ * to hand out or to remember.
+ */
+class LPObjectCache : public llvm::ObjectCache {
+
+   struct lp_cached_code *cache_out;
+
+   public:
+      LPObjectCache(struct lp_cached_code *cache) {
+         cache_out = cache;
+      }
+
+      virtual void notifyObjectCompiled(const llvm::Module *M,
+                                        llvm::MemoryBufferRef Obj) {
+         assert(!cache_out->data);
+         cache_out->data_size = Obj.getBufferSize();
+         cache_out->data = malloc(cache_out->data_size);
+         if (cache_out->data)
+            memcpy(cache_out->data, Obj.getBufferStart(), cache_out->data_size);
+         else
+            cache_out->data_size = 0;
+      }
+
+      virtual std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module *M) {
+         if (!cache_out->data_size)
+            return nullptr;
+         /* Hand out a copy, the loaded object outlives the cache entry. */
+         return llvm::MemoryBuffer::getMemBufferCopy(
+            llvm::StringRef((const char *)cache_out->data, cache_out->data_size));
+      }
+};
+#endif
+
+
 /**
  * Same as LLVMCreateJITCompilerForModule, but:
  * - allows using MCJIT and enabling AVX feature where available.
@@ -487,6 +529,7 @@ extern "C"
 LLVMBool
 lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
                                         lp_generated_code **OutCode,
+                                        struct lp_cached_code *cache_out,
                                         LLVMModuleRef M,
                                         LLVMMCJITMemoryManagerRef CMM,
                                         unsigned OptLevel,
@@ -570,6 +613,15 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
         ++f) {
       MAttrs.push_back(((*f).second ? "+" : "-") + (*f).first().str());
    }
+
+   /*
+    * Unless the 512 bits wide mode was selected (see lp_bld_init.c), keep
+    * LLVM from using AVX-512 on its own, so that LP_NATIVE_VECTOR_WIDTH
+    * really selects the instruction set used.
+    */
+   if (!util_cpu_caps.has_avx512f) {
+      MAttrs.push_back("-avx512f");
+   }
 #else
    /*
     * We need to unset attributes because sometimes LLVM mistakenly assumes
@@ -612,7 +664,7 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
       MAttrs.push_back("-fma");
    }
    MAttrs.push_back(util_cpu_caps.has_avx2 ? "+avx2" : "-avx2");
-   /* disable avx512 and all subvariants */
+   /* disable avx512 and all subvariants, it needs llvm 4.0 (lp_bld_init.c) */
 #if HAVE_LLVM >= 0x0304
    MAttrs.push_back("-avx512cd");
    MAttrs.push_back("-avx512er");
@@ -754,6 +806,13 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
    JIT->RegisterJITEventListener(JEL);
 #endif
    if (JIT) {
+#if HAVE_LLVM >= 0x0306
+      if (cache_out && useMCJIT) {
+         LPObjectCache *objcache = new LPObjectCache(cache_out);
+         JIT->setObjectCache(objcache);
+         cache_out->jit_obj = objcache;
+      }
+#endif
       *OutJIT = wrap(JIT);
       return 0;
    }
@@ -772,6 +831,51 @@ lp_free_generated_code(struct lp_generated_code *code)
    ShaderMemoryManager::freeGeneratedCode(code);
 }
 
+/**
+ * Return a string identifying the host CPU the way the code generator sees
+ * it (CPU name plus detected features), suitable for keying caches of
+ * generated machine code.  The caller must free() the result.
+ */
+extern "C"
+char *
+lp_build_host_cpu_identity(void)
+{
+   std::string id;
+
+#if HAVE_LLVM >= 0x0305
+   id = llvm::sys::getHostCPUName().str();
+#endif
+#if HAVE_LLVM >= 0x0400
+   llvm::StringMap<bool> features;
+   if (llvm::sys::getHostCPUFeatures(features)) {
+      /* Sort, StringMap iteration order is unspecified. */
+      std::map<std::string, bool> sorted;
+      for (llvm::StringMapIterator<bool> f = features.begin();
+           f != features.end();
+           ++f) {
+         sorted[(*f).first().str()] = (*f).second;
+      }
+      for (std::map<std::string, bool>::iterator f = sorted.begin();
+           f != sorted.end();
+           ++f) {
+         id += (f->second ? ",+" : ",-") + f->first;
+      }
+   }
+#endif
+
+   return strdup(id.c_str());
+}
+
+extern "C"
+void
+lp_free_objcache(void *objcache_ptr)
+{
+#if HAVE_LLVM >= 0x0306
+   LPObjectCache *objcache = (LPObjectCache *) objcache_ptr;
+   delete objcache;
+#endif
+}
+
 extern "C"
 LLVMMCJITMemoryManagerRef
 lp_get_default_memory_manager()
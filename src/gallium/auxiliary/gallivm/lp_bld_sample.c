@@ -126,6 +126,40 @@ lp_sampler_static_texture_state(struct lp_static_texture_state *state,
 }
 
 
+/**
+ * Initialize lp_static_texture_state object with the gallium image view
+ * state (this contains the parts which are considered static).
+ *
+ * Images are always accessed at a single level with unnormalized
+ * coordinates, so only the format and target matter.
+ */
+void
+lp_sampler_static_texture_state_image(struct lp_static_texture_state *state,
+                                      const struct pipe_image_view *view)
+{
+   const struct pipe_resource *resource;
+
+   memset(state, 0, sizeof *state);
+
+   if (!view || !view->resource)
+      return;
+
+   resource = view->resource;
+
+   state->format            = view->format;
+   state->swizzle_r         = PIPE_SWIZZLE_X;
+   state->swizzle_g         = PIPE_SWIZZLE_Y;
+   state->swizzle_b         = PIPE_SWIZZLE_Z;
+   state->swizzle_a         = PIPE_SWIZZLE_W;
+
+   state->target            = resource->target;
+   state->pot_width         = util_is_power_of_two(resource->width0);
+   state->pot_height        = util_is_power_of_two(resource->height0);
+   state->pot_depth         = util_is_power_of_two(resource->depth0);
+   state->level_zero_only   = TRUE;
+}
+
+
 /**
  * Initialize lp_sampler_static_sampler_state object with the gallium sampler
  * state (this contains the parts which are considered static).
@@ -196,6 +230,15 @@ lp_sampler_static_sampler_state(struct lp_static_sampler_state *state,
    }
 
    state->normalized_coords = sampler->normalized_coords;
+
+   /*
+    * Anisotropic filtering only changes the minification filter, and only
+    * makes sense if that is linear (this is also what d3d10 mandates).
+    */
+   if (sampler->max_anisotropy > 1 &&
+       sampler->min_img_filter == PIPE_TEX_FILTER_LINEAR) {
+      state->aniso = MIN2(sampler->max_anisotropy, 16);
+   }
 }
 
 
@@ -1325,7 +1368,8 @@ lp_build_mipmap_level_sizes(struct lp_build_sample_context *bld,
                                                       bld->row_stride_array,
                                                       ilevel);
    }
-   if (dims == 3 || has_layer_coord(bld->static_texture_state->target)) {
+   if (dims == 3 || has_layer_coord(bld->static_texture_state->target) ||
+       bld->static_texture_state->nr_samples > 1) {
       *img_stride_vec = lp_build_get_level_stride_vec(bld,
                                                       bld->img_stride_array,
                                                       ilevel);
@@ -2077,3 +2121,61 @@ lp_build_sample_offset(struct lp_build_context *bld,
 
    *out_offset = offset;
 }
+
+
+/**
+ * Compute the offset of a texel in a tiled image.
+ *
+ * Tiled images consist of 4x4 texel tiles, each tile being contiguous in
+ * memory with the texels in Morton (z) order, so a 2x2 bilinear footprint
+ * is usually within one cache line. Tiles are stored in rows, and a row of
+ * tiles starts every 4 * y_stride bytes, hence the image has the same
+ * size and strides as the linear one (dimensions being multiples of 4).
+ * The offset is separable into x and y parts like the linear one:
+ *
+ *   x part: ((x & ~3) * 4 + (x & 1) + (x & 2) * 2) * bpp
+ *   y part: (y & ~3) * y_stride + ((y & 1) * 2 + (y & 2) * 4) * bpp
+ *
+ * Only formats with 1x1 pixel blocks can be tiled.
+ */
+void
+lp_build_sample_tiled_offset(struct lp_build_context *bld,
+                             const struct util_format_description *format_desc,
+                             LLVMValueRef x,
+                             LLVMValueRef y,
+                             LLVMValueRef z,
+                             LLVMValueRef y_stride,
+                             LLVMValueRef z_stride,
+                             LLVMValueRef *out_offset)
+{
+   struct gallivm_state *gallivm = bld->gallivm;
+   LLVMValueRef one = lp_build_const_int_vec(gallivm, bld->type, 1);
+   LLVMValueRef two = lp_build_const_int_vec(gallivm, bld->type, 2);
+   LLVMValueRef not3 = lp_build_const_int_vec(gallivm, bld->type, ~3);
+   LLVMValueRef bpp = lp_build_const_int_vec(gallivm, bld->type,
+                                             format_desc->block.bits/8);
+   LLVMValueRef texel, tmp, offset;
+
+   assert(format_desc->block.width == 1 && format_desc->block.height == 1);
+   assert(y && y_stride);
+
+   texel = lp_build_shl_imm(bld, lp_build_and(bld, x, not3), 2);
+   texel = lp_build_or(bld, texel, lp_build_and(bld, x, one));
+   tmp = lp_build_shl_imm(bld, lp_build_and(bld, x, two), 1);
+   texel = lp_build_or(bld, texel, tmp);
+   tmp = lp_build_shl_imm(bld, lp_build_and(bld, y, one), 1);
+   texel = lp_build_or(bld, texel, tmp);
+   tmp = lp_build_shl_imm(bld, lp_build_and(bld, y, two), 2);
+   texel = lp_build_or(bld, texel, tmp);
+
+   offset = lp_build_mul(bld, texel, bpp);
+   tmp = lp_build_mul(bld, lp_build_and(bld, y, not3), y_stride);
+   offset = lp_build_add(bld, offset, tmp);
+
+   if (z && z_stride) {
+      tmp = lp_build_mul(bld, z, z_stride);
+      offset = lp_build_add(bld, offset, tmp);
+   }
+
+   *out_offset = offset;
+}
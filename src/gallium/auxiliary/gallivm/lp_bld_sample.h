@@ -49,6 +49,7 @@ extern "C" {
 struct pipe_resource;
 struct pipe_sampler_view;
 struct pipe_sampler_state;
+struct pipe_image_view;
 struct util_format_description;
 struct lp_type;
 struct lp_build_context;
@@ -108,6 +109,7 @@ struct lp_sampler_params
    const LLVMValueRef *offsets;
    LLVMValueRef lod;
    const struct lp_derivatives *derivs;
+   LLVMValueRef ms_index;
    LLVMValueRef *texel;
 };
 
@@ -122,6 +124,37 @@ struct lp_sampler_size_query_params
    LLVMValueRef explicit_lod;
    LLVMValueRef *sizes_out;
 };
+
+
+enum lp_img_op_type {
+   LP_IMG_LOAD,
+   LP_IMG_STORE,
+   LP_IMG_ATOMIC,
+   LP_IMG_ATOMIC_CAS
+};
+
+/**
+ * Image load/store/atomic parameters.
+ *
+ * Coordinates are unnormalized integers, out of bounds loads return zero
+ * and out of bounds stores and atomics are dropped.
+ */
+struct lp_img_params
+{
+   struct lp_type type;
+   unsigned image_index;
+   enum lp_img_op_type img_op;
+   unsigned target;          /**< PIPE_TEXTURE_* / PIPE_BUFFER */
+   LLVMAtomicRMWBinOp op;    /**< for LP_IMG_ATOMIC */
+   LLVMValueRef exec_mask;   /**< lanes allowed to write */
+   LLVMValueRef context_ptr;
+   const LLVMValueRef *coords;
+   LLVMValueRef indata[4];
+   LLVMValueRef indata2[4];  /**< compare value for LP_IMG_ATOMIC_CAS */
+   LLVMValueRef *outdata;
+};
+
+
 /**
  * Texture static state.
  *
@@ -143,6 +176,19 @@ struct lp_static_texture_state
    unsigned pot_height:1;
    unsigned pot_depth:1;
    unsigned level_zero_only:1;
+
+   /**
+    * Number of samples of a multisample texture whose samples are stored
+    * as consecutive images of each layer, 0 otherwise.  Only set by the
+    * drivers using that layout.
+    */
+   unsigned nr_samples:5;
+
+   /**
+    * Images are stored in 4x4 texel tiles, see lp_build_sample_tiled_offset().
+    * Only set by the drivers using that layout.
+    */
+   unsigned tiled:1;
 };
 
 
@@ -170,6 +216,7 @@ struct lp_static_sampler_state
    unsigned apply_min_lod:1;  /**< min_lod > 0 ? */
    unsigned apply_max_lod:1;  /**< max_lod < last_level ? */
    unsigned seamless_cube_map:1;
+   unsigned aniso:5;  /**< max anisotropy, 0 if anisotropic filtering is off */
 
    /* Hacks */
    unsigned force_nearest_s:1;
@@ -490,6 +537,11 @@ lp_sampler_static_texture_state(struct lp_static_texture_state *state,
                                 const struct pipe_sampler_view *view);
 
 
+void
+lp_sampler_static_texture_state_image(struct lp_static_texture_state *state,
+                                      const struct pipe_image_view *view);
+
+
 void
 lp_build_lod_selector(struct lp_build_sample_context *bld,
                       boolean is_lodq,
@@ -603,6 +655,17 @@ lp_build_sample_offset(struct lp_build_context *bld,
                        LLVMValueRef *out_j);
 
 
+void
+lp_build_sample_tiled_offset(struct lp_build_context *bld,
+                             const struct util_format_description *format_desc,
+                             LLVMValueRef x,
+                             LLVMValueRef y,
+                             LLVMValueRef z,
+                             LLVMValueRef y_stride,
+                             LLVMValueRef z_stride,
+                             LLVMValueRef *out_offset);
+
+
 void
 lp_build_sample_soa(const struct lp_static_texture_state *static_texture_state,
                     const struct lp_static_sampler_state *static_sampler_state,
@@ -626,6 +689,12 @@ lp_build_size_query_soa(struct gallivm_state *gallivm,
                         struct lp_sampler_dynamic_state *dynamic_state,
                         const struct lp_sampler_size_query_params *params);
 
+void
+lp_build_img_op_soa(const struct lp_static_texture_state *static_texture_state,
+                    struct lp_sampler_dynamic_state *dynamic_state,
+                    struct gallivm_state *gallivm,
+                    const struct lp_img_params *params);
+
 void
 lp_build_sample_nop(struct gallivm_state *gallivm, 
                     struct lp_type type,
@@ -137,10 +137,19 @@ lp_build_sample_texel_soa(struct lp_build_sample_context *bld,
    }
 
    /* convert x,y,z coords to linear offset from start of texture, in bytes */
-   lp_build_sample_offset(&bld->int_coord_bld,
-                          bld->format_desc,
-                          x, y, z, y_stride, z_stride,
-                          &offset, &i, &j);
+   if (bld->static_texture_state->tiled) {
+      lp_build_sample_tiled_offset(&bld->int_coord_bld,
+                                   bld->format_desc,
+                                   x, y, z, y_stride, z_stride,
+                                   &offset);
+      i = j = bld->int_coord_bld.zero;
+   }
+   else {
+      lp_build_sample_offset(&bld->int_coord_bld,
+                             bld->format_desc,
+                             x, y, z, y_stride, z_stride,
+                             &offset, &i, &j);
+   }
    if (mipoffsets) {
       offset = lp_build_add(&bld->int_coord_bld, offset, mipoffsets);
    }
@@ -2571,6 +2580,210 @@ lp_build_sample_general(struct lp_build_sample_context *bld,
 }
 
 
+/**
+ * Anisotropic texture sampling codegen (2d targets only).
+ * The pixel footprint is approximated by the ellipse spanned by the
+ * (texel space) derivatives. The number of taps is the ratio of the major
+ * to the minor axis (ceiled, clamped to the max anisotropy), and each tap
+ * is an ordinary (tri)linear sample with lod computed from the minor axis,
+ * the taps being distributed evenly along the major axis and averaged.
+ * This is per pixel, hence requires per-element lod.
+ */
+static void
+lp_build_sample_aniso(struct lp_build_sample_context *bld,
+                      unsigned texture_index,
+                      unsigned sampler_index,
+                      LLVMValueRef *coords,
+                      const LLVMValueRef *offsets,
+                      const struct lp_derivatives *derivs, /* optional */
+                      LLVMValueRef lod_bias, /* optional */
+                      LLVMValueRef *colors_out)
+{
+   struct gallivm_state *gallivm = bld->gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_build_context *coord_bld = &bld->coord_bld;
+   struct lp_build_context *int_coord_bld = &bld->int_coord_bld;
+   struct lp_build_context *texel_bld = &bld->texel_bld;
+   const unsigned length = coord_bld->type.length;
+   LLVMValueRef first_level, int_size, float_size, width, height;
+   LLVMValueRef ddx_s, ddy_s, ddx_t, ddy_t;
+   LLVMValueRef dudx, dvdx, dudy, dvdy, px2, py2, pmax2, pmin2, x_major;
+   LLVMValueRef major_s, major_t, num_taps, inum_taps, max_taps, ratio;
+   LLVMValueRef lod_positive = NULL, lod_fpart = NULL, lod = NULL;
+   LLVMValueRef ilevel0 = NULL, ilevel1 = NULL;
+   LLVMValueRef texels[4], tap_coords[5];
+   LLVMValueRef index0 = lp_build_const_int32(gallivm, 0);
+   LLVMValueRef index1 = lp_build_const_int32(gallivm, 1);
+   struct lp_derivatives minor_derivs;
+   struct lp_build_if_state if_ctx;
+   unsigned chan, i;
+
+   assert(bld->dims == 2);
+   assert(bld->num_lods == length || bld->num_lods == 1);
+
+   if (derivs) {
+      ddx_s = derivs->ddx[0];
+      ddy_s = derivs->ddy[0];
+      ddx_t = derivs->ddx[1];
+      ddy_t = derivs->ddy[1];
+   }
+   else {
+      ddx_s = lp_build_ddx(coord_bld, coords[0]);
+      ddy_s = lp_build_ddy(coord_bld, coords[0]);
+      ddx_t = lp_build_ddx(coord_bld, coords[1]);
+      ddy_t = lp_build_ddy(coord_bld, coords[1]);
+   }
+
+   /* the footprint is measured in texels of the first level */
+   first_level = bld->dynamic_state->first_level(bld->dynamic_state, gallivm,
+                                                 bld->context_ptr, texture_index);
+   first_level = lp_build_broadcast_scalar(&bld->int_size_in_bld, first_level);
+   int_size = lp_build_minify(&bld->int_size_in_bld, bld->int_size,
+                              first_level, TRUE);
+   float_size = lp_build_int_to_float(&bld->float_size_in_bld, int_size);
+   width = lp_build_extract_broadcast(gallivm, bld->float_size_in_type,
+                                      coord_bld->type, float_size, index0);
+   height = lp_build_extract_broadcast(gallivm, bld->float_size_in_type,
+                                       coord_bld->type, float_size, index1);
+
+   dudx = lp_build_mul(coord_bld, ddx_s, width);
+   dvdx = lp_build_mul(coord_bld, ddx_t, height);
+   dudy = lp_build_mul(coord_bld, ddy_s, width);
+   dvdy = lp_build_mul(coord_bld, ddy_t, height);
+   px2 = lp_build_add(coord_bld, lp_build_mul(coord_bld, dudx, dudx),
+                      lp_build_mul(coord_bld, dvdx, dvdx));
+   py2 = lp_build_add(coord_bld, lp_build_mul(coord_bld, dudy, dudy),
+                      lp_build_mul(coord_bld, dvdy, dvdy));
+
+   x_major = lp_build_cmp(coord_bld, PIPE_FUNC_GREATER, px2, py2);
+   pmax2 = lp_build_select(coord_bld, x_major, px2, py2);
+   pmin2 = lp_build_select(coord_bld, x_major, py2, px2);
+   major_s = lp_build_select(coord_bld, x_major, ddx_s, ddy_s);
+   major_t = lp_build_select(coord_bld, x_major, ddx_t, ddy_t);
+
+   /*
+    * num_taps = clamp(ceil(Pmax / Pmin), 1, max_aniso).
+    * The min avoids division by zero for degenerate footprints, which then
+    * simply get the max number of taps.
+    */
+   pmin2 = lp_build_max(coord_bld, pmin2,
+                        lp_build_const_vec(gallivm, coord_bld->type, 1e-20F));
+   ratio = lp_build_sqrt(coord_bld, lp_build_div(coord_bld, pmax2, pmin2));
+   num_taps = lp_build_ceil(coord_bld, ratio);
+   num_taps = lp_build_clamp(coord_bld, num_taps, coord_bld->one,
+                             lp_build_const_vec(gallivm, coord_bld->type,
+                                                bld->static_sampler_state->aniso));
+   inum_taps = lp_build_itrunc(coord_bld, num_taps);
+
+   /*
+    * Compute the lod from the minor axis, which is the major axis divided by
+    * the number of taps (so it stays the true minor axis unless clamped by
+    * max anisotropy). This way all the lod bias/clamp and mip level selection
+    * logic is shared with isotropic filtering.
+    */
+   memset(&minor_derivs, 0, sizeof minor_derivs);
+   minor_derivs.ddx[0] = lp_build_div(coord_bld, major_s, num_taps);
+   minor_derivs.ddx[1] = lp_build_div(coord_bld, major_t, num_taps);
+   minor_derivs.ddy[0] = minor_derivs.ddx[0];
+   minor_derivs.ddy[1] = minor_derivs.ddx[1];
+
+   lp_build_sample_common(bld, FALSE, texture_index, sampler_index,
+                          coords, &minor_derivs, lod_bias, NULL,
+                          &lod_positive, &lod, &lod_fpart,
+                          &ilevel0, &ilevel1);
+
+   for (chan = 0; chan < 4; ++chan) {
+      texels[chan] = lp_build_alloca(gallivm, texel_bld->vec_type, "");
+      lp_build_name(texels[chan], "sampler%u_aniso_texel_%c_var",
+                    sampler_index, "xyzw"[chan]);
+   }
+
+   /* max number of taps needed by any pixel */
+   max_taps = LLVMBuildExtractElement(builder, inum_taps, index0, "");
+   for (i = 1; i < length; i++) {
+      LLVMValueRef elem = LLVMBuildExtractElement(builder, inum_taps,
+                                                  lp_build_const_int32(gallivm, i),
+                                                  "");
+      max_taps = lp_build_max(&bld->int_bld, max_taps, elem);
+   }
+
+   lp_build_if(&if_ctx, gallivm,
+               LLVMBuildICmp(builder, LLVMIntSGT, max_taps,
+                             bld->int_bld.one, "need_aniso"));
+   {
+      struct lp_build_loop_state loop_state;
+      LLVMValueRef rcp_num_taps, tap_mask, weight, tap_colors[4];
+      LLVMValueRef itap, ftap;
+
+      for (chan = 0; chan < 4; ++chan) {
+         LLVMBuildStore(builder, texel_bld->zero, texels[chan]);
+      }
+      for (i = 0; i < 5; i++) {
+         tap_coords[i] = coords[i];
+      }
+      rcp_num_taps = lp_build_rcp(coord_bld, num_taps);
+
+      lp_build_loop_begin(&loop_state, gallivm, bld->int_bld.zero);
+      {
+         LLVMValueRef offset;
+
+         itap = lp_build_broadcast_scalar(int_coord_bld, loop_state.counter);
+         ftap = lp_build_int_to_float(coord_bld, itap);
+
+         /* tap offset along the major axis: (i + 0.5) / num_taps - 0.5 */
+         offset = lp_build_add(coord_bld, ftap,
+                               lp_build_const_vec(gallivm, coord_bld->type, 0.5F));
+         offset = lp_build_mul(coord_bld, offset, rcp_num_taps);
+         offset = lp_build_sub(coord_bld, offset,
+                               lp_build_const_vec(gallivm, coord_bld->type, 0.5F));
+         tap_coords[0] = lp_build_mad(coord_bld, offset, major_s, coords[0]);
+         tap_coords[1] = lp_build_mad(coord_bld, offset, major_t, coords[1]);
+
+         lp_build_sample_general(bld, sampler_index, FALSE,
+                                 tap_coords, offsets,
+                                 lod_positive, lod_fpart,
+                                 ilevel0, ilevel1,
+                                 tap_colors);
+
+         /* pixels needing fewer taps than the max get zero weight */
+         tap_mask = lp_build_cmp(int_coord_bld, PIPE_FUNC_LESS, itap, inum_taps);
+         weight = lp_build_select(coord_bld, tap_mask, rcp_num_taps,
+                                  coord_bld->zero);
+         for (chan = 0; chan < 4; ++chan) {
+            LLVMValueRef acc = LLVMBuildLoad(builder, texels[chan], "");
+            acc = lp_build_mad(texel_bld, tap_colors[chan], weight, acc);
+            LLVMBuildStore(builder, acc, texels[chan]);
+         }
+      }
+      lp_build_loop_end_cond(&loop_state, max_taps, NULL, LLVMIntSGE);
+   }
+   lp_build_else(&if_ctx);
+   {
+      /*
+       * Reduced-tap fast path: all pixels are (nearly) isotropic, so a single
+       * tap at the pixel center, which is just ordinary trilinear filtering.
+       */
+      LLVMValueRef tap_colors[4];
+
+      lp_build_sample_general(bld, sampler_index, FALSE,
+                              coords, offsets,
+                              lod_positive, lod_fpart,
+                              ilevel0, ilevel1,
+                              tap_colors);
+      for (chan = 0; chan < 4; ++chan) {
+         LLVMBuildStore(builder, tap_colors[chan], texels[chan]);
+      }
+   }
+   lp_build_endif(&if_ctx);
+
+   for (chan = 0; chan < 4; ++chan) {
+      colors_out[chan] = LLVMBuildLoad(builder, texels[chan], "");
+      lp_build_name(colors_out[chan], "sampler%u_texel_%c", sampler_index,
+                    "xyzw"[chan]);
+   }
+}
+
+
 /**
  * Texel fetch function.
  * In contrast to general sampling there is no filtering, no coord minification,
@@ -2585,6 +2798,7 @@ lp_build_fetch_texel(struct lp_build_sample_context *bld,
                      const LLVMValueRef *coords,
                      LLVMValueRef explicit_lod,
                      const LLVMValueRef *offsets,
+                     LLVMValueRef ms_index,
                      LLVMValueRef *colors_out)
 {
    struct lp_build_context *perquadi_bld = &bld->lodi_bld;
@@ -2671,10 +2885,41 @@ lp_build_fetch_texel(struct lp_build_sample_context *bld,
       }
    }
 
-   lp_build_sample_offset(int_coord_bld,
-                          bld->format_desc,
-                          x, y, z, row_stride_vec, img_stride_vec,
-                          &offset, &i, &j);
+   /*
+    * The samples of multisample textures are stored as consecutive images
+    * of each layer, with img_stride being the distance between samples.
+    */
+   if (ms_index && bld->static_texture_state->nr_samples > 1) {
+      unsigned nr_samples = bld->static_texture_state->nr_samples;
+      LLVMValueRef sample;
+
+      sample = lp_build_max(int_coord_bld, ms_index, int_coord_bld->zero);
+      sample = lp_build_min(int_coord_bld, sample,
+                            lp_build_const_int_vec(bld->gallivm,
+                                                   int_coord_bld->type,
+                                                   nr_samples - 1));
+      if (target == PIPE_TEXTURE_2D_ARRAY) {
+         z = lp_build_mul_imm(int_coord_bld, z, nr_samples);
+         z = lp_build_add(int_coord_bld, z, sample);
+      }
+      else {
+         z = sample;
+      }
+   }
+
+   if (bld->static_texture_state->tiled) {
+      lp_build_sample_tiled_offset(int_coord_bld,
+                                   bld->format_desc,
+                                   x, y, z, row_stride_vec, img_stride_vec,
+                                   &offset);
+      i = j = int_coord_bld->zero;
+   }
+   else {
+      lp_build_sample_offset(int_coord_bld,
+                             bld->format_desc,
+                             x, y, z, row_stride_vec, img_stride_vec,
+                             &offset, &i, &j);
+   }
 
    if (bld->static_texture_state->target != PIPE_BUFFER) {
       offset = lp_build_add(int_coord_bld, offset,
@@ -2747,6 +2992,7 @@ lp_build_sample_soa_code(struct gallivm_state *gallivm,
                          const LLVMValueRef *offsets,
                          const struct lp_derivatives *derivs, /* optional */
                          LLVMValueRef lod, /* optional */
+                         LLVMValueRef ms_index, /* optional */
                          LLVMValueRef texel_out[4])
 {
    unsigned target = static_texture_state->target;
@@ -2763,7 +3009,7 @@ lp_build_sample_soa_code(struct gallivm_state *gallivm,
    enum lp_sampler_op_type op_type;
    LLVMValueRef lod_bias = NULL;
    LLVMValueRef explicit_lod = NULL;
-   boolean op_is_tex, op_is_lodq, op_is_gather;
+   boolean op_is_tex, op_is_lodq, op_is_gather, use_aniso;
 
    if (0) {
       enum pipe_format fmt = static_texture_state->format;
@@ -2910,6 +3156,20 @@ lp_build_sample_soa_code(struct gallivm_state *gallivm,
    min_img_filter = derived_sampler_state.min_img_filter;
    mag_img_filter = derived_sampler_state.mag_img_filter;
 
+   /*
+    * Anisotropic filtering is only done for plain 2d textures (including
+    * arrays) with normalized coords. Cube maps would need the derivatives
+    * transformed to face space first, and for explicit lod there's no
+    * footprint.
+    */
+   use_aniso = derived_sampler_state.aniso > 1 &&
+               op_is_tex && !explicit_lod &&
+               dims == 2 && derived_sampler_state.normalized_coords &&
+               target != PIPE_TEXTURE_CUBE &&
+               target != PIPE_TEXTURE_CUBE_ARRAY &&
+               min_img_filter == PIPE_TEX_FILTER_LINEAR &&
+               bld.texel_type.floating;
+
 
    /*
     * This is all a bit complicated different paths are chosen for performance
@@ -2950,7 +3210,7 @@ lp_build_sample_soa_code(struct gallivm_state *gallivm,
       bld.num_lods = type.length;
    }
    else if (lod_property == LP_SAMPLER_LOD_PER_ELEMENT ||
-       (explicit_lod || lod_bias || derivs)) {
+       (explicit_lod || lod_bias || derivs) || use_aniso) {
       if ((!op_is_tex && target != PIPE_BUFFER) ||
           (op_is_tex && mip_filter != PIPE_TEX_MIPFILTER_NONE)) {
          bld.num_mips = type.length;
@@ -3094,17 +3354,24 @@ lp_build_sample_soa_code(struct gallivm_state *gallivm,
 
    else if (op_type == LP_SAMPLER_OP_FETCH) {
       lp_build_fetch_texel(&bld, texture_index, newcoords,
-                           lod, offsets,
+                           lod, offsets, ms_index,
                            texel_out);
    }
 
+   else if (use_aniso) {
+      lp_build_sample_aniso(&bld, texture_index, sampler_index,
+                            newcoords, offsets, derivs, lod_bias,
+                            texel_out);
+   }
+
    else {
       LLVMValueRef lod_fpart = NULL, lod_positive = NULL;
       LLVMValueRef ilevel0 = NULL, ilevel1 = NULL, lod = NULL;
       boolean use_aos;
 
+      /* the AoS code only knows about linear images */
       use_aos = util_format_fits_8unorm(bld.format_desc) &&
-                op_is_tex &&
+                op_is_tex && !static_texture_state->tiled &&
                 /* not sure this is strictly needed or simply impossible */
                 derived_sampler_state.compare_mode == PIPE_TEX_COMPARE_NONE &&
                 lp_is_simple_wrap_mode(derived_sampler_state.wrap_s);
@@ -3498,6 +3765,7 @@ lp_build_sample_gen_func(struct gallivm_state *gallivm,
                             offsets,
                             deriv_ptr,
                             lod,
+                            NULL,
                             texel_out);
 
    LLVMBuildAggregateRet(gallivm->builder, texel_out, 4);
@@ -3731,7 +3999,9 @@ lp_build_sample_soa(const struct lp_static_texture_state *static_texture_state,
              static_texture_state->level_zero_only == TRUE) &&
             static_sampler_state->min_img_filter == static_sampler_state->mag_img_filter);
 
-      use_tex_func = format_desc && !(simple_format && simple_tex);
+      /* the sample index of msaa fetches isn't passed to the functions */
+      use_tex_func = format_desc && !(simple_format && simple_tex) &&
+                     !params->ms_index;
    }
 
    if (use_tex_func) {
@@ -3756,6 +4026,7 @@ lp_build_sample_soa(const struct lp_static_texture_state *static_texture_state,
                                params->offsets,
                                params->derivs,
                                params->lod,
+                               params->ms_index,
                                params->texel);
    }
 }
@@ -3946,3 +4217,334 @@ lp_build_size_query_soa(struct gallivm_state *gallivm,
                                         num_levels);
    }
 }
+
+
+/**
+ * Convert one component of an image store to the raw bits of the
+ * corresponding format channel, zero extended to 32 bits.
+ *
+ * Pure integer values are clamped to the channel range, like
+ * util_format_write_4i/4ui do.
+ */
+static LLVMValueRef
+lp_build_img_pack_chan(struct gallivm_state *gallivm,
+                       struct lp_type type,
+                       const struct util_format_channel_description *chan_desc,
+                       LLVMValueRef value)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_build_context float_bld, int_bld, uint_bld;
+   unsigned width = chan_desc->size;
+   LLVMValueRef res;
+
+   lp_build_context_init(&float_bld, gallivm, type);
+   lp_build_context_init(&int_bld, gallivm, lp_int_type(type));
+   lp_build_context_init(&uint_bld, gallivm, lp_uint_type(type));
+
+   switch (chan_desc->type) {
+   case UTIL_FORMAT_TYPE_FLOAT:
+      value = LLVMBuildBitCast(builder, value, float_bld.vec_type, "");
+      if (width == 16) {
+         res = lp_build_float_to_half(gallivm, value);
+         res = LLVMBuildZExt(builder, res, int_bld.vec_type, "");
+      }
+      else {
+         assert(width == 32);
+         res = LLVMBuildBitCast(builder, value, int_bld.vec_type, "");
+      }
+      break;
+
+   case UTIL_FORMAT_TYPE_UNSIGNED:
+      if (chan_desc->normalized) {
+         value = LLVMBuildBitCast(builder, value, float_bld.vec_type, "");
+         res = lp_build_clamped_float_to_unsigned_norm(gallivm, type,
+                                                       width, value);
+      }
+      else {
+         res = LLVMBuildBitCast(builder, value, uint_bld.vec_type, "");
+         if (width < 32) {
+            res = lp_build_min(&uint_bld, res,
+                               lp_build_const_int_vec(gallivm, uint_bld.type,
+                                                      (1u << width) - 1));
+         }
+         res = LLVMBuildBitCast(builder, res, int_bld.vec_type, "");
+      }
+      break;
+
+   case UTIL_FORMAT_TYPE_SIGNED:
+      if (chan_desc->normalized) {
+         double scale = (double)((1 << (width - 1)) - 1);
+         value = LLVMBuildBitCast(builder, value, float_bld.vec_type, "");
+         value = lp_build_clamp(&float_bld, value,
+                                lp_build_const_vec(gallivm, type, -1.0),
+                                float_bld.one);
+         value = lp_build_mul(&float_bld, value,
+                              lp_build_const_vec(gallivm, type, scale));
+         res = lp_build_iround(&float_bld, value);
+      }
+      else {
+         res = LLVMBuildBitCast(builder, value, int_bld.vec_type, "");
+         if (width < 32) {
+            res = lp_build_clamp(&int_bld, res,
+                                 lp_build_const_int_vec(gallivm, int_bld.type,
+                                                        -(1 << (width - 1))),
+                                 lp_build_const_int_vec(gallivm, int_bld.type,
+                                                        (1 << (width - 1)) - 1));
+         }
+      }
+      if (width < 32) {
+         res = LLVMBuildAnd(builder, res,
+                            lp_build_const_int_vec(gallivm, int_bld.type,
+                                                   (1u << width) - 1), "");
+      }
+      break;
+
+   default:
+      assert(0);
+      res = int_bld.zero;
+      break;
+   }
+
+   return res;
+}
+
+
+/**
+ * Generate code for image loads, stores and atomics.
+ *
+ * The image level and first layer are resolved when binding the image,
+ * so addressing is the same as for a single level texture.
+ */
+void
+lp_build_img_op_soa(const struct lp_static_texture_state *static_texture_state,
+                    struct lp_sampler_dynamic_state *dynamic_state,
+                    struct gallivm_state *gallivm,
+                    const struct lp_img_params *params)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   const struct util_format_description *format_desc;
+   const unsigned target = params->target;
+   const unsigned dims = texture_dims(target);
+   const unsigned image_index = params->image_index;
+   LLVMValueRef context_ptr = params->context_ptr;
+   struct lp_type type = params->type;
+   struct lp_build_context int_bld, uint_bld;
+   LLVMValueRef coords[3] = { NULL, NULL, NULL };
+   LLVMValueRef row_stride = NULL, img_stride = NULL;
+   LLVMValueRef size, out_of_bounds, offset, i, j;
+   LLVMValueRef base_ptr, write_mask;
+   unsigned num_coords = dims, chan;
+
+   lp_build_context_init(&int_bld, gallivm, lp_int_type(type));
+   lp_build_context_init(&uint_bld, gallivm, lp_uint_type(type));
+
+   if (static_texture_state->format == PIPE_FORMAT_NONE) {
+      /*
+       * If there's nothing bound loads and atomics return zero and
+       * stores are dropped.
+       */
+      if (params->img_op != LP_IMG_STORE) {
+         for (chan = 0; chan < 4; chan++) {
+            params->outdata[chan] = lp_build_const_vec(gallivm, type, 0.0);
+         }
+      }
+      return;
+   }
+
+   format_desc = util_format_description(static_texture_state->format);
+
+   switch (target) {
+   case PIPE_TEXTURE_1D_ARRAY:
+   case PIPE_TEXTURE_2D_ARRAY:
+   case PIPE_TEXTURE_CUBE:
+   case PIPE_TEXTURE_CUBE_ARRAY:
+      /* layers (and cube faces) are stored like 3d slices */
+      num_coords++;
+      break;
+   default:
+      break;
+   }
+
+   /*
+    * Compute the byte offsets and which lanes are out of bounds, comparing
+    * unsigned so negative coordinates are out of bounds as well.
+    */
+   out_of_bounds = uint_bld.zero;
+   for (chan = 0; chan < num_coords; chan++) {
+      coords[chan] = LLVMBuildBitCast(builder, params->coords[chan],
+                                      uint_bld.vec_type, "");
+      if (chan == 0) {
+         size = dynamic_state->width(dynamic_state, gallivm,
+                                     context_ptr, image_index);
+      }
+      else if (chan == 1 && dims >= 2) {
+         size = dynamic_state->height(dynamic_state, gallivm,
+                                      context_ptr, image_index);
+      }
+      else {
+         size = dynamic_state->depth(dynamic_state, gallivm,
+                                     context_ptr, image_index);
+      }
+      size = lp_build_broadcast_scalar(&uint_bld, size);
+      out_of_bounds = lp_build_or(&uint_bld, out_of_bounds,
+                                  lp_build_cmp(&uint_bld, PIPE_FUNC_GEQUAL,
+                                               coords[chan], size));
+      coords[chan] = LLVMBuildBitCast(builder, coords[chan],
+                                      int_bld.vec_type, "");
+   }
+
+   if (num_coords >= 2) {
+      row_stride = dynamic_state->row_stride(dynamic_state, gallivm,
+                                             context_ptr, image_index);
+      row_stride = lp_build_broadcast_scalar(&int_bld, row_stride);
+   }
+   if (num_coords >= 3) {
+      img_stride = dynamic_state->img_stride(dynamic_state, gallivm,
+                                             context_ptr, image_index);
+      img_stride = lp_build_broadcast_scalar(&int_bld, img_stride);
+   }
+
+   /* 1d arrays have no rows, the layer goes in the place of z */
+   if (target == PIPE_TEXTURE_1D_ARRAY) {
+      coords[2] = coords[1];
+      coords[1] = NULL;
+      img_stride = row_stride;
+      row_stride = NULL;
+   }
+
+   lp_build_sample_offset(&int_bld, format_desc,
+                          coords[0], coords[1], coords[2],
+                          row_stride, img_stride,
+                          &offset, &i, &j);
+   offset = lp_build_andnot(&int_bld, offset, out_of_bounds);
+
+   base_ptr = dynamic_state->base_ptr(dynamic_state, gallivm,
+                                      context_ptr, image_index);
+
+   if (params->img_op == LP_IMG_LOAD) {
+      struct lp_type texel_type = type;
+      struct lp_build_context texel_bld;
+
+      if (format_desc->colorspace == UTIL_FORMAT_COLORSPACE_RGB &&
+          format_desc->channel[0].pure_integer) {
+         if (format_desc->channel[0].type == UTIL_FORMAT_TYPE_SIGNED) {
+            texel_type = lp_type_int_vec(type.width, type.width * type.length);
+         }
+         else if (format_desc->channel[0].type == UTIL_FORMAT_TYPE_UNSIGNED) {
+            texel_type = lp_type_uint_vec(type.width, type.width * type.length);
+         }
+      }
+      lp_build_context_init(&texel_bld, gallivm, texel_type);
+
+      lp_build_fetch_rgba_soa(gallivm, format_desc, texel_type, TRUE,
+                              base_ptr, offset, i, j, NULL,
+                              params->outdata);
+
+      for (chan = 0; chan < 4; chan++) {
+         params->outdata[chan] = lp_build_select(&texel_bld, out_of_bounds,
+                                                 texel_bld.zero,
+                                                 params->outdata[chan]);
+      }
+      return;
+   }
+
+   write_mask = lp_build_andnot(&int_bld, params->exec_mask, out_of_bounds);
+
+   if (params->img_op == LP_IMG_STORE) {
+      if (format_desc->format == PIPE_FORMAT_R11G11B10_FLOAT) {
+         LLVMValueRef rgb[3];
+         LLVMValueRef packed;
+
+         for (chan = 0; chan < 3; chan++) {
+            rgb[chan] = LLVMBuildBitCast(builder, params->indata[chan],
+                                         lp_build_vec_type(gallivm, type), "");
+         }
+         packed = lp_build_float_to_r11g11b10(gallivm, rgb);
+         lp_build_masked_scatter(gallivm, type.length, 32,
+                                 base_ptr, offset, packed, write_mask);
+         return;
+      }
+
+      assert(format_desc->layout == UTIL_FORMAT_LAYOUT_PLAIN);
+
+      if (format_desc->block.bits <= 32) {
+         /* Pack all channels into a single word per texel. */
+         LLVMValueRef packed = int_bld.zero;
+
+         for (chan = 0; chan < format_desc->nr_channels; chan++) {
+            const struct util_format_channel_description *chan_desc =
+               &format_desc->channel[chan];
+            unsigned comp;
+            LLVMValueRef bits;
+
+            for (comp = 0; comp < 4; comp++) {
+               if (format_desc->swizzle[comp] == chan)
+                  break;
+            }
+            if (comp == 4 || chan_desc->type == UTIL_FORMAT_TYPE_VOID)
+               continue;
+
+            bits = lp_build_img_pack_chan(gallivm, type, chan_desc,
+                                          params->indata[comp]);
+            if (chan_desc->shift) {
+               bits = LLVMBuildShl(builder, bits,
+                                   lp_build_const_int_vec(gallivm, int_bld.type,
+                                                          chan_desc->shift), "");
+            }
+            packed = LLVMBuildOr(builder, packed, bits, "");
+         }
+
+         lp_build_masked_scatter(gallivm, type.length,
+                                 format_desc->block.bits,
+                                 base_ptr, offset, packed, write_mask);
+      }
+      else {
+         /* Wide formats have byte aligned channels, store them one by one. */
+         for (chan = 0; chan < format_desc->nr_channels; chan++) {
+            const struct util_format_channel_description *chan_desc =
+               &format_desc->channel[chan];
+            LLVMValueRef bits, chan_offset;
+            unsigned comp;
+
+            for (comp = 0; comp < 4; comp++) {
+               if (format_desc->swizzle[comp] == chan)
+                  break;
+            }
+            if (comp == 4 || chan_desc->type == UTIL_FORMAT_TYPE_VOID)
+               continue;
+
+            assert(chan_desc->shift % 8 == 0 && chan_desc->size % 8 == 0);
+            bits = lp_build_img_pack_chan(gallivm, type, chan_desc,
+                                          params->indata[comp]);
+            chan_offset = lp_build_add(&int_bld, offset,
+                                       lp_build_const_int_vec(gallivm, int_bld.type,
+                                                              chan_desc->shift / 8));
+            lp_build_masked_scatter(gallivm, type.length, chan_desc->size,
+                                    base_ptr, chan_offset, bits, write_mask);
+         }
+      }
+      return;
+   }
+
+   /* Atomics, only defined for single channel 32 bit formats. */
+   assert(format_desc->block.bits == 32 && format_desc->nr_channels == 1);
+   {
+      LLVMValueRef value, cmp = NULL, res;
+
+      value = LLVMBuildBitCast(builder, params->indata[0],
+                               int_bld.vec_type, "");
+      if (params->img_op == LP_IMG_ATOMIC_CAS) {
+         cmp = LLVMBuildBitCast(builder, params->indata2[0],
+                                int_bld.vec_type, "");
+      }
+
+      res = lp_build_masked_atomic(gallivm, type.length, params->op,
+                                   params->img_op == LP_IMG_ATOMIC_CAS,
+                                   base_ptr, offset, value, cmp, write_mask);
+
+      res = LLVMBuildBitCast(builder, res, lp_build_vec_type(gallivm, type), "");
+      for (chan = 0; chan < 4; chan++) {
+         params->outdata[chan] = res;
+      }
+   }
+}
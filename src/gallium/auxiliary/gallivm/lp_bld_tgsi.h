@@ -67,6 +67,7 @@ struct lp_build_mask_context;
 struct gallivm_state;
 struct lp_derivatives;
 struct lp_build_tgsi_gs_iface;
+struct lp_build_tgsi_mem_iface;
 
 
 enum lp_build_tex_modifier {
@@ -170,6 +171,11 @@ struct lp_bld_tgsi_system_values {
    LLVMValueRef prim_id;
    LLVMValueRef basevertex;
    LLVMValueRef invocation_id;
+   /* compute shader values, thread_id is a vector, the others scalars */
+   LLVMValueRef thread_id[3];
+   LLVMValueRef block_id[3];
+   LLVMValueRef grid_size[3];
+   LLVMValueRef block_size[3];
 };
 
 
@@ -198,6 +204,26 @@ struct lp_build_sampler_soa
 };
 
 
+/**
+ * Image load/store code generation interface.
+ */
+struct lp_build_image_soa
+{
+   void
+   (*destroy)( struct lp_build_image_soa *image );
+
+   void
+   (*emit_op)(const struct lp_build_image_soa *image,
+              struct gallivm_state *gallivm,
+              const struct lp_img_params *params);
+
+   void
+   (*emit_size_query)( const struct lp_build_image_soa *image,
+                       struct gallivm_state *gallivm,
+                       const struct lp_sampler_size_query_params *params);
+};
+
+
 struct lp_build_sampler_aos
 {
    LLVMValueRef
@@ -230,7 +256,8 @@ lp_build_tgsi_soa(struct gallivm_state *gallivm,
                   LLVMValueRef thread_data_ptr,
                   const struct lp_build_sampler_soa *sampler,
                   const struct tgsi_shader_info *info,
-                  const struct lp_build_tgsi_gs_iface *gs_iface);
+                  const struct lp_build_tgsi_gs_iface *gs_iface,
+                  const struct lp_build_tgsi_mem_iface *mem_iface);
 
 
 void
@@ -430,6 +457,39 @@ struct lp_build_tgsi_gs_iface
                        LLVMValueRef emitted_prims_vec);
 };
 
+/**
+ * Memory resources (TGSI_FILE_BUFFER, TGSI_FILE_IMAGE and
+ * TGSI_FILE_MEMORY) and compute shader execution state.
+ */
+struct lp_build_tgsi_mem_iface
+{
+   /** Pointer to an array of shader buffer pointers */
+   LLVMValueRef ssbo_ptr;
+   /** Pointer to an array of int32 shader buffer sizes in bytes */
+   LLVMValueRef ssbo_sizes_ptr;
+
+   /** Workgroup shared memory and its size in bytes (int32) */
+   LLVMValueRef shared_ptr;
+   LLVMValueRef shared_size;
+
+   const struct lp_build_image_soa *image;
+
+   /**
+    * Optional storage for the temporary registers (an array of vectors).
+    * Used to carry them between the phases of a shader split at its
+    * barriers.
+    */
+   LLVMValueRef temps_ptr;
+
+   /**
+    * Index of the first instruction to translate, translation stops at
+    * the next barrier outside of control flow.  Ignored unless
+    * split_at_barriers is set.
+    */
+   unsigned start_pc;
+   boolean split_at_barriers;
+};
+
 struct lp_build_tgsi_soa_context
 {
    struct lp_build_tgsi_context bld_base;
@@ -454,6 +514,8 @@ struct lp_build_tgsi_soa_context
 
    const struct lp_build_sampler_soa *sampler;
 
+   const struct lp_build_tgsi_mem_iface *mem_iface;
+
    struct tgsi_declaration_sampler_view sv[PIPE_MAX_SHADER_SAMPLER_VIEWS];
 
    LLVMValueRef immediates[LP_MAX_INLINED_IMMEDIATES][TGSI_NUM_CHANNELS];
@@ -1647,6 +1647,36 @@ emit_fetch_system_value(
       atype = TGSI_TYPE_UNSIGNED;
       break;
 
+   case TGSI_SEMANTIC_THREAD_ID:
+      res = swizzle < 3 ? bld->system_values.thread_id[swizzle] :
+                          bld_base->uint_bld.zero;
+      atype = TGSI_TYPE_UNSIGNED;
+      break;
+
+   case TGSI_SEMANTIC_BLOCK_ID:
+      res = swizzle < 3 ?
+         lp_build_broadcast_scalar(&bld_base->uint_bld,
+                                   bld->system_values.block_id[swizzle]) :
+         bld_base->uint_bld.zero;
+      atype = TGSI_TYPE_UNSIGNED;
+      break;
+
+   case TGSI_SEMANTIC_GRID_SIZE:
+      res = swizzle < 3 ?
+         lp_build_broadcast_scalar(&bld_base->uint_bld,
+                                   bld->system_values.grid_size[swizzle]) :
+         bld_base->uint_bld.zero;
+      atype = TGSI_TYPE_UNSIGNED;
+      break;
+
+   case TGSI_SEMANTIC_BLOCK_SIZE:
+      res = swizzle < 3 ?
+         lp_build_broadcast_scalar(&bld_base->uint_bld,
+                                   bld->system_values.block_size[swizzle]) :
+         bld_base->uint_bld.zero;
+      atype = TGSI_TYPE_UNSIGNED;
+      break;
+
    default:
       assert(!"unexpected semantic in emit_fetch_system_value");
       res = bld_base->base.zero;
@@ -2479,10 +2509,11 @@ emit_fetch_texels( struct lp_build_tgsi_soa_context *bld,
       explicit_lod = lp_build_emit_fetch(&bld->bld_base, inst, 0, 3);
       lod_property = lp_build_lod_property(&bld->bld_base, inst, 0);
    }
-   /*
-    * XXX: for real msaa support, the w component (or src2.x for sample_i_ms)
-    * would be the sample index.
-    */
+   /* the w component is the sample index for msaa targets */
+   if (target == TGSI_TEXTURE_2D_MSAA ||
+       target == TGSI_TEXTURE_2D_ARRAY_MSAA) {
+      params.ms_index = lp_build_emit_fetch(&bld->bld_base, inst, 0, 3);
+   }
 
    for (i = 0; i < dims; i++) {
       coords[i] = lp_build_emit_fetch(&bld->bld_base, inst, 0, i);
@@ -3639,12 +3670,413 @@ cont_emit(
    lp_exec_continue(&bld->exec_mask);
 }
 
+/**
+ * Return the base pointer (as i8 pointer) and the size in bytes of the
+ * shader buffer or shared memory accessed by a memory instruction.
+ */
+static void
+get_mem_resource(struct lp_build_tgsi_soa_context *bld,
+                 const struct tgsi_full_src_register *reg,
+                 LLVMValueRef *base_ptr,
+                 LLVMValueRef *size)
+{
+   struct gallivm_state *gallivm = bld->bld_base.base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   const struct lp_build_tgsi_mem_iface *mem_iface = bld->mem_iface;
+   LLVMValueRef index;
+
+   if (reg->Register.File == TGSI_FILE_MEMORY) {
+      *base_ptr = mem_iface->shared_ptr;
+      *size = mem_iface->shared_size;
+      return;
+   }
+
+   assert(reg->Register.File == TGSI_FILE_BUFFER);
+
+   if (reg->Register.Indirect) {
+      /* GLSL requires the index to be dynamically uniform */
+      index = get_indirect_index(bld, reg->Register.File,
+                                 reg->Register.Index, &reg->Indirect);
+      index = LLVMBuildExtractElement(builder, index,
+                                      lp_build_const_int32(gallivm, 0), "");
+   }
+   else {
+      index = lp_build_const_int32(gallivm, reg->Register.Index);
+   }
+
+   *base_ptr = lp_build_array_get(gallivm, mem_iface->ssbo_ptr, index);
+   *size = lp_build_array_get(gallivm, mem_iface->ssbo_sizes_ptr, index);
+}
+
+
+/**
+ * Return a mask of the lanes for which the 32 bit word at the given byte
+ * offset lies outside of a resource of the given size.
+ */
+static LLVMValueRef
+mem_overflow_mask(struct lp_build_tgsi_soa_context *bld,
+                  LLVMValueRef offset,
+                  LLVMValueRef size)
+{
+   struct lp_build_context *uint_bld = &bld->bld_base.uint_bld;
+   LLVMValueRef size_vec, last_byte, overflow;
+
+   size_vec = lp_build_broadcast_scalar(uint_bld, size);
+   last_byte = lp_build_add(uint_bld, offset,
+                            lp_build_const_int_vec(uint_bld->gallivm,
+                                                   uint_bld->type, 3));
+   overflow = lp_build_cmp(uint_bld, PIPE_FUNC_GEQUAL, offset, size_vec);
+   return lp_build_or(uint_bld, overflow,
+                      lp_build_cmp(uint_bld, PIPE_FUNC_GEQUAL,
+                                   last_byte, size_vec));
+}
+
+
+/**
+ * Fetch the coordinates of an image memory instruction.
+ */
+static void
+fetch_img_coords(struct lp_build_tgsi_context *bld_base,
+                 const struct tgsi_full_instruction *inst,
+                 unsigned src_op,
+                 LLVMValueRef coords[3])
+{
+   unsigned chan;
+
+   for (chan = 0; chan < 3; chan++) {
+      coords[chan] = lp_build_emit_fetch(bld_base, inst, src_op, chan);
+   }
+}
+
+
+static void
+load_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_build_context *uint_bld = &bld_base->uint_bld;
+   const struct tgsi_full_instruction *inst = emit_data->inst;
+   const struct tgsi_full_src_register *res = &inst->Src[0];
+   LLVMValueRef base_ptr, size, addr;
+   unsigned chan;
+
+   if (res->Register.File == TGSI_FILE_IMAGE) {
+      struct lp_img_params params;
+      LLVMValueRef coords[3];
+
+      fetch_img_coords(bld_base, inst, 1, coords);
+
+      memset(&params, 0, sizeof params);
+      params.type = bld_base->base.type;
+      params.image_index = res->Register.Index;
+      params.img_op = LP_IMG_LOAD;
+      params.target = tgsi_to_pipe_tex_target(inst->Memory.Texture);
+      params.context_ptr = bld->context_ptr;
+      params.coords = coords;
+      params.outdata = emit_data->output;
+
+      bld->mem_iface->image->emit_op(bld->mem_iface->image, gallivm, &params);
+      return;
+   }
+
+   get_mem_resource(bld, res, &base_ptr, &size);
+   base_ptr = LLVMBuildBitCast(builder, base_ptr,
+                               LLVMPointerType(bld_base->base.elem_type, 0), "");
+   addr = lp_build_emit_fetch(bld_base, inst, 1, TGSI_CHAN_X);
+
+   TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+      LLVMValueRef offset, index, overflow;
+
+      offset = lp_build_add(uint_bld, addr,
+                            lp_build_const_int_vec(gallivm, uint_bld->type,
+                                                   chan * 4));
+      overflow = mem_overflow_mask(bld, offset, size);
+      index = lp_build_shr_imm(uint_bld, offset, 2);
+
+      /*
+       * build_gather reads element zero for overflowing lanes, so the
+       * callers must always provide at least 4 bytes of valid memory.
+       */
+      emit_data->output[chan] = build_gather(bld_base, base_ptr, index,
+                                             overflow, NULL);
+   }
+}
+
+
+static void
+store_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_build_context *uint_bld = &bld_base->uint_bld;
+   const struct tgsi_full_instruction *inst = emit_data->inst;
+   const struct tgsi_full_dst_register *res = &inst->Dst[0];
+   struct tgsi_full_src_register res_src;
+   LLVMValueRef base_ptr, size, addr, exec_mask;
+   unsigned chan;
+
+   exec_mask = mask_vec(bld_base);
+
+   if (res->Register.File == TGSI_FILE_IMAGE) {
+      struct lp_img_params params;
+      LLVMValueRef coords[3];
+
+      fetch_img_coords(bld_base, inst, 0, coords);
+
+      memset(&params, 0, sizeof params);
+      params.type = bld_base->base.type;
+      params.image_index = res->Register.Index;
+      params.img_op = LP_IMG_STORE;
+      params.target = tgsi_to_pipe_tex_target(inst->Memory.Texture);
+      params.exec_mask = exec_mask;
+      params.context_ptr = bld->context_ptr;
+      params.coords = coords;
+      for (chan = 0; chan < 4; chan++) {
+         params.indata[chan] = lp_build_emit_fetch(bld_base, inst, 1, chan);
+      }
+
+      bld->mem_iface->image->emit_op(bld->mem_iface->image, gallivm, &params);
+      return;
+   }
+
+   memset(&res_src, 0, sizeof res_src);
+   res_src.Register.File = res->Register.File;
+   res_src.Register.Index = res->Register.Index;
+   res_src.Register.Indirect = res->Register.Indirect;
+   res_src.Indirect = res->Indirect;
+
+   get_mem_resource(bld, &res_src, &base_ptr, &size);
+   addr = lp_build_emit_fetch(bld_base, inst, 0, TGSI_CHAN_X);
+
+   TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+      LLVMValueRef offset, overflow, value, store_mask;
+
+      offset = lp_build_add(uint_bld, addr,
+                            lp_build_const_int_vec(gallivm, uint_bld->type,
+                                                   chan * 4));
+      overflow = mem_overflow_mask(bld, offset, size);
+      store_mask = lp_build_andnot(uint_bld, exec_mask, overflow);
+
+      value = lp_build_emit_fetch(bld_base, inst, 1, chan);
+      value = LLVMBuildBitCast(builder, value, uint_bld->vec_type, "");
+
+      lp_build_masked_scatter(gallivm, uint_bld->type.length, 32,
+                              base_ptr, offset, value, store_mask);
+   }
+}
+
+
+static void
+atomic_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_build_context *uint_bld = &bld_base->uint_bld;
+   const struct tgsi_full_instruction *inst = emit_data->inst;
+   const struct tgsi_full_src_register *res = &inst->Src[0];
+   boolean is_cas = inst->Instruction.Opcode == TGSI_OPCODE_ATOMCAS;
+   LLVMAtomicRMWBinOp op = LLVMAtomicRMWBinOpAdd;
+   LLVMValueRef base_ptr, size, addr, value, cmp = NULL, exec_mask, result;
+   unsigned chan;
+
+   switch (inst->Instruction.Opcode) {
+   case TGSI_OPCODE_ATOMUADD:
+      op = LLVMAtomicRMWBinOpAdd;
+      break;
+   case TGSI_OPCODE_ATOMXCHG:
+      op = LLVMAtomicRMWBinOpXchg;
+      break;
+   case TGSI_OPCODE_ATOMAND:
+      op = LLVMAtomicRMWBinOpAnd;
+      break;
+   case TGSI_OPCODE_ATOMOR:
+      op = LLVMAtomicRMWBinOpOr;
+      break;
+   case TGSI_OPCODE_ATOMXOR:
+      op = LLVMAtomicRMWBinOpXor;
+      break;
+   case TGSI_OPCODE_ATOMUMIN:
+      op = LLVMAtomicRMWBinOpUMin;
+      break;
+   case TGSI_OPCODE_ATOMUMAX:
+      op = LLVMAtomicRMWBinOpUMax;
+      break;
+   case TGSI_OPCODE_ATOMIMIN:
+      op = LLVMAtomicRMWBinOpMin;
+      break;
+   case TGSI_OPCODE_ATOMIMAX:
+      op = LLVMAtomicRMWBinOpMax;
+      break;
+   case TGSI_OPCODE_ATOMCAS:
+      break;
+   default:
+      assert(0);
+      break;
+   }
+
+   exec_mask = mask_vec(bld_base);
+
+   /* For CAS src 2 is the value to compare with and src 3 the new value. */
+   if (is_cas) {
+      cmp = lp_build_emit_fetch(bld_base, inst, 2, TGSI_CHAN_X);
+      value = lp_build_emit_fetch(bld_base, inst, 3, TGSI_CHAN_X);
+   }
+   else {
+      value = lp_build_emit_fetch(bld_base, inst, 2, TGSI_CHAN_X);
+   }
+
+   if (res->Register.File == TGSI_FILE_IMAGE) {
+      struct lp_img_params params;
+      LLVMValueRef coords[3];
+
+      fetch_img_coords(bld_base, inst, 1, coords);
+
+      memset(&params, 0, sizeof params);
+      params.type = bld_base->base.type;
+      params.image_index = res->Register.Index;
+      params.img_op = is_cas ? LP_IMG_ATOMIC_CAS : LP_IMG_ATOMIC;
+      params.target = tgsi_to_pipe_tex_target(inst->Memory.Texture);
+      params.op = op;
+      params.exec_mask = exec_mask;
+      params.context_ptr = bld->context_ptr;
+      params.coords = coords;
+      params.indata[0] = value;
+      params.indata2[0] = cmp;
+      params.outdata = emit_data->output;
+
+      bld->mem_iface->image->emit_op(bld->mem_iface->image, gallivm, &params);
+      return;
+   }
+
+   get_mem_resource(bld, res, &base_ptr, &size);
+   addr = lp_build_emit_fetch(bld_base, inst, 1, TGSI_CHAN_X);
+   exec_mask = lp_build_andnot(uint_bld, exec_mask,
+                               mem_overflow_mask(bld, addr, size));
+
+   value = LLVMBuildBitCast(builder, value, uint_bld->vec_type, "");
+   if (cmp) {
+      cmp = LLVMBuildBitCast(builder, cmp, uint_bld->vec_type, "");
+   }
+
+   result = lp_build_masked_atomic(gallivm, uint_bld->type.length, op, is_cas,
+                                   base_ptr, addr, value, cmp, exec_mask);
+
+   TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+      emit_data->output[chan] = result;
+   }
+}
+
+
+static void
+resq_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+   struct lp_build_context *uint_bld = &bld_base->uint_bld;
+   const struct tgsi_full_instruction *inst = emit_data->inst;
+   const struct tgsi_full_src_register *res = &inst->Src[0];
+   unsigned chan;
+
+   if (res->Register.File == TGSI_FILE_IMAGE) {
+      struct lp_sampler_size_query_params params;
+      LLVMValueRef sizes[4];
+
+      for (chan = 0; chan < 4; chan++) {
+         sizes[chan] = uint_bld->zero;
+      }
+
+      memset(&params, 0, sizeof params);
+      params.int_type = bld_base->int_bld.type;
+      params.texture_unit = res->Register.Index;
+      params.target = tgsi_to_pipe_tex_target(inst->Memory.Texture);
+      params.context_ptr = bld->context_ptr;
+      params.is_sviewinfo = FALSE;
+      params.lod_property = LP_SAMPLER_LOD_SCALAR;
+      params.sizes_out = sizes;
+
+      bld->mem_iface->image->emit_size_query(bld->mem_iface->image,
+                                             gallivm, &params);
+
+      TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+         emit_data->output[chan] = sizes[chan];
+      }
+   }
+   else {
+      LLVMValueRef base_ptr, size;
+
+      get_mem_resource(bld, res, &base_ptr, &size);
+      size = lp_build_broadcast_scalar(uint_bld, size);
+      TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+         emit_data->output[chan] = chan == 0 ? size : uint_bld->zero;
+      }
+   }
+}
+
+
+static void
+barrier_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+   struct lp_exec_mask *mask = &bld->exec_mask;
+
+   /*
+    * The caller runs all invocations of the workgroup up to a barrier
+    * outside of control flow before running any past it, so end the
+    * translation here.  Barriers within control flow are left to the
+    * caller too, which must not split the shader there.
+    */
+   if (bld->mem_iface && bld->mem_iface->split_at_barriers &&
+       mask->function_stack_size == 1 &&
+       !mask_has_cond(mask) && !mask_has_loop(mask) &&
+       !mask_has_switch(mask)) {
+      bld_base->pc = -1;
+   }
+}
+
+
+static void
+membar_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   /*
+    * Nothing to do, memory accesses are not reordered across invocations
+    * and the atomics are sequentially consistent.
+    */
+}
+
 static void emit_prologue(struct lp_build_tgsi_context * bld_base)
 {
    struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
    struct gallivm_state * gallivm = bld_base->base.gallivm;
 
-   if (bld->indirect_files & (1 << TGSI_FILE_TEMPORARY)) {
+   if (bld->mem_iface && bld->mem_iface->temps_ptr) {
+      /* caller provided storage, see lp_build_tgsi_mem_iface */
+      bld->temps_array =
+         LLVMBuildBitCast(gallivm->builder, bld->mem_iface->temps_ptr,
+                          LLVMPointerType(bld_base->base.vec_type, 0),
+                          "temp_array");
+   }
+   else if (bld->indirect_files & (1 << TGSI_FILE_TEMPORARY)) {
       LLVMValueRef array_size =
          lp_build_const_int32(gallivm,
                          bld_base->info->file_max[TGSI_FILE_TEMPORARY] * 4 + 4);
@@ -3782,7 +4214,8 @@ lp_build_tgsi_soa(struct gallivm_state *gallivm,
                   LLVMValueRef thread_data_ptr,
                   const struct lp_build_sampler_soa *sampler,
                   const struct tgsi_shader_info *info,
-                  const struct lp_build_tgsi_gs_iface *gs_iface)
+                  const struct lp_build_tgsi_gs_iface *gs_iface,
+                  const struct lp_build_tgsi_mem_iface *mem_iface)
 {
    struct lp_build_tgsi_soa_context bld;
 
@@ -3837,6 +4270,13 @@ lp_build_tgsi_soa(struct gallivm_state *gallivm,
    if (info->file_max[TGSI_FILE_TEMPORARY] >= LP_MAX_INLINED_TEMPS) {
       bld.indirect_files |= (1 << TGSI_FILE_TEMPORARY);
    }
+   /*
+    * Temporaries living in caller provided storage are accessed like
+    * indirect ones too.
+    */
+   if (mem_iface && mem_iface->temps_ptr) {
+      bld.indirect_files |= (1 << TGSI_FILE_TEMPORARY);
+   }
    /*
     * For performance reason immediates are always backed in a static
     * array, but if their number is too great, we have to use just
@@ -3912,6 +4352,29 @@ lp_build_tgsi_soa(struct gallivm_state *gallivm,
    bld.bld_base.op_actions[TGSI_OPCODE_SVIEWINFO].emit = sviewinfo_emit;
    bld.bld_base.op_actions[TGSI_OPCODE_LOD].emit = lod_emit;
 
+   if (mem_iface) {
+      bld.mem_iface = mem_iface;
+      bld.bld_base.op_actions[TGSI_OPCODE_LOAD].emit = load_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_STORE].emit = store_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_RESQ].emit = resq_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMUADD].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMXCHG].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMCAS].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMAND].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMOR].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMXOR].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMUMIN].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMUMAX].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMIMIN].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMIMAX].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_BARRIER].emit = barrier_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_MEMBAR].emit = membar_emit;
+
+      if (mem_iface->split_at_barriers) {
+         bld.bld_base.pc = mem_iface->start_pc;
+      }
+   }
+
 
    if (gs_iface) {
       /* There's no specific value for this because it should always
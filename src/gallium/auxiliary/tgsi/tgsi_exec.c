@@ -58,11 +58,16 @@
 #include "tgsi/tgsi_parse.h"
 #include "tgsi/tgsi_util.h"
 #include "tgsi_exec.h"
+#include "util/u_debug.h"
 #include "util/u_half.h"
 #include "util/u_memory.h"
 #include "util/u_math.h"
 #include "util/rounding.h"
 
+#if defined(PIPE_ARCH_SSE)
+#include <emmintrin.h>
+#endif
+
 
 #define DEBUG_EXECUTION 0
 
@@ -1084,6 +1089,173 @@ tgsi_check_soa_dependencies(const struct tgsi_full_instruction *inst)
    return FALSE;
 }
 
+/*
+ * Fast path for the common float ALU instructions.
+ *
+ * When a shader is bound, instructions whose operands are all directly
+ * addressed are decoded once into a tgsi_exec_fast_instruction holding
+ * the register files and indices, the per-channel swizzles, the source
+ * modifiers and the write mask.  They are then executed a whole channel
+ * (the four lanes of a quad) at a time, with SSE when available, instead
+ * of going through fetch_source() and store_dest() for every channel.
+ * The results are bit-identical to those of the generic path.
+ */
+
+enum tgsi_exec_fast_opcode
+{
+   TGSI_EXEC_FAST_NONE = 0,
+   TGSI_EXEC_FAST_MOV,
+   TGSI_EXEC_FAST_ADD,
+   TGSI_EXEC_FAST_MUL,
+   TGSI_EXEC_FAST_MAD,
+   TGSI_EXEC_FAST_MIN,
+   TGSI_EXEC_FAST_MAX,
+   TGSI_EXEC_FAST_SLT,
+   TGSI_EXEC_FAST_SGE,
+   TGSI_EXEC_FAST_DP3,
+   TGSI_EXEC_FAST_DP4
+};
+
+struct tgsi_exec_fast_src
+{
+   ubyte file;                         /**< TGSI_FILE_x */
+   ubyte swizzle[TGSI_NUM_CHANNELS];
+   ubyte absolute;
+   ubyte negate;
+   uint index;
+   uint dimension;                     /**< constant buffer index */
+};
+
+struct tgsi_exec_fast_instruction
+{
+   ubyte opcode;                       /**< TGSI_EXEC_FAST_x */
+   ubyte num_src;
+   ubyte write_mask;
+   ubyte saturate;
+   ubyte dst_file;                     /**< TGSI_FILE_TEMPORARY or OUTPUT */
+   uint dst_index;
+   struct tgsi_exec_fast_src src[3];
+};
+
+DEBUG_GET_ONCE_BOOL_OPTION(no_fast_path, "TGSI_EXEC_NO_FAST_PATH", FALSE)
+
+
+static boolean
+decode_fast_src(const struct tgsi_full_src_register *reg,
+                struct tgsi_exec_fast_src *src)
+{
+   uint chan;
+
+   if (reg->Register.Indirect)
+      return FALSE;
+
+   switch (reg->Register.File) {
+   case TGSI_FILE_CONSTANT:
+      if (reg->Register.Dimension) {
+         if (reg->Dimension.Indirect ||
+             reg->Dimension.Index >= PIPE_MAX_CONSTANT_BUFFERS)
+            return FALSE;
+         src->dimension = reg->Dimension.Index;
+      }
+      else {
+         src->dimension = 0;
+      }
+      break;
+   case TGSI_FILE_TEMPORARY:
+   case TGSI_FILE_INPUT:
+   case TGSI_FILE_SYSTEM_VALUE:
+   case TGSI_FILE_IMMEDIATE:
+   case TGSI_FILE_OUTPUT:
+      if (reg->Register.Dimension)
+         return FALSE;
+      src->dimension = 0;
+      break;
+   default:
+      return FALSE;
+   }
+
+   src->file = reg->Register.File;
+   src->index = reg->Register.Index;
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++)
+      src->swizzle[chan] = tgsi_util_get_full_src_register_swizzle(reg, chan);
+   src->absolute = reg->Register.Absolute;
+   src->negate = reg->Register.Negate;
+   return TRUE;
+}
+
+
+/**
+ * Decode an instruction for exec_fast_instruction(), or leave
+ * fast->opcode as TGSI_EXEC_FAST_NONE if it must take the generic path.
+ */
+static void
+decode_fast_instruction(const struct tgsi_full_instruction *inst,
+                        struct tgsi_exec_fast_instruction *fast)
+{
+   const struct tgsi_full_dst_register *dst = &inst->Dst[0];
+   enum tgsi_exec_fast_opcode opcode;
+   uint i;
+
+   switch (inst->Instruction.Opcode) {
+   case TGSI_OPCODE_MOV: opcode = TGSI_EXEC_FAST_MOV; break;
+   case TGSI_OPCODE_ADD: opcode = TGSI_EXEC_FAST_ADD; break;
+   case TGSI_OPCODE_MUL: opcode = TGSI_EXEC_FAST_MUL; break;
+   case TGSI_OPCODE_MAD: opcode = TGSI_EXEC_FAST_MAD; break;
+   case TGSI_OPCODE_MIN: opcode = TGSI_EXEC_FAST_MIN; break;
+   case TGSI_OPCODE_MAX: opcode = TGSI_EXEC_FAST_MAX; break;
+   case TGSI_OPCODE_SLT: opcode = TGSI_EXEC_FAST_SLT; break;
+   case TGSI_OPCODE_SGE: opcode = TGSI_EXEC_FAST_SGE; break;
+   case TGSI_OPCODE_DP3: opcode = TGSI_EXEC_FAST_DP3; break;
+   case TGSI_OPCODE_DP4: opcode = TGSI_EXEC_FAST_DP4; break;
+   default:
+      return;
+   }
+
+   if (inst->Instruction.NumDstRegs != 1 ||
+       inst->Instruction.NumSrcRegs > ARRAY_SIZE(fast->src))
+      return;
+
+   if (dst->Register.Indirect || dst->Register.Dimension ||
+       (dst->Register.File != TGSI_FILE_TEMPORARY &&
+        dst->Register.File != TGSI_FILE_OUTPUT))
+      return;
+
+   for (i = 0; i < inst->Instruction.NumSrcRegs; i++) {
+      if (!decode_fast_src(&inst->Src[i], &fast->src[i]))
+         return;
+   }
+
+   fast->num_src = inst->Instruction.NumSrcRegs;
+   fast->write_mask = dst->Register.WriteMask;
+   fast->saturate = inst->Instruction.Saturate;
+   fast->dst_file = dst->Register.File;
+   fast->dst_index = dst->Register.Index;
+   fast->opcode = opcode;
+}
+
+
+static void
+decode_fast_instructions(struct tgsi_exec_machine *mach)
+{
+   uint i;
+
+   FREE(mach->FastInstructions);
+   mach->FastInstructions = NULL;
+
+   if (!mach->NumInstructions || debug_get_option_no_fast_path())
+      return;
+
+   mach->FastInstructions = (struct tgsi_exec_fast_instruction *)
+      CALLOC(mach->NumInstructions, sizeof(struct tgsi_exec_fast_instruction));
+   if (!mach->FastInstructions)
+      return;
+
+   for (i = 0; i < mach->NumInstructions; i++)
+      decode_fast_instruction(&mach->Instructions[i],
+                              &mach->FastInstructions[i]);
+}
+
+
 
 /**
  * Initialize machine state by expanding tokens to full instructions,
@@ -1127,6 +1299,9 @@ tgsi_exec_machine_bind_shader(
       mach->Instructions = NULL;
       mach->NumInstructions = 0;
 
+      FREE(mach->FastInstructions);
+      mach->FastInstructions = NULL;
+
       return;
    }
 
@@ -1273,6 +1448,8 @@ tgsi_exec_machine_bind_shader(
    FREE(mach->Instructions);
    mach->Instructions = instructions;
    mach->NumInstructions = numInstructions;
+
+   decode_fast_instructions(mach);
 }
 
 
@@ -1336,6 +1513,7 @@ tgsi_exec_machine_destroy(struct tgsi_exec_machine *mach)
 {
    if (mach) {
       FREE(mach->Instructions);
+      FREE(mach->FastInstructions);
       FREE(mach->Declarations);
 
       align_free(mach->Inputs);
@@ -5013,6 +5191,350 @@ micro_umsb(union tgsi_exec_channel *dst,
    dst->i[3] = util_last_bit(src->u[3]) - 1;
 }
 
+#if defined(PIPE_ARCH_SSE)
+
+typedef __m128 fast_chan;
+
+static inline fast_chan
+fast_load(const union tgsi_exec_channel *chan)
+{
+   return _mm_loadu_ps(chan->f);
+}
+
+static inline fast_chan
+fast_splat(uint value)
+{
+   return _mm_castsi128_ps(_mm_set1_epi32(value));
+}
+
+static inline fast_chan
+fast_add(fast_chan a, fast_chan b)
+{
+   return _mm_add_ps(a, b);
+}
+
+static inline fast_chan
+fast_mul(fast_chan a, fast_chan b)
+{
+   return _mm_mul_ps(a, b);
+}
+
+/** a < b ? a : b, like micro_min() */
+static inline fast_chan
+fast_min(fast_chan a, fast_chan b)
+{
+   return _mm_min_ps(a, b);
+}
+
+/** a > b ? a : b, like micro_max() */
+static inline fast_chan
+fast_max(fast_chan a, fast_chan b)
+{
+   return _mm_max_ps(a, b);
+}
+
+static inline fast_chan
+fast_slt(fast_chan a, fast_chan b)
+{
+   return _mm_and_ps(_mm_cmplt_ps(a, b), _mm_set1_ps(1.0f));
+}
+
+static inline fast_chan
+fast_sge(fast_chan a, fast_chan b)
+{
+   return _mm_and_ps(_mm_cmpge_ps(a, b), _mm_set1_ps(1.0f));
+}
+
+static inline fast_chan
+fast_abs(fast_chan a)
+{
+   return _mm_andnot_ps(_mm_set1_ps(-0.0f), a);
+}
+
+static inline fast_chan
+fast_neg(fast_chan a)
+{
+   return _mm_xor_ps(_mm_set1_ps(-0.0f), a);
+}
+
+/**
+ * Clamp to [0, 1] like store_dest(): the constants are the first operands
+ * so that NaNs are passed through.
+ */
+static inline fast_chan
+fast_saturate(fast_chan a)
+{
+   return _mm_min_ps(_mm_set1_ps(1.0f), _mm_max_ps(_mm_setzero_ps(), a));
+}
+
+static inline void
+fast_store(union tgsi_exec_channel *dst, fast_chan value, uint execmask)
+{
+   if (execmask != 0xf) {
+      const __m128 mask =
+         _mm_castsi128_ps(_mm_setr_epi32(-(int) (execmask & 1),
+                                         -(int) ((execmask >> 1) & 1),
+                                         -(int) ((execmask >> 2) & 1),
+                                         -(int) ((execmask >> 3) & 1)));
+
+      value = _mm_or_ps(_mm_and_ps(mask, value),
+                        _mm_andnot_ps(mask, _mm_loadu_ps(dst->f)));
+   }
+   _mm_storeu_ps(dst->f, value);
+}
+
+#else /* !PIPE_ARCH_SSE */
+
+typedef union tgsi_exec_channel fast_chan;
+
+static inline fast_chan
+fast_load(const union tgsi_exec_channel *chan)
+{
+   return *chan;
+}
+
+static inline fast_chan
+fast_splat(uint value)
+{
+   fast_chan r;
+   r.u[0] = r.u[1] = r.u[2] = r.u[3] = value;
+   return r;
+}
+
+static inline fast_chan
+fast_add(fast_chan a, fast_chan b)
+{
+   fast_chan r;
+   micro_add(&r, &a, &b);
+   return r;
+}
+
+static inline fast_chan
+fast_mul(fast_chan a, fast_chan b)
+{
+   fast_chan r;
+   micro_mul(&r, &a, &b);
+   return r;
+}
+
+static inline fast_chan
+fast_min(fast_chan a, fast_chan b)
+{
+   fast_chan r;
+   micro_min(&r, &a, &b);
+   return r;
+}
+
+static inline fast_chan
+fast_max(fast_chan a, fast_chan b)
+{
+   fast_chan r;
+   micro_max(&r, &a, &b);
+   return r;
+}
+
+static inline fast_chan
+fast_slt(fast_chan a, fast_chan b)
+{
+   fast_chan r;
+   micro_slt(&r, &a, &b);
+   return r;
+}
+
+static inline fast_chan
+fast_sge(fast_chan a, fast_chan b)
+{
+   fast_chan r;
+   micro_sge(&r, &a, &b);
+   return r;
+}
+
+static inline fast_chan
+fast_abs(fast_chan a)
+{
+   fast_chan r;
+   micro_abs(&r, &a);
+   return r;
+}
+
+static inline fast_chan
+fast_neg(fast_chan a)
+{
+   fast_chan r;
+   micro_neg(&r, &a);
+   return r;
+}
+
+static inline fast_chan
+fast_saturate(fast_chan a)
+{
+   uint i;
+   for (i = 0; i < TGSI_QUAD_SIZE; i++) {
+      if (a.f[i] < 0.0f)
+         a.f[i] = 0.0f;
+      else if (a.f[i] > 1.0f)
+         a.f[i] = 1.0f;
+   }
+   return a;
+}
+
+static inline void
+fast_store(union tgsi_exec_channel *dst, fast_chan value, uint execmask)
+{
+   uint i;
+   for (i = 0; i < TGSI_QUAD_SIZE; i++)
+      if (execmask & (1 << i))
+         dst->u[i] = value.u[i];
+}
+
+#endif /* !PIPE_ARCH_SSE */
+
+
+/**
+ * Equivalent of fetch_source() for a pre-decoded source operand.
+ */
+static inline fast_chan
+fetch_fast_src(const struct tgsi_exec_machine *mach,
+               const struct tgsi_exec_fast_src *src,
+               uint chan)
+{
+   const uint swizzle = src->swizzle[chan];
+   fast_chan value;
+
+   switch (src->file) {
+   case TGSI_FILE_TEMPORARY:
+      value = fast_load(&mach->Temps[src->index].xyzw[swizzle]);
+      break;
+   case TGSI_FILE_INPUT:
+      value = fast_load(&mach->Inputs[src->index].xyzw[swizzle]);
+      break;
+   case TGSI_FILE_SYSTEM_VALUE:
+      value = fast_load(&mach->SystemValue[src->index].xyzw[swizzle]);
+      break;
+   case TGSI_FILE_OUTPUT:
+      value = fast_load(&mach->Outputs[src->index].xyzw[swizzle]);
+      break;
+   case TGSI_FILE_IMMEDIATE:
+      value = fast_splat(fui(mach->Imms[src->index][swizzle]));
+      break;
+   case TGSI_FILE_CONSTANT:
+      {
+         const uint *buf = (const uint *) mach->Consts[src->dimension];
+         const int pos = src->index * 4 + swizzle;
+
+         assert(buf);
+         /* const buffer bounds check, as in fetch_src_file_channel() */
+         value = fast_splat(pos < (int) mach->ConstsSize[src->dimension] ?
+                            buf[pos] : 0);
+      }
+      break;
+   default:
+      unreachable("file not handled by the fast path");
+   }
+
+   if (src->absolute)
+      value = fast_abs(value);
+   if (src->negate)
+      value = fast_neg(value);
+   return value;
+}
+
+
+/**
+ * Execute an instruction decoded by decode_fast_instruction().  All the
+ * destination channels are computed before any is written, like
+ * exec_vector_binary() and friends, so that sources aliasing the
+ * destination are read unmodified.
+ */
+static void
+exec_fast_instruction(struct tgsi_exec_machine *mach,
+                      const struct tgsi_exec_fast_instruction *fast)
+{
+   const struct tgsi_exec_fast_src *src = fast->src;
+   const uint write_mask = fast->write_mask;
+   union tgsi_exec_channel *dst_reg;
+   fast_chan dst[TGSI_NUM_CHANNELS];
+   uint chan;
+
+   switch (fast->opcode) {
+   case TGSI_EXEC_FAST_DP3:
+   case TGSI_EXEC_FAST_DP4:
+      {
+         const uint num_chan = fast->opcode == TGSI_EXEC_FAST_DP3 ? 3 : 4;
+         fast_chan dot = fast_mul(fetch_fast_src(mach, &src[0], TGSI_CHAN_X),
+                                  fetch_fast_src(mach, &src[1], TGSI_CHAN_X));
+
+         for (chan = TGSI_CHAN_Y; chan < num_chan; chan++) {
+            dot = fast_add(fast_mul(fetch_fast_src(mach, &src[0], chan),
+                                    fetch_fast_src(mach, &src[1], chan)),
+                           dot);
+         }
+         for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++)
+            dst[chan] = dot;
+      }
+      break;
+
+   default:
+      for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+         fast_chan a;
+
+         if (!(write_mask & (1 << chan)))
+            continue;
+
+         a = fetch_fast_src(mach, &src[0], chan);
+
+         switch (fast->opcode) {
+         case TGSI_EXEC_FAST_MOV:
+            dst[chan] = a;
+            break;
+         case TGSI_EXEC_FAST_ADD:
+            dst[chan] = fast_add(a, fetch_fast_src(mach, &src[1], chan));
+            break;
+         case TGSI_EXEC_FAST_MUL:
+            dst[chan] = fast_mul(a, fetch_fast_src(mach, &src[1], chan));
+            break;
+         case TGSI_EXEC_FAST_MAD:
+            dst[chan] = fast_add(fast_mul(a, fetch_fast_src(mach, &src[1], chan)),
+                                 fetch_fast_src(mach, &src[2], chan));
+            break;
+         case TGSI_EXEC_FAST_MIN:
+            dst[chan] = fast_min(a, fetch_fast_src(mach, &src[1], chan));
+            break;
+         case TGSI_EXEC_FAST_MAX:
+            dst[chan] = fast_max(a, fetch_fast_src(mach, &src[1], chan));
+            break;
+         case TGSI_EXEC_FAST_SLT:
+            dst[chan] = fast_slt(a, fetch_fast_src(mach, &src[1], chan));
+            break;
+         case TGSI_EXEC_FAST_SGE:
+            dst[chan] = fast_sge(a, fetch_fast_src(mach, &src[1], chan));
+            break;
+         default:
+            unreachable("opcode not handled by the fast path");
+         }
+      }
+      break;
+   }
+
+   if (fast->dst_file == TGSI_FILE_TEMPORARY) {
+      dst_reg = mach->Temps[fast->dst_index].xyzw;
+   }
+   else {
+      const uint index = mach->Temps[TEMP_OUTPUT_I].xyzw[TEMP_OUTPUT_C].u[0] +
+                         fast->dst_index;
+      dst_reg = mach->Outputs[index].xyzw;
+   }
+
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+      if (write_mask & (1 << chan)) {
+         fast_store(&dst_reg[chan],
+                    fast->saturate ? fast_saturate(dst[chan]) : dst[chan],
+                    mach->ExecMask);
+      }
+   }
+}
+
+
 /**
  * Execute a TGSI instruction.
  * Returns TRUE if a barrier instruction is hit,
@@ -5028,6 +5550,16 @@ exec_instruction(
 
    (*pc)++;
 
+   if (mach->FastInstructions) {
+      const struct tgsi_exec_fast_instruction *fast =
+         &mach->FastInstructions[*pc - 1];
+
+      if (fast->opcode != TGSI_EXEC_FAST_NONE) {
+         exec_fast_instruction(mach, fast);
+         return FALSE;
+      }
+   }
+
    switch (inst->Instruction.Opcode) {
    case TGSI_OPCODE_ARL:
       exec_vector_unary(mach, inst, micro_arl, TGSI_EXEC_DATA_INT, TGSI_EXEC_DATA_FLOAT);
@@ -342,6 +342,8 @@ enum tgsi_break_type {
 #define TGSI_EXEC_MAX_BREAK_STACK (TGSI_EXEC_MAX_LOOP_NESTING + TGSI_EXEC_MAX_SWITCH_NESTING)
 
 
+struct tgsi_exec_fast_instruction;
+
 /**
  * Run-time virtual machine state for executing TGSI shader.
  */
@@ -442,6 +444,9 @@ struct tgsi_exec_machine
    struct tgsi_full_instruction *Instructions;
    uint NumInstructions;
 
+   /** Pre-decoded form of Instructions, for the simple ALU instructions */
+   struct tgsi_exec_fast_instruction *FastInstructions;
+
    struct tgsi_full_declaration *Declarations;
    uint NumDeclarations;
 
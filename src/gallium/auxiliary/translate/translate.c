@@ -46,6 +46,15 @@ struct translate *translate_create( const struct translate_key *key )
    (void)translate;
 #endif
 
+#if HAVE_LLVM
+   /* Used for the keys the SSE translate can't handle, and as the only
+    * optimized path on other architectures.
+    */
+   translate = translate_llvm_create( key );
+   if (translate)
+      return translate;
+#endif
+
    return translate_generic_create( key );
 }
 
@@ -0,0 +1,701 @@
+/**************************************************************************
+ *
+ * Copyright 2018 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Translate implementation generating its code with gallivm, for every
+ * architecture LLVM supports.
+ *
+ * Vertices are processed a native vector (4 or 8 vertices) at a time.
+ * Each element is fetched in SoA form with lp_build_fetch_rgba_soa(),
+ * which handles all u_format input formats and uses gathers where the
+ * CPU has them, converted to the output channel type a whole channel at
+ * a time, and finally stored vertex by vertex.
+ */
+
+#include "util/u_format.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "gallivm/lp_bld_arit.h"
+#include "gallivm/lp_bld_const.h"
+#include "gallivm/lp_bld_conv.h"
+#include "gallivm/lp_bld_debug.h"
+#include "gallivm/lp_bld_flow.h"
+#include "gallivm/lp_bld_format.h"
+#include "gallivm/lp_bld_gather.h"
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_intr.h"
+#include "gallivm/lp_bld_struct.h"
+#include "gallivm/lp_bld_swizzle.h"
+#include "gallivm/lp_bld_type.h"
+#include "translate.h"
+
+
+/** Number of 8 and 16-bit indices widened per call of the generated code */
+#define TRANSLATE_LLVM_ELTS_CHUNK 256
+
+
+/**
+ * Input state of an element, read by the generated code.
+ */
+struct translate_llvm_input
+{
+   const uint8_t *ptr;          /**< buffer pointer + input_offset */
+   uint32_t stride;
+   uint32_t max_index;
+};
+
+enum {
+   TRANSLATE_LLVM_INPUT_PTR = 0,
+   TRANSLATE_LLVM_INPUT_STRIDE,
+   TRANSLATE_LLVM_INPUT_MAX_INDEX,
+   TRANSLATE_LLVM_INPUT_NUM_FIELDS
+};
+
+/**
+ * Signature of the generated functions.  elts is NULL for linear runs,
+ * where the vertices are start, start + 1, ...
+ */
+typedef void (*translate_llvm_func)(const struct translate_llvm_input *inputs,
+                                    const uint32_t *elts,
+                                    uint32_t start,
+                                    uint32_t count,
+                                    uint32_t start_instance,
+                                    uint32_t instance_id,
+                                    void *output_buffer);
+
+struct translate_llvm
+{
+   struct translate translate;
+
+   struct translate_llvm_input input[TRANSLATE_MAX_ATTRIBS];
+
+   LLVMContextRef context;
+   struct gallivm_state *gallivm;
+
+   translate_llvm_func run_linear;
+   translate_llvm_func run_elts;
+};
+
+
+static struct translate_llvm *
+translate_llvm(struct translate *translate)
+{
+   return (struct translate_llvm *)translate;
+}
+
+
+static boolean
+is_copy(const struct translate_element *element,
+        const struct util_format_description *input_desc)
+{
+   if (element->type == TRANSLATE_ELEMENT_INSTANCE_ID) {
+      return element->output_format == PIPE_FORMAT_R32_USCALED ||
+             element->output_format == PIPE_FORMAT_R32_SSCALED;
+   }
+
+   return element->input_format == element->output_format &&
+          input_desc->block.width == 1 &&
+          input_desc->block.height == 1 &&
+          !(input_desc->block.bits & 7);
+}
+
+
+/**
+ * Output formats are stored a channel at a time, so they need to be
+ * arrays of 8, 16, 32 or 64-bit channels.
+ */
+static boolean
+is_output_format_supported(const struct util_format_description *desc)
+{
+   unsigned size;
+
+   if (desc->layout != UTIL_FORMAT_LAYOUT_PLAIN ||
+       desc->colorspace != UTIL_FORMAT_COLORSPACE_RGB ||
+       !desc->is_array)
+      return FALSE;
+
+   size = desc->channel[0].size;
+
+   switch (desc->channel[0].type) {
+   case UTIL_FORMAT_TYPE_FLOAT:
+      return size == 16 || size == 32 || size == 64;
+   case UTIL_FORMAT_TYPE_UNSIGNED:
+   case UTIL_FORMAT_TYPE_SIGNED:
+      return size == 8 || size == 16 || size == 32;
+   default:
+      return FALSE;
+   }
+}
+
+
+static boolean
+is_element_supported(const struct translate_element *element)
+{
+   const struct util_format_description *input_desc =
+      util_format_description(element->input_format);
+   const struct util_format_description *output_desc =
+      util_format_description(element->output_format);
+
+   if (!output_desc)
+      return FALSE;
+
+   if (element->type == TRANSLATE_ELEMENT_INSTANCE_ID) {
+      return is_copy(element, NULL) ||
+             (is_output_format_supported(output_desc) &&
+              !output_desc->channel[0].pure_integer);
+   }
+
+   if (!input_desc)
+      return FALSE;
+
+   if (is_copy(element, input_desc))
+      return TRUE;
+
+   if (!is_output_format_supported(output_desc))
+      return FALSE;
+
+   if (util_format_is_pure_integer(element->input_format)) {
+      unsigned i;
+
+      /* Same rules as translate_generic: the signs must match and
+       * integers must not lose precision.
+       */
+      if (!output_desc->channel[0].pure_integer)
+         return FALSE;
+      for (i = 0; i < MIN2(input_desc->nr_channels, output_desc->nr_channels); i++) {
+         if (input_desc->channel[i].type != output_desc->channel[i].type ||
+             input_desc->channel[i].size > output_desc->channel[i].size)
+            return FALSE;
+      }
+      return TRUE;
+   }
+
+   return !output_desc->channel[0].pure_integer;
+}
+
+
+/**
+ * Convert a vector of 32-bit floats or integers to the type of the
+ * channels of the output format.
+ */
+static LLVMValueRef
+convert_to_output_channel(struct gallivm_state *gallivm,
+                          const struct util_format_description *desc,
+                          unsigned length,
+                          LLVMValueRef value)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   const struct util_format_channel_description *channel = &desc->channel[0];
+   LLVMTypeRef i32_vec_type =
+      LLVMVectorType(LLVMInt32TypeInContext(gallivm->context), length);
+   LLVMTypeRef int_vec_type =
+      LLVMVectorType(LLVMIntTypeInContext(gallivm->context, channel->size),
+                     length);
+
+   if (channel->type == UTIL_FORMAT_TYPE_FLOAT) {
+      switch (channel->size) {
+      case 16:
+         return lp_build_float_to_half(gallivm, value);
+      case 64:
+         return LLVMBuildFPExt(builder, value,
+                               LLVMVectorType(LLVMDoubleTypeInContext(gallivm->context),
+                                              length), "");
+      default:
+         return value;
+      }
+   }
+
+   if (!channel->pure_integer) {
+      struct lp_type float_type = lp_type_float_vec(32, 32 * length);
+
+      if (channel->normalized) {
+         const unsigned bits = channel->type == UTIL_FORMAT_TYPE_UNSIGNED ?
+            channel->size : channel->size - 1;
+         const double scale = (double) ((UINT64_C(1) << bits) - 1);
+
+         /* The 32-bit scales aren't representable as floats: 1.0 would
+          * become 2^32 (or 2^31) and overflow the conversion.
+          */
+         if (channel->size == 32) {
+            float_type = lp_type_float_vec(64, 64 * length);
+            value = LLVMBuildFPExt(builder, value,
+                                   lp_build_vec_type(gallivm, float_type), "");
+         }
+
+         value = LLVMBuildFMul(builder, value,
+                               lp_build_const_vec(gallivm, float_type, scale), "");
+      }
+
+      /* Like the C casts of translate_generic: 32-bit unsigned channels
+       * are converted as unsigned, narrower ones through an int.
+       */
+      if (channel->type == UTIL_FORMAT_TYPE_UNSIGNED && channel->size == 32)
+         value = LLVMBuildFPToUI(builder, value, i32_vec_type, "");
+      else
+         value = LLVMBuildFPToSI(builder, value, i32_vec_type, "");
+   }
+
+   if (channel->size < 32)
+      value = LLVMBuildTrunc(builder, value, int_vec_type, "");
+
+   return value;
+}
+
+
+/**
+ * Generate the function translating count vertices, a vector of vertices
+ * per loop iteration.
+ */
+static LLVMValueRef
+generate_run(struct translate_llvm *tl, boolean use_elts)
+{
+   const struct translate_key *key = &tl->translate.key;
+   struct gallivm_state *gallivm = tl->gallivm;
+   LLVMContextRef context = gallivm->context;
+   LLVMBuilderRef builder = gallivm->builder;
+   const unsigned length = lp_native_vector_width / 32;
+   const struct lp_type uint_type = lp_type_uint_vec(32, 32 * length);
+   LLVMTypeRef i8_type = LLVMInt8TypeInContext(context);
+   LLVMTypeRef i32_type = LLVMInt32TypeInContext(context);
+   LLVMTypeRef i8_ptr_type = LLVMPointerType(i8_type, 0);
+   LLVMTypeRef input_elem_types[TRANSLATE_LLVM_INPUT_NUM_FIELDS];
+   LLVMTypeRef input_type, arg_types[7], func_type;
+   LLVMValueRef function, inputs_ptr, elts_ptr, start, count;
+   LLVMValueRef start_instance, instance_id, output_ptr;
+   LLVMValueRef lane_offsets[LP_MAX_VECTOR_LENGTH];
+   LLVMValueRef pos, last, index;
+   LLVMValueRef indices[TRANSLATE_MAX_ATTRIBS];
+   LLVMValueRef channels[TRANSLATE_MAX_ATTRIBS][4];
+   struct lp_build_context uint_bld;
+   struct lp_build_loop_state loop;
+   LLVMBasicBlockRef block;
+   unsigned i, lane;
+
+   input_elem_types[TRANSLATE_LLVM_INPUT_PTR] = i8_ptr_type;
+   input_elem_types[TRANSLATE_LLVM_INPUT_STRIDE] = i32_type;
+   input_elem_types[TRANSLATE_LLVM_INPUT_MAX_INDEX] = i32_type;
+   input_type = LLVMStructTypeInContext(context, input_elem_types,
+                                        ARRAY_SIZE(input_elem_types), 0);
+
+   arg_types[0] = LLVMPointerType(LLVMArrayType(input_type, TRANSLATE_MAX_ATTRIBS),
+                                  0);               /* inputs */
+   arg_types[1] = LLVMPointerType(i32_type, 0);     /* elts */
+   arg_types[2] = i32_type;                         /* start */
+   arg_types[3] = i32_type;                         /* count */
+   arg_types[4] = i32_type;                         /* start_instance */
+   arg_types[5] = i32_type;                         /* instance_id */
+   arg_types[6] = i8_ptr_type;                      /* output_buffer */
+
+   func_type = LLVMFunctionType(LLVMVoidTypeInContext(context),
+                                arg_types, ARRAY_SIZE(arg_types), 0);
+
+   function = LLVMAddFunction(gallivm->module,
+                              use_elts ? "translate_run_elts" : "translate_run",
+                              func_type);
+   LLVMSetFunctionCallConv(function, LLVMCCallConv);
+   for (i = 0; i < ARRAY_SIZE(arg_types); i++) {
+      if (LLVMGetTypeKind(arg_types[i]) == LLVMPointerTypeKind)
+         lp_add_function_attr(function, i + 1, LP_FUNC_ATTR_NOALIAS);
+   }
+
+   inputs_ptr     = LLVMGetParam(function, 0);
+   elts_ptr       = LLVMGetParam(function, 1);
+   start          = LLVMGetParam(function, 2);
+   count          = LLVMGetParam(function, 3);
+   start_instance = LLVMGetParam(function, 4);
+   instance_id    = LLVMGetParam(function, 5);
+   output_ptr     = LLVMGetParam(function, 6);
+
+   lp_build_name(inputs_ptr, "inputs");
+   lp_build_name(elts_ptr, "elts");
+   lp_build_name(start, "start");
+   lp_build_name(count, "count");
+   lp_build_name(start_instance, "start_instance");
+   lp_build_name(instance_id, "instance_id");
+   lp_build_name(output_ptr, "output_buffer");
+
+   block = LLVMAppendBasicBlockInContext(context, function, "entry");
+   LLVMPositionBuilderAtEnd(builder, block);
+
+   lp_build_context_init(&uint_bld, gallivm, uint_type);
+
+   for (lane = 0; lane < length; lane++)
+      lane_offsets[lane] = lp_build_const_int32(gallivm, lane);
+
+   /* The callers never pass a zero count, so a do-while loop is fine. */
+   last = LLVMBuildSub(builder, count, lp_build_const_int32(gallivm, 1), "");
+
+   lp_build_loop_begin(&loop, gallivm, lp_build_const_int32(gallivm, 0));
+
+   /* Vertex numbers of this iteration.  The lanes past the end repeat the
+    * last vertex, so that no index is fetched out of bounds; they are not
+    * stored.
+    */
+   pos = lp_build_broadcast_scalar(&uint_bld, loop.counter);
+   pos = LLVMBuildAdd(builder, pos, LLVMConstVector(lane_offsets, length), "");
+   pos = lp_build_min(&uint_bld, pos, lp_build_broadcast_scalar(&uint_bld, last));
+
+   if (use_elts) {
+      LLVMValueRef offsets = LLVMBuildShl(builder, pos,
+                                          lp_build_const_int_vec(gallivm, uint_type, 2), "");
+      index = lp_build_gather(gallivm, length, 32, lp_type_uint(32), TRUE,
+                              LLVMBuildBitCast(builder, elts_ptr, i8_ptr_type, ""),
+                              offsets, FALSE);
+   }
+   else {
+      index = LLVMBuildAdd(builder, pos,
+                           lp_build_broadcast_scalar(&uint_bld, start), "");
+   }
+
+   /*
+    * Fetch and convert all the elements.
+    */
+   for (i = 0; i < key->nr_elements; i++) {
+      const struct translate_element *element = &key->element[i];
+      const struct util_format_description *input_desc =
+         util_format_description(element->input_format);
+      const struct util_format_description *output_desc =
+         util_format_description(element->output_format);
+      LLVMValueRef input = lp_build_array_get_ptr(gallivm, inputs_ptr,
+                                                  lp_build_const_int32(gallivm, i));
+      LLVMValueRef rgba[4];
+      unsigned chan;
+
+      indices[i] = NULL;
+
+      if (element->type == TRANSLATE_ELEMENT_INSTANCE_ID) {
+         if (is_copy(element, input_desc))
+            continue;
+
+         rgba[0] = lp_build_broadcast(gallivm, LLVMVectorType(LLVMFloatTypeInContext(context), length),
+                                      LLVMBuildUIToFP(builder, instance_id,
+                                                      LLVMFloatTypeInContext(context), ""));
+         rgba[1] = lp_build_const_vec(gallivm, lp_type_float_vec(32, 32 * length), 0.0);
+         rgba[2] = rgba[1];
+         rgba[3] = lp_build_const_vec(gallivm, lp_type_float_vec(32, 32 * length), 1.0);
+      }
+      else {
+         LLVMValueRef ptr, stride, elem_index, offsets;
+
+         ptr = lp_build_struct_get(gallivm, input, TRANSLATE_LLVM_INPUT_PTR, "ptr");
+         stride = lp_build_struct_get(gallivm, input, TRANSLATE_LLVM_INPUT_STRIDE, "stride");
+
+         if (element->instance_divisor) {
+            elem_index = LLVMBuildUDiv(builder, instance_id,
+                                       lp_build_const_int32(gallivm, element->instance_divisor), "");
+            elem_index = LLVMBuildAdd(builder, start_instance, elem_index, "");
+            elem_index = lp_build_broadcast_scalar(&uint_bld, elem_index);
+         }
+         else {
+            /* clamp to avoid going out of bounds */
+            LLVMValueRef max_index =
+               lp_build_struct_get(gallivm, input, TRANSLATE_LLVM_INPUT_MAX_INDEX, "max_index");
+            elem_index = lp_build_min(&uint_bld, index,
+                                      lp_build_broadcast_scalar(&uint_bld, max_index));
+         }
+
+         /* This mul can overflow.  Wraparound is ok. */
+         offsets = lp_build_mul(&uint_bld, elem_index,
+                                lp_build_broadcast_scalar(&uint_bld, stride));
+
+         if (is_copy(element, input_desc)) {
+            indices[i] = offsets;
+            continue;
+         }
+
+         if (util_format_is_pure_integer(element->input_format)) {
+            struct lp_type fetch_type =
+               input_desc->channel[0].type == UTIL_FORMAT_TYPE_SIGNED ?
+               lp_type_int_vec(32, 32 * length) : uint_type;
+
+            lp_build_fetch_rgba_soa(gallivm, input_desc, fetch_type, FALSE,
+                                    ptr, offsets, uint_bld.zero, uint_bld.zero,
+                                    NULL, rgba);
+         }
+         else {
+            lp_build_fetch_rgba_soa(gallivm, input_desc,
+                                    lp_type_float_vec(32, 32 * length), FALSE,
+                                    ptr, offsets, uint_bld.zero, uint_bld.zero,
+                                    NULL, rgba);
+         }
+      }
+
+      /* Put the components in the order of the output channels. */
+      for (chan = 0; chan < output_desc->nr_channels; chan++) {
+         unsigned comp;
+
+         for (comp = 0; comp < 4; comp++) {
+            if (output_desc->swizzle[comp] == chan)
+               break;
+         }
+
+         channels[i][chan] =
+            convert_to_output_channel(gallivm, output_desc, length,
+                                      comp < 4 ? rgba[comp] :
+                                      LLVMConstNull(LLVMTypeOf(rgba[0])));
+      }
+   }
+
+   /*
+    * Store the vertices of this iteration.
+    */
+   for (lane = 0; lane < length; lane++) {
+      LLVMValueRef lane_index = lp_build_const_int32(gallivm, lane);
+      LLVMValueRef vertex, vertex_ptr;
+      struct lp_build_if_state if_valid;
+
+      vertex = LLVMBuildAdd(builder, loop.counter, lane_index, "");
+      if (lane) {
+         lp_build_if(&if_valid, gallivm,
+                     LLVMBuildICmp(builder, LLVMIntULT, vertex, count, ""));
+      }
+
+      vertex_ptr = LLVMBuildMul(builder, vertex,
+                                lp_build_const_int32(gallivm, key->output_stride), "");
+      vertex_ptr = LLVMBuildGEP(builder, output_ptr, &vertex_ptr, 1, "");
+
+      for (i = 0; i < key->nr_elements; i++) {
+         const struct translate_element *element = &key->element[i];
+         const struct util_format_description *input_desc =
+            util_format_description(element->input_format);
+         const struct util_format_description *output_desc =
+            util_format_description(element->output_format);
+         LLVMValueRef offset = lp_build_const_int32(gallivm, element->output_offset);
+         LLVMValueRef dst = LLVMBuildGEP(builder, vertex_ptr, &offset, 1, "");
+         unsigned chan;
+
+         if (is_copy(element, input_desc)) {
+            LLVMValueRef value;
+
+            if (element->type == TRANSLATE_ELEMENT_INSTANCE_ID) {
+               dst = LLVMBuildBitCast(builder, dst, LLVMPointerType(i32_type, 0), "");
+               value = instance_id;
+            }
+            else {
+               LLVMTypeRef copy_type =
+                  LLVMVectorType(i8_type, input_desc->block.bits / 8);
+               LLVMValueRef input, src, src_offset;
+
+               input = lp_build_array_get_ptr(gallivm, inputs_ptr,
+                                              lp_build_const_int32(gallivm, i));
+               src = lp_build_struct_get(gallivm, input, TRANSLATE_LLVM_INPUT_PTR, "ptr");
+               src_offset = LLVMBuildExtractElement(builder, indices[i], lane_index, "");
+               src = LLVMBuildGEP(builder, src, &src_offset, 1, "");
+               src = LLVMBuildBitCast(builder, src, LLVMPointerType(copy_type, 0), "");
+               dst = LLVMBuildBitCast(builder, dst, LLVMPointerType(copy_type, 0), "");
+
+               value = LLVMBuildLoad(builder, src, "");
+               LLVMSetAlignment(value, 1);
+            }
+
+            LLVMSetAlignment(LLVMBuildStore(builder, value, dst), 1);
+            continue;
+         }
+
+         for (chan = 0; chan < output_desc->nr_channels; chan++) {
+            LLVMValueRef value =
+               LLVMBuildExtractElement(builder, channels[i][chan], lane_index, "");
+            LLVMValueRef chan_offset =
+               lp_build_const_int32(gallivm, chan * output_desc->channel[0].size / 8);
+            LLVMValueRef chan_ptr = LLVMBuildGEP(builder, dst, &chan_offset, 1, "");
+
+            chan_ptr = LLVMBuildBitCast(builder, chan_ptr,
+                                        LLVMPointerType(LLVMTypeOf(value), 0), "");
+            LLVMSetAlignment(LLVMBuildStore(builder, value, chan_ptr), 1);
+         }
+      }
+
+      if (lane)
+         lp_build_endif(&if_valid);
+   }
+
+   lp_build_loop_end_cond(&loop, count,
+                          lp_build_const_int32(gallivm, length), LLVMIntUGE);
+
+   LLVMBuildRetVoid(builder);
+
+   gallivm_verify_function(gallivm, function);
+
+   return function;
+}
+
+
+static void
+llvm_run_elts(struct translate *translate,
+              const unsigned *elts,
+              unsigned count,
+              unsigned start_instance,
+              unsigned instance_id,
+              void *output_buffer)
+{
+   struct translate_llvm *tl = translate_llvm(translate);
+
+   if (count)
+      tl->run_elts(tl->input, elts, 0, count, start_instance, instance_id,
+                   output_buffer);
+}
+
+
+#define LLVM_RUN_SMALL_ELTS(NAME, TYPE)                                    \
+static void                                                                \
+NAME(struct translate *translate,                                          \
+     const TYPE *elts,                                                     \
+     unsigned count,                                                       \
+     unsigned start_instance,                                              \
+     unsigned instance_id,                                                 \
+     void *output_buffer)                                                  \
+{                                                                          \
+   struct translate_llvm *tl = translate_llvm(translate);                  \
+   uint8_t *output = output_buffer;                                        \
+   uint32_t elts32[TRANSLATE_LLVM_ELTS_CHUNK];                             \
+                                                                           \
+   while (count) {                                                         \
+      const unsigned n = MIN2(count, TRANSLATE_LLVM_ELTS_CHUNK);           \
+      unsigned i;                                                          \
+                                                                           \
+      for (i = 0; i < n; i++)                                              \
+         elts32[i] = elts[i];                                              \
+                                                                           \
+      tl->run_elts(tl->input, elts32, 0, n, start_instance, instance_id,  \
+                   output);                                                \
+                                                                           \
+      elts += n;                                                           \
+      count -= n;                                                          \
+      output += n * translate->key.output_stride;                          \
+   }                                                                       \
+}
+
+LLVM_RUN_SMALL_ELTS(llvm_run_elts16, uint16_t)
+LLVM_RUN_SMALL_ELTS(llvm_run_elts8, uint8_t)
+
+
+static void
+llvm_run(struct translate *translate,
+         unsigned start,
+         unsigned count,
+         unsigned start_instance,
+         unsigned instance_id,
+         void *output_buffer)
+{
+   struct translate_llvm *tl = translate_llvm(translate);
+
+   if (count)
+      tl->run_linear(tl->input, NULL, start, count, start_instance,
+                     instance_id, output_buffer);
+}
+
+
+static void
+llvm_set_buffer(struct translate *translate,
+                unsigned buf,
+                const void *ptr,
+                unsigned stride,
+                unsigned max_index)
+{
+   struct translate_llvm *tl = translate_llvm(translate);
+   unsigned i;
+
+   for (i = 0; i < translate->key.nr_elements; i++) {
+      if (translate->key.element[i].input_buffer == buf) {
+         tl->input[i].ptr = (const uint8_t *)ptr +
+                            translate->key.element[i].input_offset;
+         tl->input[i].stride = stride;
+         tl->input[i].max_index = max_index;
+      }
+   }
+}
+
+
+static void
+llvm_release(struct translate *translate)
+{
+   struct translate_llvm *tl = translate_llvm(translate);
+
+   if (tl->gallivm)
+      gallivm_destroy(tl->gallivm);
+   if (tl->context)
+      LLVMContextDispose(tl->context);
+   FREE(tl);
+}
+
+
+struct translate *
+translate_llvm_create(const struct translate_key *key)
+{
+   struct translate_llvm *tl;
+   LLVMValueRef run_linear, run_elts;
+   unsigned i;
+
+   for (i = 0; i < key->nr_elements; i++) {
+      if (!is_element_supported(&key->element[i]))
+         return NULL;
+   }
+
+   if (!lp_build_init())
+      return NULL;
+
+   tl = CALLOC_STRUCT(translate_llvm);
+   if (!tl)
+      return NULL;
+
+   tl->translate.key = *key;
+   tl->translate.release = llvm_release;
+   tl->translate.set_buffer = llvm_set_buffer;
+   tl->translate.run_elts = llvm_run_elts;
+   tl->translate.run_elts16 = llvm_run_elts16;
+   tl->translate.run_elts8 = llvm_run_elts8;
+   tl->translate.run = llvm_run;
+
+   tl->context = LLVMContextCreate();
+   if (!tl->context)
+      goto fail;
+
+   tl->gallivm = gallivm_create("translate", tl->context, NULL);
+   if (!tl->gallivm)
+      goto fail;
+
+   run_linear = generate_run(tl, FALSE);
+   run_elts = generate_run(tl, TRUE);
+
+   gallivm_compile_module(tl->gallivm);
+
+   tl->run_linear = (translate_llvm_func)
+      gallivm_jit_function(tl->gallivm, run_linear);
+   tl->run_elts = (translate_llvm_func)
+      gallivm_jit_function(tl->gallivm, run_elts);
+
+   gallivm_free_ir(tl->gallivm);
+
+   if (!tl->run_linear || !tl->run_elts)
+      goto fail;
+
+   return &tl->translate;
+
+fail:
+   llvm_release(&tl->translate);
+   return NULL;
+}
@@ -610,12 +610,35 @@ def generate_pack_kernel(format, src_channel, src_native_type):
         print_channels(format, pack_into_union)
 
 
+# Functions with vectorized versions in u_format_simd.c, which the format
+# descriptions use instead of the generated ones.  The latter are still
+# needed for the fallback, so they are not static.
+simd_functions = {
+    'r8g8b8a8_unorm': ('unpack_rgba_8unorm', 'pack_rgba_8unorm', 'unpack_rgba_float', 'pack_rgba_float'),
+    'b8g8r8a8_unorm': ('unpack_rgba_8unorm', 'pack_rgba_8unorm', 'unpack_rgba_float', 'pack_rgba_float'),
+    'r10g10b10a2_unorm': ('unpack_rgba_float', 'pack_rgba_float'),
+    'r16g16b16a16_float': ('unpack_rgba_float', 'pack_rgba_float'),
+    'z16_unorm': ('unpack_z_float', 'pack_z_float'),
+    'z24_unorm_s8_uint': ('unpack_z_float', 'pack_z_float', 'unpack_z_32unorm'),
+}
+
+
+def has_simd_function(format, func):
+    return func in simd_functions.get(format.short_name(), ())
+
+
+def function_storage(format, func):
+    if has_simd_function(format, func):
+        return 'void'
+    return 'static inline void'
+
+
 def generate_format_unpack(format, dst_channel, dst_native_type, dst_suffix):
     '''Generate the function to unpack pixels from a particular format'''
 
     name = format.short_name()
 
-    print 'static inline void'
+    print function_storage(format, 'unpack_' + dst_suffix)
     print 'util_format_%s_unpack_%s(%s *dst_row, unsigned dst_stride, const uint8_t *src_row, unsigned src_stride, unsigned width, unsigned height)' % (name, dst_suffix, dst_native_type)
     print '{'
 
@@ -644,7 +667,7 @@ def generate_format_pack(format, src_channel, src_native_type, src_suffix):
 
     name = format.short_name()
 
-    print 'static inline void'
+    print function_storage(format, 'pack_' + src_suffix)
     print 'util_format_%s_pack_%s(uint8_t *dst_row, unsigned dst_stride, const %s *src_row, unsigned src_stride, unsigned width, unsigned height)' % (name, src_suffix, src_native_type)
     print '{'
     
@@ -0,0 +1,576 @@
+/**************************************************************************
+ *
+ * Copyright 2018 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * Vectorized pack/unpack row functions for the most common formats.
+ *
+ * Rows are processed a full SSE2 register at a time, and the remaining
+ * pixels are handed to the C functions.  On x86-64 the results are
+ * bit-identical to those of the C functions, which the u_format unit test
+ * checks.
+ */
+
+
+#include "pipe/p_config.h"
+#include "u_cpu_detect.h"
+#include "u_format_simd.h"
+#include "u_format_zs.h"
+
+
+#if defined(PIPE_ARCH_SSE)
+
+#include <emmintrin.h>
+
+
+/**
+ * Swap the first and third byte of each 32bit lane, i.e., convert between
+ * RGBA8 and BGRA8.
+ */
+static inline __m128i
+swap_rb_epi8(__m128i pixels)
+{
+   const __m128i ag_mask = _mm_set1_epi32(0xff00ff00);
+   __m128i ag = _mm_and_si128(pixels, ag_mask);
+   __m128i rb = _mm_andnot_si128(ag_mask, pixels);
+
+   rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+   return _mm_or_si128(ag, rb);
+}
+
+
+/**
+ * Vector version of ubyte_to_float() for four RGBA8 pixels.
+ */
+static inline void
+unpack_unorm8_float(float *dst, __m128i pixels)
+{
+   const __m128i zero = _mm_setzero_si128();
+   const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+   __m128i lo = _mm_unpacklo_epi8(pixels, zero);
+   __m128i hi = _mm_unpackhi_epi8(pixels, zero);
+
+   _mm_storeu_ps(dst + 0, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale));
+   _mm_storeu_ps(dst + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale));
+   _mm_storeu_ps(dst + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale));
+   _mm_storeu_ps(dst + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale));
+}
+
+
+/**
+ * Vector version of float_to_ubyte().  Returns the bytes in 32bit lanes.
+ */
+static inline __m128i
+float_to_unorm8(__m128 src)
+{
+   const __m128i bits = _mm_castps_si128(src);
+   const __m128i max = _mm_set1_epi32(0xff);
+   __m128i negative, saturated, value;
+
+   negative = _mm_cmplt_epi32(bits, _mm_setzero_si128());
+   saturated = _mm_cmpgt_epi32(bits, _mm_set1_epi32(0x3f800000 - 1));
+
+   value = _mm_castps_si128(_mm_add_ps(_mm_mul_ps(src, _mm_set1_ps(255.0f/256.0f)),
+                                       _mm_set1_ps(32768.0f)));
+   value = _mm_and_si128(value, max);
+   value = _mm_or_si128(_mm_andnot_si128(saturated, value),
+                        _mm_and_si128(saturated, max));
+   return _mm_andnot_si128(negative, value);
+}
+
+
+/**
+ * Pack four RGBA float pixels into RGBA8 ones.
+ */
+static inline __m128i
+pack_float_unorm8(const float *src)
+{
+   __m128i p0 = float_to_unorm8(_mm_loadu_ps(src + 0));
+   __m128i p1 = float_to_unorm8(_mm_loadu_ps(src + 4));
+   __m128i p2 = float_to_unorm8(_mm_loadu_ps(src + 8));
+   __m128i p3 = float_to_unorm8(_mm_loadu_ps(src + 12));
+
+   return _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3));
+}
+
+
+/**
+ * Scale non-negative floats and round them to integers like util_iround()
+ * does on x86-64, i.e., with halfway cases rounded up.
+ */
+static inline __m128i
+unorm_round(__m128 src, __m128 scale)
+{
+   return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(src, scale), _mm_set1_ps(0.5f)));
+}
+
+
+/**
+ * Pack the low 16 bits of each 32bit lane of two vectors.
+ */
+static inline __m128i
+pack_lo_epi16(__m128i a, __m128i b)
+{
+   /* Sign extend so that the saturation of packs is a no-op. */
+   a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+   b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+   return _mm_packs_epi32(a, b);
+}
+
+
+/**
+ * Vector version of util_half_to_float().  The halves are in 32bit lanes.
+ *
+ * Unlike the magic multiply of util_half_to_float(), this never operates
+ * on denormals (which are very slow on many CPUs), but gives the same
+ * results.
+ */
+static inline __m128
+half_to_float(__m128i f16)
+{
+   const __m128i exp_mask = _mm_set1_epi32(0x1f << 23);
+   const __m128i exp_adjust = _mm_set1_epi32((127 - 15) << 23);
+   __m128i bits, exp, infnan, denorm;
+   __m128 denorm_value;
+
+   bits = _mm_slli_epi32(_mm_and_si128(f16, _mm_set1_epi32(0x7fff)), 13);
+   exp = _mm_and_si128(bits, exp_mask);
+   bits = _mm_add_epi32(bits, exp_adjust);
+
+   /* Inf / NaN */
+   infnan = _mm_cmpeq_epi32(exp, exp_mask);
+   bits = _mm_add_epi32(bits, _mm_and_si128(infnan, exp_adjust));
+
+   /* Denormals become normal floats, renormalize them. */
+   denorm = _mm_cmpeq_epi32(exp, _mm_setzero_si128());
+   denorm_value = _mm_sub_ps(_mm_castsi128_ps(_mm_add_epi32(bits, _mm_set1_epi32(1 << 23))),
+                             _mm_castsi128_ps(_mm_set1_epi32(113 << 23)));
+   bits = _mm_or_si128(_mm_andnot_si128(denorm, bits),
+                       _mm_and_si128(denorm, _mm_castps_si128(denorm_value)));
+
+   /* Sign */
+   bits = _mm_or_si128(bits,
+                       _mm_slli_epi32(_mm_and_si128(f16, _mm_set1_epi32(0x8000)), 16));
+   return _mm_castsi128_ps(bits);
+}
+
+
+/**
+ * Vector version of util_float_to_half().  Returns the halves in 32bit
+ * lanes.
+ */
+static inline __m128i
+float_to_half(__m128 src)
+{
+   const __m128i f32inf = _mm_set1_epi32(0xff << 23);
+   const __m128i f16inf = _mm_set1_epi32(0x1f << 23);
+   const __m128i round_mask = _mm_set1_epi32(~0xfff);
+   __m128i bits, sign, inf, nan, overflow, value;
+
+   bits = _mm_castps_si128(src);
+   sign = _mm_and_si128(bits, _mm_set1_epi32(0x80000000));
+   bits = _mm_xor_si128(bits, sign);
+
+   /* With the sign removed, signed comparisons are fine. */
+   inf = _mm_cmpeq_epi32(bits, f32inf);
+   nan = _mm_cmpgt_epi32(bits, f32inf);
+
+   value = _mm_and_si128(bits, round_mask);
+   value = _mm_castps_si128(_mm_mul_ps(_mm_castsi128_ps(value),
+                                       _mm_castsi128_ps(_mm_set1_epi32(0xf << 23))));
+   value = _mm_sub_epi32(value, round_mask);
+
+   overflow = _mm_cmpgt_epi32(value, f16inf);
+   value = _mm_or_si128(_mm_andnot_si128(overflow, value),
+                        _mm_and_si128(overflow, _mm_sub_epi32(f16inf, _mm_set1_epi32(1))));
+   value = _mm_srli_epi32(value, 13);
+
+   value = _mm_or_si128(_mm_andnot_si128(inf, value),
+                        _mm_and_si128(inf, _mm_set1_epi32(0x7c00)));
+   value = _mm_or_si128(_mm_andnot_si128(nan, value),
+                        _mm_and_si128(nan, _mm_set1_epi32(0x7e00)));
+
+   return _mm_or_si128(value, _mm_srli_epi32(sign, 16));
+}
+
+
+/*
+ * Row functions.  They return the number of pixels converted, the rest of
+ * the row is left to the C function.
+ */
+
+static unsigned
+copy_32bit_row(void *dst, const void *src, unsigned width)
+{
+   memcpy(dst, src, width * 4);
+   return width;
+}
+
+
+static unsigned
+swap_rb_row(void *dst, const void *src, unsigned width)
+{
+   unsigned x;
+
+   for (x = 0; x + 4 <= width; x += 4) {
+      __m128i pixels = _mm_loadu_si128((const __m128i *)src + x / 4);
+      _mm_storeu_si128((__m128i *)dst + x / 4, swap_rb_epi8(pixels));
+   }
+   return x;
+}
+
+
+static unsigned
+rgba8_unpack_float_row(void *dst, const void *src, unsigned width)
+{
+   unsigned x;
+
+   for (x = 0; x + 4 <= width; x += 4) {
+      __m128i pixels = _mm_loadu_si128((const __m128i *)src + x / 4);
+      unpack_unorm8_float((float *)dst + x * 4, pixels);
+   }
+   return x;
+}
+
+
+static unsigned
+bgra8_unpack_float_row(void *dst, const void *src, unsigned width)
+{
+   unsigned x;
+
+   for (x = 0; x + 4 <= width; x += 4) {
+      __m128i pixels = _mm_loadu_si128((const __m128i *)src + x / 4);
+      unpack_unorm8_float((float *)dst + x * 4, swap_rb_epi8(pixels));
+   }
+   return x;
+}
+
+
+static unsigned
+rgba8_pack_float_row(void *dst, const void *src, unsigned width)
+{
+   unsigned x;
+
+   for (x = 0; x + 4 <= width; x += 4) {
+      __m128i pixels = pack_float_unorm8((const float *)src + x * 4);
+      _mm_storeu_si128((__m128i *)dst + x / 4, pixels);
+   }
+   return x;
+}
+
+
+static unsigned
+bgra8_pack_float_row(void *dst, const void *src, unsigned width)
+{
+   unsigned x;
+
+   for (x = 0; x + 4 <= width; x += 4) {
+      __m128i pixels = pack_float_unorm8((const float *)src + x * 4);
+      _mm_storeu_si128((__m128i *)dst + x / 4, swap_rb_epi8(pixels));
+   }
+   return x;
+}
+
+
+static unsigned
+rgb10a2_unpack_float_row(void *dst, const void *src, unsigned width)
+{
+   const __m128i mask10 = _mm_set1_epi32(0x3ff);
+   const __m128 scale10 = _mm_set1_ps(1.0f / 0x3ff);
+   const __m128 scale2 = _mm_set1_ps(1.0f / 0x3);
+   float *dst_f = dst;
+   unsigned x;
+
+   for (x = 0; x + 4 <= width; x += 4) {
+      __m128i pixels = _mm_loadu_si128((const __m128i *)src + x / 4);
+      __m128 r, g, b, a;
+
+      r = _mm_cvtepi32_ps(_mm_and_si128(pixels, mask10));
+      g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pixels, 10), mask10));
+      b = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pixels, 20), mask10));
+      a = _mm_cvtepi32_ps(_mm_srli_epi32(pixels, 30));
+
+      r = _mm_mul_ps(r, scale10);
+      g = _mm_mul_ps(g, scale10);
+      b = _mm_mul_ps(b, scale10);
+      a = _mm_mul_ps(a, scale2);
+
+      _MM_TRANSPOSE4_PS(r, g, b, a);
+
+      _mm_storeu_ps(dst_f + x * 4 + 0, r);
+      _mm_storeu_ps(dst_f + x * 4 + 4, g);
+      _mm_storeu_ps(dst_f + x * 4 + 8, b);
+      _mm_storeu_ps(dst_f + x * 4 + 12, a);
+   }
+   return x;
+}
+
+
+static unsigned
+rgb10a2_pack_float_row(void *dst, const void *src, unsigned width)
+{
+   const __m128 zero = _mm_setzero_ps();
+   const __m128 one = _mm_set1_ps(1.0f);
+   const __m128 scale10 = _mm_set1_ps(0x3ff);
+   const __m128 scale2 = _mm_set1_ps(0x3);
+   const float *src_f = src;
+   unsigned x;
+
+   for (x = 0; x + 4 <= width; x += 4) {
+      __m128 r = _mm_loadu_ps(src_f + x * 4 + 0);
+      __m128 g = _mm_loadu_ps(src_f + x * 4 + 4);
+      __m128 b = _mm_loadu_ps(src_f + x * 4 + 8);
+      __m128 a = _mm_loadu_ps(src_f + x * 4 + 12);
+      __m128i pixels;
+
+      _MM_TRANSPOSE4_PS(r, g, b, a);
+
+      /* max(x, 0) returns 0 for NaN, like util_iround(NaN) & mask does. */
+      r = _mm_min_ps(_mm_max_ps(r, zero), one);
+      g = _mm_min_ps(_mm_max_ps(g, zero), one);
+      b = _mm_min_ps(_mm_max_ps(b, zero), one);
+      a = _mm_min_ps(_mm_max_ps(a, zero), one);
+
+      pixels = unorm_round(r, scale10);
+      pixels = _mm_or_si128(pixels, _mm_slli_epi32(unorm_round(g, scale10), 10));
+      pixels = _mm_or_si128(pixels, _mm_slli_epi32(unorm_round(b, scale10), 20));
+      pixels = _mm_or_si128(pixels, _mm_slli_epi32(unorm_round(a, scale2), 30));
+
+      _mm_storeu_si128((__m128i *)dst + x / 4, pixels);
+   }
+   return x;
+}
+
+
+static unsigned
+rgba16f_unpack_float_row(void *dst, const void *src, unsigned width)
+{
+   const __m128i zero = _mm_setzero_si128();
+   float *dst_f = dst;
+   unsigned x;
+
+   for (x = 0; x + 4 <= width; x += 4) {
+      __m128i p01 = _mm_loadu_si128((const __m128i *)src + x / 2);
+      __m128i p23 = _mm_loadu_si128((const __m128i *)src + x / 2 + 1);
+
+      _mm_storeu_ps(dst_f + x * 4 + 0, half_to_float(_mm_unpacklo_epi16(p01, zero)));
+      _mm_storeu_ps(dst_f + x * 4 + 4, half_to_float(_mm_unpackhi_epi16(p01, zero)));
+      _mm_storeu_ps(dst_f + x * 4 + 8, half_to_float(_mm_unpacklo_epi16(p23, zero)));
+      _mm_storeu_ps(dst_f + x * 4 + 12, half_to_float(_mm_unpackhi_epi16(p23, zero)));
+   }
+   return x;
+}
+
+
+static unsigned
+rgba16f_pack_float_row(void *dst, const void *src, unsigned width)
+{
+   const float *src_f = src;
+   unsigned x;
+
+   for (x = 0; x + 4 <= width; x += 4) {
+      __m128i p0 = float_to_half(_mm_loadu_ps(src_f + x * 4 + 0));
+      __m128i p1 = float_to_half(_mm_loadu_ps(src_f + x * 4 + 4));
+      __m128i p2 = float_to_half(_mm_loadu_ps(src_f + x * 4 + 8));
+      __m128i p3 = float_to_half(_mm_loadu_ps(src_f + x * 4 + 12));
+
+      _mm_storeu_si128((__m128i *)dst + x / 2, pack_lo_epi16(p0, p1));
+      _mm_storeu_si128((__m128i *)dst + x / 2 + 1, pack_lo_epi16(p2, p3));
+   }
+   return x;
+}
+
+
+static unsigned
+z16_unpack_float_row(void *dst, const void *src, unsigned width)
+{
+   const __m128i zero = _mm_setzero_si128();
+   /* Same rounding of the scale as in z16_unorm_to_z32_float(). */
+   const float scale_f = 1.0 / 0xffff;
+   const __m128 scale = _mm_set1_ps(scale_f);
+   float *dst_f = dst;
+   unsigned x;
+
+   for (x = 0; x + 8 <= width; x += 8) {
+      __m128i z = _mm_loadu_si128((const __m128i *)src + x / 8);
+
+      _mm_storeu_ps(dst_f + x + 0,
+                    _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(z, zero)), scale));
+      _mm_storeu_ps(dst_f + x + 4,
+                    _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(z, zero)), scale));
+   }
+   return x;
+}
+
+
+static unsigned
+z16_pack_float_row(void *dst, const void *src, unsigned width)
+{
+   const __m128 scale = _mm_set1_ps(0xffff);
+   const __m128 half = _mm_set1_ps(0.5f);
+   const float *src_f = src;
+   unsigned x;
+
+   for (x = 0; x + 8 <= width; x += 8) {
+      __m128 z0 = _mm_loadu_ps(src_f + x + 0);
+      __m128 z1 = _mm_loadu_ps(src_f + x + 4);
+      __m128i i0 = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(z0, scale), half));
+      __m128i i1 = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(z1, scale), half));
+
+      _mm_storeu_si128((__m128i *)dst + x / 8, pack_lo_epi16(i0, i1));
+   }
+   return x;
+}
+
+
+static unsigned
+z24s8_unpack_float_row(void *dst, const void *src, unsigned width)
+{
+   /* z24_unorm_to_z32_float() computes in double precision. */
+   const __m128d scale = _mm_set1_pd(1.0 / 0xffffff);
+   const __m128i mask = _mm_set1_epi32(0xffffff);
+   float *dst_f = dst;
+   unsigned x;
+
+   for (x = 0; x + 4 <= width; x += 4) {
+      __m128i z = _mm_and_si128(_mm_loadu_si128((const __m128i *)src + x / 4), mask);
+      __m128d lo = _mm_mul_pd(_mm_cvtepi32_pd(z), scale);
+      __m128d hi = _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(z, _MM_SHUFFLE(3, 2, 3, 2))),
+                              scale);
+
+      _mm_storeu_ps(dst_f + x, _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi)));
+   }
+   return x;
+}
+
+
+static unsigned
+z24s8_pack_float_row(void *dst, const void *src, unsigned width)
+{
+   const __m128d scale = _mm_set1_pd(0xffffff);
+   const __m128i mask = _mm_set1_epi32(0xffffff);
+   const float *src_f = src;
+   unsigned x;
+
+   for (x = 0; x + 4 <= width; x += 4) {
+      __m128 z = _mm_loadu_ps(src_f + x);
+      __m128i *pixels = (__m128i *)dst + x / 4;
+      __m128i lo = _mm_cvttpd_epi32(_mm_mul_pd(_mm_cvtps_pd(z), scale));
+      __m128i hi = _mm_cvttpd_epi32(_mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(z, z)), scale));
+      __m128i value = _mm_and_si128(_mm_unpacklo_epi64(lo, hi), mask);
+
+      value = _mm_or_si128(value, _mm_andnot_si128(mask, _mm_loadu_si128(pixels)));
+      _mm_storeu_si128(pixels, value);
+   }
+   return x;
+}
+
+
+static unsigned
+z24s8_unpack_z32_row(void *dst, const void *src, unsigned width)
+{
+   const __m128i mask = _mm_set1_epi32(0xffffff);
+   unsigned x;
+
+   for (x = 0; x + 4 <= width; x += 4) {
+      __m128i z = _mm_and_si128(_mm_loadu_si128((const __m128i *)src + x / 4), mask);
+
+      z = _mm_or_si128(_mm_slli_epi32(z, 8), _mm_srli_epi32(z, 16));
+      _mm_storeu_si128((__m128i *)dst + x / 4, z);
+   }
+   return x;
+}
+
+
+/**
+ * Define util_format_<format>_<func>_simd(), which runs the row function
+ * when SSE2 is available, and the C function otherwise.
+ */
+#define SIMD_FUNC(format, func, dst_type, dst_bpp, src_type, src_bpp, row_func) \
+void                                                                         \
+util_format_##format##_##func##_simd(dst_type *dst_row, unsigned dst_stride, \
+                                     const src_type *src_row, unsigned src_stride, \
+                                     unsigned width, unsigned height)        \
+{                                                                            \
+   unsigned x, y;                                                            \
+                                                                             \
+   if (!util_cpu_caps.has_sse2) {                                            \
+      util_format_##format##_##func(dst_row, dst_stride, src_row, src_stride, \
+                                    width, height);                          \
+      return;                                                                \
+   }                                                                         \
+                                                                             \
+   for (y = 0; y < height; ++y) {                                            \
+      x = row_func(dst_row, src_row, width);                                 \
+      if (x < width) {                                                       \
+         util_format_##format##_##func(                                      \
+            (dst_type *)((uint8_t *)dst_row + x * (dst_bpp)), 0,             \
+            (const src_type *)((const uint8_t *)src_row + x * (src_bpp)), 0, \
+            width - x, 1);                                                   \
+      }                                                                      \
+      dst_row = (dst_type *)((uint8_t *)dst_row + dst_stride);               \
+      src_row = (const src_type *)((const uint8_t *)src_row + src_stride);   \
+   }                                                                         \
+}
+
+#else /* !PIPE_ARCH_SSE */
+
+#define SIMD_FUNC(format, func, dst_type, dst_bpp, src_type, src_bpp, row_func) \
+void                                                                         \
+util_format_##format##_##func##_simd(dst_type *dst_row, unsigned dst_stride, \
+                                     const src_type *src_row, unsigned src_stride, \
+                                     unsigned width, unsigned height)        \
+{                                                                            \
+   util_format_##format##_##func(dst_row, dst_stride, src_row, src_stride,   \
+                                 width, height);                             \
+}
+
+#endif /* !PIPE_ARCH_SSE */
+
+
+SIMD_FUNC(r8g8b8a8_unorm, unpack_rgba_8unorm, uint8_t, 4, uint8_t, 4, copy_32bit_row)
+SIMD_FUNC(r8g8b8a8_unorm, pack_rgba_8unorm, uint8_t, 4, uint8_t, 4, copy_32bit_row)
+SIMD_FUNC(r8g8b8a8_unorm, unpack_rgba_float, float, 16, uint8_t, 4, rgba8_unpack_float_row)
+SIMD_FUNC(r8g8b8a8_unorm, pack_rgba_float, uint8_t, 4, float, 16, rgba8_pack_float_row)
+
+SIMD_FUNC(b8g8r8a8_unorm, unpack_rgba_8unorm, uint8_t, 4, uint8_t, 4, swap_rb_row)
+SIMD_FUNC(b8g8r8a8_unorm, pack_rgba_8unorm, uint8_t, 4, uint8_t, 4, swap_rb_row)
+SIMD_FUNC(b8g8r8a8_unorm, unpack_rgba_float, float, 16, uint8_t, 4, bgra8_unpack_float_row)
+SIMD_FUNC(b8g8r8a8_unorm, pack_rgba_float, uint8_t, 4, float, 16, bgra8_pack_float_row)
+
+SIMD_FUNC(r10g10b10a2_unorm, unpack_rgba_float, float, 16, uint8_t, 4, rgb10a2_unpack_float_row)
+SIMD_FUNC(r10g10b10a2_unorm, pack_rgba_float, uint8_t, 4, float, 16, rgb10a2_pack_float_row)
+
+SIMD_FUNC(r16g16b16a16_float, unpack_rgba_float, float, 16, uint8_t, 8, rgba16f_unpack_float_row)
+SIMD_FUNC(r16g16b16a16_float, pack_rgba_float, uint8_t, 8, float, 16, rgba16f_pack_float_row)
+
+SIMD_FUNC(z16_unorm, unpack_z_float, float, 4, uint8_t, 2, z16_unpack_float_row)
+SIMD_FUNC(z16_unorm, pack_z_float, uint8_t, 2, float, 4, z16_pack_float_row)
+
+SIMD_FUNC(z24_unorm_s8_uint, unpack_z_float, float, 4, uint8_t, 4, z24s8_unpack_float_row)
+SIMD_FUNC(z24_unorm_s8_uint, pack_z_float, uint8_t, 4, float, 4, z24s8_pack_float_row)
+SIMD_FUNC(z24_unorm_s8_uint, unpack_z_32unorm, uint32_t, 4, uint8_t, 4, z24s8_unpack_z32_row)
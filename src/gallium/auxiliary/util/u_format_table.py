@@ -60,6 +60,13 @@ type_map = {
 }
 
 
+def function_ref(format, func):
+    name = 'util_format_%s_%s' % (format.short_name(), func)
+    if u_format_pack.has_simd_function(format, func):
+        name += '_simd'
+    return '&' + name
+
+
 def bool_map(value):
     if value:
         return "TRUE"
@@ -89,6 +96,7 @@ def write_format_table(formats):
     print '#include "u_format_rgtc.h"'
     print '#include "u_format_latc.h"'
     print '#include "u_format_etc.h"'
+    print '#include "u_format_simd.h"'
     print
     
     u_format_pack.generate(formats)
@@ -143,14 +151,14 @@ def write_format_table(formats):
         if format.layout == 'etc' and format.short_name() != 'etc1_rgb8':
             access = False
         if format.colorspace != ZS and not format.is_pure_color() and access:
-            print "   &util_format_%s_unpack_rgba_8unorm," % format.short_name() 
-            print "   &util_format_%s_pack_rgba_8unorm," % format.short_name() 
+            print "   %s," % function_ref(format, 'unpack_rgba_8unorm')
+            print "   %s," % function_ref(format, 'pack_rgba_8unorm')
             if format.layout == 's3tc' or format.layout == 'rgtc':
                 print "   &util_format_%s_fetch_rgba_8unorm," % format.short_name()
             else:
                 print "   NULL, /* fetch_rgba_8unorm */" 
-            print "   &util_format_%s_unpack_rgba_float," % format.short_name() 
-            print "   &util_format_%s_pack_rgba_float," % format.short_name() 
+            print "   %s," % function_ref(format, 'unpack_rgba_float')
+            print "   %s," % function_ref(format, 'pack_rgba_float')
             print "   &util_format_%s_fetch_rgba_float," % format.short_name()
         else:
             print "   NULL, /* unpack_rgba_8unorm */" 
@@ -160,10 +168,10 @@ def write_format_table(formats):
             print "   NULL, /* pack_rgba_float */" 
             print "   NULL, /* fetch_rgba_float */" 
         if format.has_depth():
-            print "   &util_format_%s_unpack_z_32unorm," % format.short_name() 
-            print "   &util_format_%s_pack_z_32unorm," % format.short_name() 
-            print "   &util_format_%s_unpack_z_float," % format.short_name() 
-            print "   &util_format_%s_pack_z_float," % format.short_name() 
+            print "   %s," % function_ref(format, 'unpack_z_32unorm')
+            print "   %s," % function_ref(format, 'pack_z_32unorm')
+            print "   %s," % function_ref(format, 'unpack_z_float')
+            print "   %s," % function_ref(format, 'pack_z_float')
         else:
             print "   NULL, /* unpack_z_32unorm */" 
             print "   NULL, /* pack_z_32unorm */" 
@@ -457,6 +457,15 @@ lp_build_occlusion_count(struct gallivm_state *gallivm,
                                        LLVMInt32TypeInContext(context), bits);
       count = LLVMBuildZExt(builder, count, LLVMIntTypeInContext(context, 64), "");
    }
+   else if (util_cpu_caps.has_avx512f && type.length == 16) {
+      /* sign bits into a mask register, then popcount that */
+      LLVMTypeRef int16t = LLVMInt16TypeInContext(context);
+      LLVMValueRef bits = LLVMBuildICmp(builder, LLVMIntSLT, maskvalue,
+                                        LLVMConstNull(LLVMTypeOf(maskvalue)), "");
+      bits = LLVMBuildBitCast(builder, bits, int16t, "");
+      count = lp_build_intrinsic_unary(builder, "llvm.ctpop.i16", int16t, bits);
+      count = LLVMBuildZExt(builder, count, LLVMIntTypeInContext(context, 64), "");
+   }
    else {
       unsigned i;
       LLVMValueRef countv = LLVMBuildAnd(builder, maskvalue, countmask, "countv");
@@ -537,7 +546,7 @@ lp_build_depth_stencil_load_swizzled(struct gallivm_state *gallivm,
 {
    LLVMBuilderRef builder = gallivm->builder;
    LLVMValueRef shuffles[LP_MAX_VECTOR_LENGTH / 4];
-   LLVMValueRef zs_dst1, zs_dst2;
+   LLVMValueRef zs_dst1 = NULL, zs_dst2 = NULL;
    LLVMValueRef zs_dst_ptr;
    LLVMValueRef depth_offset1, depth_offset2;
    LLVMTypeRef load_ptr_type;
@@ -565,11 +574,10 @@ lp_build_depth_stencil_load_swizzled(struct gallivm_state *gallivm,
          shuffles[i] = lp_build_const_int32(gallivm, i);
       }
    }
-   else {
+   else if (z_src_type.length == 8) {
       unsigned i;
       LLVMValueRef loopx2 = LLVMBuildShl(builder, loop_counter,
                                          lp_build_const_int32(gallivm, 1), "");
-      assert(z_src_type.length == 8);
       depth_offset1 = LLVMBuildMul(builder, loopx2, depth_stride, "");
       /*
        * We load 2x4 values, and need to swizzle them (order
@@ -579,20 +587,57 @@ lp_build_depth_stencil_load_swizzled(struct gallivm_state *gallivm,
          shuffles[i] = lp_build_const_int32(gallivm, (i&1) + (i&2) * 2 + (i&4) / 2);
       }
    }
+   else {
+      /*
+       * The whole 4x4 block in one go: load the 4 rows and swizzle them
+       * into 2x2 quad order.
+       */
+      LLVMValueRef rows[4], offset;
+      unsigned i;
 
-   depth_offset2 = LLVMBuildAdd(builder, depth_offset1, depth_stride, "");
+      assert(z_src_type.length == 16);
+      assert(!is_1d);
+      (void)loop_counter;
 
-   /* Load current z/stencil values from z/stencil buffer */
-   zs_dst_ptr = LLVMBuildGEP(builder, depth_ptr, &depth_offset1, 1, "");
-   zs_dst_ptr = LLVMBuildBitCast(builder, zs_dst_ptr, load_ptr_type, "");
-   zs_dst1 = LLVMBuildLoad(builder, zs_dst_ptr, "");
-   if (is_1d) {
-      zs_dst2 = lp_build_undef(gallivm, zs_load_type);
+      zs_load_type.length = 4;
+      load_ptr_type = LLVMPointerType(lp_build_vec_type(gallivm, zs_load_type), 0);
+
+      for (i = 0; i < 4; i++) {
+         offset = LLVMBuildMul(builder, depth_stride,
+                               lp_build_const_int32(gallivm, i), "");
+         zs_dst_ptr = LLVMBuildGEP(builder, depth_ptr, &offset, 1, "");
+         zs_dst_ptr = LLVMBuildBitCast(builder, zs_dst_ptr, load_ptr_type, "");
+         rows[i] = LLVMBuildLoad(builder, zs_dst_ptr, "");
+      }
+      for (i = 0; i < 8; i++) {
+         shuffles[i] = lp_build_const_int32(gallivm, i);
+      }
+      zs_dst1 = LLVMBuildShuffleVector(builder, rows[0], rows[1],
+                                       LLVMConstVector(shuffles, 8), "");
+      zs_dst2 = LLVMBuildShuffleVector(builder, rows[2], rows[3],
+                                       LLVMConstVector(shuffles, 8), "");
+      for (i = 0; i < 16; i++) {
+         unsigned x = (i & 1) + ((i >> 2) & 1) * 2;
+         unsigned y = ((i >> 1) & 1) + ((i >> 3) & 1) * 2;
+         shuffles[i] = lp_build_const_int32(gallivm, y * 4 + x);
+      }
    }
-   else {
-      zs_dst_ptr = LLVMBuildGEP(builder, depth_ptr, &depth_offset2, 1, "");
+
+   if (z_src_type.length <= 8) {
+      depth_offset2 = LLVMBuildAdd(builder, depth_offset1, depth_stride, "");
+
+      /* Load current z/stencil values from z/stencil buffer */
+      zs_dst_ptr = LLVMBuildGEP(builder, depth_ptr, &depth_offset1, 1, "");
       zs_dst_ptr = LLVMBuildBitCast(builder, zs_dst_ptr, load_ptr_type, "");
-      zs_dst2 = LLVMBuildLoad(builder, zs_dst_ptr, "");
+      zs_dst1 = LLVMBuildLoad(builder, zs_dst_ptr, "");
+      if (is_1d) {
+         zs_dst2 = lp_build_undef(gallivm, zs_load_type);
+      }
+      else {
+         zs_dst_ptr = LLVMBuildGEP(builder, depth_ptr, &depth_offset2, 1, "");
+         zs_dst_ptr = LLVMBuildBitCast(builder, zs_dst_ptr, load_ptr_type, "");
+         zs_dst2 = LLVMBuildLoad(builder, zs_dst_ptr, "");
+      }
    }
 
    *z_fb = LLVMBuildShuffleVector(builder, zs_dst1, zs_dst2,
@@ -706,11 +751,10 @@ lp_build_depth_stencil_write_swizzled(struct gallivm_state *gallivm,
                                    lp_build_const_int32(gallivm, depth_bytes * 2), "");
       depth_offset1 = LLVMBuildAdd(builder, depth_offset1, offset2, "");
    }
-   else {
+   else if (z_src_type.length == 8) {
       unsigned i;
       LLVMValueRef loopx2 = LLVMBuildShl(builder, loop_counter,
                                          lp_build_const_int32(gallivm, 1), "");
-      assert(z_src_type.length == 8);
       depth_offset1 = LLVMBuildMul(builder, loopx2, depth_stride, "");
       /*
        * We load 2x4 values, and need to swizzle them (order
@@ -720,6 +764,12 @@ lp_build_depth_stencil_write_swizzled(struct gallivm_state *gallivm,
          shuffles[i] = lp_build_const_int32(gallivm, (i&1) + (i&2) * 2 + (i&4) / 2);
       }
    }
+   else {
+      /* the whole 4x4 block, stored row by row below */
+      assert(z_src_type.length == 16);
+      assert(!is_1d);
+      depth_offset1 = lp_build_const_int32(gallivm, 0);
+   }
 
    depth_offset2 = LLVMBuildAdd(builder, depth_offset1, depth_stride, "");
 
@@ -747,6 +797,49 @@ lp_build_depth_stencil_write_swizzled(struct gallivm_state *gallivm,
                                lp_build_int_vec_type(gallivm, zs_type), "");
    }
 
+   if (z_src_type.length == 16) {
+      /*
+       * Unswizzle the 2x2 quads back into 4 rows of 4 values, interleaving
+       * the stencil values for 64-bit formats.
+       */
+      unsigned row, i;
+
+      zs_load_type.length = 4;
+      load_ptr_type = LLVMPointerType(lp_build_vec_type(gallivm, zs_load_type), 0);
+
+      for (row = 0; row < 4; row++) {
+         LLVMValueRef offset, ptr, value;
+
+         for (i = 0; i < 4; i++) {
+            unsigned idx = (row & 1) * 2 + (row >> 1) * 8 + (i & 1) + (i >> 1) * 4;
+            if (format_desc->block.bits <= 32) {
+               shuffles[i] = lp_build_const_int32(gallivm, idx);
+            }
+            else {
+               shuffles[2*i] = lp_build_const_int32(gallivm, idx);
+               shuffles[2*i + 1] = lp_build_const_int32(gallivm, idx + 16);
+            }
+         }
+         if (format_desc->block.bits <= 32) {
+            value = LLVMBuildShuffleVector(builder, z_value, z_value,
+                                           LLVMConstVector(shuffles, 4), "");
+         }
+         else {
+            value = LLVMBuildShuffleVector(builder, z_value, s_value,
+                                           LLVMConstVector(shuffles, 8), "");
+            value = LLVMBuildBitCast(builder, value,
+                                     lp_build_vec_type(gallivm, zs_load_type), "");
+         }
+
+         offset = LLVMBuildMul(builder, depth_stride,
+                               lp_build_const_int32(gallivm, row), "");
+         ptr = LLVMBuildGEP(builder, depth_ptr, &offset, 1, "");
+         ptr = LLVMBuildBitCast(builder, ptr, load_ptr_type, "");
+         LLVMBuildStore(builder, value, ptr);
+      }
+      return;
+   }
+
    if (format_desc->block.bits <= 32) {
       if (z_src_type.length == 4) {
          zs_dst1 = lp_build_extract_range(gallivm, z_value, 0, 2);
@@ -45,7 +45,10 @@
 #include "lp_state.h"
 #include "lp_surface.h"
 #include "lp_query.h"
+#include "lp_rast.h"
+#include "lp_screen.h"
 #include "lp_setup.h"
+#include "lp_state_cs.h"
 
 /* This is only safe if there's just one concurrent context */
 #ifdef PIPE_SUBSYSTEM_EMBEDDED
@@ -89,6 +92,12 @@ static void llvmpipe_destroy( struct pipe_context *pipe )
       pipe_sampler_view_reference(&llvmpipe->sampler_views[PIPE_SHADER_GEOMETRY][i], NULL);
    }
 
+   for (i = 0; i < ARRAY_SIZE(llvmpipe->sampler_views[0]); i++) {
+      pipe_sampler_view_reference(&llvmpipe->sampler_views[PIPE_SHADER_COMPUTE][i], NULL);
+   }
+
+   llvmpipe_cleanup_compute(llvmpipe);
+
    for (i = 0; i < ARRAY_SIZE(llvmpipe->constants); i++) {
       for (j = 0; j < ARRAY_SIZE(llvmpipe->constants[i]); j++) {
          pipe_resource_reference(&llvmpipe->constants[i][j].buffer, NULL);
@@ -131,6 +140,40 @@ llvmpipe_render_condition(struct pipe_context *pipe,
    llvmpipe->render_cond_cond = condition;
 }
 
+static void
+llvmpipe_get_sample_position(struct pipe_context *pipe,
+                             unsigned sample_count,
+                             unsigned sample_index,
+                             float *out_value)
+{
+   if (sample_count == LP_MAX_SAMPLES && sample_index < LP_MAX_SAMPLES) {
+      out_value[0] = 0.5f + lp_sample_offsets[sample_index][0] / 16.0f;
+      out_value[1] = 0.5f + lp_sample_offsets[sample_index][1] / 16.0f;
+   }
+   else {
+      out_value[0] = 0.5f;
+      out_value[1] = 0.5f;
+   }
+}
+
+static void
+lp_draw_disk_cache_find_shader(void *cookie,
+                               struct lp_cached_code *cache,
+                               const unsigned char ir_sha1_cache_key[20])
+{
+   lp_disk_cache_find_shader((struct llvmpipe_screen *)cookie, cache,
+                             ir_sha1_cache_key);
+}
+
+static void
+lp_draw_disk_cache_insert_shader(void *cookie,
+                                 struct lp_cached_code *cache,
+                                 const unsigned char ir_sha1_cache_key[20])
+{
+   lp_disk_cache_insert_shader((struct llvmpipe_screen *)cookie, cache,
+                               ir_sha1_cache_key);
+}
+
 struct pipe_context *
 llvmpipe_create_context(struct pipe_screen *screen, void *priv,
                         unsigned flags)
@@ -160,6 +203,7 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    llvmpipe->pipe.flush = do_flush;
 
    llvmpipe->pipe.render_condition = llvmpipe_render_condition;
+   llvmpipe->pipe.get_sample_position = llvmpipe_get_sample_position;
 
    llvmpipe_init_blend_funcs(llvmpipe);
    llvmpipe_init_clip_funcs(llvmpipe);
@@ -171,6 +215,7 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    llvmpipe_init_fs_funcs(llvmpipe);
    llvmpipe_init_vs_funcs(llvmpipe);
    llvmpipe_init_gs_funcs(llvmpipe);
+   llvmpipe_init_compute_funcs(llvmpipe);
    llvmpipe_init_rasterizer_funcs(llvmpipe);
    llvmpipe_init_context_resource_funcs( &llvmpipe->pipe );
    llvmpipe_init_surface_functions(llvmpipe);
@@ -192,6 +237,12 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    if (!llvmpipe->draw)
       goto fail;
 
+   if (llvmpipe_screen(screen)->disk_shader_cache)
+      draw_set_disk_cache_callbacks(llvmpipe->draw,
+                                    llvmpipe_screen(screen),
+                                    lp_draw_disk_cache_find_shader,
+                                    lp_draw_disk_cache_insert_shader);
+
    /* FIXME: devise alternative to draw_texture_samplers */
 
    llvmpipe->setup = lp_setup_create( &llvmpipe->pipe,
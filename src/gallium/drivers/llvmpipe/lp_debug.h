@@ -59,6 +59,8 @@ st_print_current(void);
 #define PERF_NO_BLEND       0x20  	/* disable blending */
 #define PERF_NO_DEPTH       0x40  	/* disable depth buffering entirely */
 #define PERF_NO_ALPHATEST   0x80  	/* disable alpha testing */
+#define PERF_NO_HIZ         0x100 	/* disable hierarchical Z rejection */
+#define PERF_NO_TILED       0x200 	/* disable tiled texture layout */
 
 
 extern int LP_PERF;
@@ -39,14 +39,20 @@
 #include "gallivm/lp_bld_format.h"
 #include "lp_context.h"
 #include "lp_jit.h"
+#include "lp_state_cs.h"
 
 
+/**
+ * Create the LLVM types of the jit context and thread data, which are
+ * shared by fragment and compute shaders.
+ */
 static void
-lp_jit_create_types(struct lp_fragment_shader_variant *lp)
+lp_jit_create_types(struct gallivm_state *gallivm,
+                    LLVMTypeRef *jit_context_ptr_type,
+                    LLVMTypeRef *jit_thread_data_ptr_type)
 {
-   struct gallivm_state *gallivm = lp->gallivm;
    LLVMContextRef lc = gallivm->context;
-   LLVMTypeRef viewport_type, texture_type, sampler_type;
+   LLVMTypeRef viewport_type, texture_type, sampler_type, image_type;
 
    /* struct lp_jit_viewport */
    {
@@ -145,6 +151,42 @@ lp_jit_create_types(struct lp_fragment_shader_variant *lp)
                            gallivm->target, sampler_type);
    }
 
+   /* struct lp_jit_image */
+   {
+      LLVMTypeRef elem_types[LP_JIT_IMAGE_NUM_FIELDS];
+
+      elem_types[LP_JIT_IMAGE_WIDTH]  =
+      elem_types[LP_JIT_IMAGE_HEIGHT] =
+      elem_types[LP_JIT_IMAGE_DEPTH] = LLVMInt32TypeInContext(lc);
+      elem_types[LP_JIT_IMAGE_BASE] = LLVMPointerType(LLVMInt8TypeInContext(lc), 0);
+      elem_types[LP_JIT_IMAGE_ROW_STRIDE] =
+      elem_types[LP_JIT_IMAGE_IMG_STRIDE] = LLVMInt32TypeInContext(lc);
+
+      image_type = LLVMStructTypeInContext(lc, elem_types,
+                                           ARRAY_SIZE(elem_types), 0);
+
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_image, width,
+                             gallivm->target, image_type,
+                             LP_JIT_IMAGE_WIDTH);
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_image, height,
+                             gallivm->target, image_type,
+                             LP_JIT_IMAGE_HEIGHT);
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_image, depth,
+                             gallivm->target, image_type,
+                             LP_JIT_IMAGE_DEPTH);
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_image, base,
+                             gallivm->target, image_type,
+                             LP_JIT_IMAGE_BASE);
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_image, row_stride,
+                             gallivm->target, image_type,
+                             LP_JIT_IMAGE_ROW_STRIDE);
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_image, img_stride,
+                             gallivm->target, image_type,
+                             LP_JIT_IMAGE_IMG_STRIDE);
+      LP_CHECK_STRUCT_SIZE(struct lp_jit_image,
+                           gallivm->target, image_type);
+   }
+
    /* struct lp_jit_context */
    {
       LLVMTypeRef elem_types[LP_JIT_CTX_COUNT];
@@ -164,6 +206,12 @@ lp_jit_create_types(struct lp_fragment_shader_variant *lp)
                                                       PIPE_MAX_SHADER_SAMPLER_VIEWS);
       elem_types[LP_JIT_CTX_SAMPLERS] = LLVMArrayType(sampler_type,
                                                       PIPE_MAX_SAMPLERS);
+      elem_types[LP_JIT_CTX_SSBOS] =
+         LLVMArrayType(LLVMPointerType(LLVMInt8TypeInContext(lc), 0), LP_MAX_TGSI_SHADER_BUFFERS);
+      elem_types[LP_JIT_CTX_NUM_SSBOS] =
+            LLVMArrayType(LLVMInt32TypeInContext(lc), LP_MAX_TGSI_SHADER_BUFFERS);
+      elem_types[LP_JIT_CTX_IMAGES] = LLVMArrayType(image_type,
+                                                    LP_MAX_TGSI_SHADER_IMAGES);
 
       context_type = LLVMStructTypeInContext(lc, elem_types,
                                              ARRAY_SIZE(elem_types), 0);
@@ -198,10 +246,19 @@ lp_jit_create_types(struct lp_fragment_shader_variant *lp)
       LP_CHECK_MEMBER_OFFSET(struct lp_jit_context, samplers,
                              gallivm->target, context_type,
                              LP_JIT_CTX_SAMPLERS);
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_context, ssbos,
+                             gallivm->target, context_type,
+                             LP_JIT_CTX_SSBOS);
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_context, num_ssbos,
+                             gallivm->target, context_type,
+                             LP_JIT_CTX_NUM_SSBOS);
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_context, images,
+                             gallivm->target, context_type,
+                             LP_JIT_CTX_IMAGES);
       LP_CHECK_STRUCT_SIZE(struct lp_jit_context,
                            gallivm->target, context_type);
 
-      lp->jit_context_ptr_type = LLVMPointerType(context_type, 0);
+      *jit_context_ptr_type = LLVMPointerType(context_type, 0);
    }
 
    /* struct lp_jit_thread_data */
@@ -218,7 +275,7 @@ lp_jit_create_types(struct lp_fragment_shader_variant *lp)
       thread_data_type = LLVMStructTypeInContext(lc, elem_types,
                                                  ARRAY_SIZE(elem_types), 0);
 
-      lp->jit_thread_data_ptr_type = LLVMPointerType(thread_data_type, 0);
+      *jit_thread_data_ptr_type = LLVMPointerType(thread_data_type, 0);
    }
 
    if (gallivm_debug & GALLIVM_DEBUG_IR) {
@@ -251,5 +308,17 @@ void
 lp_jit_init_types(struct lp_fragment_shader_variant *lp)
 {
    if (!lp->jit_context_ptr_type)
-      lp_jit_create_types(lp);
+      lp_jit_create_types(lp->gallivm,
+                          &lp->jit_context_ptr_type,
+                          &lp->jit_thread_data_ptr_type);
+}
+
+
+void
+lp_jit_init_cs_types(struct lp_compute_shader_variant *lp)
+{
+   if (!lp->jit_context_ptr_type)
+      lp_jit_create_types(lp->gallivm,
+                          &lp->jit_context_ptr_type,
+                          &lp->jit_thread_data_ptr_type);
 }
@@ -45,6 +45,7 @@
 
 struct lp_build_format_cache;
 struct lp_fragment_shader_variant;
+struct lp_compute_shader_variant;
 struct llvmpipe_screen;
 
 
@@ -71,6 +72,21 @@ struct lp_jit_sampler
 };
 
 
+/**
+ * A single level (and, for arrays, range of layers) of a texture bound as
+ * a shader image.
+ */
+struct lp_jit_image
+{
+   uint32_t width;        /* same as number of elements */
+   uint32_t height;
+   uint32_t depth;        /* doubles as array size */
+   const void *base;
+   uint32_t row_stride;
+   uint32_t img_stride;
+};
+
+
 struct lp_jit_viewport
 {
    float min_depth;
@@ -101,6 +117,17 @@ enum {
 };
 
 
+enum {
+   LP_JIT_IMAGE_WIDTH = 0,
+   LP_JIT_IMAGE_HEIGHT,
+   LP_JIT_IMAGE_DEPTH,
+   LP_JIT_IMAGE_BASE,
+   LP_JIT_IMAGE_ROW_STRIDE,
+   LP_JIT_IMAGE_IMG_STRIDE,
+   LP_JIT_IMAGE_NUM_FIELDS  /* number of fields above */
+};
+
+
 enum {
    LP_JIT_VIEWPORT_MIN_DEPTH,
    LP_JIT_VIEWPORT_MAX_DEPTH,
@@ -109,9 +136,11 @@ enum {
 
 
 /**
- * This structure is passed directly to the generated fragment shader.
+ * This structure is passed directly to the generated fragment and compute
+ * shaders.
  *
- * It contains the derived state.
+ * It contains the derived state.  The rasterization state is unused by
+ * compute shaders, and images are only bound for compute shaders.
  *
  * Changes here must be reflected in the lp_jit_context_* macros and
  * lp_jit_init_types function. Changes to the ordering should be avoided.
@@ -135,6 +164,11 @@ struct lp_jit_context
 
    struct lp_jit_texture textures[PIPE_MAX_SHADER_SAMPLER_VIEWS];
    struct lp_jit_sampler samplers[PIPE_MAX_SAMPLERS];
+
+   uint8_t *ssbos[LP_MAX_TGSI_SHADER_BUFFERS];
+   int num_ssbos[LP_MAX_TGSI_SHADER_BUFFERS];
+
+   struct lp_jit_image images[LP_MAX_TGSI_SHADER_IMAGES];
 };
 
 
@@ -153,6 +187,9 @@ enum {
    LP_JIT_CTX_VIEWPORTS,
    LP_JIT_CTX_TEXTURES,
    LP_JIT_CTX_SAMPLERS,
+   LP_JIT_CTX_SSBOS,
+   LP_JIT_CTX_NUM_SSBOS,
+   LP_JIT_CTX_IMAGES,
    LP_JIT_CTX_COUNT
 };
 
@@ -187,6 +224,15 @@ enum {
 #define lp_jit_context_samplers(_gallivm, _ptr) \
    lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CTX_SAMPLERS, "samplers")
 
+#define lp_jit_context_ssbos(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CTX_SSBOS, "ssbos")
+
+#define lp_jit_context_num_ssbos(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CTX_NUM_SSBOS, "num_ssbos")
+
+#define lp_jit_context_images(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CTX_IMAGES, "images")
+
 
 struct lp_jit_thread_data
 {
@@ -233,10 +279,12 @@ enum {
  * @param dady          shader input dady
  * @param color         color buffer
  * @param depth         depth buffer
- * @param mask          mask of visible pixels in block
+ * @param mask          mask of visible pixels in block, 16 bits per sample
  * @param thread_data   task thread data
  * @param stride        color buffer row stride in bytes
  * @param depth_stride  depth buffer row stride in bytes
+ * @param sample_stride color buffer sample stride in bytes
+ * @param depth_sample_stride  depth buffer sample stride in bytes
  */
 typedef void
 (*lp_jit_frag_func)(const struct lp_jit_context *context,
@@ -248,10 +296,44 @@ typedef void
                     const void *dady,
                     uint8_t **color,
                     uint8_t *depth,
-                    uint32_t mask,
+                    uint64_t mask,
                     struct lp_jit_thread_data *thread_data,
                     unsigned *stride,
-                    unsigned depth_stride);
+                    unsigned depth_stride,
+                    unsigned *sample_stride,
+                    unsigned depth_sample_stride);
+
+
+/**
+ * typedef for compute shader function
+ *
+ * Runs one phase (the code between two workgroup barriers) of all the
+ * invocations of a workgroup.
+ *
+ * @param context       jit context
+ * @param block_id_x    workgroup id x
+ * @param block_id_y    workgroup id y
+ * @param block_id_z    workgroup id z
+ * @param grid_size_x   number of workgroups in x
+ * @param grid_size_y   number of workgroups in y
+ * @param grid_size_z   number of workgroups in z
+ * @param shared        workgroup shared memory
+ * @param shared_size   size of the shared memory in bytes
+ * @param temps         temporaries kept across phases, or NULL
+ * @param thread_data   task thread data
+ */
+typedef void
+(*lp_jit_cs_func)(const struct lp_jit_context *context,
+                  uint32_t block_id_x,
+                  uint32_t block_id_y,
+                  uint32_t block_id_z,
+                  uint32_t grid_size_x,
+                  uint32_t grid_size_y,
+                  uint32_t grid_size_z,
+                  uint8_t *shared,
+                  uint32_t shared_size,
+                  void *temps,
+                  struct lp_jit_thread_data *thread_data);
 
 
 void
@@ -266,4 +348,8 @@ void
 lp_jit_init_types(struct lp_fragment_shader_variant *lp);
 
 
+void
+lp_jit_init_cs_types(struct lp_compute_shader_variant *lp);
+
+
 #endif /* LP_JIT_H */
@@ -61,7 +61,19 @@
 #define LP_MAX_WIDTH  (1 << (LP_MAX_TEXTURE_LEVELS - 1))
 
 
-#define LP_MAX_THREADS 16
+/**
+ * Number of samples of multisample surfaces.  This is the only sample
+ * count supported besides single-sampled.  The 16-bit coverage mask of
+ * each sample of a 4x4 block is packed into a 64-bit mask.
+ */
+#define LP_MAX_SAMPLES 4
+
+
+/**
+ * Upper bound for LP_NUM_THREADS.  Per-thread state is allocated for the
+ * actual number of threads, so this is only a sanity limit.
+ */
+#define LP_MAX_THREADS 256
 
 
 /**
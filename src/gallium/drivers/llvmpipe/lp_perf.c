@@ -98,6 +98,14 @@ lp_print_counters(void)
       debug_printf("llvmpipe:   nr_empty_4x4:               %9u (%3.0f%% of %u)\n", lp_count.nr_empty_4, p1, total_4);
       debug_printf("llvmpipe:   nr_non_empty_4x4:           %9u (%3.0f%% of %u)\n", lp_count.nr_non_empty_4, p4, total_4);
 
+      debug_printf("llvmpipe: nr_hiz_rejected_64x64:        %9u\n", lp_count.nr_hiz_rejected_64);
+      debug_printf("llvmpipe: nr_hiz_rejected_16x16:        %9u\n", lp_count.nr_hiz_rejected_16);
+
+      debug_printf("llvmpipe: nr_scenes:                    %9u\n", lp_count.nr_scenes);
+      debug_printf("llvmpipe:   nr_scene_overlaps:          %9u\n", lp_count.nr_scene_overlaps);
+      debug_printf("llvmpipe:   nr_scene_waits:             %9u\n", lp_count.nr_scene_waits);
+      debug_printf("llvmpipe:   total scene wait time:      %.2f sec\n", lp_count.scene_wait_time / 1000000.0);
+
       debug_printf("llvmpipe: nr_color_tile_clear:          %9u\n", lp_count.nr_color_tile_clear);
       debug_printf("llvmpipe: nr_color_tile_load:           %9u\n", lp_count.nr_color_tile_load);
       debug_printf("llvmpipe: nr_color_tile_store:          %9u\n", lp_count.nr_color_tile_store);
@@ -105,6 +113,8 @@ lp_print_counters(void)
       debug_printf("llvmpipe: nr_llvm_compiles:             %u\n", lp_count.nr_llvm_compiles);
       debug_printf("llvmpipe: total LLVM compile time:      %.2f sec\n", lp_count.llvm_compile_time / 1000000.0);
       debug_printf("llvmpipe: average LLVM compile time:    %.2f sec\n", lp_count.llvm_compile_time / 1000000.0 / lp_count.nr_llvm_compiles);
+      debug_printf("llvmpipe: nr_disk_cache_hits:           %u\n", lp_count.nr_disk_cache_hits);
+      debug_printf("llvmpipe: nr_disk_cache_misses:         %u\n", lp_count.nr_disk_cache_misses);
 
    }
 }
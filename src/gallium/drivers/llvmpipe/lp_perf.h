@@ -56,8 +56,17 @@ struct lp_counters
    unsigned nr_fully_covered_4;
    unsigned nr_partially_covered_4;
    unsigned nr_non_empty_4;
+   unsigned nr_hiz_rejected_64; /**< whole tiles rejected by hierarchical Z */
+   unsigned nr_hiz_rejected_16; /**< 16x16 blocks rejected by hierarchical Z */
    unsigned nr_llvm_compiles;
    int64_t llvm_compile_time;  /**< total, in microseconds */
+   unsigned nr_disk_cache_hits;
+   unsigned nr_disk_cache_misses;
+
+   unsigned nr_scenes;
+   unsigned nr_scene_overlaps;  /**< queued while an earlier one rasterized */
+   unsigned nr_scene_waits;     /**< setup had to wait for a free scene */
+   int64_t scene_wait_time;     /**< total, in microseconds */
 
    unsigned nr_color_tile_clear;
    unsigned nr_color_tile_load;
@@ -57,6 +57,14 @@ const struct lp_rasterizer_task *jit_task = NULL;
 #endif
 
 
+const int lp_sample_offsets[LP_MAX_SAMPLES][2] = {
+   { -2, -6 },
+   {  6, -2 },
+   { -6,  2 },
+   {  2,  6 }
+};
+
+
 /**
  * Begin rasterizing a scene.
  * Called once per scene by one thread.
@@ -77,9 +85,18 @@ lp_rast_begin( struct lp_rasterizer *rast,
 static void
 lp_rast_end( struct lp_rasterizer *rast )
 {
-   lp_scene_end_rasterization( rast->curr_scene );
+   struct lp_scene *scene = rast->curr_scene;
+
+   lp_scene_end_rasterization( scene );
 
    rast->curr_scene = NULL;
+
+   /* Setup may recycle the scene as soon as the fence is complete, so
+    * this must be the last time the rasterizer touches it.
+    */
+   if (scene->fence) {
+      lp_fence_signal(scene->fence);
+   }
 }
 
 
@@ -109,6 +126,10 @@ lp_rast_tile_begin(struct lp_rasterizer_task *task,
    task->thread_data.vis_counter = 0;
    task->ps_invocations = 0;
 
+   for (i = 0; i < ARRAY_SIZE(task->hiz_max); i++) {
+      task->hiz_max[i] = LP_HIZ_UNKNOWN;
+   }
+
    for (i = 0; i < task->scene->fb.nr_cbufs; i++) {
       if (task->scene->fb.cbufs[i]) {
          task->color_tiles[i] = scene->cbufs[i].map +
@@ -137,6 +158,8 @@ lp_rast_clear_color(struct lp_rasterizer_task *task,
    unsigned cbuf = arg.clear_rb->cbuf;
    union util_color uc;
    enum pipe_format format;
+   unsigned num_slices = scene->fb_max_layer + 1;
+   unsigned slice_stride = scene->cbufs[cbuf].layer_stride;
 
    /* we never bin clear commands for non-existing buffers */
    assert(cbuf < scene->fb.nr_cbufs);
@@ -152,17 +175,22 @@ lp_rast_clear_color(struct lp_rasterizer_task *task,
    LP_DBG(DEBUG_RAST, "%s clear value (target format %d) raw 0x%x,0x%x,0x%x,0x%x\n",
           __FUNCTION__, format, uc.ui[0], uc.ui[1], uc.ui[2], uc.ui[3]);
 
+   /* the samples of each layer are consecutive images, clear them all */
+   if (scene->cbufs[cbuf].sample_stride) {
+      num_slices *= scene->fb_max_samples;
+      slice_stride = scene->cbufs[cbuf].sample_stride;
+   }
 
    util_fill_box(scene->cbufs[cbuf].map,
                  format,
                  scene->cbufs[cbuf].stride,
-                 scene->cbufs[cbuf].layer_stride,
+                 slice_stride,
                  task->x,
                  task->y,
                  0,
                  task->width,
                  task->height,
-                 scene->fb_max_layer + 1,
+                 num_slices,
                  &uc);
 
    /* this will increase for each rb which probably doesn't mean much */
@@ -200,12 +228,20 @@ lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
 
    if (scene->fb.zsbuf) {
       unsigned layer;
+      unsigned num_slices = scene->fb_max_layer + 1;
+      unsigned slice_stride = scene->zsbuf.layer_stride;
       uint8_t *dst_layer = task->depth_tile;
       block_size = util_format_get_blocksize(scene->fb.zsbuf->format);
 
       clear_value &= clear_mask;
 
-      for (layer = 0; layer <= scene->fb_max_layer; layer++) {
+      /* the samples of each layer are consecutive images, clear them all */
+      if (scene->zsbuf.sample_stride) {
+         num_slices *= scene->fb_max_samples;
+         slice_stride = scene->zsbuf.sample_stride;
+      }
+
+      for (layer = 0; layer < num_slices; layer++) {
          dst = dst_layer;
 
          switch (block_size) {
@@ -279,7 +315,27 @@ lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
             assert(0);
             break;
          }
-         dst_layer += scene->zsbuf.layer_stride;
+         dst_layer += slice_stride;
+      }
+
+      /* update the hierarchical Z bounds to the cleared depth */
+      if (util_format_has_depth(util_format_description(scene->fb.zsbuf->format))) {
+         const struct util_format_description *desc =
+            util_format_description(scene->fb.zsbuf->format);
+         uint64_t zmask = util_pack64_mask_z(scene->fb.zsbuf->format, ~0);
+
+         if (clear_mask64 & zmask) {
+            /* a partial depth clear leaves nothing we can bound */
+            float depth = LP_HIZ_UNKNOWN;
+
+            if ((clear_mask64 & zmask) == zmask) {
+               desc->unpack_z_float(&depth, 0, (const uint8_t *)&clear_value64,
+                                    0, 1, 1);
+            }
+            for (i = 0; i < ARRAY_SIZE(task->hiz_max); i++) {
+               task->hiz_max[i] = depth;
+            }
+         }
       }
    }
 }
@@ -300,6 +356,7 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
    const struct lp_rast_state *state;
    struct lp_fragment_shader_variant *variant;
    const unsigned tile_x = task->x, tile_y = task->y;
+   unsigned rejected = 0, nr_rejected = 0, nr_blocks = 0;
    unsigned x, y;
 
    if (inputs->disable) {
@@ -316,24 +373,46 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
    }
    variant = state->variant;
 
+   /* find the 16x16 blocks hidden behind what was already drawn */
+   for (y = 0; y < task->height; y += 16) {
+      for (x = 0; x < task->width; x += 16) {
+         nr_blocks++;
+         if (lp_rast_hiz_reject(task, inputs, tile_x + x, tile_y + y)) {
+            rejected |= 1 << ((y / 16) * (TILE_SIZE / 16) + x / 16);
+            nr_rejected++;
+         }
+      }
+   }
+   if (nr_rejected == nr_blocks) {
+      LP_COUNT(nr_hiz_rejected_64);
+      return;
+   }
+
    /* render the whole 64x64 tile in 4x4 chunks */
    for (y = 0; y < task->height; y += 4){
       for (x = 0; x < task->width; x += 4) {
          uint8_t *color[PIPE_MAX_COLOR_BUFS];
          unsigned stride[PIPE_MAX_COLOR_BUFS];
+         unsigned sample_stride[PIPE_MAX_COLOR_BUFS];
          uint8_t *depth = NULL;
          unsigned depth_stride = 0;
+         unsigned depth_sample_stride = 0;
          unsigned i;
 
+         if (rejected & (1 << ((y / 16) * (TILE_SIZE / 16) + x / 16)))
+            continue;
+
          /* color buffer */
          for (i = 0; i < scene->fb.nr_cbufs; i++){
             if (scene->fb.cbufs[i]) {
                stride[i] = scene->cbufs[i].stride;
+               sample_stride[i] = scene->cbufs[i].sample_stride;
                color[i] = lp_rast_get_color_block_pointer(task, i, tile_x + x,
                                                           tile_y + y, inputs->layer);
             }
             else {
                stride[i] = 0;
+               sample_stride[i] = 0;
                color[i] = NULL;
             }
          }
@@ -343,6 +422,7 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
             depth = lp_rast_get_depth_block_pointer(task, tile_x + x,
                                                     tile_y + y, inputs->layer);
             depth_stride = scene->zsbuf.stride;
+            depth_sample_stride = scene->zsbuf.sample_stride;
          }
 
          /* Propagate non-interpolated raster state. */
@@ -358,13 +438,22 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
                                             GET_DADY(inputs),
                                             color,
                                             depth,
-                                            0xffff,
+                                            LP_RAST_FULL_MASK,
                                             &task->thread_data,
                                             stride,
-                                            depth_stride);
+                                            depth_stride,
+                                            sample_stride,
+                                            depth_sample_stride);
          END_JIT_CALL();
       }
    }
+
+   for (y = 0; y < task->height; y += 16) {
+      for (x = 0; x < task->width; x += 16) {
+         if (!(rejected & (1 << ((y / 16) * (TILE_SIZE / 16) + x / 16))))
+            lp_rast_hiz_update(task, inputs, tile_x + x, tile_y + y);
+      }
+   }
 }
 
 
@@ -398,15 +487,17 @@ void
 lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
                          const struct lp_rast_shader_inputs *inputs,
                          unsigned x, unsigned y,
-                         unsigned mask)
+                         uint64_t mask)
 {
    const struct lp_rast_state *state = task->state;
    struct lp_fragment_shader_variant *variant = state->variant;
    const struct lp_scene *scene = task->scene;
    uint8_t *color[PIPE_MAX_COLOR_BUFS];
    unsigned stride[PIPE_MAX_COLOR_BUFS];
+   unsigned sample_stride[PIPE_MAX_COLOR_BUFS];
    uint8_t *depth = NULL;
    unsigned depth_stride = 0;
+   unsigned depth_sample_stride = 0;
    unsigned i;
 
    assert(state);
@@ -424,11 +515,13 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
    for (i = 0; i < scene->fb.nr_cbufs; i++) {
       if (scene->fb.cbufs[i]) {
          stride[i] = scene->cbufs[i].stride;
+         sample_stride[i] = scene->cbufs[i].sample_stride;
          color[i] = lp_rast_get_color_block_pointer(task, i, x, y,
                                                     inputs->layer);
       }
       else {
          stride[i] = 0;
+         sample_stride[i] = 0;
          color[i] = NULL;
       }
    }
@@ -436,6 +529,7 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
    /* depth buffer */
    if (scene->zsbuf.map) {
       depth_stride = scene->zsbuf.stride;
+      depth_sample_stride = scene->zsbuf.sample_stride;
       depth = lp_rast_get_depth_block_pointer(task, x, y, inputs->layer);
    }
 
@@ -466,7 +560,9 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
                                             mask,
                                             &task->thread_data,
                                             stride,
-                                            depth_stride);
+                                            depth_stride,
+                                            sample_stride,
+                                            depth_sample_stride);
       END_JIT_CALL();
    }
 }
@@ -539,6 +635,14 @@ lp_rast_set_state(struct lp_rasterizer_task *task,
                   const union lp_rast_cmd_arg arg)
 {
    task->state = arg.state;
+
+   /* depth values may grow, the hierarchical Z bounds no longer hold */
+   if (task->state->variant->hiz_reset) {
+      unsigned i;
+      for (i = 0; i < ARRAY_SIZE(task->hiz_max); i++) {
+         task->hiz_max[i] = LP_HIZ_UNKNOWN;
+      }
+   }
 }
 
 
@@ -708,7 +812,10 @@ rasterize_scene(struct lp_rasterizer_task *task,
    }
 #endif
 
-   if (scene->fence) {
+   /* Thread 0 signals from lp_rast_end(), after the scene has been
+    * unmapped.
+    */
+   if (scene->fence && task->thread_index != 0) {
       lp_fence_signal(scene->fence);
    }
 
@@ -760,29 +867,14 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
 }
 
 
-void
-lp_rast_finish( struct lp_rasterizer *rast )
-{
-   if (rast->num_threads == 0) {
-      /* nothing to do */
-   }
-   else {
-      int i;
-
-      /* wait for work to complete */
-      for (i = 0; i < rast->num_threads; i++) {
-         pipe_semaphore_wait(&rast->tasks[i].work_done);
-      }
-   }
-}
-
-
 /**
  * This is the thread's main entrypoint.
  * It's a simple loop:
  *   1. wait for work
  *   2. do work
- *   3. signal that we're done
+ *
+ * Completion is reported through the scene's fence; setup doesn't wait for
+ * the rasterizer otherwise, so it can bin the next scene meanwhile.
  */
 static int
 thread_function(void *init_data)
@@ -841,11 +933,8 @@ thread_function(void *init_data)
          lp_rast_end( rast );
       }
 
-      /* signal done with work */
       if (debug)
          debug_printf("thread %d done working\n", task->thread_index);
-
-      pipe_semaphore_signal(&task->work_done);
    }
 
 #ifdef _WIN32
@@ -896,6 +985,18 @@ lp_rast_create( unsigned num_threads )
       goto no_full_scenes;
    }
 
+   rast->tasks = CALLOC(MAX2(1, num_threads), sizeof *rast->tasks);
+   if (!rast->tasks) {
+      goto no_tasks;
+   }
+
+   if (num_threads) {
+      rast->threads = CALLOC(num_threads, sizeof *rast->threads);
+      if (!rast->threads) {
+         goto no_thread_data_cache;
+      }
+   }
+
    for (i = 0; i < MAX2(1, num_threads); i++) {
       struct lp_rasterizer_task *task = &rast->tasks[i];
       task->rast = rast;
@@ -923,12 +1024,15 @@ lp_rast_create( unsigned num_threads )
    return rast;
 
 no_thread_data_cache:
-   for (i = 0; i < MAX2(1, rast->num_threads); i++) {
+   for (i = 0; i < MAX2(1, num_threads); i++) {
       if (rast->tasks[i].thread_data.cache) {
          align_free(rast->tasks[i].thread_data.cache);
       }
    }
 
+   FREE(rast->threads);
+   FREE(rast->tasks);
+no_tasks:
    lp_scene_queue_destroy(rast->full_scenes);
 no_full_scenes:
    FREE(rast);
@@ -979,6 +1083,8 @@ void lp_rast_destroy( struct lp_rasterizer *rast )
 
    lp_scene_queue_destroy(rast->full_scenes);
 
+   FREE(rast->threads);
+   FREE(rast->tasks);
    FREE(rast);
 }
 
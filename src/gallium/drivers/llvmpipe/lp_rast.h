@@ -68,6 +68,20 @@ struct cmd_bin;
 
 #define LP_MAX_ACTIVE_BINNED_QUERIES 64
 
+/**
+ * Coverage mask of all pixels of a 4x4 block, for all samples.
+ * Sample s of pixel i is bit 16 * s + i.
+ */
+#define LP_RAST_FULL_MASK 0xffffffffffffffffULL
+
+/**
+ * Positions of the LP_MAX_SAMPLES samples of multisample rendering,
+ * in 1/16th of a pixel relative to the pixel center (the standard
+ * D3D 4x pattern).  Shading and interpolation always happen at the
+ * pixel center.
+ */
+extern const int lp_sample_offsets[][2];
+
 #define IMUL64(a, b) (((int64_t)(a)) * ((int64_t)(b)))
 
 struct lp_rasterizer_task;
@@ -100,7 +114,8 @@ struct lp_rast_shader_inputs {
    unsigned frontfacing:1;      /** True for front-facing */
    unsigned disable:1;          /** Partially binned, disable this command */
    unsigned opaque:1;           /** Is opaque */
-   unsigned pad0:29;            /* wasted space */
+   unsigned center_coverage:1;  /** Multisampling off, use pixel center coverage */
+   unsigned pad0:28;            /* wasted space */
    unsigned stride;             /* how much to advance data between a0, dadx, dady */
    unsigned layer;              /* the layer to render to (from gs, already clamped) */
    unsigned viewport_index;     /* the active viewport index (from gs, already clamped) */
@@ -124,6 +139,18 @@ struct lp_rast_plane {
    uint32_t pad;
 };
 
+/**
+ * Difference of the edge function value at sample s of a pixel to the
+ * value at the pixel center.  Exact since dcdx and dcdy are multiples of
+ * FIXED_ONE and the offsets are in 1/16th pixels.
+ */
+static inline int64_t
+lp_rast_sample_offset(const struct lp_rast_plane *plane, unsigned s)
+{
+   return (IMUL64(plane->dcdy, lp_sample_offsets[s][1]) -
+           IMUL64(plane->dcdx, lp_sample_offsets[s][0])) / 16;
+}
+
 /**
  * Rasterization information for a triangle known to be in this bin,
  * plus inputs to run the shader:
@@ -166,9 +193,6 @@ void
 lp_rast_queue_scene( struct lp_rasterizer *rast,
                      struct lp_scene *scene );
 
-void
-lp_rast_finish( struct lp_rasterizer *rast );
-
 
 union lp_rast_cmd_arg {
    const struct lp_rast_shader_inputs *shade_tile;
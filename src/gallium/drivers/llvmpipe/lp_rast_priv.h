@@ -28,6 +28,7 @@
 #ifndef LP_RAST_PRIV_H
 #define LP_RAST_PRIV_H
 
+#include <float.h>
 #include "util/u_format.h"
 #include "util/u_thread.h"
 #include "gallivm/lp_bld_debug.h"
@@ -37,11 +38,15 @@
 #include "lp_state.h"
 #include "lp_texture.h"
 #include "lp_limits.h"
+#include "lp_perf.h"
 
 
 #define TILE_VECTOR_HEIGHT 4
 #define TILE_VECTOR_WIDTH 4
 
+/** Hierarchical Z bound of a block whose depth values are not known */
+#define LP_HIZ_UNKNOWN FLT_MAX
+
 /* If we crash in a jitted function, we can examine jit_line and jit_state
  * to get some info.  This is not thread-safe, however.
  */
@@ -102,6 +107,13 @@ struct lp_rasterizer_task
    uint64_t ps_invocations;
    uint8_t ps_inv_multiplier;
 
+   /**
+    * Hierarchical Z: upper bound of the depth values of the first layer in
+    * each 16x16 block of the tile, or LP_HIZ_UNKNOWN.  Only valid while
+    * the tile is being rasterized.
+    */
+   float hiz_max[(TILE_SIZE / 16) * (TILE_SIZE / 16)];
+
    pipe_semaphore work_ready;
    pipe_semaphore work_done;
 };
@@ -123,11 +135,11 @@ struct lp_rasterizer
    /** The scene currently being rasterized by the threads */
    struct lp_scene *curr_scene;
 
-   /** A task object for each rasterization thread */
-   struct lp_rasterizer_task tasks[LP_MAX_THREADS];
+   /** A task object for each rasterization thread, MAX2(1, num_threads) */
+   struct lp_rasterizer_task *tasks;
 
    unsigned num_threads;
-   thrd_t threads[LP_MAX_THREADS];
+   thrd_t *threads;
 
    /** For synchronizing the rasterization threads */
    util_barrier barrier;
@@ -138,7 +150,7 @@ void
 lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
                          const struct lp_rast_shader_inputs *inputs,
                          unsigned x, unsigned y,
-                         unsigned mask);
+                         uint64_t mask);
 
 
 /**
@@ -217,6 +229,86 @@ lp_rast_get_depth_block_pointer(struct lp_rasterizer_task *task,
 
 
 
+/**
+ * Depth range of the primitive plane over the 16x16 block at x, y.
+ *
+ * The block is extended by one pixel on each side so that the range covers
+ * the pixel center offset and the sample positions, and the returned error
+ * bounds the rounding of the fragment shader's own interpolation.
+ */
+static inline void
+lp_rast_hiz_block_range(const struct lp_rast_shader_inputs *inputs,
+                        int x, int y,
+                        float *zmin, float *zmax, float *err)
+{
+   const double a0 = GET_A0(inputs)[0][2];
+   const double dzdx = GET_DADX(inputs)[0][2];
+   const double dzdy = GET_DADY(inputs)[0][2];
+   const double z = a0 + dzdx * (x - 1) + dzdy * (y - 1);
+   const double zx = dzdx * 18;
+   const double zy = dzdy * 18;
+
+   *zmin = (float)(z + MIN2(zx, 0.0) + MIN2(zy, 0.0));
+   *zmax = (float)(z + MAX2(zx, 0.0) + MAX2(zy, 0.0));
+   *err = (float)((fabs(a0) + fabs(dzdx) * (x + 17) + fabs(dzdy) * (y + 17)) *
+                  (1.0 / (1 << 20)));
+}
+
+
+/**
+ * Check whether every fragment of the 16x16 block at x, y will fail the
+ * depth test, according to the block's hierarchical Z bound.
+ */
+static inline boolean
+lp_rast_hiz_reject(struct lp_rasterizer_task *task,
+                   const struct lp_rast_shader_inputs *inputs,
+                   int x, int y)
+{
+   const struct lp_fragment_shader_variant *variant = task->state->variant;
+   const unsigned block = ((y % TILE_SIZE) / 16) * (TILE_SIZE / 16) +
+                          (x % TILE_SIZE) / 16;
+   float zmin, zmax, err, bound;
+
+   if (!variant->hiz_test || inputs->layer ||
+       task->hiz_max[block] == LP_HIZ_UNKNOWN)
+      return FALSE;
+
+   lp_rast_hiz_block_range(inputs, x, y, &zmin, &zmax, &err);
+   bound = task->hiz_max[block] + task->scene->zsbuf.depth_eps + err;
+
+   if (variant->key.depth.func == PIPE_FUNC_LESS ? zmin >= bound
+                                                 : zmin > bound) {
+      LP_COUNT(nr_hiz_rejected_16);
+      return TRUE;
+   }
+   return FALSE;
+}
+
+
+/**
+ * Update the hierarchical Z bound of a 16x16 block after all its pixels
+ * were shaded.  Every pixel now holds at most the primitive's depth.
+ */
+static inline void
+lp_rast_hiz_update(struct lp_rasterizer_task *task,
+                   const struct lp_rast_shader_inputs *inputs,
+                   int x, int y)
+{
+   const struct lp_fragment_shader_variant *variant = task->state->variant;
+   const unsigned block = ((y % TILE_SIZE) / 16) * (TILE_SIZE / 16) +
+                          (x % TILE_SIZE) / 16;
+   float zmin, zmax, err;
+
+   if (!variant->hiz_update || inputs->layer)
+      return;
+
+   lp_rast_hiz_block_range(inputs, x, y, &zmin, &zmax, &err);
+   zmax += task->scene->zsbuf.depth_eps + err;
+   if (zmax < task->hiz_max[block])
+      task->hiz_max[block] = zmax;
+}
+
+
 /**
  * Shade all pixels in a 4x4 block.  The fragment code omits the
  * triangle in/out tests.
@@ -232,19 +324,23 @@ lp_rast_shade_quads_all( struct lp_rasterizer_task *task,
    struct lp_fragment_shader_variant *variant = state->variant;
    uint8_t *color[PIPE_MAX_COLOR_BUFS];
    unsigned stride[PIPE_MAX_COLOR_BUFS];
+   unsigned sample_stride[PIPE_MAX_COLOR_BUFS];
    uint8_t *depth = NULL;
    unsigned depth_stride = 0;
+   unsigned depth_sample_stride = 0;
    unsigned i;
 
    /* color buffer */
    for (i = 0; i < scene->fb.nr_cbufs; i++) {
       if (scene->fb.cbufs[i]) {
          stride[i] = scene->cbufs[i].stride;
+         sample_stride[i] = scene->cbufs[i].sample_stride;
          color[i] = lp_rast_get_color_block_pointer(task, i, x, y,
                                                     inputs->layer);
       }
       else {
          stride[i] = 0;
+         sample_stride[i] = 0;
          color[i] = NULL;
       }
    }
@@ -252,6 +348,7 @@ lp_rast_shade_quads_all( struct lp_rasterizer_task *task,
    if (scene->zsbuf.map) {
       depth = lp_rast_get_depth_block_pointer(task, x, y, inputs->layer);
       depth_stride = scene->zsbuf.stride;
+      depth_sample_stride = scene->zsbuf.sample_stride;
    }
 
    /*
@@ -276,10 +373,12 @@ lp_rast_shade_quads_all( struct lp_rasterizer_task *task,
                                          GET_DADY(inputs),
                                          color,
                                          depth,
-                                         0xffff,
+                                         LP_RAST_FULL_MASK,
                                          &task->thread_data,
                                          stride,
-                                         depth_stride);
+                                         depth_stride,
+                                         sample_stride,
+                                         depth_sample_stride);
       END_JIT_CALL();
    }
 }
@@ -31,6 +31,46 @@
 
 
 
+/**
+ * Multisample version of do_block_4: evaluate the edge functions at each
+ * sample position instead of the pixel centers and pass the coverage of
+ * all samples to the shader.
+ */
+static void
+TAG(do_block_4_ms)(struct lp_rasterizer_task *task,
+                   const struct lp_rast_triangle *tri,
+                   const struct lp_rast_plane *plane,
+                   int x, int y,
+                   const int64_t *c)
+{
+   uint64_t mask = 0;
+   unsigned s;
+   int j;
+
+   for (s = 0; s < LP_MAX_SAMPLES; s++) {
+      unsigned smask = 0xffff;
+
+      for (j = 0; j < NR_PLANES; j++) {
+         const int64_t cs = c[j] + lp_rast_sample_offset(&plane[j], s);
+#ifdef RASTER_64
+         smask &= ~BUILD_MASK_LINEAR(((cs - 1) >> (int64_t)FIXED_ORDER),
+                                     -plane[j].dcdx >> FIXED_ORDER,
+                                     plane[j].dcdy >> FIXED_ORDER);
+#else
+         smask &= ~BUILD_MASK_LINEAR((cs - 1),
+                                     -plane[j].dcdx,
+                                     plane[j].dcdy);
+#endif
+      }
+
+      mask |= (uint64_t)smask << (16 * s);
+   }
+
+   if (mask)
+      lp_rast_shade_quads_mask(task, &tri->inputs, x, y, mask);
+}
+
+
 /**
  * Prototype for a 8 plane rasterizer function.  Will codegenerate
  * several of these.
@@ -49,6 +89,11 @@ TAG(do_block_4)(struct lp_rasterizer_task *task,
    unsigned mask = 0xffff;
    int j;
 
+   if (task->scene->fb_max_samples > 1 && !tri->inputs.center_coverage) {
+      TAG(do_block_4_ms)(task, tri, plane, x, y, c);
+      return;
+   }
+
    for (j = 0; j < NR_PLANES; j++) {
 #ifdef RASTER_64
       mask &= ~BUILD_MASK_LINEAR(((c[j] - 1) >> (int64_t)FIXED_ORDER),
@@ -63,8 +108,15 @@ TAG(do_block_4)(struct lp_rasterizer_task *task,
 
    /* Now pass to the shader:
     */
-   if (mask)
-      lp_rast_shade_quads_mask(task, &tri->inputs, x, y, mask);
+   if (mask) {
+      if (task->scene->fb_max_samples > 1) {
+         /* multisampling is disabled, every sample gets the pixel's coverage */
+         lp_rast_shade_quads_mask(task, &tri->inputs, x, y,
+                                  mask * 0x0001000100010001ULL);
+      }
+      else
+         lp_rast_shade_quads_mask(task, &tri->inputs, x, y, mask);
+   }
 }
 
 /**
@@ -294,13 +346,16 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
       int py = y + iy;
       int64_t cx[NR_PLANES];
 
+      partial_mask &= ~(1 << i);
+
+      if (lp_rast_hiz_reject(task, &tri->inputs, px, py))
+         continue;
+
       for (j = 0; j < NR_PLANES; j++)
          cx[j] = (c[j]
                   - IMUL64(plane[j].dcdx, ix)
                   + IMUL64(plane[j].dcdy, iy));
 
-      partial_mask &= ~(1 << i);
-
       LP_COUNT(nr_partially_covered_16);
       TAG(do_block_16)(task, tri, plane, px, py, cx);
    }
@@ -316,8 +371,12 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
 
       inmask &= ~(1 << i);
 
+      if (lp_rast_hiz_reject(task, &tri->inputs, px, py))
+         continue;
+
       LP_COUNT(nr_fully_covered_16);
       block_full_16(task, tri, px, py);
+      lp_rast_hiz_update(task, &tri->inputs, px, py);
    }
 }
 
@@ -31,6 +31,7 @@
 #include "util/u_inlines.h"
 #include "util/simple_list.h"
 #include "util/u_format.h"
+#include "util/u_atomic.h"
 #include "lp_scene.h"
 #include "lp_fence.h"
 #include "lp_debug.h"
@@ -51,8 +52,9 @@ struct resource_ref {
  * \param queue  the queue to put newly rendered/emptied scenes into
  */
 struct lp_scene *
-lp_scene_create( struct pipe_context *pipe )
+lp_scene_create( struct pipe_context *pipe, unsigned num_binners )
 {
+   unsigned i;
    struct lp_scene *scene = CALLOC_STRUCT(lp_scene);
    if (!scene)
       return NULL;
@@ -62,7 +64,19 @@ lp_scene_create( struct pipe_context *pipe )
    scene->data.head =
       CALLOC_STRUCT(data_block);
 
-   (void) mtx_init(&scene->mutex, mtx_plain);
+   if (num_binners) {
+      scene->bin_data = CALLOC(num_binners, sizeof *scene->bin_data);
+      if (!scene->bin_data) {
+         FREE(scene->data.head);
+         FREE(scene);
+         return NULL;
+      }
+      scene->num_binners = num_binners;
+
+      for (i = 0; i < num_binners; i++) {
+         scene->bin_data[i].head = CALLOC_STRUCT(data_block);
+      }
+   }
 
 #ifdef DEBUG
    /* Do some scene limit sanity checks here */
@@ -89,10 +103,17 @@ lp_scene_create( struct pipe_context *pipe )
 void
 lp_scene_destroy(struct lp_scene *scene)
 {
+   unsigned i;
+
    lp_fence_reference(&scene->fence, NULL);
-   mtx_destroy(&scene->mutex);
    assert(scene->data.head->next == NULL);
    FREE(scene->data.head);
+   FREE(scene->tile);
+   for (i = 0; i < scene->num_binners; i++) {
+      assert(scene->bin_data[i].head->next == NULL);
+      FREE(scene->bin_data[i].head);
+   }
+   FREE(scene->bin_data);
    FREE(scene);
 }
 
@@ -104,14 +125,11 @@ lp_scene_destroy(struct lp_scene *scene)
 boolean
 lp_scene_is_empty(struct lp_scene *scene )
 {
-   unsigned x, y;
+   unsigned i;
 
-   for (y = 0; y < TILES_Y; y++) {
-      for (x = 0; x < TILES_X; x++) {
-         const struct cmd_bin *bin = lp_scene_get_bin(scene, x, y);
-         if (bin->head) {
-            return FALSE;
-         }
+   for (i = 0; i < scene->max_bins; i++) {
+      if (scene->tile[i].head) {
+         return FALSE;
       }
    }
    return TRUE;
@@ -160,6 +178,7 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
       if (!cbuf) {
          scene->cbufs[i].stride = 0;
          scene->cbufs[i].layer_stride = 0;
+         scene->cbufs[i].sample_stride = 0;
          scene->cbufs[i].map = NULL;
          continue;
       }
@@ -169,6 +188,7 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
                                                            cbuf->u.tex.level);
          scene->cbufs[i].layer_stride = llvmpipe_layer_stride(cbuf->texture,
                                                               cbuf->u.tex.level);
+         scene->cbufs[i].sample_stride = llvmpipe_sample_stride(cbuf->texture);
 
          scene->cbufs[i].map = llvmpipe_resource_map(cbuf->texture,
                                                      cbuf->u.tex.level,
@@ -181,6 +201,7 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
          unsigned pixstride = util_format_get_blocksize(cbuf->format);
          scene->cbufs[i].stride = cbuf->texture->width0;
          scene->cbufs[i].layer_stride = 0;
+         scene->cbufs[i].sample_stride = 0;
          scene->cbufs[i].map = lpr->data;
          scene->cbufs[i].map += cbuf->u.buf.first_element * pixstride;
          scene->cbufs[i].format_bytes = util_format_get_blocksize(cbuf->format);
@@ -191,12 +212,27 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
       struct pipe_surface *zsbuf = scene->fb.zsbuf;
       scene->zsbuf.stride = llvmpipe_resource_stride(zsbuf->texture, zsbuf->u.tex.level);
       scene->zsbuf.layer_stride = llvmpipe_layer_stride(zsbuf->texture, zsbuf->u.tex.level);
+      scene->zsbuf.sample_stride = llvmpipe_sample_stride(zsbuf->texture);
 
       scene->zsbuf.map = llvmpipe_resource_map(zsbuf->texture,
                                                zsbuf->u.tex.level,
                                                zsbuf->u.tex.first_layer,
                                                LP_TEX_USAGE_READ_WRITE);
       scene->zsbuf.format_bytes = util_format_get_blocksize(zsbuf->format);
+
+      {
+         const struct util_format_description *desc =
+            util_format_description(zsbuf->format);
+         const unsigned z = desc->swizzle[0];
+
+         if (z <= PIPE_SWIZZLE_W && desc->channel[z].normalized) {
+            scene->zsbuf.depth_eps =
+               (float)(1.0 / ((1ULL << desc->channel[z].size) - 1));
+         }
+         else {
+            scene->zsbuf.depth_eps = 0.0f;
+         }
+      }
    }
 }
 
@@ -204,7 +240,27 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
 
 
 /**
- * Free all the temporary data in a scene.
+ * Free all but the current data block of the list, and empty that one.
+ */
+static void
+free_data_blocks(struct data_block_list *list)
+{
+   struct data_block *block, *tmp;
+
+   for (block = list->head->next; block; block = tmp) {
+      tmp = block->next;
+      FREE(block);
+   }
+
+   list->head->next = NULL;
+   list->head->used = 0;
+}
+
+
+/**
+ * Unmap the framebuffer and reset the bins once all rasterizer threads are
+ * done with the scene.  Called by the rasterizer; the scene still holds on
+ * to its data, resources and fence until lp_scene_recycle().
  */
 void
 lp_scene_end_rasterization(struct lp_scene *scene )
@@ -248,12 +304,24 @@ lp_scene_end_rasterization(struct lp_scene *scene )
     * they will be caught (on debug builds at least) by this assert:
     */
    assert(lp_scene_is_empty(scene));
+}
+
+
+/**
+ * Free all the temporary data in a scene and drop its references, so that
+ * it can be binned again.  Called by setup once the scene's fence has been
+ * signalled, or for a scene which is abandoned without being rasterized.
+ */
+void
+lp_scene_recycle(struct lp_scene *scene)
+{
+   int i;
 
    /* Decrement texture ref counts
     */
    {
       struct resource_ref *ref;
-      int i, j = 0;
+      int j = 0;
 
       for (ref = scene->resources; ref; ref = ref->next) {
          for (i = 0; i < ref->count; i++) {
@@ -276,17 +344,9 @@ lp_scene_end_rasterization(struct lp_scene *scene )
 
    /* Free all scene data blocks:
     */
-   {
-      struct data_block_list *list = &scene->data;
-      struct data_block *block, *tmp;
-
-      for (block = list->head->next; block; block = tmp) {
-         tmp = block->next;
-	 FREE(block);
-      }
-
-      list->head->next = NULL;
-      list->head->used = 0;
+   free_data_blocks(&scene->data);
+   for (i = 0; i < scene->num_binners; i++) {
+      free_data_blocks(&scene->bin_data[i]);
    }
 
    lp_fence_reference(&scene->fence, NULL);
@@ -309,7 +369,10 @@ struct cmd_block *
 lp_scene_new_cmd_block( struct lp_scene *scene,
                         struct cmd_bin *bin )
 {
-   struct cmd_block *block = lp_scene_alloc(scene, sizeof(struct cmd_block));
+   unsigned y = (bin - scene->tile) / scene->tiles_x;
+   struct cmd_block *block =
+      lp_scene_list_alloc(scene, lp_scene_bin_data(scene, y),
+                          sizeof(struct cmd_block));
    if (block) {
       if (bin->tail) {
          bin->tail->next = block;
@@ -328,26 +391,36 @@ lp_scene_new_cmd_block( struct lp_scene *scene,
 
 
 struct data_block *
-lp_scene_new_data_block( struct lp_scene *scene )
+lp_scene_new_data_block( struct lp_scene *scene,
+                         struct data_block_list *list )
 {
-   if (scene->scene_size + DATA_BLOCK_SIZE > LP_SCENE_MAX_SIZE) {
-      if (0) debug_printf("%s: failed\n", __FUNCTION__);
-      scene->alloc_failed = TRUE;
+   struct data_block *block;
+   unsigned size;
+
+   /* Binning threads may be growing their lists concurrently, so reserve
+    * the space of the block before checking and allocating it.
+    */
+   do {
+      size = p_atomic_read(&scene->scene_size);
+      if (size + DATA_BLOCK_SIZE > LP_SCENE_MAX_SIZE) {
+         if (0) debug_printf("%s: failed\n", __FUNCTION__);
+         scene->alloc_failed = TRUE;
+         return NULL;
+      }
+   } while (p_atomic_cmpxchg(&scene->scene_size, size,
+                             size + sizeof *block) != size);
+
+   block = MALLOC_STRUCT(data_block);
+   if (!block) {
+      p_atomic_add(&scene->scene_size, -(int) sizeof *block);
       return NULL;
    }
-   else {
-      struct data_block *block = MALLOC_STRUCT(data_block);
-      if (!block)
-         return NULL;
-      
-      scene->scene_size += sizeof *block;
 
-      block->used = 0;
-      block->next = scene->data.head;
-      scene->data.head = block;
+   block->used = 0;
+   block->next = list->head;
+   list->head = block;
 
-      return block;
-   }
+   return block;
 }
 
 
@@ -360,9 +433,15 @@ lp_scene_data_size( const struct lp_scene *scene )
 {
    unsigned size = 0;
    const struct data_block *block;
+   unsigned i;
    for (block = scene->data.head; block; block = block->next) {
       size += block->used;
    }
+   for (i = 0; i < scene->num_binners; i++) {
+      for (block = scene->bin_data[i].head; block; block = block->next) {
+         size += block->used;
+      }
+   }
    return size;
 }
 
@@ -449,66 +528,46 @@ lp_scene_is_resource_referenced(const struct lp_scene *scene,
 
 
 
-/** advance curr_x,y to the next bin */
-static boolean
-next_bin(struct lp_scene *scene)
-{
-   scene->curr_x++;
-   if (scene->curr_x >= scene->tiles_x) {
-      scene->curr_x = 0;
-      scene->curr_y++;
-   }
-   if (scene->curr_y >= scene->tiles_y) {
-      /* no more bins */
-      return FALSE;
-   }
-   return TRUE;
-}
-
-
 void
 lp_scene_bin_iter_begin( struct lp_scene *scene )
 {
-   scene->curr_x = scene->curr_y = -1;
+   scene->curr_bin = 0;
 }
 
 
 /**
  * Return pointer to next bin to be rendered.
- * The lp_scene::curr_x and ::curr_y fields will be advanced.
+ * The lp_scene::curr_bin counter will be advanced.
  * Multiple rendering threads will call this function to get a chunk
- * of work (a bin) to work on.
+ * of work (a bin) to work on.  Bins are handed out in raster order with
+ * a single atomic increment, so that this does not serialize the threads.
  */
 struct cmd_bin *
 lp_scene_bin_iter_next( struct lp_scene *scene , int *x, int *y)
 {
-   struct cmd_bin *bin = NULL;
+   unsigned num_bins = scene->tiles_x * scene->tiles_y;
+   unsigned i;
 
-   mtx_lock(&scene->mutex);
-
-   if (scene->curr_x < 0) {
-      /* first bin */
-      scene->curr_x = 0;
-      scene->curr_y = 0;
-   }
-   else if (!next_bin(scene)) {
+   i = (unsigned) p_atomic_inc_return(&scene->curr_bin) - 1;
+   if (i >= num_bins) {
       /* no more bins left */
-      goto end;
+      return NULL;
    }
 
-   bin = lp_scene_get_bin(scene, scene->curr_x, scene->curr_y);
-   *x = scene->curr_x;
-   *y = scene->curr_y;
+   *x = i % scene->tiles_x;
+   *y = i / scene->tiles_x;
 
-end:
-   /*printf("return bin %p at %d, %d\n", (void *) bin, *bin_x, *bin_y);*/
-   mtx_unlock(&scene->mutex);
-   return bin;
+   return lp_scene_get_bin(scene, *x, *y);
 }
 
 
-void lp_scene_begin_binning( struct lp_scene *scene,
-                             struct pipe_framebuffer_state *fb, boolean discard )
+/**
+ * Prepare the scene for binning into framebuffer fb.
+ * Returns FALSE if the bins could not be allocated, in which case the
+ * scene has no tiles and must not be binned into.
+ */
+boolean lp_scene_begin_binning( struct lp_scene *scene,
+                                struct pipe_framebuffer_state *fb, boolean discard )
 {
    int i;
    unsigned max_layer = ~0;
@@ -523,6 +582,27 @@ void lp_scene_begin_binning( struct lp_scene *scene,
    assert(scene->tiles_x <= TILES_X);
    assert(scene->tiles_y <= TILES_Y);
 
+   /*
+    * Only allocate bins for the framebuffer extent, so that small
+    * framebuffers don't pay for the worst case and the bins of a row
+    * are contiguous.
+    */
+   if (scene->tiles_x * scene->tiles_y > scene->max_bins) {
+      unsigned num_bins = scene->tiles_x * scene->tiles_y;
+      struct cmd_bin *tile = CALLOC(num_bins, sizeof *tile);
+
+      if (!tile) {
+         /* keep the old bins, the scene is reset with no tiles */
+         scene->tiles_x = 0;
+         scene->tiles_y = 0;
+         return FALSE;
+      }
+
+      FREE(scene->tile);
+      scene->tile = tile;
+      scene->max_bins = num_bins;
+   }
+
    /*
     * Determine how many layers the fb has (used for clamping layer value).
     * OpenGL (but not d3d10) permits different amount of layers per rt, however
@@ -546,6 +626,11 @@ void lp_scene_begin_binning( struct lp_scene *scene,
       max_layer = MIN2(max_layer, zsbuf->u.tex.last_layer - zsbuf->u.tex.first_layer);
    }
    scene->fb_max_layer = max_layer;
+
+   scene->fb_max_samples =
+      util_framebuffer_get_num_samples(fb) > 1 ? LP_MAX_SAMPLES : 1;
+
+   return TRUE;
 }
 
 
@@ -42,8 +42,8 @@
 struct lp_scene_queue;
 struct lp_rast_state;
 
-/* We're limited to 2K by 2K for 32bit fixed point rasterization.
- * Will need a 64-bit version for larger framebuffers.
+/* Maximum number of tiles in each dimension.  Bins are only allocated
+ * for the tiles covered by the current framebuffer though.
  */
 #define TILES_X (LP_MAX_WIDTH / TILE_SIZE)
 #define TILES_Y (LP_MAX_HEIGHT / TILE_SIZE)
@@ -107,11 +107,10 @@ struct cmd_bin {
  * Examples include triangle data and state data.  The commands in
  * the per-tile bins will point to chunks of data in this structure.
  *
- * Include the first block of data statically to ensure we can always
- * initiate a scene without relying on malloc succeeding.
+ * The first block is allocated with the scene and kept when the scene
+ * is recycled.
  */
 struct data_block_list {
-   struct data_block first;
    struct data_block *head;
 };
 
@@ -142,12 +141,17 @@ struct lp_scene {
       uint8_t *map;
       unsigned stride;
       unsigned layer_stride;
+      unsigned sample_stride;
       unsigned format_bytes;
+      float depth_eps;        /**< precision of stored depth values */
    } zsbuf, cbufs[PIPE_MAX_COLOR_BUFS];
 
    /* The amount of layers in the fb (minimum of all attachments) */
    unsigned fb_max_layer;
 
+   /* The number of samples of the fb, 1 or LP_MAX_SAMPLES */
+   unsigned fb_max_samples;
+
    /** the framebuffer to render the scene into */
    struct pipe_framebuffer_state fb;
 
@@ -173,16 +177,31 @@ struct lp_scene {
     */
    unsigned tiles_x, tiles_y;
 
-   int curr_x, curr_y;  /**< for iterating over bins */
-   mtx_t mutex;
+   int curr_bin;  /**< next bin to hand out, see lp_scene_bin_iter_next() */
+
+   /**
+    * The bins of the tiles_x * tiles_y framebuffer tiles, in raster order.
+    * Only grown when a larger framebuffer is bound, see
+    * lp_scene_begin_binning().
+    */
+   struct cmd_bin *tile;
+   unsigned max_bins;
 
-   struct cmd_bin tile[TILES_X][TILES_Y];
    struct data_block_list data;
+
+   /**
+    * With multi-threaded binning, tile row y belongs to binning thread
+    * y % num_binners, and the triangles and command blocks it bins are
+    * allocated from bin_data[y % num_binners].  Zero otherwise.
+    */
+   unsigned num_binners;
+   struct data_block_list *bin_data;
 };
 
 
 
-struct lp_scene *lp_scene_create(struct pipe_context *pipe);
+struct lp_scene *lp_scene_create(struct pipe_context *pipe,
+                                 unsigned num_binners);
 
 void lp_scene_destroy(struct lp_scene *scene);
 
@@ -190,7 +209,8 @@ boolean lp_scene_is_empty(struct lp_scene *scene );
 boolean lp_scene_is_oom(struct lp_scene *scene );
 
 
-struct data_block *lp_scene_new_data_block( struct lp_scene *scene );
+struct data_block *lp_scene_new_data_block( struct lp_scene *scene,
+                                            struct data_block_list *list );
 
 struct cmd_block *lp_scene_new_cmd_block( struct lp_scene *scene,
                                           struct cmd_bin *bin );
@@ -204,13 +224,13 @@ boolean lp_scene_is_resource_referenced(const struct lp_scene *scene,
 
 
 /**
- * Allocate space for a command/data in the bin's data buffer.
+ * Allocate space for a command/data in the given data block list.
  * Grow the block list if needed.
  */
 static inline void *
-lp_scene_alloc( struct lp_scene *scene, unsigned size)
+lp_scene_list_alloc( struct lp_scene *scene, struct data_block_list *list,
+                     unsigned size)
 {
-   struct data_block_list *list = &scene->data;
    struct data_block *block = list->head;
 
    assert(size <= DATA_BLOCK_SIZE);
@@ -222,7 +242,7 @@ lp_scene_alloc( struct lp_scene *scene, unsigned size)
 		   scene->scene_size, LP_SCENE_MAX_SIZE);
 
    if (block->used + size > DATA_BLOCK_SIZE) {
-      block = lp_scene_new_data_block( scene );
+      block = lp_scene_new_data_block( scene, list );
       if (!block) {
          /* out of memory */
          return NULL;
@@ -241,10 +261,10 @@ lp_scene_alloc( struct lp_scene *scene, unsigned size)
  * As above, but with specific alignment.
  */
 static inline void *
-lp_scene_alloc_aligned( struct lp_scene *scene, unsigned size,
-			unsigned alignment )
+lp_scene_list_alloc_aligned( struct lp_scene *scene,
+                             struct data_block_list *list,
+                             unsigned size, unsigned alignment )
 {
-   struct data_block_list *list = &scene->data;
    struct data_block *block = list->head;
 
    assert(block != NULL);
@@ -256,7 +276,7 @@ lp_scene_alloc_aligned( struct lp_scene *scene, unsigned size,
 		   scene->scene_size, LP_SCENE_MAX_SIZE);
        
    if (block->used + size + alignment - 1 > DATA_BLOCK_SIZE) {
-      block = lp_scene_new_data_block( scene );
+      block = lp_scene_new_data_block( scene, list );
       if (!block)
          return NULL;
    }
@@ -270,6 +290,24 @@ lp_scene_alloc_aligned( struct lp_scene *scene, unsigned size,
 }
 
 
+/**
+ * Allocate space for a command/data in the scene's shared data buffer.
+ */
+static inline void *
+lp_scene_alloc( struct lp_scene *scene, unsigned size)
+{
+   return lp_scene_list_alloc(scene, &scene->data, size);
+}
+
+
+static inline void *
+lp_scene_alloc_aligned( struct lp_scene *scene, unsigned size,
+			unsigned alignment )
+{
+   return lp_scene_list_alloc_aligned(scene, &scene->data, size, alignment);
+}
+
+
 /* Put back data if we decide not to use it, eg. culled triangles.
  */
 static inline void
@@ -281,11 +319,24 @@ lp_scene_putback_data( struct lp_scene *scene, unsigned size)
 }
 
 
+/**
+ * Return the data block list that commands for bins in tile row y are
+ * allocated from.
+ */
+static inline struct data_block_list *
+lp_scene_bin_data(struct lp_scene *scene, unsigned y)
+{
+   if (scene->num_binners)
+      return &scene->bin_data[y % scene->num_binners];
+   return &scene->data;
+}
+
+
 /** Return pointer to a particular tile's bin. */
 static inline struct cmd_bin *
 lp_scene_get_bin(struct lp_scene *scene, unsigned x, unsigned y)
 {
-   return &scene->tile[x][y];
+   return &scene->tile[y * scene->tiles_x + x];
 }
 
 
@@ -388,7 +439,7 @@ lp_scene_bin_iter_next( struct lp_scene *scene, int *x, int *y );
 
 /* Begin/end binning of a scene
  */
-void
+boolean
 lp_scene_begin_binning( struct lp_scene *scene,
                         struct pipe_framebuffer_state *fb,
                         boolean discard );
@@ -405,6 +456,9 @@ lp_scene_begin_rasterization(struct lp_scene *scene);
 void
 lp_scene_end_rasterization(struct lp_scene *scene );
 
+void
+lp_scene_recycle(struct lp_scene *scene);
+
 
 
 
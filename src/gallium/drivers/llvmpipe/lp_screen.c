@@ -36,6 +36,11 @@
 #include "pipe/p_screen.h"
 #include "draw/draw_context.h"
 #include "gallivm/lp_bld_type.h"
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_misc.h"
+#include "gallivm/lp_bld_debug.h"
+#include "util/disk_cache.h"
+#include "util/mesa-sha1.h"
 
 #include "os/os_misc.h"
 #include "util/os_time.h"
@@ -48,6 +53,7 @@
 #include "lp_public.h"
 #include "lp_limits.h"
 #include "lp_rast.h"
+#include "lp_perf.h"
 
 #include "state_tracker/sw_winsys.h"
 
@@ -81,6 +87,8 @@ static const struct debug_named_value lp_perf_flags[] = {
    { "no_blend",       PERF_NO_BLEND, NULL },
    { "no_depth",       PERF_NO_DEPTH, NULL },
    { "no_alphatest",   PERF_NO_ALPHATEST, NULL },
+   { "no_hiz",         PERF_NO_HIZ, NULL },
+   { "no_tiled",       PERF_NO_TILED, NULL },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -207,8 +215,11 @@ llvmpipe_get_param(struct pipe_screen *screen, enum pipe_cap param)
       return 330;
    case PIPE_CAP_QUADS_FOLLOW_PROVOKING_VERTEX_CONVENTION:
       return 0;
+   case PIPE_CAP_SHADER_BUFFER_OFFSET_ALIGNMENT:
+      return 4;
    case PIPE_CAP_COMPUTE:
-      return 0;
+      /* atomic compare-and-swap is missing from older C APIs */
+      return HAVE_LLVM >= 0x0309;
    case PIPE_CAP_USER_VERTEX_BUFFERS:
       return 1;
    case PIPE_CAP_VERTEX_BUFFER_OFFSET_4BYTE_ALIGNED_ONLY:
@@ -224,7 +235,7 @@ llvmpipe_get_param(struct pipe_screen *screen, enum pipe_cap param)
    case PIPE_CAP_CONSTANT_BUFFER_OFFSET_ALIGNMENT:
       return 16;
    case PIPE_CAP_TEXTURE_MULTISAMPLE:
-      return 0;
+      return 1;
    case PIPE_CAP_MIN_MAP_BUFFER_ALIGNMENT:
       return 64;
    case PIPE_CAP_TEXTURE_BUFFER_OBJECTS:
@@ -257,7 +268,7 @@ llvmpipe_get_param(struct pipe_screen *screen, enum pipe_cap param)
    case PIPE_CAP_SAMPLER_VIEW_TARGET:
       return 1;
    case PIPE_CAP_FAKE_SW_MSAA:
-      return 1;
+      return 0;
    case PIPE_CAP_TEXTURE_QUERY_LOD:
    case PIPE_CAP_CONDITIONAL_RENDER_INVERTED:
    case PIPE_CAP_TGSI_ARRAY_COMPONENTS:
@@ -318,7 +329,6 @@ llvmpipe_get_param(struct pipe_screen *screen, enum pipe_cap param)
    case PIPE_CAP_MULTI_DRAW_INDIRECT_PARAMS:
    case PIPE_CAP_TGSI_FS_POSITION_IS_SYSVAL:
    case PIPE_CAP_TGSI_FS_FACE_IS_INTEGER_SYSVAL:
-   case PIPE_CAP_SHADER_BUFFER_OFFSET_ALIGNMENT:
    case PIPE_CAP_INVALIDATE_BUFFER:
    case PIPE_CAP_GENERATE_MIPMAP:
    case PIPE_CAP_STRING_MARKER:
@@ -377,6 +387,17 @@ llvmpipe_get_shader_param(struct pipe_screen *screen,
    {
    case PIPE_SHADER_FRAGMENT:
       switch (param) {
+      case PIPE_SHADER_CAP_MAX_SHADER_BUFFERS:
+         return LP_MAX_TGSI_SHADER_BUFFERS;
+      default:
+         return gallivm_get_shader_param(param);
+      }
+   case PIPE_SHADER_COMPUTE:
+      switch (param) {
+      case PIPE_SHADER_CAP_MAX_SHADER_BUFFERS:
+         return LP_MAX_TGSI_SHADER_BUFFERS;
+      case PIPE_SHADER_CAP_MAX_SHADER_IMAGES:
+         return LP_MAX_TGSI_SHADER_IMAGES;
       default:
          return gallivm_get_shader_param(param);
       }
@@ -405,6 +426,59 @@ llvmpipe_get_shader_param(struct pipe_screen *screen,
    }
 }
 
+static int
+llvmpipe_get_compute_param(struct pipe_screen *_screen,
+                           enum pipe_shader_ir ir_type,
+                           enum pipe_compute_cap param,
+                           void *ret)
+{
+   switch (param) {
+   case PIPE_COMPUTE_CAP_IR_TARGET:
+      return 0;
+   case PIPE_COMPUTE_CAP_MAX_GRID_SIZE:
+      if (ret) {
+         uint64_t *grid_size = ret;
+         grid_size[0] = 65535;
+         grid_size[1] = 65535;
+         grid_size[2] = 65535;
+      }
+      return 3 * sizeof(uint64_t) ;
+   case PIPE_COMPUTE_CAP_MAX_BLOCK_SIZE:
+      if (ret) {
+         uint64_t *block_size = ret;
+         block_size[0] = 1024;
+         block_size[1] = 1024;
+         block_size[2] = 1024;
+      }
+      return 3 * sizeof(uint64_t);
+   case PIPE_COMPUTE_CAP_MAX_THREADS_PER_BLOCK:
+      if (ret) {
+         uint64_t *max_threads_per_block = ret;
+         *max_threads_per_block = 1024;
+      }
+      return sizeof(uint64_t);
+   case PIPE_COMPUTE_CAP_MAX_LOCAL_SIZE:
+      if (ret) {
+         uint64_t *max_local_size = ret;
+         *max_local_size = 32768;
+      }
+      return sizeof(uint64_t);
+   case PIPE_COMPUTE_CAP_GRID_DIMENSION:
+   case PIPE_COMPUTE_CAP_MAX_GLOBAL_SIZE:
+   case PIPE_COMPUTE_CAP_MAX_PRIVATE_SIZE:
+   case PIPE_COMPUTE_CAP_MAX_INPUT_SIZE:
+   case PIPE_COMPUTE_CAP_MAX_MEM_ALLOC_SIZE:
+   case PIPE_COMPUTE_CAP_MAX_CLOCK_FREQUENCY:
+   case PIPE_COMPUTE_CAP_MAX_COMPUTE_UNITS:
+   case PIPE_COMPUTE_CAP_IMAGES_SUPPORTED:
+   case PIPE_COMPUTE_CAP_SUBGROUP_SIZE:
+   case PIPE_COMPUTE_CAP_ADDRESS_BITS:
+   case PIPE_COMPUTE_CAP_MAX_VARIABLE_THREADS_PER_BLOCK:
+      break;
+   }
+   return 0;
+}
+
 static float
 llvmpipe_get_paramf(struct pipe_screen *screen, enum pipe_capf param)
 {
@@ -418,7 +492,7 @@ llvmpipe_get_paramf(struct pipe_screen *screen, enum pipe_capf param)
    case PIPE_CAPF_MAX_POINT_WIDTH_AA:
       return 255.0; /* arbitrary */
    case PIPE_CAPF_MAX_TEXTURE_ANISOTROPY:
-      return 16.0; /* not actually signficant at this time */
+      return 16.0; /* see lp_build_sample_aniso() */
    case PIPE_CAPF_MAX_TEXTURE_LOD_BIAS:
       return 16.0; /* arbitrary */
    }
@@ -458,8 +532,21 @@ llvmpipe_is_format_supported( struct pipe_screen *_screen,
           target == PIPE_TEXTURE_CUBE ||
           target == PIPE_TEXTURE_CUBE_ARRAY);
 
-   if (sample_count > 1)
-      return FALSE;
+   if (sample_count > 1) {
+      /*
+       * Multisample surfaces can be rendered to, resolved and fetched from,
+       * but neither shader images nor display targets know about samples.
+       */
+      if (sample_count != LP_MAX_SAMPLES)
+         return FALSE;
+      if (target != PIPE_TEXTURE_2D &&
+          target != PIPE_TEXTURE_2D_ARRAY)
+         return FALSE;
+      if (bind & ~(PIPE_BIND_RENDER_TARGET |
+                   PIPE_BIND_DEPTH_STENCIL |
+                   PIPE_BIND_SAMPLER_VIEW))
+         return FALSE;
+   }
 
    if (bind & PIPE_BIND_RENDER_TARGET) {
       if (format_desc->colorspace == UTIL_FORMAT_COLORSPACE_SRGB) {
@@ -500,6 +587,16 @@ llvmpipe_is_format_supported( struct pipe_screen *_screen,
       }
    }
 
+   if (bind & PIPE_BIND_SHADER_IMAGE) {
+      /* images are read and written with the generic format code */
+      if (format_desc->colorspace != UTIL_FORMAT_COLORSPACE_RGB)
+         return FALSE;
+
+      if (format_desc->layout != UTIL_FORMAT_LAYOUT_PLAIN &&
+          format != PIPE_FORMAT_R11G11B10_FLOAT)
+         return FALSE;
+   }
+
    if (bind & PIPE_BIND_DISPLAY_TARGET) {
       if(!winsys->is_displaytarget_format_supported(winsys, bind, format))
          return FALSE;
@@ -564,8 +661,16 @@ llvmpipe_destroy_screen( struct pipe_screen *_screen )
    if (screen->rast)
       lp_rast_destroy(screen->rast);
 
+   if (util_queue_is_initialized(&screen->compile_queue))
+      util_queue_destroy(&screen->compile_queue);
+
+   if (util_queue_is_initialized(&screen->cs_queue))
+      util_queue_destroy(&screen->cs_queue);
+
    lp_jit_screen_cleanup(screen);
 
+   disk_cache_destroy(screen->disk_shader_cache);
+
    if(winsys->destroy)
       winsys->destroy(winsys);
 
@@ -616,6 +721,114 @@ llvmpipe_get_timestamp(struct pipe_screen *_screen)
    return os_time_get_nano();
 }
 
+/**
+ * Create the on-disk cache of generated shader machine code.
+ *
+ * Besides the Mesa and LLVM builds, the cached code depends on everything
+ * which changes code generation without being part of the variant keys:
+ * the host CPU as seen by LLVM, the CPU caps and vector width (which may be
+ * overridden for testing) and the perf/debug flags.
+ */
+static void
+lp_disk_cache_create(struct llvmpipe_screen *screen)
+{
+   uint32_t mesa_timestamp, llvm_timestamp;
+   unsigned char cpu_sha1[20];
+   char cpu_id[20 * 2 + 1];
+   char timestamp[64 + sizeof cpu_id];
+   uint64_t driver_flags;
+   char *host_cpu;
+
+   if (!disk_cache_get_function_timestamp(lp_disk_cache_create,
+                                          &mesa_timestamp) ||
+       !disk_cache_get_function_timestamp(LLVMLinkInMCJIT,
+                                          &llvm_timestamp))
+      return;
+
+   host_cpu = lp_build_host_cpu_identity();
+   if (!host_cpu)
+      return;
+   _mesa_sha1_compute(host_cpu, strlen(host_cpu), cpu_sha1);
+   free(host_cpu);
+   disk_cache_format_hex_id(cpu_id, cpu_sha1, sizeof cpu_sha1 * 2);
+
+   util_snprintf(timestamp, sizeof timestamp, "%u_%u_%s",
+                 mesa_timestamp, llvm_timestamp, cpu_id);
+
+   driver_flags = lp_native_vector_width |
+                  (uint64_t)util_cpu_caps.has_sse2 << 12 |
+                  (uint64_t)util_cpu_caps.has_sse3 << 13 |
+                  (uint64_t)util_cpu_caps.has_ssse3 << 14 |
+                  (uint64_t)util_cpu_caps.has_sse4_1 << 15 |
+                  (uint64_t)util_cpu_caps.has_sse4_2 << 16 |
+                  (uint64_t)util_cpu_caps.has_avx << 17 |
+                  (uint64_t)util_cpu_caps.has_avx2 << 18 |
+                  (uint64_t)util_cpu_caps.has_f16c << 19 |
+                  (uint64_t)util_cpu_caps.has_fma << 20 |
+                  (uint64_t)util_cpu_caps.has_altivec << 21 |
+                  (uint64_t)util_cpu_caps.has_neon << 22 |
+                  (uint64_t)(gallivm_debug & (GALLIVM_DEBUG_NO_OPT |
+                                              GALLIVM_DEBUG_NO_BRILINEAR |
+                                              GALLIVM_DEBUG_NO_RHO_APPROX |
+                                              GALLIVM_DEBUG_NO_QUAD_LOD)) << 24 |
+                  (uint64_t)LP_PERF << 40;
+
+   screen->disk_shader_cache = disk_cache_create("llvmpipe", timestamp,
+                                                 driver_flags);
+}
+
+
+/**
+ * Look up the machine code for a shader variant, identified by the hash of
+ * its IR inputs (tokens and variant key).  On a hit, cache->data holds
+ * malloc'ed object code for gallivm_create() to load.
+ */
+void
+lp_disk_cache_find_shader(struct llvmpipe_screen *screen,
+                          struct lp_cached_code *cache,
+                          const unsigned char ir_sha1_cache_key[20])
+{
+   unsigned char sha1[CACHE_KEY_SIZE];
+
+   if (!screen->disk_shader_cache)
+      return;
+
+   disk_cache_compute_key(screen->disk_shader_cache, ir_sha1_cache_key,
+                          20, sha1);
+
+   cache->data = disk_cache_get(screen->disk_shader_cache, sha1,
+                                &cache->data_size);
+   if (cache->data) {
+      LP_COUNT(nr_disk_cache_hits);
+   }
+   else {
+      cache->data_size = 0;
+      LP_COUNT(nr_disk_cache_misses);
+   }
+}
+
+
+/**
+ * Store the machine code generated for a shader variant missed by
+ * lp_disk_cache_find_shader().
+ */
+void
+lp_disk_cache_insert_shader(struct llvmpipe_screen *screen,
+                            struct lp_cached_code *cache,
+                            const unsigned char ir_sha1_cache_key[20])
+{
+   unsigned char sha1[CACHE_KEY_SIZE];
+
+   if (!screen->disk_shader_cache || !cache->data_size || cache->dont_cache)
+      return;
+
+   disk_cache_compute_key(screen->disk_shader_cache, ir_sha1_cache_key,
+                          20, sha1);
+   disk_cache_put(screen->disk_shader_cache, sha1, cache->data,
+                  cache->data_size, NULL);
+}
+
+
 /**
  * Create a new pipe_screen object
  * Note: we're not presently subclassing pipe_screen (no llvmpipe_screen).
@@ -652,6 +865,7 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    screen->base.get_param = llvmpipe_get_param;
    screen->base.get_shader_param = llvmpipe_get_shader_param;
    screen->base.get_paramf = llvmpipe_get_paramf;
+   screen->base.get_compute_param = llvmpipe_get_compute_param;
    screen->base.is_format_supported = llvmpipe_is_format_supported;
 
    screen->base.context_create = llvmpipe_create_context;
@@ -678,5 +892,33 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    }
    (void) mtx_init(&screen->rast_mutex, mtx_plain);
 
+   lp_disk_cache_create(screen);
+
+   /* Number of threads compiling optimized fragment shader variants in the
+    * background, while an unoptimized version is used.  Zero disables it.
+    * Not available with a single global LLVM context, since each job needs
+    * its own.
+    */
+#ifndef PIPE_SUBSYSTEM_EMBEDDED
+   {
+      unsigned num_compile_threads =
+         debug_get_num_option("LP_ASYNC_COMPILE", 0);
+      if (num_compile_threads)
+         util_queue_init(&screen->compile_queue, "llvmpipe_cc", 64,
+                         MIN2(num_compile_threads, 8),
+                         UTIL_QUEUE_INIT_RESIZE_IF_FULL |
+                         UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY);
+   }
+#endif
+
+   /* Compute grids and large texture uploads run on the calling thread
+    * plus these workers.  They are separate from the rasterizer threads,
+    * which may be busy with scenes of the same context at that time.
+    */
+   if (screen->num_threads > 1)
+      util_queue_init(&screen->cs_queue, "llvmpipe_cs", 64,
+                      screen->num_threads - 1,
+                      UTIL_QUEUE_INIT_RESIZE_IF_FULL);
+
    return &screen->base;
 }
@@ -37,10 +37,13 @@
 #include "pipe/p_screen.h"
 #include "pipe/p_defines.h"
 #include "os/os_thread.h"
+#include "util/u_queue.h"
 #include "gallivm/lp_bld.h"
 
 
 struct sw_winsys;
+struct disk_cache;
+struct lp_cached_code;
 
 
 struct llvmpipe_screen
@@ -57,6 +60,17 @@ struct llvmpipe_screen
 
    struct lp_rasterizer *rast;
    mtx_t rast_mutex;
+
+   /** Machine code of shader variants, shared across processes */
+   struct disk_cache *disk_shader_cache;
+
+   /** Background compilation of optimized shader variants (LP_ASYNC_COMPILE) */
+   struct util_queue compile_queue;
+
+   /** Workers running compute grids and large texture uploads along with
+    * the calling thread
+    */
+   struct util_queue cs_queue;
 };
 
 
@@ -69,5 +83,16 @@ llvmpipe_screen( struct pipe_screen *pipe )
 }
 
 
+void
+lp_disk_cache_find_shader(struct llvmpipe_screen *screen,
+                          struct lp_cached_code *cache,
+                          const unsigned char ir_sha1_cache_key[20]);
+
+void
+lp_disk_cache_insert_shader(struct llvmpipe_screen *screen,
+                            struct lp_cached_code *cache,
+                            const unsigned char ir_sha1_cache_key[20]);
+
+
 
 #endif /* LP_SCREEN_H */
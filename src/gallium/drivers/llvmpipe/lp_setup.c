@@ -48,6 +48,7 @@
 #include "lp_texture.h"
 #include "lp_debug.h"
 #include "lp_fence.h"
+#include "lp_perf.h"
 #include "lp_query.h"
 #include "lp_rast.h"
 #include "lp_setup_context.h"
@@ -64,26 +65,76 @@ static boolean set_scene_state( struct lp_setup_context *, enum setup_state,
 static boolean try_update_scene_state( struct lp_setup_context *setup );
 
 
-static void
+/**
+ * Recycle a scene the rasterizer has finished with.  Scenes which are still
+ * queued or being rasterized are left alone.
+ */
+static boolean
+lp_setup_try_recycle_scene(struct lp_scene *scene)
+{
+   if (!scene->fence)
+      return TRUE;
+
+   if (!lp_fence_signalled(scene->fence))
+      return FALSE;
+
+   lp_scene_recycle(scene);
+   return TRUE;
+}
+
+
+/**
+ * Get a scene to bin into.  Up to MAX_SCENES scenes are kept per context
+ * and reused, so binning can run ahead of rasterization by that many
+ * scenes before having to wait for the oldest one.
+ * Returns FALSE if the scene could not be prepared for binning.
+ */
+static boolean
 lp_setup_get_empty_scene(struct lp_setup_context *setup)
 {
+   struct lp_scene *scene = NULL;
+   unsigned i;
+
    assert(setup->scene == NULL);
 
-   setup->scene_idx++;
-   setup->scene_idx %= ARRAY_SIZE(setup->scenes);
+   for (i = 0; i < setup->num_scenes; i++) {
+      if (lp_setup_try_recycle_scene(setup->scenes[i])) {
+         scene = setup->scenes[i];
+         break;
+      }
+   }
+
+   if (!scene && setup->num_scenes < MAX_SCENES) {
+      scene = lp_scene_create(setup->pipe, setup->num_bin_threads);
+      if (scene)
+         setup->scenes[setup->num_scenes++] = scene;
+   }
+
+   if (!scene) {
+      /* All scenes are in flight, wait for the oldest one. */
+      int64_t t0 = os_time_get();
 
-   setup->scene = setup->scenes[setup->scene_idx];
+      scene = setup->scenes[0];
+      for (i = 1; i < setup->num_scenes; i++) {
+         if (setup->scenes[i]->fence->id < scene->fence->id)
+            scene = setup->scenes[i];
+      }
 
-   if (setup->scene->fence) {
       if (LP_DEBUG & DEBUG_SETUP)
          debug_printf("%s: wait for scene %d\n",
-                      __FUNCTION__, setup->scene->fence->id);
+                      __FUNCTION__, scene->fence->id);
 
-      lp_fence_wait(setup->scene->fence);
+      lp_fence_wait(scene->fence);
+      lp_scene_recycle(scene);
+
+      LP_COUNT(nr_scene_waits);
+      LP_COUNT_ADD(scene_wait_time, os_time_get() - t0);
    }
 
-   lp_scene_begin_binning(setup->scene, &setup->fb, setup->rasterizer_discard);
+   setup->scene = scene;
 
+   return lp_scene_begin_binning(setup->scene, &setup->fb,
+                                 setup->rasterizer_discard);
 }
 
 
@@ -153,6 +204,9 @@ lp_setup_rasterize_scene( struct lp_setup_context *setup )
 {
    struct lp_scene *scene = setup->scene;
    struct llvmpipe_screen *screen = llvmpipe_screen(scene->pipe->screen);
+#ifdef DEBUG
+   unsigned i;
+#endif
 
    scene->num_active_queries = setup->active_binned_queries;
    memcpy(scene->active_queries, setup->active_queries,
@@ -165,23 +219,27 @@ lp_setup_rasterize_scene( struct lp_setup_context *setup )
    if (setup->last_fence)
       setup->last_fence->issued = TRUE;
 
-   mtx_lock(&screen->rast_mutex);
+#ifdef DEBUG
+   LP_COUNT(nr_scenes);
+   for (i = 0; i < setup->num_scenes; i++) {
+      struct lp_scene *other = setup->scenes[i];
+      if (other != scene && other->fence &&
+          !lp_fence_signalled(other->fence)) {
+         /* Still rasterizing an earlier scene while this one was binned */
+         LP_COUNT(nr_scene_overlaps);
+         break;
+      }
+   }
+#endif
 
-   /* FIXME: We enqueue the scene then wait on the rasterizer to finish.
-    * This means we never actually run any vertex stuff in parallel to
-    * rasterization (not in the same context at least) which is what the
-    * multiple scenes per setup is about - when we get a new empty scene
-    * any old one is already empty again because we waited here for
-    * raster tasks to be finished. Ideally, we shouldn't need to wait here
-    * and rely on fences elsewhere when waiting is necessary.
-    * Certainly, lp_scene_end_rasterization() would need to be deferred too
-    * and there's probably other bits why this doesn't actually work.
+   /* Don't wait for the rasterizer here: the scene's fence tells when it
+    * is done, and lp_setup_get_empty_scene() only waits when all the
+    * scenes are in flight.
     */
+   mtx_lock(&screen->rast_mutex);
    lp_rast_queue_scene(screen->rast, scene);
-   lp_rast_finish(screen->rast);
    mtx_unlock(&screen->rast_mutex);
 
-   lp_scene_end_rasterization(setup->scene);
    lp_setup_reset( setup );
 
    LP_DBG(DEBUG_SETUP, "%s done \n", __FUNCTION__);
@@ -311,8 +369,10 @@ set_scene_state( struct lp_setup_context *setup,
 
    /* wait for a free/empty scene
     */
-   if (old_state == SETUP_FLUSHED) 
-      lp_setup_get_empty_scene(setup);
+   if (old_state == SETUP_FLUSHED) {
+      if (!lp_setup_get_empty_scene(setup))
+         goto fail;
+   }
 
    switch (new_state) {
    case SETUP_CLEARED:
@@ -343,6 +403,7 @@ set_scene_state( struct lp_setup_context *setup,
 fail:
    if (setup->scene) {
       lp_scene_end_rasterization(setup->scene);
+      lp_scene_recycle(setup->scene);
       setup->scene = NULL;
    }
 
@@ -581,7 +642,8 @@ lp_setup_set_triangle_state( struct lp_setup_context *setup,
                              boolean ccw_is_frontface,
                              boolean scissor,
                              boolean half_pixel_center,
-                             boolean bottom_edge_rule)
+                             boolean bottom_edge_rule,
+                             boolean multisample)
 {
    LP_DBG(DEBUG_SETUP, "%s\n", __FUNCTION__);
 
@@ -590,6 +652,7 @@ lp_setup_set_triangle_state( struct lp_setup_context *setup,
    setup->triangle = first_triangle;
    setup->pixel_offset = half_pixel_center ? 0.5f : 0.0f;
    setup->bottom_edge_rule = bottom_edge_rule;
+   setup->multisample = multisample;
 
    if (setup->scissor_test != scissor) {
       setup->dirty |= LP_SETUP_NEW_SCISSOR;
@@ -663,6 +726,35 @@ lp_setup_set_fs_constants(struct lp_setup_context *setup,
 }
 
 
+void
+lp_setup_set_fs_ssbos(struct lp_setup_context *setup,
+                      unsigned num,
+                      const struct pipe_shader_buffer *buffers)
+{
+   unsigned i;
+
+   LP_DBG(DEBUG_SETUP, "%s %p\n", __FUNCTION__, (void *) buffers);
+
+   assert(num <= ARRAY_SIZE(setup->ssbos));
+
+   for (i = 0; i < ARRAY_SIZE(setup->ssbos); i++) {
+      struct pipe_shader_buffer *current = &setup->ssbos[i].current;
+
+      if (i < num && buffers[i].buffer) {
+         pipe_resource_reference(&current->buffer, buffers[i].buffer);
+         current->buffer_offset = buffers[i].buffer_offset;
+         current->buffer_size = buffers[i].buffer_size;
+      }
+      else {
+         pipe_resource_reference(&current->buffer, NULL);
+         current->buffer_offset = 0;
+         current->buffer_size = 0;
+      }
+   }
+   setup->dirty |= LP_SETUP_NEW_SSBOS;
+}
+
+
 void
 lp_setup_set_alpha_ref_value( struct lp_setup_context *setup,
                               float alpha_ref_value )
@@ -857,6 +949,10 @@ lp_setup_set_fragment_sampler_views(struct lp_setup_context *setup,
                      jit_tex->row_stride[j] = lp_tex->row_stride[j];
                      jit_tex->img_stride[j] = lp_tex->img_stride[j];
                   }
+                  if (res->nr_samples > 1) {
+                     /* samples are fetched as images within the layer */
+                     jit_tex->img_stride[0] = lp_tex->sample_stride;
+                  }
 
                   if (res->target == PIPE_TEXTURE_1D_ARRAY ||
                       res->target == PIPE_TEXTURE_2D_ARRAY ||
@@ -961,6 +1057,21 @@ lp_setup_set_fragment_sampler_state(struct lp_setup_context *setup,
 }
 
 
+static boolean
+fb_references_resource(const struct pipe_framebuffer_state *fb,
+                       const struct pipe_resource *texture)
+{
+   unsigned i;
+
+   for (i = 0; i < fb->nr_cbufs; i++) {
+      if (fb->cbufs[i] && fb->cbufs[i]->texture == texture)
+         return TRUE;
+   }
+
+   return fb->zsbuf && fb->zsbuf->texture == texture;
+}
+
+
 /**
  * Is the given texture referenced by any scene?
  * Note: we have to check all scenes including any scenes currently
@@ -973,17 +1084,30 @@ lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
    unsigned i;
 
    /* check the render targets */
-   for (i = 0; i < setup->fb.nr_cbufs; i++) {
-      if (setup->fb.cbufs[i] && setup->fb.cbufs[i]->texture == texture)
-         return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
-   }
-   if (setup->fb.zsbuf && setup->fb.zsbuf->texture == texture) {
+   if (fb_references_resource(&setup->fb, texture))
       return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+
+   /* check the shader buffers, which fragment shaders may write */
+   for (i = 0; i < ARRAY_SIZE(setup->ssbos); i++) {
+      if (setup->ssbos[i].current.buffer == texture)
+         return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
    }
 
-   /* check textures referenced by the scene */
-   for (i = 0; i < ARRAY_SIZE(setup->scenes); i++) {
-      if (lp_scene_is_resource_referenced(setup->scenes[i], texture)) {
+   /* check textures referenced by the scenes being built or in flight */
+   for (i = 0; i < setup->num_scenes; i++) {
+      struct lp_scene *scene = setup->scenes[i];
+
+      if (scene != setup->scene && lp_setup_try_recycle_scene(scene))
+         continue;
+
+      /* the framebuffer may have changed since the scene was queued */
+      if (fb_references_resource(&scene->fb, texture))
+         return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+
+      if (lp_scene_is_resource_referenced(scene, texture)) {
+         /* a scene still in flight may write to a buffer no longer bound */
+         if (texture->bind & PIPE_BIND_SHADER_BUFFER)
+            return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
          return LP_REFERENCED_FOR_READ;
       }
    }
@@ -1008,6 +1132,7 @@ static boolean
 try_update_scene_state( struct lp_setup_context *setup )
 {
    static const float fake_const_buf[4];
+   static uint32_t fake_ssbo[4];
    boolean new_scene = (setup->fs.stored == NULL);
    struct lp_scene *scene = setup->scene;
    unsigned i;
@@ -1131,6 +1256,27 @@ try_update_scene_state( struct lp_setup_context *setup )
       }
    }
 
+   if (setup->dirty & LP_SETUP_NEW_SSBOS) {
+      /* Unlike constants, shader buffers are not copied into the scene,
+       * as the shader writes go to the resource itself.
+       */
+      for (i = 0; i < ARRAY_SIZE(setup->ssbos); ++i) {
+         const struct pipe_shader_buffer *current = &setup->ssbos[i].current;
+
+         if (current->buffer) {
+            setup->fs.current.jit_context.ssbos[i] =
+               (uint8_t *) llvmpipe_resource_data(current->buffer) +
+               current->buffer_offset;
+            setup->fs.current.jit_context.num_ssbos[i] = current->buffer_size;
+         }
+         else {
+            setup->fs.current.jit_context.ssbos[i] = (uint8_t *) fake_ssbo;
+            setup->fs.current.jit_context.num_ssbos[i] = 0;
+         }
+      }
+      setup->dirty |= LP_SETUP_NEW_FS;
+   }
+
 
    if (setup->dirty & LP_SETUP_NEW_FS) {
       if (!setup->fs.stored ||
@@ -1168,6 +1314,16 @@ try_update_scene_state( struct lp_setup_context *setup )
                }
             }
          }
+         for (i = 0; i < ARRAY_SIZE(setup->ssbos); i++) {
+            if (setup->ssbos[i].current.buffer) {
+               if (!lp_scene_add_resource_reference(scene,
+                                                    setup->ssbos[i].current.buffer,
+                                                    new_scene)) {
+                  assert(!new_scene);
+                  return FALSE;
+               }
+            }
+         }
       }
    }
 
@@ -1264,6 +1420,25 @@ lp_setup_update_state( struct lp_setup_context *setup,
 
 
 
+static void
+lp_setup_destroy_bin_threads(struct lp_setup_context *setup)
+{
+   unsigned i;
+
+   if (!setup->bin_threads)
+      return;
+
+   util_queue_destroy(&setup->bin_queue);
+
+   for (i = 0; i < setup->num_bin_threads; i++) {
+      util_queue_fence_destroy(&setup->bin_threads[i].fence);
+   }
+
+   FREE(setup->bin_threads);
+   setup->bin_threads = NULL;
+}
+
+
 /* Only caller is lp_setup_vbuf_destroy()
  */
 void 
@@ -1283,18 +1458,25 @@ lp_setup_destroy( struct lp_setup_context *setup )
       pipe_resource_reference(&setup->constants[i].current.buffer, NULL);
    }
 
-   /* free the scenes in the 'empty' queue */
-   for (i = 0; i < ARRAY_SIZE(setup->scenes); i++) {
+   for (i = 0; i < ARRAY_SIZE(setup->ssbos); i++) {
+      pipe_resource_reference(&setup->ssbos[i].current.buffer, NULL);
+   }
+
+   /* wait for the scenes still in flight and free them all */
+   for (i = 0; i < setup->num_scenes; i++) {
       struct lp_scene *scene = setup->scenes[i];
 
       if (scene->fence)
          lp_fence_wait(scene->fence);
 
+      lp_scene_recycle(scene);
       lp_scene_destroy(scene);
    }
 
    lp_fence_reference(&setup->last_fence, NULL);
 
+   lp_setup_destroy_bin_threads(setup);
+
    FREE( setup );
 }
 
@@ -1325,6 +1507,35 @@ lp_setup_create( struct pipe_context *pipe,
 
 
    setup->num_threads = screen->num_threads;
+
+   /* Threads binning large batches of triangles in parallel.  The calling
+    * thread is one of them.
+    */
+   setup->num_bin_threads = debug_get_num_option("LP_NUM_BIN_THREADS", 0);
+   setup->num_bin_threads = MIN2(setup->num_bin_threads, LP_MAX_BIN_THREADS);
+   if (setup->num_bin_threads > 1) {
+      setup->bin_threads = CALLOC(setup->num_bin_threads,
+                                  sizeof *setup->bin_threads);
+      if (!setup->bin_threads ||
+          !util_queue_init(&setup->bin_queue, "llvmpipe_bin",
+                           setup->num_bin_threads,
+                           setup->num_bin_threads - 1, 0)) {
+         FREE(setup->bin_threads);
+         setup->bin_threads = NULL;
+         setup->num_bin_threads = 0;
+      }
+      else {
+         for (i = 0; i < setup->num_bin_threads; i++) {
+            setup->bin_threads[i].index = i;
+            util_queue_fence_init(&setup->bin_threads[i].fence);
+         }
+         lp_setup_init_vbuf_bin_threads(setup);
+      }
+   }
+   else {
+      setup->num_bin_threads = 0;
+   }
+
    setup->vbuf = draw_vbuf_stage(draw, &setup->base);
    if (!setup->vbuf) {
       goto no_vbuf;
@@ -1333,13 +1544,12 @@ lp_setup_create( struct pipe_context *pipe,
    draw_set_rasterize_stage(draw, setup->vbuf);
    draw_set_render(draw, &setup->base);
 
-   /* create some empty scenes */
-   for (i = 0; i < MAX_SCENES; i++) {
-      setup->scenes[i] = lp_scene_create( pipe );
-      if (!setup->scenes[i]) {
-         goto no_scenes;
-      }
+   /* create the first scene, more are added as they are needed */
+   setup->scenes[0] = lp_scene_create( pipe, setup->num_bin_threads );
+   if (!setup->scenes[0]) {
+      goto no_scenes;
    }
+   setup->num_scenes = 1;
 
    setup->triangle = first_triangle;
    setup->line     = first_line;
@@ -1354,14 +1564,9 @@ lp_setup_create( struct pipe_context *pipe,
    return setup;
 
 no_scenes:
-   for (i = 0; i < MAX_SCENES; i++) {
-      if (setup->scenes[i]) {
-         lp_scene_destroy(setup->scenes[i]);
-      }
-   }
-
    setup->vbuf->destroy(setup->vbuf);
 no_vbuf:
+   lp_setup_destroy_bin_threads(setup);
    FREE(setup);
 no_setup:
    return NULL;
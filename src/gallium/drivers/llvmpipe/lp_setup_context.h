@@ -43,20 +43,28 @@
 #include "draw/draw_vbuf.h"
 #include "util/u_rect.h"
 #include "util/u_pack_color.h"
+#include "util/u_queue.h"
 
 #define LP_SETUP_NEW_FS          0x01
 #define LP_SETUP_NEW_CONSTANTS   0x02
 #define LP_SETUP_NEW_BLEND_COLOR 0x04
 #define LP_SETUP_NEW_SCISSOR     0x08
 #define LP_SETUP_NEW_VIEWPORTS   0x10
+#define LP_SETUP_NEW_SSBOS       0x20
 
 
 struct lp_setup_variant;
+struct lp_setup_bin_thread;
 
 
-/** Max number of scenes */
-/* XXX: make multiple scenes per context work, see lp_setup_rasterize_scene */
-#define MAX_SCENES 1
+/**
+ * Max number of scenes per context.  Setup bins into one while the others
+ * are queued or being rasterized.
+ */
+#define MAX_SCENES 4
+
+/** Max number of threads binning triangles in parallel */
+#define LP_MAX_BIN_THREADS 16
 
 
 
@@ -87,7 +95,16 @@ struct lp_setup_context
     */
    struct draw_stage *vbuf;
    unsigned num_threads;
-   unsigned scene_idx;
+
+   /** Multi-threaded binning, see lp_setup_vbuf.c (LP_NUM_BIN_THREADS) */
+   unsigned num_bin_threads;
+   struct util_queue bin_queue;
+   struct lp_setup_bin_thread *bin_threads;
+
+   /** Non-NULL in the private copies of this struct used by binning threads */
+   struct lp_setup_bin_thread *bin_thread;
+
+   unsigned num_scenes;
    struct lp_scene *scenes[MAX_SCENES];  /**< all the scenes */
    struct lp_scene *scene;               /**< current scene being built */
 
@@ -100,6 +117,7 @@ struct lp_setup_context
    boolean scissor_test;
    boolean point_size_per_vertex;
    boolean rasterizer_discard;
+   boolean multisample;
    unsigned cullmode;
    unsigned bottom_edge_rule;
    float pixel_offset;
@@ -143,6 +161,11 @@ struct lp_setup_context
       const void *stored_data;
    } constants[LP_MAX_TGSI_CONST_BUFFERS];
 
+   /** fragment shader buffers, written in place */
+   struct {
+      struct pipe_shader_buffer current;
+   } ssbos[LP_MAX_TGSI_SHADER_BUFFERS];
+
    struct {
       struct pipe_blend_color current;
       uint8_t *stored;
@@ -188,6 +211,7 @@ void lp_setup_choose_line( struct lp_setup_context *setup );
 void lp_setup_choose_point( struct lp_setup_context *setup );
 
 void lp_setup_init_vbuf(struct lp_setup_context *setup);
+void lp_setup_init_vbuf_bin_threads(struct lp_setup_context *setup);
 
 boolean lp_setup_update_state( struct lp_setup_context *setup,
                             boolean update_scene);
@@ -209,7 +233,7 @@ lp_setup_print_vertex(struct lp_setup_context *setup,
 
 
 struct lp_rast_triangle *
-lp_setup_alloc_triangle(struct lp_scene *scene,
+lp_setup_alloc_triangle(struct lp_setup_context *setup,
                         unsigned num_inputs,
                         unsigned nr_planes,
                         unsigned *tri_size);
@@ -222,4 +246,68 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
                       int nr_planes,
                       unsigned scissor_index);
 
+
+/**
+ * State of a thread binning a batch of triangles.
+ *
+ * Each binning thread walks the whole batch in order, but only bins into
+ * the tile rows it owns, so commands in any bin stay in primitive order.
+ */
+struct lp_setup_bin_thread
+{
+   /** Private copy of the setup context, with bin_thread pointing here */
+   struct lp_setup_context setup;
+
+   unsigned index;   /**< owns tile rows y with y % num_bin_threads == index */
+
+   /** The batch */
+   const ushort *indices;
+   unsigned start, nr;
+
+   /** The context's triangle function, called for non-skipped triangles */
+   void (*triangle)( struct lp_setup_context *,
+                     const float (*v0)[4],
+                     const float (*v1)[4],
+                     const float (*v2)[4]);
+
+   unsigned nr_tris;    /**< triangles of the batch seen so far */
+   unsigned skip;       /**< triangles binned into a previous scene */
+   unsigned nr_counted; /**< triangles counted in the pipeline statistics */
+   boolean failed;      /**< scene ran out of memory */
+   boolean done;
+
+   struct util_queue_fence fence;
+};
+
+
+/**
+ * Whether the calling binning thread owns any of the tile rows y0..y1.
+ * Always true when not binning in parallel.
+ */
+static inline boolean
+lp_setup_owns_tile_rows(const struct lp_setup_context *setup, int y0, int y1)
+{
+   const struct lp_setup_bin_thread *bin_thread = setup->bin_thread;
+
+   if (!bin_thread)
+      return TRUE;
+
+   if (y1 - y0 + 1 >= (int)setup->num_bin_threads)
+      return TRUE;
+
+   for (; y0 <= y1; y0++) {
+      if (y0 % setup->num_bin_threads == bin_thread->index)
+         return TRUE;
+   }
+   return FALSE;
+}
+
+
+static inline boolean
+lp_setup_owns_tile_row(const struct lp_setup_context *setup, int y)
+{
+   return !setup->bin_thread ||
+          y % setup->num_bin_threads == setup->bin_thread->index;
+}
+
 #endif
@@ -566,6 +566,14 @@ try_setup_line( struct lp_setup_context *setup,
        */
       bbox.x1--;
       bbox.y1--;
+
+      /* Samples of pixels whose centers are outside may still be covered */
+      if (scene->fb_max_samples > 1) {
+         bbox.x0--;
+         bbox.y0--;
+         bbox.x1++;
+         bbox.y1++;
+      }
    }
 
    if (bbox.x1 < bbox.x0 ||
@@ -600,7 +608,7 @@ try_setup_line( struct lp_setup_context *setup,
       nr_planes += s_planes[0] + s_planes[1] + s_planes[2] + s_planes[3];
    }
 
-   line = lp_setup_alloc_triangle(scene,
+   line = lp_setup_alloc_triangle(setup,
                                   key->num_inputs,
                                   nr_planes,
                                   &tri_bytes);
@@ -650,6 +658,7 @@ try_setup_line( struct lp_setup_context *setup,
 
    line->inputs.disable = FALSE;
    line->inputs.opaque = FALSE;
+   line->inputs.center_coverage = !setup->multisample;
    line->inputs.layer = layer;
    line->inputs.viewport_index = viewport_index;
 
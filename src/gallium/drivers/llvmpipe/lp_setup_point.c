@@ -444,7 +444,7 @@ try_setup_point( struct lp_setup_context *setup,
 
    u_rect_find_intersection(&setup->draw_regions[viewport_index], &bbox);
 
-   point = lp_setup_alloc_triangle(scene,
+   point = lp_setup_alloc_triangle(setup,
                                    key->num_inputs,
                                    nr_planes,
                                    &bytes);
@@ -486,6 +486,7 @@ try_setup_point( struct lp_setup_context *setup,
 
    point->inputs.disable = FALSE;
    point->inputs.opaque = FALSE;
+   point->inputs.center_coverage = !setup->multisample;
    point->inputs.layer = layer;
    point->inputs.viewport_index = viewport_index;
 
@@ -511,6 +512,16 @@ try_setup_point( struct lp_setup_context *setup,
       plane[3].dcdy = -1 << 8;
       plane[3].c = (bbox.y1+1) << 8;
       plane[3].eo = 0;
+
+      /*
+       * These edges are only accurate at pixel centers.  Move them onto
+       * the pixel boundaries so points cover all samples of their pixels.
+       */
+      if (scene->fb_max_samples > 1) {
+         unsigned i;
+         for (i = 0; i < 4; i++)
+            plane[i].c -= FIXED_ONE / 2;
+      }
    }
 
    return lp_setup_bin_triangle(setup, point, &bbox, &bbox, nr_planes, viewport_index);
@@ -82,7 +82,7 @@ struct fixed_position {
  * \return pointer to triangle space
  */
 struct lp_rast_triangle *
-lp_setup_alloc_triangle(struct lp_scene *scene,
+lp_setup_alloc_triangle(struct lp_setup_context *setup,
                         unsigned nr_inputs,
                         unsigned nr_planes,
                         unsigned *tri_size)
@@ -97,7 +97,16 @@ lp_setup_alloc_triangle(struct lp_scene *scene,
                 3 * input_array_sz +
                 plane_sz);
 
-   tri = lp_scene_alloc_aligned( scene, *tri_size, 16 );
+   if (setup->bin_thread) {
+      /* Data of the binning thread's tile rows, see lp_scene_bin_data() */
+      struct lp_scene *scene = setup->scene;
+      tri = lp_scene_list_alloc_aligned( scene,
+                                         &scene->bin_data[setup->bin_thread->index],
+                                         *tri_size, 16 );
+   }
+   else {
+      tri = lp_scene_alloc_aligned( setup->scene, *tri_size, 16 );
+   }
    if (!tri)
       return NULL;
 
@@ -319,6 +328,14 @@ do_triangle_ccw(struct lp_setup_context *setup,
       /* Inclusive / exclusive depending upon adj (bottom-left or top-right) */
       bbox.y0 = (MIN3(position->y[0], position->y[1], position->y[2]) + adj) >> FIXED_ORDER;
       bbox.y1 = (MAX3(position->y[0], position->y[1], position->y[2]) - 1 + adj) >> FIXED_ORDER;
+
+      /* Samples of pixels whose centers are outside may still be covered */
+      if (scene->fb_max_samples > 1) {
+         bbox.x0--;
+         bbox.y0--;
+         bbox.x1++;
+         bbox.y1++;
+      }
    }
 
    if (bbox.x1 < bbox.x0 ||
@@ -343,6 +360,18 @@ do_triangle_ccw(struct lp_setup_context *setup,
    bboxpos.x0 = MAX2(bboxpos.x0, 0);
    bboxpos.y0 = MAX2(bboxpos.y0, 0);
 
+   /* Leave triangles which touch none of our tile rows to the other
+    * binning threads.
+    */
+   if (setup->bin_thread) {
+      struct u_rect trimmed_box = bboxpos;
+      u_rect_find_intersection(&setup->draw_regions[viewport_index],
+                               &trimmed_box);
+      if (!lp_setup_owns_tile_rows(setup, trimmed_box.y0 / TILE_SIZE,
+                                   trimmed_box.y1 / TILE_SIZE))
+         return TRUE;
+   }
+
    nr_planes = 3;
    /*
     * Determine how many scissor planes we need, that is drop scissor
@@ -355,7 +384,7 @@ do_triangle_ccw(struct lp_setup_context *setup,
       nr_planes += s_planes[0] + s_planes[1] + s_planes[2] + s_planes[3];
    }
 
-   tri = lp_setup_alloc_triangle(scene,
+   tri = lp_setup_alloc_triangle(setup,
                                  key->num_inputs,
                                  nr_planes,
                                  &tri_bytes);
@@ -384,6 +413,7 @@ do_triangle_ccw(struct lp_setup_context *setup,
    tri->inputs.frontfacing = frontfacing;
    tri->inputs.disable = FALSE;
    tri->inputs.opaque = setup->fs.current.variant->opaque;
+   tri->inputs.center_coverage = !setup->multisample;
    tri->inputs.layer = layer;
    tri->inputs.viewport_index = viewport_index;
 
@@ -779,6 +809,31 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
    int max_szorig = ((bboxorig->x1 - (bboxorig->x0 & ~3)) |
                      (bboxorig->y1 - (bboxorig->y0 & ~3)));
    boolean use_32bits = max_szorig <= MAX_FIXED_LENGTH32;
+   boolean multisample = scene->fb_max_samples > 1;
+
+   if (multisample) {
+      /*
+       * The block in/out tests only look at pixel centers.  Widen the
+       * trivial reject offsets by the furthest any sample is from the
+       * center along each edge; as ei = dcdy - dcdx - eo this narrows
+       * the trivial accept offsets by the same amount, so blocks are
+       * only rejected if no sample is inside, and only fully shaded if
+       * every sample is.  Keep eo a multiple of FIXED_ONE for the 64-bit
+       * rasterizer.
+       */
+      struct lp_rast_plane *plane = GET_PLANES(tri);
+
+      for (i = 0; i < nr_planes; i++) {
+         int64_t margin = 0;
+         unsigned s;
+
+         for (s = 0; s < LP_MAX_SAMPLES; s++) {
+            int64_t offset = lp_rast_sample_offset(&plane[i], s);
+            margin = MAX2(margin, offset < 0 ? -offset : offset);
+         }
+         plane[i].eo += align((unsigned)margin, FIXED_ONE);
+      }
+   }
 
    /* Now apply scissor, etc to the bounding box.  Could do this
     * earlier, but it confuses the logic for tri-16 and would force
@@ -800,7 +855,11 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
       assert(iy0 == bbox->y1 / TILE_SIZE &&
 	     ix0 == bbox->x1 / TILE_SIZE);
 
-      if (nr_planes == 3) {
+      /* The small triangle rasterizers know nothing about samples */
+      if (multisample) {
+         /* fall through to the single tile rasterizers */
+      }
+      else if (nr_planes == 3) {
          if (sz < 4)
          {
             /* Triangle is contained in a single 4x4 stamp:
@@ -905,6 +964,12 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
          boolean in = FALSE;  /* are we inside the triangle? */
          int64_t cx[MAX_PLANES];
 
+         if (!lp_setup_owns_tile_row(setup, y)) {
+            for (i = 0; i < nr_planes; i++)
+               c[i] += ystep[i];
+            continue;
+         }
+
          for (i = 0; i < nr_planes; i++)
             cx[i] = c[i];
 
@@ -986,6 +1051,14 @@ static void retry_triangle_ccw( struct lp_setup_context *setup,
 {
    if (!do_triangle_ccw( setup, position, v0, v1, v2, front ))
    {
+      /* Binning threads can't flush, the scene is restarted once they are
+       * all done.
+       */
+      if (setup->bin_thread) {
+         setup->bin_thread->failed = TRUE;
+         return;
+      }
+
       if (!lp_setup_flush_and_restart(setup))
          return;
 
@@ -1155,6 +1228,29 @@ static void triangle_ccw(struct lp_setup_context *setup,
       retry_triangle_ccw(setup, &position, v0, v1, v2, setup->ccw_is_frontface);
 }
 
+/**
+ * Whether the current triangle is to be counted in the pipeline statistics.
+ *
+ * Every binning thread sees every triangle, so only the first one counts
+ * them.  After running out of scene memory it walks the batch again from
+ * the triangle which didn't fit, so only count the ones not reached before.
+ */
+static inline boolean
+count_triangle(struct lp_setup_context *setup)
+{
+   struct lp_setup_bin_thread *bin_thread = setup->bin_thread;
+
+   if (!bin_thread)
+      return TRUE;
+
+   if (bin_thread->index != 0 ||
+       bin_thread->nr_tris <= bin_thread->nr_counted)
+      return FALSE;
+
+   bin_thread->nr_counted = bin_thread->nr_tris;
+   return TRUE;
+}
+
 /**
  * Draw triangle whether it's CW or CCW.
  */
@@ -1167,7 +1263,8 @@ static void triangle_both(struct lp_setup_context *setup,
    struct llvmpipe_context *lp_context = (struct llvmpipe_context *)setup->pipe;
 
    if (lp_context->active_statistics_queries &&
-       !llvmpipe_rasterization_disabled(lp_context)) {
+       !llvmpipe_rasterization_disabled(lp_context) &&
+       count_triangle(setup)) {
       lp_context->pipeline_statistics.c_primitives++;
    }
 
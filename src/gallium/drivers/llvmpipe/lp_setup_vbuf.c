@@ -46,6 +46,13 @@
 #define LP_MAX_VBUF_INDEXES 1024
 #define LP_MAX_VBUF_SIZE    4096
 
+/* Larger batches when binning in parallel, to amortize the hand-off. */
+#define LP_MAX_VBUF_INDEXES_PARALLEL 16384
+#define LP_MAX_VBUF_SIZE_PARALLEL    (256 * 1024)
+
+/* Smallest batch worth binning in parallel. */
+#define LP_MIN_PARALLEL_BIN_VERTICES 384
+
   
 
 /** cast wrapper */
@@ -130,22 +137,16 @@ static inline const_float4_ptr get_vert( const void *vertex_buffer,
 }
 
 /**
- * draw elements / indexed primitives
+ * Set up and bin indexed primitives.
  */
 static void
-lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
+emit_elements(struct lp_setup_context *setup, const ushort *indices, uint nr)
 {
-   struct lp_setup_context *setup = lp_setup_context(vbr);
    const unsigned stride = setup->vertex_info->size * sizeof(float);
    const void *vertex_buffer = setup->vertex_buffer;
    const boolean flatshade_first = setup->flatshade_first;
    unsigned i;
 
-   assert(setup->setup.variant);
-
-   if (!lp_setup_update_state(setup, TRUE))
-      return;
-
    switch (setup->prim) {
    case PIPE_PRIM_POINTS:
       for (i = 0; i < nr; i++) {
@@ -328,22 +329,17 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
 
 
 /**
- * This function is hit when the draw module is working in pass-through mode.
- * It's up to us to convert the vertex array into point/line/tri prims.
+ * Set up and bin the primitives of a vertex array.
  */
 static void
-lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
+emit_arrays(struct lp_setup_context *setup, uint start, uint nr)
 {
-   struct lp_setup_context *setup = lp_setup_context(vbr);
    const unsigned stride = setup->vertex_info->size * sizeof(float);
    const void *vertex_buffer =
       (void *) get_vert(setup->vertex_buffer, start, stride);
    const boolean flatshade_first = setup->flatshade_first;
    unsigned i;
 
-   if (!lp_setup_update_state(setup, TRUE))
-      return;
-
    switch (setup->prim) {
    case PIPE_PRIM_POINTS:
       for (i = 0; i < nr; i++) {
@@ -523,6 +519,180 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
 
 
 
+/**
+ * Triangle function of the binning threads' setup contexts.  Skips the
+ * triangles binned in a previous scene and everything after the scene ran
+ * out of memory.
+ */
+static void
+bin_thread_triangle(struct lp_setup_context *setup,
+                    const float (*v0)[4],
+                    const float (*v1)[4],
+                    const float (*v2)[4])
+{
+   struct lp_setup_bin_thread *bin_thread = setup->bin_thread;
+
+   if (bin_thread->nr_tris++ < bin_thread->skip || bin_thread->failed)
+      return;
+
+   bin_thread->triangle(setup, v0, v1, v2);
+
+   if (bin_thread->failed) {
+      unsigned failed_tri = bin_thread->nr_tris - 1;
+
+      /* Like retry_triangle_ccw(), give up on a triangle which doesn't fit
+       * into an empty scene either.
+       */
+      bin_thread->skip = failed_tri == bin_thread->skip ?
+                         failed_tri + 1 : failed_tri;
+   }
+}
+
+
+static void
+bin_thread_execute(void *data, int thread_index)
+{
+   struct lp_setup_bin_thread *bin_thread = (struct lp_setup_bin_thread *)data;
+
+   if (bin_thread->indices)
+      emit_elements(&bin_thread->setup, bin_thread->indices, bin_thread->nr);
+   else
+      emit_arrays(&bin_thread->setup, bin_thread->start, bin_thread->nr);
+}
+
+
+/**
+ * Set up and bin a batch of triangles on all binning threads, each of them
+ * binning into its own tile rows.
+ *
+ * If the scene runs out of memory, it is flushed once all threads are
+ * done, and each thread continues from where it stopped.
+ *
+ * \return FALSE if the batch should be handled serially instead
+ */
+static boolean
+bin_in_parallel(struct lp_setup_context *setup,
+                const ushort *indices, uint start, uint nr)
+{
+   unsigned num_bin_threads = setup->num_bin_threads;
+   boolean failed;
+   unsigned i;
+
+   if (num_bin_threads < 2 ||
+       nr < LP_MIN_PARALLEL_BIN_VERTICES ||
+       setup->scene->tiles_y < 2)
+      return FALSE;
+
+   switch (setup->prim) {
+   case PIPE_PRIM_TRIANGLES:
+   case PIPE_PRIM_TRIANGLE_STRIP:
+   case PIPE_PRIM_TRIANGLE_FAN:
+   case PIPE_PRIM_QUADS:
+   case PIPE_PRIM_QUAD_STRIP:
+   case PIPE_PRIM_POLYGON:
+      break;
+   default:
+      return FALSE;
+   }
+
+   for (i = 0; i < num_bin_threads; i++) {
+      struct lp_setup_bin_thread *bin_thread = &setup->bin_threads[i];
+
+      bin_thread->indices = indices;
+      bin_thread->start = start;
+      bin_thread->nr = nr;
+      bin_thread->skip = 0;
+      bin_thread->nr_counted = 0;
+      bin_thread->done = FALSE;
+   }
+
+   do {
+      /* Resolve first_triangle, which binding a rasterizer state or a scene
+       * restart installs, here: on a thread's copy it would replace
+       * bin_thread_triangle.
+       */
+      lp_setup_choose_triangle(setup);
+
+      for (i = 0; i < num_bin_threads; i++) {
+         struct lp_setup_bin_thread *bin_thread = &setup->bin_threads[i];
+
+         if (bin_thread->done)
+            continue;
+
+         /* Snapshot of the current state, including the scene. */
+         memcpy(&bin_thread->setup, setup, sizeof *setup);
+         bin_thread->setup.bin_thread = bin_thread;
+         bin_thread->setup.triangle = bin_thread_triangle;
+         bin_thread->triangle = setup->triangle;
+         bin_thread->nr_tris = 0;
+         bin_thread->failed = FALSE;
+
+         if (i > 0) {
+            util_queue_add_job(&setup->bin_queue, bin_thread,
+                               &bin_thread->fence, bin_thread_execute, NULL);
+         }
+      }
+
+      if (!setup->bin_threads[0].done)
+         bin_thread_execute(&setup->bin_threads[0], 0);
+
+      failed = FALSE;
+      for (i = 0; i < num_bin_threads; i++) {
+         struct lp_setup_bin_thread *bin_thread = &setup->bin_threads[i];
+
+         if (bin_thread->done)
+            continue;
+
+         if (i > 0)
+            util_queue_fence_wait(&bin_thread->fence);
+
+         if (bin_thread->failed)
+            failed = TRUE;
+         else
+            bin_thread->done = TRUE;
+      }
+   } while (failed && lp_setup_flush_and_restart(setup));
+
+   return TRUE;
+}
+
+
+/**
+ * draw elements / indexed primitives
+ */
+static void
+lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
+{
+   struct lp_setup_context *setup = lp_setup_context(vbr);
+
+   assert(setup->setup.variant);
+
+   if (!lp_setup_update_state(setup, TRUE))
+      return;
+
+   if (!bin_in_parallel(setup, indices, 0, nr))
+      emit_elements(setup, indices, nr);
+}
+
+
+/**
+ * This function is hit when the draw module is working in pass-through mode.
+ * It's up to us to convert the vertex array into point/line/tri prims.
+ */
+static void
+lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
+{
+   struct lp_setup_context *setup = lp_setup_context(vbr);
+
+   if (!lp_setup_update_state(setup, TRUE))
+      return;
+
+   if (!bin_in_parallel(setup, NULL, start, nr))
+      emit_arrays(setup, start, nr);
+}
+
+
+
 static void
 lp_setup_vbuf_destroy(struct vbuf_render *vbr)
 {
@@ -600,3 +770,14 @@ lp_setup_init_vbuf(struct lp_setup_context *setup)
    setup->base.set_stream_output_info = lp_setup_so_info;
    setup->base.pipeline_statistics = lp_setup_pipeline_statistics;
 }
+
+
+/**
+ * Let the draw module emit larger batches, see bin_in_parallel().
+ */
+void
+lp_setup_init_vbuf_bin_threads(struct lp_setup_context *setup)
+{
+   setup->base.max_indices = LP_MAX_VBUF_INDEXES_PARALLEL;
+   setup->base.max_vertex_buffer_bytes = LP_MAX_VBUF_SIZE_PARALLEL;
+}
@@ -0,0 +1,1135 @@
+/**************************************************************************
+ *
+ * Copyright 2018 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * Compute shaders.
+ *
+ * Each workgroup runs on a single thread: the generated code loops over
+ * the vectors of invocations of the workgroup.  Barriers outside of
+ * control flow cut the shader into phases, compiled into separate
+ * functions, so that every invocation reaches a barrier before any goes
+ * past it.  Temporaries live across phases in memory provided by the
+ * caller.  Workgroups are distributed among the threads of a util_queue.
+ */
+
+#include "pipe/p_defines.h"
+#include "util/u_inlines.h"
+#include "util/u_memory.h"
+#include "util/u_math.h"
+#include "util/u_format.h"
+#include "util/u_string.h"
+#include "util/u_atomic.h"
+#include "util/u_queue.h"
+#include "util/simple_list.h"
+#include "pipe/p_shader_tokens.h"
+#include "tgsi/tgsi_dump.h"
+#include "tgsi/tgsi_parse.h"
+#include "gallivm/lp_bld_type.h"
+#include "gallivm/lp_bld_const.h"
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_intr.h"
+#include "gallivm/lp_bld_flow.h"
+#include "gallivm/lp_bld_tgsi.h"
+#include "gallivm/lp_bld_format.h"
+#include "gallivm/lp_bld_debug.h"
+
+#include "lp_context.h"
+#include "lp_debug.h"
+#include "lp_flush.h"
+#include "lp_limits.h"
+#include "lp_query.h"
+#include "lp_screen.h"
+#include "lp_state.h"
+#include "lp_state_cs.h"
+#include "lp_tex_sample.h"
+#include "lp_texture.h"
+#include "state_tracker/sw_winsys.h"
+
+
+/** Maximum number of variants kept for each compute shader */
+#define LP_MAX_CS_VARIANTS 32
+
+
+static unsigned cs_no = 0;
+
+
+/**
+ * Find the barriers outside of control flow, which delimit the phases of
+ * the shader.
+ *
+ * Returns FALSE if some barrier can't be implemented that way, because it
+ * is inside control flow or there are too many of them.
+ */
+static boolean
+scan_phases(struct lp_compute_shader *shader)
+{
+   struct tgsi_parse_context parse;
+   unsigned pc = 0;
+   unsigned depth = 0;
+   boolean too_many = FALSE;
+   boolean in_control_flow = FALSE;
+
+   shader->num_phases = 1;
+   shader->phase_start[0] = 0;
+
+   tgsi_parse_init(&parse, shader->base.tokens);
+
+   while (!tgsi_parse_end_of_tokens(&parse)) {
+      tgsi_parse_token(&parse);
+
+      if (parse.FullToken.Token.Type != TGSI_TOKEN_TYPE_INSTRUCTION)
+         continue;
+
+      switch (parse.FullToken.FullInstruction.Instruction.Opcode) {
+      case TGSI_OPCODE_IF:
+      case TGSI_OPCODE_UIF:
+      case TGSI_OPCODE_BGNLOOP:
+      case TGSI_OPCODE_SWITCH:
+      case TGSI_OPCODE_BGNSUB:
+         depth++;
+         break;
+      case TGSI_OPCODE_ENDIF:
+      case TGSI_OPCODE_ENDLOOP:
+      case TGSI_OPCODE_ENDSWITCH:
+      case TGSI_OPCODE_ENDSUB:
+         depth--;
+         break;
+      case TGSI_OPCODE_BARRIER:
+         if (depth == 0) {
+            if (shader->num_phases < LP_MAX_CS_PHASES)
+               shader->phase_start[shader->num_phases++] = pc + 1;
+            else
+               too_many = TRUE;
+         }
+         else {
+            in_control_flow = TRUE;
+         }
+         break;
+      default:
+         break;
+      }
+
+      pc++;
+   }
+
+   tgsi_parse_free(&parse);
+
+   if (too_many || in_control_flow) {
+      shader->num_phases = 1;
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Whether the shader declares a workgroup size small enough to run in a
+ * single vector, in lockstep, where barriers need no phases at all.
+ */
+static boolean
+fixed_block_fits_vector(const struct lp_compute_shader *shader)
+{
+   const unsigned *props = shader->info.properties;
+   unsigned vector_length = MIN2(lp_native_vector_width / 32, 16);
+   unsigned block_size = props[TGSI_PROPERTY_CS_FIXED_BLOCK_WIDTH] *
+                         props[TGSI_PROPERTY_CS_FIXED_BLOCK_HEIGHT] *
+                         props[TGSI_PROPERTY_CS_FIXED_BLOCK_DEPTH];
+
+   /* zero if the size is only known at launch */
+   return block_size != 0 && block_size <= vector_length;
+}
+
+
+/**
+ * Generate the function running one phase of the shader for all the
+ * invocations of a workgroup.
+ */
+static void
+generate_compute(struct lp_compute_shader *shader,
+                 struct lp_compute_shader_variant *variant,
+                 unsigned phase)
+{
+   struct gallivm_state *gallivm = variant->gallivm;
+   const struct lp_compute_shader_variant_key *key = &variant->key;
+   LLVMContextRef lc = gallivm->context;
+   char func_name[64];
+   struct lp_type cs_type;
+   struct lp_type int_type;
+   LLVMTypeRef int32_type = LLVMInt32TypeInContext(lc);
+   LLVMTypeRef int8_ptr_type = LLVMPointerType(LLVMInt8TypeInContext(lc), 0);
+   LLVMTypeRef arg_types[11];
+   LLVMTypeRef func_type;
+   LLVMValueRef function;
+   LLVMValueRef context_ptr;
+   LLVMValueRef shared_ptr;
+   LLVMValueRef shared_size;
+   LLVMValueRef temps_ptr;
+   LLVMValueRef thread_data_ptr;
+   LLVMValueRef consts_ptr, num_consts_ptr;
+   LLVMValueRef num_invocations, invocation, tid, mask_val;
+   LLVMValueRef outputs[PIPE_MAX_SHADER_OUTPUTS][TGSI_NUM_CHANNELS];
+   LLVMBasicBlockRef block;
+   LLVMBuilderRef builder;
+   struct lp_build_sampler_soa *sampler;
+   struct lp_build_image_soa *image;
+   struct lp_build_for_loop_state loop_state;
+   struct lp_build_mask_context mask;
+   struct lp_bld_tgsi_system_values system_values;
+   struct lp_build_tgsi_mem_iface mem_iface;
+   unsigned num_vectors, temps_size;
+   unsigned i;
+
+   memset(&cs_type, 0, sizeof cs_type);
+   cs_type.floating = TRUE;      /* floating point values */
+   cs_type.sign = TRUE;          /* values are signed */
+   cs_type.norm = FALSE;         /* values are not limited to [0,1] or [-1,1] */
+   cs_type.width = 32;           /* 32-bit float */
+   cs_type.length = MIN2(lp_native_vector_width / 32, 16);
+
+   int_type = lp_int_type(cs_type);
+
+   num_vectors = (key->block_size[0] * key->block_size[1] * key->block_size[2] +
+                  cs_type.length - 1) / cs_type.length;
+
+   /* size in bytes of the temporaries of one vector of invocations */
+   temps_size = (shader->info.file_max[TGSI_FILE_TEMPORARY] + 1) *
+                TGSI_NUM_CHANNELS * cs_type.length * 4;
+
+   /*
+    * Generate the function prototype. Any change here must be reflected in
+    * lp_jit.h's lp_jit_cs_func function pointer type, and vice-versa.
+    */
+
+   util_snprintf(func_name, sizeof(func_name), "cs%u_variant%u_phase%u",
+                 shader->no, variant->no, phase);
+
+   arg_types[0] = variant->jit_context_ptr_type;       /* context */
+   arg_types[1] = int32_type;                          /* block_id_x */
+   arg_types[2] = int32_type;                          /* block_id_y */
+   arg_types[3] = int32_type;                          /* block_id_z */
+   arg_types[4] = int32_type;                          /* grid_size_x */
+   arg_types[5] = int32_type;                          /* grid_size_y */
+   arg_types[6] = int32_type;                          /* grid_size_z */
+   arg_types[7] = int8_ptr_type;                       /* shared */
+   arg_types[8] = int32_type;                          /* shared_size */
+   arg_types[9] = int8_ptr_type;                       /* temps */
+   arg_types[10] = variant->jit_thread_data_ptr_type;  /* per thread data */
+
+   func_type = LLVMFunctionType(LLVMVoidTypeInContext(lc),
+                                arg_types, ARRAY_SIZE(arg_types), 0);
+
+   function = LLVMAddFunction(gallivm->module, func_name, func_type);
+   LLVMSetFunctionCallConv(function, LLVMCCallConv);
+
+   variant->function[phase] = function;
+
+   for(i = 0; i < ARRAY_SIZE(arg_types); ++i)
+      if(LLVMGetTypeKind(arg_types[i]) == LLVMPointerTypeKind)
+         lp_add_function_attr(function, i + 1, LP_FUNC_ATTR_NOALIAS);
+
+   memset(&system_values, 0, sizeof(system_values));
+
+   context_ptr  = LLVMGetParam(function, 0);
+   for (i = 0; i < 3; i++) {
+      system_values.block_id[i] = LLVMGetParam(function, 1 + i);
+      system_values.grid_size[i] = LLVMGetParam(function, 4 + i);
+      system_values.block_size[i] =
+         lp_build_const_int32(gallivm, key->block_size[i]);
+   }
+   shared_ptr   = LLVMGetParam(function, 7);
+   shared_size  = LLVMGetParam(function, 8);
+   temps_ptr    = LLVMGetParam(function, 9);
+   thread_data_ptr = LLVMGetParam(function, 10);
+
+   lp_build_name(context_ptr, "context");
+   lp_build_name(system_values.block_id[0], "block_id_x");
+   lp_build_name(system_values.block_id[1], "block_id_y");
+   lp_build_name(system_values.block_id[2], "block_id_z");
+   lp_build_name(system_values.grid_size[0], "grid_size_x");
+   lp_build_name(system_values.grid_size[1], "grid_size_y");
+   lp_build_name(system_values.grid_size[2], "grid_size_z");
+   lp_build_name(shared_ptr, "shared");
+   lp_build_name(shared_size, "shared_size");
+   lp_build_name(temps_ptr, "temps");
+   lp_build_name(thread_data_ptr, "thread_data");
+
+   /*
+    * Function body
+    */
+
+   block = LLVMAppendBasicBlockInContext(lc, function, "entry");
+   builder = gallivm->builder;
+   assert(builder);
+   LLVMPositionBuilderAtEnd(builder, block);
+
+   sampler = lp_llvm_sampler_soa_create(key->state);
+   image = lp_llvm_image_soa_create(key->image_state);
+
+   consts_ptr = lp_jit_context_constants(gallivm, context_ptr);
+   num_consts_ptr = lp_jit_context_num_constants(gallivm, context_ptr);
+
+   num_invocations =
+      lp_build_const_int_vec(gallivm, int_type,
+                             key->block_size[0] * key->block_size[1] *
+                             key->block_size[2]);
+
+   lp_build_for_loop_begin(&loop_state, gallivm,
+                           lp_build_const_int32(gallivm, 0),
+                           LLVMIntULT,
+                           lp_build_const_int32(gallivm, num_vectors),
+                           lp_build_const_int32(gallivm, 1));
+
+   /* flat index of each invocation of this vector within the workgroup */
+   {
+      LLVMValueRef elems[LP_MAX_VECTOR_LENGTH];
+
+      for (i = 0; i < cs_type.length; i++)
+         elems[i] = lp_build_const_int32(gallivm, i);
+
+      invocation = LLVMBuildMul(builder, loop_state.counter,
+                                lp_build_const_int32(gallivm, cs_type.length),
+                                "");
+      invocation = lp_build_broadcast(gallivm,
+                                      lp_build_vec_type(gallivm, int_type),
+                                      invocation);
+      invocation = LLVMBuildAdd(builder, invocation,
+                                LLVMConstVector(elems, cs_type.length),
+                                "invocation");
+   }
+
+   tid = invocation;
+   system_values.thread_id[0] =
+      LLVMBuildURem(builder, tid,
+                    lp_build_const_int_vec(gallivm, int_type,
+                                           key->block_size[0]), "");
+   tid = LLVMBuildUDiv(builder, tid,
+                       lp_build_const_int_vec(gallivm, int_type,
+                                              key->block_size[0]), "");
+   system_values.thread_id[1] =
+      LLVMBuildURem(builder, tid,
+                    lp_build_const_int_vec(gallivm, int_type,
+                                           key->block_size[1]), "");
+   system_values.thread_id[2] =
+      LLVMBuildUDiv(builder, tid,
+                    lp_build_const_int_vec(gallivm, int_type,
+                                           key->block_size[1]), "");
+
+   /* the last vector may be partially filled */
+   mask_val = LLVMBuildICmp(builder, LLVMIntULT, invocation,
+                            num_invocations, "");
+   mask_val = LLVMBuildSExt(builder, mask_val,
+                            lp_build_vec_type(gallivm, int_type), "");
+
+   memset(&mem_iface, 0, sizeof mem_iface);
+   mem_iface.ssbo_ptr = lp_jit_context_ssbos(gallivm, context_ptr);
+   mem_iface.ssbo_sizes_ptr = lp_jit_context_num_ssbos(gallivm, context_ptr);
+   mem_iface.shared_ptr = shared_ptr;
+   mem_iface.shared_size = shared_size;
+   mem_iface.image = image;
+   if (variant->num_phases > 1) {
+      /* each vector of invocations keeps its temporaries across phases */
+      LLVMValueRef temps_offset =
+         LLVMBuildMul(builder, loop_state.counter,
+                      lp_build_const_int32(gallivm, temps_size), "");
+      mem_iface.temps_ptr =
+         LLVMBuildGEP(builder, temps_ptr, &temps_offset, 1, "temps");
+      mem_iface.start_pc = shader->phase_start[phase];
+      mem_iface.split_at_barriers = TRUE;
+   }
+
+   memset(outputs, 0, sizeof outputs);
+
+   lp_build_mask_begin(&mask, gallivm, cs_type, mask_val);
+
+   lp_build_tgsi_soa(gallivm, shader->base.tokens, cs_type, &mask,
+                     consts_ptr, num_consts_ptr, &system_values,
+                     NULL,
+                     outputs, context_ptr, thread_data_ptr,
+                     sampler, &shader->info, NULL, &mem_iface);
+
+   lp_build_mask_end(&mask);
+
+   lp_build_for_loop_end(&loop_state);
+
+   sampler->destroy(sampler);
+   image->destroy(image);
+
+   LLVMBuildRetVoid(builder);
+
+   gallivm_verify_function(gallivm, function);
+}
+
+
+/**
+ * Generate a new compute shader variant for the given key.
+ */
+static struct lp_compute_shader_variant *
+generate_variant(struct llvmpipe_context *lp,
+                 struct lp_compute_shader *shader,
+                 const struct lp_compute_shader_variant_key *key)
+{
+   struct lp_compute_shader_variant *variant;
+   char module_name[64];
+   unsigned vector_length = MIN2(lp_native_vector_width / 32, 16);
+   unsigned phase;
+
+   variant = CALLOC_STRUCT(lp_compute_shader_variant);
+   if (!variant)
+      return NULL;
+
+   util_snprintf(module_name, sizeof(module_name), "cs%u_variant%u",
+                 shader->no, shader->variants_created);
+
+   variant->gallivm = gallivm_create(module_name, lp->context, NULL);
+   if (!variant->gallivm) {
+      FREE(variant);
+      return NULL;
+   }
+
+   variant->shader = shader;
+   variant->list_item_local.base = variant;
+   variant->no = shader->variants_created++;
+
+   memcpy(&variant->key, key, sizeof variant->key);
+
+   /*
+    * A workgroup fitting in a single vector runs in lockstep, so barriers
+    * need no splitting.
+    */
+   if (key->block_size[0] * key->block_size[1] * key->block_size[2] >
+       vector_length)
+      variant->num_phases = shader->num_phases;
+   else
+      variant->num_phases = 1;
+
+   lp_jit_init_cs_types(variant);
+
+   for (phase = 0; phase < variant->num_phases; phase++)
+      generate_compute(shader, variant, phase);
+
+   gallivm_compile_module(variant->gallivm);
+
+   for (phase = 0; phase < variant->num_phases; phase++) {
+      variant->jit_function[phase] = (lp_jit_cs_func)
+         gallivm_jit_function(variant->gallivm, variant->function[phase]);
+   }
+
+   gallivm_free_ir(variant->gallivm);
+
+   return variant;
+}
+
+
+static void
+remove_cs_variant(struct lp_compute_shader_variant *variant)
+{
+   gallivm_destroy(variant->gallivm);
+
+   remove_from_list(&variant->list_item_local);
+   variant->shader->variants_cached--;
+
+   FREE(variant);
+}
+
+
+static void
+make_variant_key(struct llvmpipe_context *lp,
+                 struct lp_compute_shader *shader,
+                 const struct pipe_grid_info *info,
+                 struct lp_compute_shader_variant_key *key)
+{
+   unsigned i;
+
+   memset(key, 0, sizeof *key);
+
+   for (i = 0; i < 3; i++)
+      key->block_size[i] = MAX2(info->block[i], 1);
+
+   key->nr_samplers = shader->info.file_max[TGSI_FILE_SAMPLER] + 1;
+   for (i = 0; i < key->nr_samplers; ++i) {
+      if (shader->info.file_mask[TGSI_FILE_SAMPLER] & (1 << i)) {
+         lp_sampler_static_sampler_state(&key->state[i].sampler_state,
+                                         lp->samplers[PIPE_SHADER_COMPUTE][i]);
+      }
+   }
+
+   if (shader->info.file_max[TGSI_FILE_SAMPLER_VIEW] != -1) {
+      key->nr_sampler_views = shader->info.file_max[TGSI_FILE_SAMPLER_VIEW] + 1;
+      for (i = 0; i < key->nr_sampler_views; ++i) {
+         if (shader->info.file_mask[TGSI_FILE_SAMPLER_VIEW] & (1 << i)) {
+            lp_llvm_sampler_static_texture_state(&key->state[i].texture_state,
+                                                 lp->sampler_views[PIPE_SHADER_COMPUTE][i]);
+         }
+      }
+   }
+   else {
+      key->nr_sampler_views = key->nr_samplers;
+      for (i = 0; i < key->nr_sampler_views; ++i) {
+         if (shader->info.file_mask[TGSI_FILE_SAMPLER] & (1 << i)) {
+            lp_llvm_sampler_static_texture_state(&key->state[i].texture_state,
+                                                 lp->sampler_views[PIPE_SHADER_COMPUTE][i]);
+         }
+      }
+   }
+
+   key->nr_images = shader->info.file_max[TGSI_FILE_IMAGE] + 1;
+   for (i = 0; i < key->nr_images; ++i) {
+      const struct pipe_image_view *view = &lp->images[i];
+
+      /* display targets can't be bound as images, treat them as unbound */
+      if (view->resource && !llvmpipe_resource(view->resource)->dt)
+         lp_sampler_static_texture_state_image(&key->image_state[i], view);
+   }
+}
+
+
+/**
+ * Find or create the variant of the bound shader for the current state.
+ */
+static struct lp_compute_shader_variant *
+update_cs_variant(struct llvmpipe_context *lp,
+                  const struct pipe_grid_info *info)
+{
+   struct lp_compute_shader *shader = lp->cs;
+   struct lp_compute_shader_variant_key key;
+   struct lp_compute_shader_variant *variant = NULL;
+   struct lp_cs_variant_list_item *li;
+
+   make_variant_key(lp, shader, info, &key);
+
+   li = first_elem(&shader->variants);
+   while(!at_end(&shader->variants, li)) {
+      if(memcmp(&li->base->key, &key, sizeof key) == 0) {
+         variant = li->base;
+         break;
+      }
+      li = next_elem(li);
+   }
+
+   if (variant) {
+      move_to_head(&shader->variants, &variant->list_item_local);
+      return variant;
+   }
+
+   /* Nothing is running by now, so the least recently used can go. */
+   if (shader->variants_cached >= LP_MAX_CS_VARIANTS)
+      remove_cs_variant(last_elem(&shader->variants)->base);
+
+   variant = generate_variant(lp, shader, &key);
+   if (variant) {
+      insert_at_head(&shader->variants, &variant->list_item_local);
+      shader->variants_cached++;
+   }
+
+   return variant;
+}
+
+
+static void *
+llvmpipe_create_compute_state(struct pipe_context *pipe,
+                              const struct pipe_compute_state *templ)
+{
+   struct lp_compute_shader *shader;
+
+   if (templ->ir_type != PIPE_SHADER_IR_TGSI)
+      return NULL;
+
+   shader = CALLOC_STRUCT(lp_compute_shader);
+   if (!shader)
+      return NULL;
+
+   shader->no = cs_no++;
+   make_empty_list(&shader->variants);
+
+   /* we need to keep a local copy of the tokens */
+   shader->base.tokens = tgsi_dup_tokens(templ->prog);
+   if (!shader->base.tokens) {
+      FREE(shader);
+      return NULL;
+   }
+
+   tgsi_scan_shader(shader->base.tokens, &shader->info);
+   shader->req_local_mem = templ->req_local_mem;
+
+   /* Running past a barrier would give wrong results, refuse the shader. */
+   if (!scan_phases(shader) && !fixed_block_fits_vector(shader)) {
+      debug_printf("llvmpipe: compute shader #%u has barriers in control "
+                   "flow or too many barriers, rejecting it\n", shader->no);
+      FREE((void *) shader->base.tokens);
+      FREE(shader);
+      return NULL;
+   }
+
+   if (LP_DEBUG & DEBUG_TGSI) {
+      debug_printf("llvmpipe: Create compute shader #%u %p:\n",
+                   shader->no, (void *) shader);
+      tgsi_dump(shader->base.tokens, 0);
+      debug_printf("phases: %u\n", shader->num_phases);
+   }
+
+   return shader;
+}
+
+
+static void
+llvmpipe_bind_compute_state(struct pipe_context *pipe, void *cs)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+
+   llvmpipe->cs = (struct lp_compute_shader *) cs;
+}
+
+
+static void
+llvmpipe_delete_compute_state(struct pipe_context *pipe, void *cs)
+{
+   struct lp_compute_shader *shader = cs;
+   struct lp_cs_variant_list_item *li;
+
+   /* Grids run synchronously, no variant can still be in use */
+   li = first_elem(&shader->variants);
+   while(!at_end(&shader->variants, li)) {
+      struct lp_cs_variant_list_item *next = next_elem(li);
+      remove_cs_variant(li->base);
+      li = next;
+   }
+
+   assert(shader->variants_cached == 0);
+   FREE((void *) shader->base.tokens);
+   FREE(shader);
+}
+
+
+static void
+llvmpipe_set_shader_buffers(struct pipe_context *pipe,
+                            enum pipe_shader_type shader,
+                            unsigned start_slot, unsigned count,
+                            const struct pipe_shader_buffer *buffers)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   unsigned i;
+
+   assert(shader < PIPE_SHADER_TYPES);
+   assert(start_slot + count <= ARRAY_SIZE(llvmpipe->ssbos[shader]));
+
+   for (i = 0; i < count; i++) {
+      struct pipe_shader_buffer *dst = &llvmpipe->ssbos[shader][start_slot + i];
+
+      if (buffers && buffers[i].buffer) {
+         pipe_resource_reference(&dst->buffer, buffers[i].buffer);
+         dst->buffer_offset = buffers[i].buffer_offset;
+         dst->buffer_size = buffers[i].buffer_size;
+      }
+      else {
+         pipe_resource_reference(&dst->buffer, NULL);
+         memset(dst, 0, sizeof *dst);
+      }
+   }
+
+   if (shader == PIPE_SHADER_FRAGMENT)
+      llvmpipe->dirty |= LP_NEW_FS_SSBOS;
+}
+
+
+static void
+llvmpipe_set_shader_images(struct pipe_context *pipe,
+                           enum pipe_shader_type shader,
+                           unsigned start_slot, unsigned count,
+                           const struct pipe_image_view *images)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   unsigned i;
+
+   /* only compute shaders can access images */
+   if (shader != PIPE_SHADER_COMPUTE)
+      return;
+
+   assert(start_slot + count <= ARRAY_SIZE(llvmpipe->images));
+
+   for (i = 0; i < count; i++) {
+      struct pipe_image_view *dst = &llvmpipe->images[start_slot + i];
+
+      if (images && images[i].resource) {
+         /* the image code only knows about linear textures */
+         if (images[i].resource->target != PIPE_BUFFER)
+            llvmpipe_resource_untile(pipe, images[i].resource);
+         pipe_resource_reference(&dst->resource, images[i].resource);
+         *dst = images[i];
+      }
+      else {
+         pipe_resource_reference(&dst->resource, NULL);
+         memset(dst, 0, sizeof *dst);
+      }
+   }
+}
+
+
+/**
+ * Setup the jit context textures from the compute sampler views, as
+ * lp_setup_set_fragment_sampler_views() does for fragment shaders.
+ */
+static void
+update_cs_textures(struct llvmpipe_context *lp,
+                   struct lp_jit_context *jit_context)
+{
+   unsigned i;
+
+   for (i = 0; i < lp->num_sampler_views[PIPE_SHADER_COMPUTE]; i++) {
+      struct pipe_sampler_view *view = lp->sampler_views[PIPE_SHADER_COMPUTE][i];
+      struct lp_jit_texture *jit_tex = &jit_context->textures[i];
+      struct pipe_resource *res;
+      struct llvmpipe_resource *lp_tex;
+      unsigned j;
+
+      if (!view)
+         continue;
+
+      res = view->texture;
+      lp_tex = llvmpipe_resource(res);
+
+      jit_tex->width = res->width0;
+      jit_tex->height = res->height0;
+      jit_tex->depth = res->depth0;
+      jit_tex->first_level = 0;
+      jit_tex->last_level = 0;
+
+      if (lp_tex->dt) {
+         /* display target texture/surface */
+         struct llvmpipe_screen *screen = llvmpipe_screen(res->screen);
+         struct sw_winsys *winsys = screen->winsys;
+         jit_tex->base = winsys->displaytarget_map(winsys, lp_tex->dt,
+                                                   PIPE_TRANSFER_READ);
+         jit_tex->row_stride[0] = lp_tex->row_stride[0];
+         jit_tex->img_stride[0] = lp_tex->img_stride[0];
+         jit_tex->mip_offsets[0] = 0;
+      }
+      else if (llvmpipe_resource_is_texture(res)) {
+         jit_tex->base = lp_tex->tex_data;
+         jit_tex->first_level = view->u.tex.first_level;
+         jit_tex->last_level = view->u.tex.last_level;
+
+         for (j = jit_tex->first_level; j <= jit_tex->last_level; j++) {
+            jit_tex->mip_offsets[j] = lp_tex->mip_offsets[j];
+            jit_tex->row_stride[j] = lp_tex->row_stride[j];
+            jit_tex->img_stride[j] = lp_tex->img_stride[j];
+         }
+         if (res->nr_samples > 1) {
+            /* samples are fetched as images within the layer */
+            jit_tex->img_stride[0] = lp_tex->sample_stride;
+         }
+
+         if (res->target == PIPE_TEXTURE_1D_ARRAY ||
+             res->target == PIPE_TEXTURE_2D_ARRAY ||
+             res->target == PIPE_TEXTURE_CUBE ||
+             res->target == PIPE_TEXTURE_CUBE_ARRAY) {
+            /* the first layer goes in the mip level offsets */
+            jit_tex->depth = view->u.tex.last_layer - view->u.tex.first_layer + 1;
+            for (j = jit_tex->first_level; j <= jit_tex->last_level; j++) {
+               jit_tex->mip_offsets[j] += view->u.tex.first_layer *
+                                          lp_tex->img_stride[j];
+            }
+         }
+      }
+      else {
+         /* buffers are sized in elements and offset through the base */
+         unsigned view_blocksize = util_format_get_blocksize(view->format);
+
+         jit_tex->mip_offsets[0] = 0;
+         jit_tex->row_stride[0] = 0;
+         jit_tex->img_stride[0] = 0;
+         jit_tex->width = view->u.buf.size / view_blocksize;
+         jit_tex->base = (uint8_t *)lp_tex->data + view->u.buf.offset;
+      }
+   }
+
+   for (i = 0; i < lp->num_samplers[PIPE_SHADER_COMPUTE]; i++) {
+      const struct pipe_sampler_state *sampler =
+         lp->samplers[PIPE_SHADER_COMPUTE][i];
+      struct lp_jit_sampler *jit_sam = &jit_context->samplers[i];
+
+      if (!sampler)
+         continue;
+
+      jit_sam->min_lod = sampler->min_lod;
+      jit_sam->max_lod = sampler->max_lod;
+      jit_sam->lod_bias = sampler->lod_bias;
+      COPY_4V(jit_sam->border_color, sampler->border_color.f);
+   }
+}
+
+
+/**
+ * Setup the jit context images.  The level and first layer of the view
+ * are resolved here, so the shader sees a single level image.
+ */
+static void
+update_cs_images(struct llvmpipe_context *lp,
+                 const struct lp_compute_shader_variant_key *key,
+                 struct lp_jit_context *jit_context)
+{
+   unsigned i;
+
+   for (i = 0; i < key->nr_images; i++) {
+      const struct pipe_image_view *view = &lp->images[i];
+      struct lp_jit_image *jit_image = &jit_context->images[i];
+      struct llvmpipe_resource *lp_res;
+      struct pipe_resource *res;
+
+      if (key->image_state[i].format == PIPE_FORMAT_NONE)
+         continue;
+
+      res = view->resource;
+      lp_res = llvmpipe_resource(res);
+
+      if (llvmpipe_resource_is_texture(res)) {
+         unsigned level = view->u.tex.level;
+
+         jit_image->width = u_minify(res->width0, level);
+         jit_image->height = u_minify(res->height0, level);
+         jit_image->depth = view->u.tex.last_layer - view->u.tex.first_layer + 1;
+         jit_image->row_stride = lp_res->row_stride[level];
+         jit_image->img_stride = lp_res->img_stride[level];
+         jit_image->base = (uint8_t *)lp_res->tex_data +
+                           lp_res->mip_offsets[level] +
+                           view->u.tex.first_layer * lp_res->img_stride[level];
+      }
+      else {
+         unsigned blocksize = util_format_get_blocksize(view->format);
+
+         jit_image->width = view->u.buf.size / blocksize;
+         jit_image->height = 1;
+         jit_image->depth = 1;
+         jit_image->row_stride = 0;
+         jit_image->img_stride = 0;
+         jit_image->base = (uint8_t *)lp_res->data + view->u.buf.offset;
+      }
+   }
+}
+
+
+/**
+ * Setup the jit context constant and shader buffers.
+ */
+static void
+update_cs_buffers(struct llvmpipe_context *lp,
+                  struct lp_jit_context *jit_context)
+{
+   /* unbound buffers have size zero, but must point to readable memory */
+   static const float fake_const_buf[4];
+   static uint32_t fake_ssbo[4];
+   unsigned i;
+
+   for (i = 0; i < LP_MAX_TGSI_CONST_BUFFERS; i++) {
+      const struct pipe_constant_buffer *cb = &lp->constants[PIPE_SHADER_COMPUTE][i];
+      const ubyte *data = NULL;
+
+      if (cb->buffer)
+         data = (const ubyte *) llvmpipe_resource_data(cb->buffer);
+      else if (cb->user_buffer)
+         data = (const ubyte *) cb->user_buffer;
+
+      if (data) {
+         jit_context->constants[i] = (const float *)(data + cb->buffer_offset);
+         jit_context->num_constants[i] =
+            MIN2(cb->buffer_size, LP_MAX_TGSI_CONST_BUFFER_SIZE) /
+            (sizeof(float) * 4);
+      }
+      else {
+         jit_context->constants[i] = fake_const_buf;
+         jit_context->num_constants[i] = 0;
+      }
+   }
+
+   for (i = 0; i < LP_MAX_TGSI_SHADER_BUFFERS; i++) {
+      const struct pipe_shader_buffer *sb = &lp->ssbos[PIPE_SHADER_COMPUTE][i];
+
+      if (sb->buffer) {
+         jit_context->ssbos[i] =
+            (uint8_t *) llvmpipe_resource_data(sb->buffer) + sb->buffer_offset;
+         jit_context->num_ssbos[i] = sb->buffer_size;
+      }
+      else {
+         jit_context->ssbos[i] = (uint8_t *) fake_ssbo;
+         jit_context->num_ssbos[i] = 0;
+      }
+   }
+}
+
+
+/**
+ * Wait for the rendering using any of the resources bound to the compute
+ * shader, as it may write to any of them.
+ */
+static void
+flush_cs_resources(struct llvmpipe_context *lp,
+                   const struct pipe_grid_info *info)
+{
+   struct pipe_context *pipe = &lp->pipe;
+   unsigned i;
+
+   for (i = 0; i < LP_MAX_TGSI_CONST_BUFFERS; i++) {
+      if (lp->constants[PIPE_SHADER_COMPUTE][i].buffer)
+         llvmpipe_flush_resource(pipe, lp->constants[PIPE_SHADER_COMPUTE][i].buffer,
+                                 0, TRUE, TRUE, FALSE, "compute");
+   }
+   for (i = 0; i < lp->num_sampler_views[PIPE_SHADER_COMPUTE]; i++) {
+      if (lp->sampler_views[PIPE_SHADER_COMPUTE][i])
+         llvmpipe_flush_resource(pipe, lp->sampler_views[PIPE_SHADER_COMPUTE][i]->texture,
+                                 0, TRUE, TRUE, FALSE, "compute");
+   }
+   for (i = 0; i < LP_MAX_TGSI_SHADER_BUFFERS; i++) {
+      if (lp->ssbos[PIPE_SHADER_COMPUTE][i].buffer)
+         llvmpipe_flush_resource(pipe, lp->ssbos[PIPE_SHADER_COMPUTE][i].buffer,
+                                 0, FALSE, TRUE, FALSE, "compute");
+   }
+   for (i = 0; i < LP_MAX_TGSI_SHADER_IMAGES; i++) {
+      if (lp->images[i].resource)
+         llvmpipe_flush_resource(pipe, lp->images[i].resource,
+                                 0, FALSE, TRUE, FALSE, "compute");
+   }
+   if (info->indirect)
+      llvmpipe_flush_resource(pipe, info->indirect,
+                              0, TRUE, TRUE, FALSE, "compute");
+}
+
+
+/**
+ * Shared state of the threads running a grid.
+ */
+struct lp_cs_dispatch
+{
+   const struct lp_compute_shader_variant *variant;
+   const struct lp_jit_context *jit_context;
+   uint32_t grid_size[3];
+   unsigned num_groups;
+   unsigned shared_size;
+
+   /** Next workgroup to run, atomically incremented */
+   int next_group;
+};
+
+
+/**
+ * The work of one thread, with its private memory.
+ */
+struct lp_cs_job
+{
+   struct lp_cs_dispatch *dispatch;
+   struct lp_jit_thread_data thread_data;
+   uint8_t *shared;
+   void *temps;
+   struct util_queue_fence fence;
+};
+
+
+/**
+ * Run workgroups until there are none left.
+ */
+static void
+cs_job_execute(void *data, int thread_index)
+{
+   struct lp_cs_job *job = (struct lp_cs_job *) data;
+   struct lp_cs_dispatch *dispatch = job->dispatch;
+   const struct lp_compute_shader_variant *variant = dispatch->variant;
+   const uint32_t *grid_size = dispatch->grid_size;
+   unsigned group, phase;
+
+   while ((group = (unsigned) p_atomic_inc_return(&dispatch->next_group) - 1) <
+          dispatch->num_groups) {
+      uint32_t x = group % grid_size[0];
+      uint32_t y = (group / grid_size[0]) % grid_size[1];
+      uint32_t z = group / (grid_size[0] * grid_size[1]);
+
+      for (phase = 0; phase < variant->num_phases; phase++) {
+         variant->jit_function[phase](dispatch->jit_context,
+                                      x, y, z,
+                                      grid_size[0], grid_size[1], grid_size[2],
+                                      job->shared, dispatch->shared_size,
+                                      job->temps, &job->thread_data);
+      }
+   }
+}
+
+
+static void
+llvmpipe_launch_grid(struct pipe_context *pipe,
+                     const struct pipe_grid_info *info)
+{
+   struct llvmpipe_context *lp = llvmpipe_context(pipe);
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+   struct lp_compute_shader *shader = lp->cs;
+   struct lp_compute_shader_variant *variant;
+   struct lp_jit_context *jit_context;
+   struct lp_cs_dispatch dispatch;
+   struct lp_cs_job *jobs;
+   unsigned vector_length = MIN2(lp_native_vector_width / 32, 16);
+   unsigned num_jobs, temps_size = 0;
+   unsigned i;
+
+   if (!shader)
+      return;
+
+   if (!llvmpipe_check_render_cond(lp))
+      return;
+
+   flush_cs_resources(lp, info);
+
+   memset(&dispatch, 0, sizeof dispatch);
+
+   if (info->indirect) {
+      const uint32_t *params = (const uint32_t *)
+         ((const uint8_t *) llvmpipe_resource_data(info->indirect) +
+          info->indirect_offset);
+      memcpy(dispatch.grid_size, params, sizeof dispatch.grid_size);
+   }
+   else {
+      memcpy(dispatch.grid_size, info->grid, sizeof dispatch.grid_size);
+   }
+
+   dispatch.num_groups = dispatch.grid_size[0] * dispatch.grid_size[1] *
+                         dispatch.grid_size[2];
+   if (!dispatch.num_groups)
+      return;
+
+   variant = update_cs_variant(lp, info);
+   if (!variant)
+      return;
+
+   jit_context = align_malloc(sizeof *jit_context, 16);
+   if (!jit_context)
+      return;
+   memset(jit_context, 0, sizeof *jit_context);
+
+   update_cs_buffers(lp, jit_context);
+   update_cs_textures(lp, jit_context);
+   update_cs_images(lp, &variant->key, jit_context);
+
+   dispatch.variant = variant;
+   dispatch.jit_context = jit_context;
+   dispatch.shared_size = shader->req_local_mem;
+
+   if (variant->num_phases > 1) {
+      unsigned num_invocations = variant->key.block_size[0] *
+                                 variant->key.block_size[1] *
+                                 variant->key.block_size[2];
+      temps_size = (num_invocations + vector_length - 1) / vector_length *
+                   (shader->info.file_max[TGSI_FILE_TEMPORARY] + 1) *
+                   TGSI_NUM_CHANNELS * vector_length * 4;
+   }
+
+   num_jobs = 1;
+   if (util_queue_is_initialized(&screen->cs_queue))
+      num_jobs = MIN2(screen->num_threads, dispatch.num_groups);
+
+   jobs = CALLOC(num_jobs, sizeof *jobs);
+   if (!jobs) {
+      align_free(jit_context);
+      return;
+   }
+
+   for (i = 0; i < num_jobs; i++) {
+      struct lp_cs_job *job = &jobs[i];
+
+      job->dispatch = &dispatch;
+      job->thread_data.cache =
+         align_malloc(sizeof(struct lp_build_format_cache), 16);
+      /* allocate a little even if unused, the code may still read it */
+      job->shared = align_malloc(MAX2(dispatch.shared_size, 16), 16);
+      if (temps_size)
+         job->temps = align_malloc(temps_size, 64);
+      util_queue_fence_init(&job->fence);
+
+      if (!job->thread_data.cache || !job->shared ||
+          (temps_size && !job->temps)) {
+         /* run the grid with the jobs allocated so far */
+         util_queue_fence_destroy(&job->fence);
+         align_free(job->thread_data.cache);
+         align_free(job->shared);
+         align_free(job->temps);
+         num_jobs = i;
+         break;
+      }
+   }
+
+   /* Run the first share of the workgroups on this thread */
+   for (i = 1; i < num_jobs; i++) {
+      util_queue_add_job(&screen->cs_queue, &jobs[i], &jobs[i].fence,
+                         cs_job_execute, NULL);
+   }
+
+   if (num_jobs)
+      cs_job_execute(&jobs[0], 0);
+
+   for (i = 0; i < num_jobs; i++) {
+      if (i > 0)
+         util_queue_fence_wait(&jobs[i].fence);
+      util_queue_fence_destroy(&jobs[i].fence);
+      align_free(jobs[i].thread_data.cache);
+      align_free(jobs[i].shared);
+      align_free(jobs[i].temps);
+   }
+
+   FREE(jobs);
+   align_free(jit_context);
+
+   /* Textures may have been written */
+   screen->timestamp++;
+}
+
+
+void
+llvmpipe_init_compute_funcs(struct llvmpipe_context *llvmpipe)
+{
+   llvmpipe->pipe.create_compute_state = llvmpipe_create_compute_state;
+   llvmpipe->pipe.bind_compute_state = llvmpipe_bind_compute_state;
+   llvmpipe->pipe.delete_compute_state = llvmpipe_delete_compute_state;
+   llvmpipe->pipe.set_shader_buffers = llvmpipe_set_shader_buffers;
+   llvmpipe->pipe.set_shader_images = llvmpipe_set_shader_images;
+   llvmpipe->pipe.launch_grid = llvmpipe_launch_grid;
+}
+
+
+/**
+ * Release the shader buffers and images of the context.
+ */
+void
+llvmpipe_cleanup_compute(struct llvmpipe_context *llvmpipe)
+{
+   unsigned i, j;
+
+   for (i = 0; i < ARRAY_SIZE(llvmpipe->ssbos); i++) {
+      for (j = 0; j < ARRAY_SIZE(llvmpipe->ssbos[i]); j++) {
+         pipe_resource_reference(&llvmpipe->ssbos[i][j].buffer, NULL);
+      }
+   }
+
+   for (i = 0; i < ARRAY_SIZE(llvmpipe->images); i++) {
+      pipe_resource_reference(&llvmpipe->images[i].resource, NULL);
+   }
+}
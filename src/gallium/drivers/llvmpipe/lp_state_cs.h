@@ -0,0 +1,134 @@
+/**************************************************************************
+ *
+ * Copyright 2018 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+
+#ifndef LP_STATE_CS_H_
+#define LP_STATE_CS_H_
+
+
+#include "pipe/p_compiler.h"
+#include "pipe/p_state.h"
+#include "tgsi/tgsi_scan.h" /* for tgsi_shader_info */
+#include "gallivm/lp_bld_sample.h" /* for struct lp_static_texture_state */
+#include "lp_jit.h"
+#include "lp_state_fs.h" /* for struct lp_sampler_static_state */
+
+
+struct llvmpipe_context;
+struct lp_compute_shader;
+
+
+/**
+ * Maximum number of pieces a compute shader is cut into by its barriers.
+ * Shaders with more barriers outside of control flow are not split at the
+ * extra ones.
+ */
+#define LP_MAX_CS_PHASES 16
+
+
+struct lp_compute_shader_variant_key
+{
+   /** Workgroup dimensions */
+   unsigned block_size[3];
+
+   unsigned nr_samplers:8;
+   unsigned nr_sampler_views:8;
+   unsigned nr_images:8;
+
+   struct lp_static_texture_state image_state[LP_MAX_TGSI_SHADER_IMAGES];
+   struct lp_sampler_static_state state[PIPE_MAX_SHADER_SAMPLER_VIEWS];
+};
+
+
+/** doubly-linked list item */
+struct lp_cs_variant_list_item
+{
+   struct lp_compute_shader_variant *base;
+   struct lp_cs_variant_list_item *next, *prev;
+};
+
+
+struct lp_compute_shader_variant
+{
+   struct lp_compute_shader_variant_key key;
+
+   struct gallivm_state *gallivm;
+
+   LLVMTypeRef jit_context_ptr_type;
+   LLVMTypeRef jit_thread_data_ptr_type;
+
+   /**
+    * One function per phase, run in order for every workgroup.  Workgroups
+    * fitting in a single vector run in lockstep and are never split.
+    */
+   unsigned num_phases;
+   LLVMValueRef function[LP_MAX_CS_PHASES];
+
+   lp_jit_cs_func jit_function[LP_MAX_CS_PHASES];
+
+   struct lp_cs_variant_list_item list_item_local;
+   struct lp_compute_shader *shader;
+
+   /* For debugging/profiling purposes */
+   unsigned no;
+};
+
+
+/** Subclass of pipe_compute_state */
+struct lp_compute_shader
+{
+   struct pipe_shader_state base;
+
+   struct tgsi_shader_info info;
+
+   /** Workgroup shared memory size in bytes */
+   unsigned req_local_mem;
+
+   /**
+    * Index of the first instruction of each phase.  Phases are separated
+    * by the barriers outside of control flow.
+    */
+   unsigned num_phases;
+   unsigned phase_start[LP_MAX_CS_PHASES];
+
+   struct lp_cs_variant_list_item variants;
+
+   /* For debugging/profiling purposes */
+   unsigned no;
+   unsigned variants_created;
+   unsigned variants_cached;
+};
+
+
+void
+llvmpipe_init_compute_funcs(struct llvmpipe_context *llvmpipe);
+
+void
+llvmpipe_cleanup_compute(struct llvmpipe_context *llvmpipe);
+
+
+#endif /* LP_STATE_CS_H_ */
@@ -65,9 +65,12 @@
 #include "util/u_format.h"
 #include "util/u_dump.h"
 #include "util/u_string.h"
+#include "util/u_atomic.h"
 #include "util/simple_list.h"
 #include "util/u_dual_blend.h"
+#include "util/u_framebuffer.h"
 #include "util/os_time.h"
+#include "util/mesa-sha1.h"
 #include "pipe/p_shader_tokens.h"
 #include "draw/draw_context.h"
 #include "tgsi/tgsi_dump.h"
@@ -96,6 +99,7 @@
 #include "lp_context.h"
 #include "lp_debug.h"
 #include "lp_perf.h"
+#include "lp_screen.h"
 #include "lp_setup.h"
 #include "lp_state.h"
 #include "lp_tex_sample.h"
@@ -287,6 +291,156 @@ lp_build_depth_clamp(struct gallivm_state *gallivm,
 }
 
 
+/**
+ * Evaluate coverage for each sample of a multisampled framebuffer.
+ *
+ * The shader runs once per pixel, but the context's sample mask,
+ * alpha-to-coverage, the sample mask output and the depth/stencil test are
+ * evaluated per sample.  The depth
+ * is extrapolated from the pixel center to each sample position unless the
+ * shader writes it.  The surviving sample masks are written back to
+ * sample_mask_store for blending, and pixels without any live sample are
+ * killed.
+ */
+static void
+generate_sample_tests(struct gallivm_state *gallivm,
+                      const struct lp_fragment_shader_variant_key *key,
+                      struct lp_type type,
+                      LLVMValueRef context_ptr,
+                      LLVMValueRef thread_data_ptr,
+                      struct lp_build_interp_soa_context *interp,
+                      const struct util_format_description *zs_format_desc,
+                      unsigned depth_mode,
+                      boolean z_written,
+                      LLVMValueRef z,
+                      LLVMValueRef *stencil_refs,
+                      LLVMValueRef facing,
+                      LLVMValueRef alpha,
+                      LLVMValueRef smask,
+                      LLVMValueRef depth_ptr,
+                      LLVMValueRef depth_stride,
+                      LLVMValueRef depth_sample_stride,
+                      LLVMValueRef *sample_mask_store,
+                      LLVMValueRef counter,
+                      struct lp_build_mask_context *mask)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_type int_type = lp_int_type(type);
+   struct lp_build_context bld, int_bld;
+   LLVMValueRef pixel_mask = lp_build_mask_value(mask);
+   LLVMValueRef dzdx = NULL, dzdy = NULL;
+   LLVMValueRef covered;
+   unsigned s;
+
+   lp_build_context_init(&bld, gallivm, type);
+   lp_build_context_init(&int_bld, gallivm, int_type);
+   covered = int_bld.zero;
+
+   if ((depth_mode & LATE_DEPTH_TEST) && !z_written) {
+      LLVMValueRef index = lp_build_const_int32(gallivm, 2);
+      dzdx = lp_build_extract_broadcast(gallivm, interp->setup_bld.type, type,
+                                        interp->dadxaos[0], index);
+      dzdy = lp_build_extract_broadcast(gallivm, interp->setup_bld.type, type,
+                                        interp->dadyaos[0], index);
+   }
+
+   if (smask) {
+      smask = LLVMBuildBitCast(builder, smask, int_bld.vec_type, "");
+   }
+
+   for (s = 0; s < LP_MAX_SAMPLES; s++) {
+      LLVMValueRef s_mask_ptr = LLVMBuildGEP(builder, sample_mask_store[s],
+                                             &counter, 1, "");
+      LLVMValueRef s_mask;
+
+      if (!(key->sample_mask & (1 << s))) {
+         LLVMBuildStore(builder, int_bld.zero, s_mask_ptr);
+         continue;
+      }
+
+      s_mask = LLVMBuildLoad(builder, s_mask_ptr, "");
+      s_mask = LLVMBuildAnd(builder, s_mask, pixel_mask, "");
+
+      if (alpha) {
+         /* sample s is covered when alpha > (s + 0.5) / LP_MAX_SAMPLES */
+         LLVMValueRef ref = lp_build_const_vec(gallivm, type,
+                                               (s + 0.5) / LP_MAX_SAMPLES);
+         LLVMValueRef test = lp_build_cmp(&bld, PIPE_FUNC_GREATER, alpha, ref);
+         s_mask = LLVMBuildAnd(builder, s_mask, test, "");
+      }
+
+      if (smask) {
+         LLVMValueRef bit = lp_build_const_int_vec(gallivm, int_type, 1 << s);
+         LLVMValueRef test = lp_build_and(&int_bld, smask, bit);
+         test = lp_build_cmp(&int_bld, PIPE_FUNC_NOTEQUAL, test, int_bld.zero);
+         s_mask = LLVMBuildAnd(builder, s_mask, test, "");
+      }
+
+      if (depth_mode & LATE_DEPTH_TEST) {
+         struct lp_build_mask_context s_mask_ctx;
+         LLVMValueRef z_s = z;
+         LLVMValueRef z_fb, s_fb, z_value, s_value;
+         LLVMValueRef offset, s_depth_ptr;
+
+         if (dzdx) {
+            z_s = lp_build_fmuladd(builder, dzdx,
+                                   lp_build_const_vec(gallivm, type,
+                                                      lp_sample_offsets[s][0] / 16.0),
+                                   z_s);
+            z_s = lp_build_fmuladd(builder, dzdy,
+                                   lp_build_const_vec(gallivm, type,
+                                                      lp_sample_offsets[s][1] / 16.0),
+                                   z_s);
+         }
+         if (key->depth_clamp) {
+            z_s = lp_build_depth_clamp(gallivm, builder, type, context_ptr,
+                                       thread_data_ptr, z_s);
+         }
+
+         offset = LLVMBuildMul(builder, depth_sample_stride,
+                               lp_build_const_int32(gallivm, s), "");
+         s_depth_ptr = LLVMBuildGEP(builder, depth_ptr, &offset, 1, "");
+
+         lp_build_mask_begin(&s_mask_ctx, gallivm, type, s_mask);
+         lp_build_depth_stencil_load_swizzled(gallivm, type,
+                                              zs_format_desc, key->resource_1d,
+                                              s_depth_ptr, depth_stride,
+                                              &z_fb, &s_fb, counter);
+         lp_build_depth_stencil_test(gallivm,
+                                     &key->depth,
+                                     key->stencil,
+                                     type,
+                                     zs_format_desc,
+                                     &s_mask_ctx,
+                                     stencil_refs,
+                                     z_s, z_fb, s_fb,
+                                     facing,
+                                     &z_value, &s_value,
+                                     FALSE);
+         if (depth_mode & LATE_DEPTH_WRITE) {
+            lp_build_depth_stencil_write_swizzled(gallivm, type,
+                                                  zs_format_desc, key->resource_1d,
+                                                  NULL, NULL, NULL, counter,
+                                                  s_depth_ptr, depth_stride,
+                                                  z_value, s_value);
+         }
+         s_mask = lp_build_mask_end(&s_mask_ctx);
+      }
+
+      if (key->occlusion_count) {
+         LLVMValueRef occ_counter = lp_jit_thread_data_counter(gallivm,
+                                                               thread_data_ptr);
+         lp_build_occlusion_count(gallivm, type, s_mask, occ_counter);
+      }
+
+      LLVMBuildStore(builder, s_mask, s_mask_ptr);
+      covered = LLVMBuildOr(builder, covered, s_mask, "");
+   }
+
+   lp_build_mask_update(mask, covered);
+}
+
+
 /**
  * Generate the fragment shader, depth/stencil test, and alpha tests.
  */
@@ -301,9 +455,11 @@ generate_fs_loop(struct gallivm_state *gallivm,
                  struct lp_build_interp_soa_context *interp,
                  const struct lp_build_sampler_soa *sampler,
                  LLVMValueRef mask_store,
+                 LLVMValueRef *sample_mask_store,
                  LLVMValueRef (*out_color)[4],
                  LLVMValueRef depth_ptr,
                  LLVMValueRef depth_stride,
+                 LLVMValueRef depth_sample_stride,
                  LLVMValueRef facing,
                  LLVMValueRef thread_data_ptr)
 {
@@ -320,6 +476,7 @@ generate_fs_loop(struct gallivm_state *gallivm,
    LLVMValueRef outputs[PIPE_MAX_SHADER_OUTPUTS][TGSI_NUM_CHANNELS];
    struct lp_build_for_loop_state loop_state;
    struct lp_build_mask_context mask;
+   struct lp_build_tgsi_mem_iface mem_iface;
    /*
     * TODO: figure out if simple_shader optimization is really worthwile to
     * keep. Disabled because it may hide some real bugs in the (depth/stencil)
@@ -345,7 +502,13 @@ generate_fs_loop(struct gallivm_state *gallivm,
       zs_format_desc = util_format_description(key->zsbuf_format);
       assert(zs_format_desc);
 
-      if (!shader->info.base.writes_z && !shader->info.base.writes_stencil) {
+      /*
+       * Stores to shader buffers must happen for fragments failing the
+       * depth/stencil test unless the shader asks for early tests.
+       */
+      if (!shader->info.base.writes_z && !shader->info.base.writes_stencil &&
+          (!shader->info.base.writes_memory ||
+           shader->info.base.properties[TGSI_PROPERTY_FS_EARLY_DEPTH_STENCIL])) {
          if (key->alpha.enabled ||
              key->blend.alpha_to_coverage ||
              shader->info.base.uses_kill ||
@@ -370,6 +533,13 @@ generate_fs_loop(struct gallivm_state *gallivm,
          depth_mode = LATE_DEPTH_TEST | LATE_DEPTH_WRITE;
       }
 
+      /*
+       * With multisampling the test needs the final sample coverage, so it
+       * is always done per sample after the shader.
+       */
+      if (key->multisample)
+         depth_mode = LATE_DEPTH_TEST | LATE_DEPTH_WRITE;
+
       if (!(key->depth.enabled && key->depth.writemask) &&
           !(key->stencil[0].enabled && (key->stencil[0].writemask ||
                                         (key->stencil[1].enabled &&
@@ -474,12 +644,16 @@ generate_fs_loop(struct gallivm_state *gallivm,
 
    lp_build_interp_soa_update_inputs_dyn(interp, gallivm, loop_state.counter);
 
+   memset(&mem_iface, 0, sizeof mem_iface);
+   mem_iface.ssbo_ptr = lp_jit_context_ssbos(gallivm, context_ptr);
+   mem_iface.ssbo_sizes_ptr = lp_jit_context_num_ssbos(gallivm, context_ptr);
+
    /* Build the actual shader */
    lp_build_tgsi_soa(gallivm, tokens, type, &mask,
                      consts_ptr, num_consts_ptr, &system_values,
                      interp->inputs,
                      outputs, context_ptr, thread_data_ptr,
-                     sampler, &shader->info.base, NULL);
+                     sampler, &shader->info.base, NULL, &mem_iface);
 
    /* Alpha test */
    if (key->alpha.enabled) {
@@ -504,7 +678,7 @@ generate_fs_loop(struct gallivm_state *gallivm,
    }
 
    /* Emulate Alpha to Coverage with Alpha test */
-   if (key->blend.alpha_to_coverage) {
+   if (key->blend.alpha_to_coverage && !key->multisample) {
       int color0 = find_output_by_semantic(&shader->info.base,
                                            TGSI_SEMANTIC_COLOR,
                                            0);
@@ -518,7 +692,7 @@ generate_fs_loop(struct gallivm_state *gallivm,
       }
    }
 
-   if (shader->info.base.writes_samplemask) {
+   if (shader->info.base.writes_samplemask && !key->multisample) {
       int smaski = find_output_by_semantic(&shader->info.base,
                                            TGSI_SEMANTIC_SAMPLEMASK,
                                            0);
@@ -537,8 +711,55 @@ generate_fs_loop(struct gallivm_state *gallivm,
       lp_build_mask_update(&mask, smask);
    }
 
+   if (key->multisample) {
+      int pos0 = find_output_by_semantic(&shader->info.base,
+                                         TGSI_SEMANTIC_POSITION,
+                                         0);
+      int s_out = find_output_by_semantic(&shader->info.base,
+                                          TGSI_SEMANTIC_STENCIL,
+                                          0);
+      int color0 = find_output_by_semantic(&shader->info.base,
+                                           TGSI_SEMANTIC_COLOR,
+                                           0);
+      int smaski = find_output_by_semantic(&shader->info.base,
+                                           TGSI_SEMANTIC_SAMPLEMASK,
+                                           0);
+      LLVMValueRef alpha = NULL;
+      LLVMValueRef smask = NULL;
+      boolean z_written = FALSE;
+
+      if (pos0 != -1 && outputs[pos0][2]) {
+         z = LLVMBuildLoad(builder, outputs[pos0][2], "output.z");
+         z_written = TRUE;
+      }
+
+      if (s_out != -1 && outputs[s_out][1]) {
+         /* there's only one value, and spec says to discard additional bits */
+         LLVMValueRef s_max_mask = lp_build_const_int_vec(gallivm, int_type, 255);
+         stencil_refs[0] = LLVMBuildLoad(builder, outputs[s_out][1], "output.s");
+         stencil_refs[0] = LLVMBuildBitCast(builder, stencil_refs[0], int_vec_type, "");
+         stencil_refs[0] = LLVMBuildAnd(builder, stencil_refs[0], s_max_mask, "");
+         stencil_refs[1] = stencil_refs[0];
+      }
+
+      if (key->blend.alpha_to_coverage &&
+          color0 != -1 && outputs[color0][3]) {
+         alpha = LLVMBuildLoad(builder, outputs[color0][3], "alpha");
+      }
+
+      if (shader->info.base.writes_samplemask) {
+         assert(smaski >= 0);
+         smask = LLVMBuildLoad(builder, outputs[smaski][0], "smask");
+      }
+
+      generate_sample_tests(gallivm, key, type, context_ptr, thread_data_ptr,
+                            interp, zs_format_desc, depth_mode, z_written,
+                            z, stencil_refs, facing, alpha, smask,
+                            depth_ptr, depth_stride, depth_sample_stride,
+                            sample_mask_store, loop_state.counter, &mask);
+   }
    /* Late Z test */
-   if (depth_mode & LATE_DEPTH_TEST) {
+   else if (depth_mode & LATE_DEPTH_TEST) {
       int pos0 = find_output_by_semantic(&shader->info.base,
                                          TGSI_SEMANTIC_POSITION,
                                          0);
@@ -628,7 +849,7 @@ generate_fs_loop(struct gallivm_state *gallivm,
       }
    }
 
-   if (key->occlusion_count) {
+   if (key->occlusion_count && !key->multisample) {
       LLVMValueRef counter = lp_jit_thread_data_counter(gallivm, thread_data_ptr);
       lp_build_name(counter, "counter");
       lp_build_occlusion_count(gallivm, type,
@@ -2397,8 +2618,7 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
  * 2x2 pixels.
  */
 static void
-generate_fragment(struct llvmpipe_context *lp,
-                  struct lp_fragment_shader *shader,
+generate_fragment(struct lp_fragment_shader *shader,
                   struct lp_fragment_shader_variant *variant,
                   unsigned partial_mask)
 {
@@ -2407,12 +2627,14 @@ generate_fragment(struct llvmpipe_context *lp,
    struct lp_shader_input inputs[PIPE_MAX_SHADER_INPUTS];
    char func_name[64];
    struct lp_type fs_type;
+   struct lp_type fs_blend_type;
    struct lp_type blend_type;
    LLVMTypeRef fs_elem_type;
    LLVMTypeRef blend_vec_type;
-   LLVMTypeRef arg_types[13];
+   LLVMTypeRef arg_types[15];
    LLVMTypeRef func_type;
    LLVMTypeRef int32_type = LLVMInt32TypeInContext(gallivm->context);
+   LLVMTypeRef int64_type = LLVMInt64TypeInContext(gallivm->context);
    LLVMTypeRef int8_type = LLVMInt8TypeInContext(gallivm->context);
    LLVMValueRef context_ptr;
    LLVMValueRef x;
@@ -2424,6 +2646,8 @@ generate_fragment(struct llvmpipe_context *lp,
    LLVMValueRef stride_ptr;
    LLVMValueRef depth_ptr;
    LLVMValueRef depth_stride;
+   LLVMValueRef sample_stride_ptr;
+   LLVMValueRef depth_sample_stride;
    LLVMValueRef mask_input;
    LLVMValueRef thread_data_ptr;
    LLVMBasicBlockRef block;
@@ -2431,13 +2655,16 @@ generate_fragment(struct llvmpipe_context *lp,
    struct lp_build_sampler_soa *sampler;
    struct lp_build_interp_soa_context interp;
    LLVMValueRef fs_mask[16 / 4];
+   LLVMValueRef fs_sample_mask[LP_MAX_SAMPLES][16 / 4];
    LLVMValueRef fs_out_color[PIPE_MAX_COLOR_BUFS][TGSI_NUM_CHANNELS][16 / 4];
    LLVMValueRef function;
    LLVMValueRef facing;
    unsigned num_fs;
+   unsigned num_blend;
    unsigned i;
    unsigned chan;
    unsigned cbuf;
+   unsigned s;
    boolean cbuf0_write_all;
    const boolean dual_source_blend = key->blend.rt[0].blend_enable &&
                                      util_blend_state_is_dual(&key->blend, 0);
@@ -2470,6 +2697,10 @@ generate_fragment(struct llvmpipe_context *lp,
    fs_type.width = 32;           /* 32-bit float */
    fs_type.length = MIN2(lp_native_vector_width / 32, 16); /* n*4 elements per vector */
 
+   /* only the upper half of the stamp is shaded for 1d resources */
+   if (key->resource_1d)
+      fs_type.length = MIN2(fs_type.length, 8);
+
    memset(&blend_type, 0, sizeof blend_type);
    blend_type.floating = FALSE; /* values are integers */
    blend_type.sign = FALSE;     /* values are unsigned */
@@ -2486,8 +2717,13 @@ generate_fragment(struct llvmpipe_context *lp,
 
    blend_vec_type = lp_build_vec_type(gallivm, blend_type);
 
-   util_snprintf(func_name, sizeof(func_name), "fs%u_variant%u_%s",
-                 shader->no, variant->no, partial_mask ? "partial" : "whole");
+   /*
+    * The name must not depend on the creation order: the shader cache
+    * hands out the machine code of any variant with the same cache key,
+    * and the function is looked up in it by name.
+    */
+   util_snprintf(func_name, sizeof(func_name), "fs_variant_%s",
+                 partial_mask ? "partial" : "whole");
 
    arg_types[0] = variant->jit_context_ptr_type;       /* context */
    arg_types[1] = int32_type;                          /* x */
@@ -2498,10 +2734,12 @@ generate_fragment(struct llvmpipe_context *lp,
    arg_types[6] = LLVMPointerType(fs_elem_type, 0);    /* dady */
    arg_types[7] = LLVMPointerType(LLVMPointerType(blend_vec_type, 0), 0);  /* color */
    arg_types[8] = LLVMPointerType(int8_type, 0);       /* depth */
-   arg_types[9] = int32_type;                          /* mask_input */
+   arg_types[9] = int64_type;                          /* mask_input */
    arg_types[10] = variant->jit_thread_data_ptr_type;  /* per thread data */
    arg_types[11] = LLVMPointerType(int32_type, 0);     /* stride */
    arg_types[12] = int32_type;                         /* depth_stride */
+   arg_types[13] = LLVMPointerType(int32_type, 0);     /* sample_stride */
+   arg_types[14] = int32_type;                         /* depth_sample_stride */
 
    func_type = LLVMFunctionType(LLVMVoidTypeInContext(gallivm->context),
                                 arg_types, ARRAY_SIZE(arg_types), 0);
@@ -2531,6 +2769,8 @@ generate_fragment(struct llvmpipe_context *lp,
    thread_data_ptr  = LLVMGetParam(function, 10);
    stride_ptr   = LLVMGetParam(function, 11);
    depth_stride = LLVMGetParam(function, 12);
+   sample_stride_ptr = LLVMGetParam(function, 13);
+   depth_sample_stride = LLVMGetParam(function, 14);
 
    lp_build_name(context_ptr, "context");
    lp_build_name(x, "x");
@@ -2544,6 +2784,8 @@ generate_fragment(struct llvmpipe_context *lp,
    lp_build_name(thread_data_ptr, "thread_data");
    lp_build_name(stride_ptr, "stride_ptr");
    lp_build_name(depth_stride, "depth_stride");
+   lp_build_name(sample_stride_ptr, "sample_stride_ptr");
+   lp_build_name(depth_sample_stride, "depth_sample_stride");
 
    /*
     * Function body
@@ -2567,6 +2809,8 @@ generate_fragment(struct llvmpipe_context *lp,
       LLVMTypeRef mask_type = lp_build_int_vec_type(gallivm, fs_type);
       LLVMValueRef mask_store = lp_build_array_alloca(gallivm, mask_type,
                                                       num_loop, "mask_store");
+      LLVMValueRef sample_mask_store[LP_MAX_SAMPLES];
+      LLVMValueRef pixel_mask_input;
       LLVMValueRef color_store[PIPE_MAX_COLOR_BUFS][TGSI_NUM_CHANNELS];
       boolean pixel_center_integer =
          shader->info.base.properties[TGSI_PROPERTY_FS_COORD_PIXEL_CENTER];
@@ -2586,6 +2830,49 @@ generate_fragment(struct llvmpipe_context *lp,
                                a0_ptr, dadx_ptr, dady_ptr,
                                x, y);
 
+      /*
+       * The mask input holds 16 coverage bits per sample.  The shader runs
+       * for the pixels covered by any sample, the per-sample masks are kept
+       * apart for the depth test and blending.
+       */
+      if (key->multisample) {
+         LLVMValueRef union_mask = mask_input;
+
+         for (s = 0; s < LP_MAX_SAMPLES; s++) {
+            LLVMValueRef s_mask_input =
+               LLVMBuildLShr(builder, mask_input,
+                             LLVMConstInt(int64_type, 16 * s, 0), "");
+
+            if (s > 0) {
+               union_mask = LLVMBuildOr(builder, union_mask, s_mask_input, "");
+            }
+            s_mask_input = LLVMBuildTrunc(builder, s_mask_input, int32_type, "");
+            sample_mask_store[s] = lp_build_array_alloca(gallivm, mask_type,
+                                                         num_loop,
+                                                         "sample_mask_store");
+            for (i = 0; i < num_fs; i++) {
+               LLVMValueRef mask;
+               LLVMValueRef indexi = lp_build_const_int32(gallivm, i);
+               LLVMValueRef mask_ptr = LLVMBuildGEP(builder, sample_mask_store[s],
+                                                    &indexi, 1, "");
+
+               if (partial_mask) {
+                  mask = generate_quad_mask(gallivm, fs_type,
+                                            i*fs_type.length/4, s_mask_input);
+               }
+               else {
+                  mask = lp_build_const_int_vec(gallivm, fs_type, ~0);
+               }
+               LLVMBuildStore(builder, mask, mask_ptr);
+            }
+         }
+         pixel_mask_input = LLVMBuildTrunc(builder, union_mask, int32_type, "");
+      }
+      else {
+         memset(sample_mask_store, 0, sizeof sample_mask_store);
+         pixel_mask_input = LLVMBuildTrunc(builder, mask_input, int32_type, "");
+      }
+
       for (i = 0; i < num_fs; i++) {
          LLVMValueRef mask;
          LLVMValueRef indexi = lp_build_const_int32(gallivm, i);
@@ -2594,7 +2881,7 @@ generate_fragment(struct llvmpipe_context *lp,
 
          if (partial_mask) {
             mask = generate_quad_mask(gallivm, fs_type,
-                                      i*fs_type.length/4, mask_input);
+                                      i*fs_type.length/4, pixel_mask_input);
          }
          else {
             mask = lp_build_const_int_vec(gallivm, fs_type, ~0);
@@ -2611,9 +2898,11 @@ generate_fragment(struct llvmpipe_context *lp,
                        &interp,
                        sampler,
                        mask_store, /* output */
+                       sample_mask_store, /* output */
                        color_store,
                        depth_ptr,
                        depth_stride,
+                       depth_sample_stride,
                        facing,
                        thread_data_ptr);
 
@@ -2622,6 +2911,16 @@ generate_fragment(struct llvmpipe_context *lp,
          LLVMValueRef ptr = LLVMBuildGEP(builder, mask_store,
                                          &indexi, 1, "");
          fs_mask[i] = LLVMBuildLoad(builder, ptr, "mask");
+         if (key->multisample) {
+            /* the sample masks aren't updated when the shader skipped */
+            for (s = 0; s < LP_MAX_SAMPLES; s++) {
+               ptr = LLVMBuildGEP(builder, sample_mask_store[s],
+                                  &indexi, 1, "");
+               fs_sample_mask[s][i] = LLVMBuildAnd(builder, fs_mask[i],
+                                                   LLVMBuildLoad(builder, ptr, ""),
+                                                   "sample_mask");
+            }
+         }
          /* This is fucked up need to reorganize things */
          for (cbuf = 0; cbuf < key->nr_cbufs; cbuf++) {
             for (chan = 0; chan < TGSI_NUM_CHANNELS; ++chan) {
@@ -2645,6 +2944,44 @@ generate_fragment(struct llvmpipe_context *lp,
 
    sampler->destroy(sampler);
 
+   /*
+    * The blend and color conversion code handles at most 8 pixels at a
+    * time, a 16-wide stamp is blended as its two 4x2 halves.
+    */
+   fs_blend_type = fs_type;
+   num_blend = num_fs;
+   if (fs_type.length == 16) {
+      LLVMTypeRef half_ptr_type =
+         LLVMPointerType(LLVMVectorType(fs_elem_type, 8), 0);
+
+      fs_blend_type.length = 8;
+      num_blend = 2;
+
+      /* backwards, element 0 still holds the whole stamp */
+      for (i = num_blend; i-- > 0;) {
+         LLVMValueRef index = lp_build_const_int32(gallivm, i);
+
+         fs_mask[i] = lp_build_extract_range(gallivm, fs_mask[0], i * 8, 8);
+         if (key->multisample) {
+            for (s = 0; s < LP_MAX_SAMPLES; s++) {
+               fs_sample_mask[s][i] =
+                  lp_build_extract_range(gallivm, fs_sample_mask[s][0], i * 8, 8);
+            }
+         }
+         for (cbuf = 0; cbuf < PIPE_MAX_COLOR_BUFS; cbuf++) {
+            if (cbuf >= key->nr_cbufs && !(cbuf == 1 && dual_source_blend))
+               continue;
+            for (chan = 0; chan < TGSI_NUM_CHANNELS; ++chan) {
+               LLVMValueRef ptr = LLVMBuildBitCast(builder,
+                                                   fs_out_color[cbuf][chan][0],
+                                                   half_ptr_type, "");
+               fs_out_color[cbuf][chan][i] =
+                  LLVMBuildGEP(builder, ptr, &index, 1, "");
+            }
+         }
+      }
+   }
+
    /* Loop over color outputs / color buffers to do blending.
     */
    for(cbuf = 0; cbuf < key->nr_cbufs; cbuf++) {
@@ -2669,11 +3006,43 @@ generate_fragment(struct llvmpipe_context *lp,
                                 LLVMBuildGEP(builder, stride_ptr, &index, 1, ""),
                                 "");
 
-         generate_unswizzled_blend(gallivm, cbuf, variant,
-                                   key->cbuf_format[cbuf],
-                                   num_fs, fs_type, fs_mask, fs_out_color,
-                                   context_ptr, color_ptr, stride,
-                                   partial_mask, do_branch);
+         if (key->multisample) {
+            LLVMValueRef sample_stride =
+               LLVMBuildLoad(builder,
+                             LLVMBuildGEP(builder, sample_stride_ptr,
+                                          &index, 1, ""),
+                             "");
+
+            /* each sample is blended into its own image */
+            for (s = 0; s < LP_MAX_SAMPLES; s++) {
+               LLVMValueRef offset = LLVMBuildMul(builder, sample_stride,
+                                                  lp_build_const_int32(gallivm, s),
+                                                  "");
+               LLVMValueRef s_color_ptr;
+
+               s_color_ptr = LLVMBuildBitCast(builder, color_ptr,
+                                              LLVMPointerType(int8_type, 0), "");
+               s_color_ptr = LLVMBuildGEP(builder, s_color_ptr, &offset, 1, "");
+               s_color_ptr = LLVMBuildBitCast(builder, s_color_ptr,
+                                              LLVMTypeOf(color_ptr), "");
+
+               generate_unswizzled_blend(gallivm, cbuf, variant,
+                                         key->cbuf_format[cbuf],
+                                         num_blend, fs_blend_type,
+                                         fs_sample_mask[s],
+                                         fs_out_color, context_ptr,
+                                         s_color_ptr, stride,
+                                         TRUE, do_branch);
+            }
+         }
+         else {
+            generate_unswizzled_blend(gallivm, cbuf, variant,
+                                      key->cbuf_format[cbuf],
+                                      num_blend, fs_blend_type, fs_mask,
+                                      fs_out_color,
+                                      context_ptr, color_ptr, stride,
+                                      partial_mask, do_branch);
+         }
       }
    }
 
@@ -2723,6 +3092,11 @@ dump_fs_variant_key(const struct lp_fragment_shader_variant_key *key)
       debug_printf("occlusion_count = 1\n");
    }
 
+   if (key->multisample) {
+      debug_printf("multisample = 1\n");
+      debug_printf("sample_mask = 0x%x\n", key->sample_mask);
+   }
+
    if (key->blend.logicop_enable) {
       debug_printf("blend.logicop_func = %s\n", util_str_logicop(key->blend.logicop_func, TRUE));
    }
@@ -2784,10 +3158,160 @@ lp_debug_fs_variant(const struct lp_fragment_shader_variant *variant)
    tgsi_dump(variant->shader->base.tokens, 0);
    dump_fs_variant_key(&variant->key);
    debug_printf("variant->opaque = %u\n", variant->opaque);
+   debug_printf("variant->hiz_test = %u\n", variant->hiz_test);
+   debug_printf("variant->hiz_update = %u\n", variant->hiz_update);
+   debug_printf("variant->hiz_reset = %u\n", variant->hiz_reset);
    debug_printf("\n");
 }
 
 
+/**
+ * Compute the hash of everything the generated fragment shader code
+ * depends on, for looking it up in the shader cache.
+ */
+static void
+lp_fs_get_ir_cache_key(const struct lp_fragment_shader *shader,
+                       const struct lp_fragment_shader_variant_key *key,
+                       unsigned char ir_sha1_cache_key[20])
+{
+   struct mesa_sha1 ctx;
+
+   _mesa_sha1_init(&ctx);
+   _mesa_sha1_update(&ctx, shader->base.tokens,
+                     tgsi_num_tokens(shader->base.tokens) *
+                     sizeof(struct tgsi_token));
+   _mesa_sha1_update(&ctx, key, shader->variant_key_size);
+   _mesa_sha1_final(&ctx, ir_sha1_cache_key);
+}
+
+
+/**
+ * Generate and JIT the fragment functions of a variant whose gallivm
+ * state has been created.
+ */
+static void
+compile_variant(struct lp_fragment_shader *shader,
+                struct lp_fragment_shader_variant *variant)
+{
+   lp_jit_init_types(variant);
+
+   if (variant->jit_function[RAST_EDGE_TEST] == NULL)
+      generate_fragment(shader, variant, RAST_EDGE_TEST);
+
+   if (variant->jit_function[RAST_WHOLE] == NULL) {
+      if (variant->opaque) {
+         /* Specialized shader, which doesn't need to read the color buffer. */
+         generate_fragment(shader, variant, RAST_WHOLE);
+      }
+   }
+
+   /*
+    * Compile everything
+    */
+
+   gallivm_compile_module(variant->gallivm);
+
+   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
+
+   if (variant->function[RAST_EDGE_TEST]) {
+      variant->jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)
+            gallivm_jit_function(variant->gallivm,
+                                 variant->function[RAST_EDGE_TEST]);
+   }
+
+   if (variant->function[RAST_WHOLE]) {
+         variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
+               gallivm_jit_function(variant->gallivm,
+                                    variant->function[RAST_WHOLE]);
+   } else if (!variant->jit_function[RAST_WHOLE]) {
+      variant->jit_function[RAST_WHOLE] = variant->jit_function[RAST_EDGE_TEST];
+   }
+}
+
+
+struct lp_async_compile_job
+{
+   struct llvmpipe_screen *screen;
+   struct lp_fragment_shader_variant *variant;
+   char module_name[64];
+   boolean needs_caching;
+   unsigned char ir_sha1_cache_key[20];
+};
+
+
+/**
+ * Compile the optimized version of a variant on a compile queue thread and
+ * make the rasterizer use it.
+ *
+ * The work is done on a scratch variant, in a private LLVM context, since
+ * the variant's own types and functions belong to the context's one.
+ */
+static void
+async_compile_variant(void *data, int thread_index)
+{
+   struct lp_async_compile_job *job = (struct lp_async_compile_job *)data;
+   struct llvmpipe_screen *screen = job->screen;
+   struct lp_fragment_shader_variant *variant = job->variant;
+   struct lp_fragment_shader *shader = variant->shader;
+   struct lp_fragment_shader_variant *opt;
+   LLVMContextRef context;
+   struct lp_cached_code cached = { 0 };
+
+   opt = CALLOC_STRUCT(lp_fragment_shader_variant);
+   if (!opt)
+      return;
+
+   context = LLVMContextCreate();
+   if (!context) {
+      FREE(opt);
+      return;
+   }
+
+   opt->gallivm = gallivm_create(job->module_name, context,
+                                 job->needs_caching ? &cached : NULL);
+   if (!opt->gallivm) {
+      free(cached.data);
+      LLVMContextDispose(context);
+      FREE(opt);
+      return;
+   }
+
+   opt->shader = shader;
+   opt->no = variant->no;
+   opt->opaque = variant->opaque;
+   opt->hiz_test = variant->hiz_test;
+   opt->hiz_update = variant->hiz_update;
+   opt->hiz_reset = variant->hiz_reset;
+   opt->ps_inv_multiplier = variant->ps_inv_multiplier;
+   memcpy(&opt->key, &variant->key, shader->variant_key_size);
+
+   compile_variant(shader, opt);
+
+   if (job->needs_caching)
+      lp_disk_cache_insert_shader(screen, &cached, job->ir_sha1_cache_key);
+
+   gallivm_free_ir(opt->gallivm);
+   free(cached.data);
+
+   /* The machine code outlives the module and the context. */
+   variant->gallivm_opt = opt->gallivm;
+   p_atomic_set(&variant->jit_function[RAST_EDGE_TEST],
+                opt->jit_function[RAST_EDGE_TEST]);
+   p_atomic_set(&variant->jit_function[RAST_WHOLE],
+                opt->jit_function[RAST_WHOLE]);
+
+   FREE(opt);
+   LLVMContextDispose(context);
+}
+
+
+static void
+async_compile_cleanup(void *data, int thread_index)
+{
+   FREE(data);
+}
+
+
 /**
  * Generate a new fragment shader variant from the shader code and
  * other state indicated by the key.
@@ -2797,10 +3321,15 @@ generate_variant(struct llvmpipe_context *lp,
                  struct lp_fragment_shader *shader,
                  const struct lp_fragment_shader_variant_key *key)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
    struct lp_fragment_shader_variant *variant;
    const struct util_format_description *cbuf0_format_desc = NULL;
    boolean fullcolormask;
    char module_name[64];
+   unsigned char ir_sha1_cache_key[20];
+   struct lp_cached_code cached = { 0 };
+   boolean needs_caching = FALSE;
+   struct lp_async_compile_job *job = NULL;
 
    variant = CALLOC_STRUCT(lp_fragment_shader_variant);
    if (!variant)
@@ -2809,12 +3338,45 @@ generate_variant(struct llvmpipe_context *lp,
    util_snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
                  shader->no, shader->variants_created);
 
-   variant->gallivm = gallivm_create(module_name, lp->context);
+   if (screen->disk_shader_cache) {
+      lp_fs_get_ir_cache_key(shader, key, ir_sha1_cache_key);
+      lp_disk_cache_find_shader(screen, &cached, ir_sha1_cache_key);
+      if (!cached.data_size)
+         needs_caching = TRUE;
+   }
+
+   /*
+    * Unless the machine code is already in the disk cache, quickly compile
+    * an unoptimized version now and have the optimized one built in the
+    * background.
+    */
+   if (util_queue_is_initialized(&screen->compile_queue) &&
+       !cached.data_size) {
+      job = CALLOC_STRUCT(lp_async_compile_job);
+   }
+
+   if (job) {
+      job->screen = screen;
+      job->variant = variant;
+      memcpy(job->module_name, module_name, sizeof module_name);
+      job->needs_caching = needs_caching;
+      memcpy(job->ir_sha1_cache_key, ir_sha1_cache_key,
+             sizeof ir_sha1_cache_key);
+      needs_caching = FALSE;
+
+      variant->gallivm = gallivm_create_unoptimized(module_name, lp->context);
+   } else {
+      variant->gallivm = gallivm_create(module_name, lp->context, &cached);
+   }
    if (!variant->gallivm) {
+      free(cached.data);
+      FREE(job);
       FREE(variant);
       return NULL;
    }
 
+   util_queue_fence_init(&variant->compile_fence);
+
    variant->shader = shader;
    variant->list_item_global.base = variant;
    variant->list_item_local.base = variant;
@@ -2843,6 +3405,43 @@ generate_variant(struct llvmpipe_context *lp,
          !shader->info.base.writes_samplemask
       ? TRUE : FALSE;
 
+   /*
+    * Hierarchical Z only knows about LESS/LEQUAL tests against depth values
+    * interpolated from the primitive plane.  Anything which might observe
+    * a rejected fragment (stencil ops, memory writes) disables it.
+    */
+   {
+      const struct tgsi_shader_info *info = &shader->info.base;
+      const unsigned func = key->depth.func;
+      const boolean less = key->depth.enabled &&
+                           (func == PIPE_FUNC_LESS || func == PIPE_FUNC_LEQUAL);
+
+      variant->hiz_test =
+         less &&
+         !key->stencil[0].enabled &&
+         !key->depth_clamp &&
+         !info->writes_z &&
+         (!info->writes_memory ||
+          info->properties[TGSI_PROPERTY_FS_EARLY_DEPTH_STENCIL]) &&
+         !(LP_PERF & PERF_NO_HIZ);
+
+      /* every covered fragment passing the test writes its depth */
+      variant->hiz_update =
+         variant->hiz_test &&
+         key->depth.writemask &&
+         !key->alpha.enabled &&
+         !key->blend.alpha_to_coverage &&
+         !info->uses_kill &&
+         !info->writes_samplemask;
+
+      variant->hiz_reset =
+         key->depth.enabled &&
+         key->depth.writemask &&
+         !less &&
+         func != PIPE_FUNC_EQUAL &&
+         func != PIPE_FUNC_NEVER;
+   }
+
    if ((shader->info.base.num_tokens <= 1) &&
        !key->depth.enabled && !key->stencil[0].enabled) {
       variant->ps_inv_multiplier = 0;
@@ -2854,42 +3453,19 @@ generate_variant(struct llvmpipe_context *lp,
       lp_debug_fs_variant(variant);
    }
 
-   lp_jit_init_types(variant);
-   
-   if (variant->jit_function[RAST_EDGE_TEST] == NULL)
-      generate_fragment(lp, shader, variant, RAST_EDGE_TEST);
+   compile_variant(shader, variant);
 
-   if (variant->jit_function[RAST_WHOLE] == NULL) {
-      if (variant->opaque) {
-         /* Specialized shader, which doesn't need to read the color buffer. */
-         generate_fragment(lp, shader, variant, RAST_WHOLE);
-      }
-   }
-
-   /*
-    * Compile everything
-    */
+   if (needs_caching)
+      lp_disk_cache_insert_shader(screen, &cached, ir_sha1_cache_key);
 
-   gallivm_compile_module(variant->gallivm);
-
-   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
-
-   if (variant->function[RAST_EDGE_TEST]) {
-      variant->jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)
-            gallivm_jit_function(variant->gallivm,
-                                 variant->function[RAST_EDGE_TEST]);
-   }
+   gallivm_free_ir(variant->gallivm);
+   free(cached.data);
 
-   if (variant->function[RAST_WHOLE]) {
-         variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
-               gallivm_jit_function(variant->gallivm,
-                                    variant->function[RAST_WHOLE]);
-   } else if (!variant->jit_function[RAST_WHOLE]) {
-      variant->jit_function[RAST_WHOLE] = variant->jit_function[RAST_EDGE_TEST];
+   if (job) {
+      util_queue_add_job(&screen->compile_queue, job, &variant->compile_fence,
+                         async_compile_variant, async_compile_cleanup);
    }
 
-   gallivm_free_ir(variant->gallivm);
-
    return variant;
 }
 
@@ -3015,6 +3591,8 @@ void
 llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
                                struct lp_fragment_shader_variant *variant)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+
    if ((LP_DEBUG & DEBUG_FS) || (gallivm_debug & GALLIVM_DEBUG_IR)) {
       debug_printf("llvmpipe: del fs #%u var %u v created %u v cached %u "
                    "v total cached %u inst %u total inst %u\n",
@@ -3024,7 +3602,13 @@ llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
                    lp->nr_fs_variants, variant->nr_instrs, lp->nr_fs_instrs);
    }
 
+   if (util_queue_is_initialized(&screen->compile_queue))
+      util_queue_drop_job(&screen->compile_queue, &variant->compile_fence);
+   util_queue_fence_destroy(&variant->compile_fence);
+
    gallivm_destroy(variant->gallivm);
+   if (variant->gallivm_opt)
+      gallivm_destroy(variant->gallivm_opt);
 
    /* remove from shader's list */
    remove_from_list(&variant->list_item_local);
@@ -3214,6 +3798,10 @@ make_variant_key(struct llvmpipe_context *lp,
    /* alpha.ref_value is passed in jit_context */
 
    key->flatshade = lp->rasterizer->flatshade;
+   key->multisample = util_framebuffer_get_num_samples(&lp->framebuffer) > 1;
+   if (key->multisample) {
+      key->sample_mask = lp->sample_mask & ((1 << LP_MAX_SAMPLES) - 1);
+   }
    if (lp->active_occlusion_queries) {
       key->occlusion_count = TRUE;
    }
@@ -3324,8 +3912,8 @@ make_variant_key(struct llvmpipe_context *lp,
       key->nr_sampler_views = shader->info.base.file_max[TGSI_FILE_SAMPLER_VIEW] + 1;
       for(i = 0; i < key->nr_sampler_views; ++i) {
          if(shader->info.base.file_mask[TGSI_FILE_SAMPLER_VIEW] & (1 << i)) {
-            lp_sampler_static_texture_state(&key->state[i].texture_state,
-                                            lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
+            lp_llvm_sampler_static_texture_state(&key->state[i].texture_state,
+                                                 lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
          }
       }
    }
@@ -3333,8 +3921,8 @@ make_variant_key(struct llvmpipe_context *lp,
       key->nr_sampler_views = key->nr_samplers;
       for(i = 0; i < key->nr_sampler_views; ++i) {
          if(shader->info.base.file_mask[TGSI_FILE_SAMPLER] & (1 << i)) {
-            lp_sampler_static_texture_state(&key->state[i].texture_state,
-                                            lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
+            lp_llvm_sampler_static_texture_state(&key->state[i].texture_state,
+                                                 lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
          }
       }
    }
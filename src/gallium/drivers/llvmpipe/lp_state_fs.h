@@ -33,6 +33,7 @@
 #include "pipe/p_compiler.h"
 #include "pipe/p_state.h"
 #include "tgsi/tgsi_scan.h" /* for tgsi_shader_info */
+#include "util/u_queue.h" /* for util_queue_fence */
 #include "gallivm/lp_bld_sample.h" /* for struct lp_sampler_static_state */
 #include "gallivm/lp_bld_tgsi.h" /* for lp_tgsi_info */
 #include "lp_bld_interp.h" /* for struct lp_shader_input */
@@ -77,6 +78,8 @@ struct lp_fragment_shader_variant_key
    unsigned occlusion_count:1;
    unsigned resource_1d:1;
    unsigned depth_clamp:1;
+   unsigned multisample:1;      /* framebuffer has LP_MAX_SAMPLES samples */
+   unsigned sample_mask:4;      /* one bit per sample, only if multisample */
 
    enum pipe_format zsbuf_format;
    enum pipe_format cbuf_format[PIPE_MAX_COLOR_BUFS];
@@ -100,6 +103,11 @@ struct lp_fragment_shader_variant
    boolean opaque;
    uint8_t ps_inv_multiplier;
 
+   /* Hierarchical Z, see lp_rast_hiz_reject() */
+   boolean hiz_test;    /**< fragments can be rejected by the depth bounds */
+   boolean hiz_update;  /**< fully covered blocks lower the depth bounds */
+   boolean hiz_reset;   /**< depth values may grow, drop the depth bounds */
+
    struct gallivm_state *gallivm;
 
    LLVMTypeRef jit_context_ptr_type;
@@ -110,6 +118,13 @@ struct lp_fragment_shader_variant
 
    lp_jit_frag_func jit_function[2];
 
+   /* Optimized code compiled in the background while the quickly compiled
+    * jit_function[] above are in use.  Once done, jit_function[] point into
+    * it.  See LP_ASYNC_COMPILE.
+    */
+   struct gallivm_state *gallivm_opt;
+   struct util_queue_fence compile_fence;
+
    /* Total number of LLVM instructions generated */
    unsigned nr_instrs;
 
@@ -98,7 +98,7 @@ llvmpipe_bind_sampler_states(struct pipe_context *pipe,
                         llvmpipe->samplers[shader],
                         llvmpipe->num_samplers[shader]);
    }
-   else {
+   else if (shader == PIPE_SHADER_FRAGMENT) {
       llvmpipe->dirty |= LP_NEW_SAMPLER;
    }
 }
@@ -151,12 +151,17 @@ llvmpipe_set_sampler_views(struct pipe_context *pipe,
    }
 
    if (shader == PIPE_SHADER_VERTEX || shader == PIPE_SHADER_GEOMETRY) {
+      /* the draw module samplers only know about linear textures */
+      for (i = 0; i < num; i++) {
+         if (views[i] && views[i]->texture->target != PIPE_BUFFER)
+            llvmpipe_resource_untile(pipe, views[i]->texture);
+      }
       draw_set_sampler_views(llvmpipe->draw,
                              shader,
                              llvmpipe->sampler_views[shader],
                              llvmpipe->num_sampler_views[shader]);
    }
-   else {
+   else if (shader == PIPE_SHADER_FRAGMENT) {
       llvmpipe->dirty |= LP_NEW_SAMPLER_VIEW;
    }
 }
@@ -25,6 +25,9 @@
  * 
  **************************************************************************/
 
+#include "util/u_format.h"
+#include "util/u_memory.h"
+#include "util/u_pack_color.h"
 #include "util/u_rect.h"
 #include "util/u_surface.h"
 #include "lp_context.h"
@@ -34,6 +37,203 @@
 #include "lp_texture.h"
 #include "lp_query.h"
 
+#if defined(PIPE_ARCH_SSE)
+#include <emmintrin.h>
+#endif
+
+
+/**
+ * Address of the image holding the given sample of a layer of a
+ * multisampled resource.  Samples are stored as consecutive images
+ * within each layer (see llvmpipe_texture_layout()).
+ */
+static ubyte *
+lp_sample_image_address(struct pipe_resource *res,
+                        unsigned layer, unsigned sample)
+{
+   struct llvmpipe_resource *lpr = llvmpipe_resource(res);
+
+   assert(res->nr_samples > 1);
+   assert(lpr->tex_data);
+
+   return llvmpipe_get_texture_image_address(lpr, layer, 0) +
+          sample * lpr->sample_stride;
+}
+
+
+/**
+ * Average four rows of 8-bit unorm channels, rounding to nearest.
+ */
+static void
+lp_resolve_row_unorm8(ubyte *dst, const ubyte * const *src, unsigned size)
+{
+   unsigned i = 0;
+
+#if defined(PIPE_ARCH_SSE)
+   {
+      const __m128i zero = _mm_setzero_si128();
+      const __m128i two = _mm_set1_epi16(2);
+
+      for (; i + 16 <= size; i += 16) {
+         __m128i lo = two, hi = two;
+         unsigned s;
+
+         for (s = 0; s < LP_MAX_SAMPLES; s++) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(src[s] + i));
+            lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+            hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+         }
+         lo = _mm_srli_epi16(lo, 2);
+         hi = _mm_srli_epi16(hi, 2);
+         _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+      }
+   }
+#endif
+
+   for (; i < size; i++) {
+      dst[i] = (src[0][i] + src[1][i] + src[2][i] + src[3][i] + 2) >> 2;
+   }
+}
+
+
+/**
+ * Resolve a rectangle of a 4x multisampled layer into a single-sampled
+ * image of the same format.
+ *
+ * Color formats are averaged, through a fast path for 8-bit unorm
+ * formats and through float otherwise.  Depth/stencil and integer formats
+ * take the value of sample 0.
+ */
+static void
+lp_resolve_rect(ubyte *dst, unsigned dst_stride,
+                struct pipe_resource *src, unsigned src_layer,
+                unsigned x, unsigned y,
+                unsigned width, unsigned height,
+                enum pipe_format format)
+{
+   const struct util_format_description *desc = util_format_description(format);
+   unsigned src_stride = llvmpipe_resource_stride(src, 0);
+   unsigned blocksize = util_format_get_blocksize(format);
+   const ubyte *rows[LP_MAX_SAMPLES];
+   unsigned s, j;
+
+   assert(src->nr_samples == LP_MAX_SAMPLES);
+
+   for (s = 0; s < LP_MAX_SAMPLES; s++) {
+      rows[s] = lp_sample_image_address(src, src_layer, s) +
+                y * src_stride + x * blocksize;
+   }
+
+   if (util_format_is_depth_or_stencil(format) ||
+       util_format_is_pure_integer(format)) {
+      util_copy_rect(dst, format, dst_stride, 0, 0, width, height,
+                     rows[0], src_stride, 0, 0);
+   }
+   else if (util_format_is_rgba8_variant(desc)) {
+      for (j = 0; j < height; j++) {
+         lp_resolve_row_unorm8(dst, rows, width * blocksize);
+         dst += dst_stride;
+         for (s = 0; s < LP_MAX_SAMPLES; s++)
+            rows[s] += src_stride;
+      }
+   }
+   else {
+      float *tmp = MALLOC(LP_MAX_SAMPLES * width * 4 * sizeof(float));
+      unsigned i;
+
+      if (!tmp)
+         return;
+
+      for (j = 0; j < height; j++) {
+         for (s = 0; s < LP_MAX_SAMPLES; s++) {
+            desc->unpack_rgba_float(tmp + s * width * 4, 0,
+                                    rows[s], 0, width, 1);
+            rows[s] += src_stride;
+         }
+         for (i = 0; i < width * 4; i++) {
+            float sum = 0.0f;
+            for (s = 0; s < LP_MAX_SAMPLES; s++)
+               sum += tmp[s * width * 4 + i];
+            tmp[i] = sum * (1.0f / LP_MAX_SAMPLES);
+         }
+         desc->pack_rgba_float(dst, 0, tmp, 0, width, 1);
+         dst += dst_stride;
+      }
+
+      FREE(tmp);
+   }
+}
+
+
+/**
+ * Resolve the src box of a multisampled resource into the same box of a
+ * single-sampled resource.
+ */
+static void
+lp_resolve(struct pipe_context *pipe,
+           struct pipe_resource *dst, unsigned dst_level,
+           const struct pipe_box *dst_box,
+           struct pipe_resource *src, const struct pipe_box *src_box,
+           enum pipe_format format)
+{
+   struct pipe_transfer *dst_trans;
+   ubyte *dst_map;
+   int z;
+
+   llvmpipe_flush_resource(pipe,
+                           src, 0,
+                           TRUE, /* read_only */
+                           TRUE, /* cpu_access */
+                           FALSE, /* do_not_block */
+                           "resolve src");
+
+   dst_map = pipe_transfer_map_3d(pipe, dst, dst_level, PIPE_TRANSFER_WRITE,
+                                  dst_box->x, dst_box->y, dst_box->z,
+                                  dst_box->width, dst_box->height,
+                                  dst_box->depth, &dst_trans);
+   if (!dst_map)
+      return;
+
+   for (z = 0; z < src_box->depth; z++) {
+      lp_resolve_rect(dst_map + z * dst_trans->layer_stride, dst_trans->stride,
+                      src, src_box->z + z,
+                      src_box->x, src_box->y,
+                      src_box->width, src_box->height,
+                      format);
+   }
+
+   pipe->transfer_unmap(pipe, dst_trans);
+}
+
+
+/**
+ * Copy every sample of a box between multisampled resources with the same
+ * sample count.
+ */
+static void
+lp_copy_samples(struct pipe_resource *dst,
+                unsigned dstx, unsigned dsty, unsigned dstz,
+                struct pipe_resource *src,
+                const struct pipe_box *src_box)
+{
+   unsigned dst_stride = llvmpipe_resource_stride(dst, 0);
+   unsigned src_stride = llvmpipe_resource_stride(src, 0);
+   unsigned s;
+   int z;
+
+   assert(dst->nr_samples == src->nr_samples);
+
+   for (z = 0; z < src_box->depth; z++) {
+      for (s = 0; s < src->nr_samples; s++) {
+         util_copy_rect(lp_sample_image_address(dst, dstz + z, s),
+                        dst->format, dst_stride, dstx, dsty,
+                        src_box->width, src_box->height,
+                        lp_sample_image_address(src, src_box->z + z, s),
+                        src_stride, src_box->x, src_box->y);
+      }
+   }
+}
+
 
 static void
 lp_resource_copy(struct pipe_context *pipe,
@@ -56,6 +256,11 @@ lp_resource_copy(struct pipe_context *pipe,
                            FALSE, /* do_not_block */
                            "blit src");
 
+   if (src->nr_samples > 1) {
+      lp_copy_samples(dst, dstx, dsty, dstz, src, src_box);
+      return;
+   }
+
    util_resource_copy_region(pipe, dst, dst_level, dstx, dsty, dstz,
                              src, src_level, src_box);
 }
@@ -71,10 +276,43 @@ static void lp_blit(struct pipe_context *pipe,
       return;
 
    if (info.src.resource->nr_samples > 1 &&
-       info.dst.resource->nr_samples <= 1 &&
-       !util_format_is_depth_or_stencil(info.src.resource->format) &&
-       !util_format_is_pure_integer(info.src.resource->format)) {
-      debug_printf("llvmpipe: color resolve unimplemented\n");
+       info.dst.resource->nr_samples <= 1) {
+      struct pipe_resource *src = info.src.resource;
+      struct pipe_resource templ;
+      struct pipe_resource *tmp;
+
+      /* Plain resolves go straight into the destination. */
+      if (info.src.format == src->format &&
+          info.dst.format == info.dst.resource->format &&
+          info.src.format == info.dst.format &&
+          info.src.box.width == info.dst.box.width &&
+          info.src.box.height == info.dst.box.height &&
+          info.src.box.depth == info.dst.box.depth &&
+          info.src.box.width > 0 && info.src.box.height > 0 &&
+          !info.scissor_enable &&
+          info.mask == util_format_get_mask(info.dst.format)) {
+         lp_resolve(pipe, info.dst.resource, info.dst.level, &info.dst.box,
+                    src, &info.src.box, info.src.format);
+         return;
+      }
+
+      /*
+       * Otherwise resolve into a single-sampled copy of the source and
+       * blit from that.
+       */
+      templ = *src;
+      templ.nr_samples = 0;
+      templ.bind = PIPE_BIND_SAMPLER_VIEW;
+      tmp = pipe->screen->resource_create(pipe->screen, &templ);
+      if (!tmp)
+         return;
+
+      lp_resolve(pipe, tmp, 0, &info.src.box,
+                 src, &info.src.box, src->format);
+      info.src.resource = tmp;
+      info.render_condition_enable = FALSE;
+      lp_blit(pipe, &info);
+      pipe_resource_reference(&tmp, NULL);
       return;
    }
 
@@ -141,6 +379,10 @@ llvmpipe_create_surface(struct pipe_context *pipe,
       }
    }
 
+   /* rendering only knows about linear textures */
+   if (llvmpipe_resource_is_texture(pt))
+      llvmpipe_resource_untile(pipe, pt);
+
    ps = CALLOC_STRUCT(pipe_surface);
    if (ps) {
       pipe_reference_init(&ps->reference, 1);
@@ -185,6 +427,117 @@ llvmpipe_surface_destroy(struct pipe_context *pipe,
 }
 
 
+/**
+ * Clear every sample of the bound layers of a multisampled color surface.
+ */
+static void
+lp_clear_color_samples(struct pipe_context *pipe,
+                       struct pipe_surface *dst,
+                       const union pipe_color_union *color,
+                       unsigned dstx, unsigned dsty,
+                       unsigned width, unsigned height)
+{
+   struct pipe_resource *res = dst->texture;
+   unsigned stride = llvmpipe_resource_stride(res, 0);
+   union util_color uc;
+   unsigned layer, s;
+
+   llvmpipe_flush_resource(pipe, res, 0,
+                           FALSE, /* read_only */
+                           TRUE, /* cpu_access */
+                           FALSE, /* do_not_block */
+                           "clear samples");
+
+   if (util_format_is_pure_sint(dst->format)) {
+      util_format_write_4i(dst->format, color->i, 0, &uc, 0, 0, 0, 1, 1);
+   }
+   else if (util_format_is_pure_uint(dst->format)) {
+      util_format_write_4ui(dst->format, color->ui, 0, &uc, 0, 0, 0, 1, 1);
+   }
+   else {
+      util_pack_color(color->f, dst->format, &uc);
+   }
+
+   for (layer = dst->u.tex.first_layer; layer <= dst->u.tex.last_layer; layer++) {
+      for (s = 0; s < res->nr_samples; s++) {
+         util_fill_rect(lp_sample_image_address(res, layer, s), dst->format,
+                        stride, dstx, dsty, width, height, &uc);
+      }
+   }
+}
+
+
+/**
+ * Clear every sample of the bound layers of a multisampled depth/stencil
+ * surface, leaving the bits outside clear_flags untouched.
+ */
+static void
+lp_clear_zs_samples(struct pipe_context *pipe,
+                    struct pipe_surface *dst,
+                    unsigned clear_flags,
+                    double depth,
+                    unsigned stencil,
+                    unsigned dstx, unsigned dsty,
+                    unsigned width, unsigned height)
+{
+   struct pipe_resource *res = dst->texture;
+   unsigned stride = llvmpipe_resource_stride(res, 0);
+   unsigned blocksize = util_format_get_blocksize(dst->format);
+   uint32_t zmask32 = (clear_flags & PIPE_CLEAR_DEPTH) ? ~0 : 0;
+   uint8_t smask8 = (clear_flags & PIPE_CLEAR_STENCIL) ? ~0 : 0;
+   uint64_t zsvalue, zsmask;
+   unsigned layer, s, i, j;
+
+   llvmpipe_flush_resource(pipe, res, 0,
+                           FALSE, /* read_only */
+                           TRUE, /* cpu_access */
+                           FALSE, /* do_not_block */
+                           "clear samples");
+
+   zsvalue = util_pack64_z_stencil(dst->format, depth, stencil);
+   zsmask = util_pack64_mask_z_stencil(dst->format, zmask32, smask8);
+   zsvalue &= zsmask;
+
+   for (layer = dst->u.tex.first_layer; layer <= dst->u.tex.last_layer; layer++) {
+      for (s = 0; s < res->nr_samples; s++) {
+         ubyte *row = lp_sample_image_address(res, layer, s) +
+                      dsty * stride + dstx * blocksize;
+
+         for (j = 0; j < height; j++) {
+            switch (blocksize) {
+            case 1:
+               for (i = 0; i < width; i++)
+                  row[i] = (row[i] & ~zsmask) | zsvalue;
+               break;
+            case 2:
+               for (i = 0; i < width; i++) {
+                  uint16_t *p = (uint16_t *)row + i;
+                  *p = (*p & ~zsmask) | zsvalue;
+               }
+               break;
+            case 4:
+               for (i = 0; i < width; i++) {
+                  uint32_t *p = (uint32_t *)row + i;
+                  *p = (*p & ~zsmask) | zsvalue;
+               }
+               break;
+            case 8:
+               for (i = 0; i < width; i++) {
+                  uint64_t *p = (uint64_t *)row + i;
+                  *p = (*p & ~zsmask) | zsvalue;
+               }
+               break;
+            default:
+               assert(0);
+               break;
+            }
+            row += stride;
+         }
+      }
+   }
+}
+
+
 static void
 llvmpipe_clear_render_target(struct pipe_context *pipe,
                              struct pipe_surface *dst,
@@ -198,6 +551,11 @@ llvmpipe_clear_render_target(struct pipe_context *pipe,
    if (render_condition_enabled && !llvmpipe_check_render_cond(llvmpipe))
       return;
 
+   if (dst->texture->nr_samples > 1) {
+      lp_clear_color_samples(pipe, dst, color, dstx, dsty, width, height);
+      return;
+   }
+
    util_clear_render_target(pipe, dst, color,
                             dstx, dsty, width, height);
 }
@@ -218,6 +576,12 @@ llvmpipe_clear_depth_stencil(struct pipe_context *pipe,
    if (render_condition_enabled && !llvmpipe_check_render_cond(llvmpipe))
       return;
 
+   if (dst->texture->nr_samples > 1) {
+      lp_clear_zs_samples(pipe, dst, clear_flags, depth, stencil,
+                          dstx, dsty, width, height);
+      return;
+   }
+
    util_clear_depth_stencil(pipe, dst, clear_flags,
                             depth, stencil,
                             dstx, dsty, width, height);
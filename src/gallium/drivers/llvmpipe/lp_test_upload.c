@@ -0,0 +1,285 @@
+/**************************************************************************
+ *
+ * Copyright 2018 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * @file
+ * Checks and measures the upload bandwidth of lp_upload_copy_rows() against
+ * plain memcpy(), for RGBA8 images of various sizes.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "util/os_time.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_memory.h"
+#include "util/u_queue.h"
+
+#include "lp_test.h"
+#include "lp_upload.h"
+
+
+/** Amount of data copied for each measurement */
+#define BENCH_BYTES (256 * 1024 * 1024)
+
+
+enum upload_method {
+   UPLOAD_MEMCPY,
+   UPLOAD_STREAMING,
+   UPLOAD_THREADED,
+   UPLOAD_NUM_METHODS
+};
+
+
+struct upload_test_case
+{
+   unsigned width;
+   unsigned height;
+   boolean whole_rows;  /**< destination rows are contiguous */
+};
+
+
+static const struct upload_test_case test_cases[] = {
+   {  256,  256, TRUE },
+   { 1024, 1024, FALSE },
+   { 1920, 1080, TRUE },
+   { 1920, 1080, FALSE },
+   { 3840, 2160, TRUE },
+   { 3840, 2160, FALSE },
+   { 4096, 4096, TRUE },
+};
+
+
+static struct util_queue upload_queue;
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "width\t"
+           "height\t"
+           "whole_rows\t"
+           "memcpy_gbps\t"
+           "streaming_gbps\t"
+           "threaded_gbps\n");
+
+   fflush(fp);
+}
+
+
+static void
+upload(enum upload_method method,
+       ubyte *dst, unsigned dst_stride,
+       const ubyte *src, unsigned src_stride,
+       unsigned row_size, unsigned num_rows)
+{
+   unsigned y;
+
+   switch (method) {
+   case UPLOAD_MEMCPY:
+      for (y = 0; y < num_rows; y++)
+         memcpy(dst + y * dst_stride, src + y * src_stride, row_size);
+      break;
+   case UPLOAD_STREAMING:
+      lp_upload_copy_rows(NULL, 1, dst, dst_stride, src, src_stride,
+                          row_size, num_rows);
+      break;
+   case UPLOAD_THREADED:
+      lp_upload_copy_rows(&upload_queue, util_cpu_caps.nr_cpus,
+                          dst, dst_stride, src, src_stride,
+                          row_size, num_rows);
+      break;
+   default:
+      assert(0);
+   }
+}
+
+
+static boolean
+test_one(unsigned verbose, FILE *fp,
+         const struct upload_test_case *test,
+         boolean bench)
+{
+   const unsigned row_size = test->width * 4;
+   /* Unaligned source rows, like those of client memory */
+   const unsigned src_stride = row_size + 12;
+   const unsigned dst_stride = test->whole_rows ? row_size : row_size + 64;
+   double gbps[UPLOAD_NUM_METHODS] = { 0.0 };
+   boolean success = TRUE;
+   ubyte *src, *dst;
+   unsigned method, i, y;
+
+   src = MALLOC((size_t)src_stride * test->height + 4);
+   dst = align_malloc((size_t)dst_stride * test->height, 64);
+   if (!src || !dst) {
+      FREE(src);
+      align_free(dst);
+      return FALSE;
+   }
+
+   for (i = 0; i < src_stride * test->height; i++)
+      src[i + 4] = rand();
+
+   for (method = 0; method < UPLOAD_NUM_METHODS; method++) {
+      memset(dst, 0, (size_t)dst_stride * test->height);
+
+      upload(method, dst, dst_stride, src + 4, src_stride,
+             row_size, test->height);
+
+      for (y = 0; y < test->height; y++) {
+         if (memcmp(dst + y * dst_stride, src + 4 + y * src_stride,
+                    row_size) != 0) {
+            success = FALSE;
+            break;
+         }
+      }
+
+      if (bench) {
+         unsigned runs = MAX2(BENCH_BYTES / (row_size * test->height), 1);
+         int64_t start = os_time_get_nano();
+
+         for (i = 0; i < runs; i++) {
+            upload(method, dst, dst_stride, src + 4, src_stride,
+                   row_size, test->height);
+         }
+
+         gbps[method] = (double)runs * row_size * test->height /
+                        (os_time_get_nano() - start);
+      }
+   }
+
+   if (verbose >= 1 || !success) {
+      printf("%4ux%-4u %s  %s", test->width, test->height,
+             test->whole_rows ? "whole rows" : "sub rows  ",
+             success ? "pass" : "FAIL");
+      if (bench) {
+         printf("  memcpy %5.1f GB/s  streaming %5.1f GB/s  threaded %5.1f GB/s",
+                gbps[UPLOAD_MEMCPY], gbps[UPLOAD_STREAMING],
+                gbps[UPLOAD_THREADED]);
+      }
+      printf("\n");
+      fflush(stdout);
+   }
+
+   if (fp) {
+      fprintf(fp, "%s\t%u\t%u\t%u\t%.2f\t%.2f\t%.2f\n",
+              success ? "pass" : "fail",
+              test->width, test->height, test->whole_rows,
+              gbps[UPLOAD_MEMCPY], gbps[UPLOAD_STREAMING],
+              gbps[UPLOAD_THREADED]);
+      fflush(fp);
+   }
+
+   FREE(src);
+   align_free(dst);
+
+   return success;
+}
+
+
+static void
+init_upload_queue(void)
+{
+   if (util_cpu_caps.nr_cpus > 1)
+      util_queue_init(&upload_queue, "lp_upload", 8,
+                      util_cpu_caps.nr_cpus - 1, 0);
+}
+
+
+static void
+destroy_upload_queue(void)
+{
+   if (util_queue_is_initialized(&upload_queue))
+      util_queue_destroy(&upload_queue);
+}
+
+
+boolean
+test_all(unsigned verbose, FILE *fp)
+{
+   boolean success = TRUE;
+   unsigned i;
+
+   init_upload_queue();
+
+   for (i = 0; i < ARRAY_SIZE(test_cases); i++) {
+      if (!test_one(MAX2(verbose, 1), fp, &test_cases[i], TRUE))
+         success = FALSE;
+   }
+
+   destroy_upload_queue();
+
+   return success;
+}
+
+
+boolean
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   boolean success = TRUE;
+   unsigned long i;
+
+   init_upload_queue();
+
+   /* Random sizes around the streaming and threading thresholds */
+   for (i = 0; i < MIN2(n, 100); i++) {
+      struct upload_test_case test;
+
+      test.width = 1 + rand() % 2048;
+      test.height = 1 + rand() % 1024;
+      test.whole_rows = rand() & 1;
+
+      if (!test_one(verbose, fp, &test, FALSE))
+         success = FALSE;
+   }
+
+   destroy_upload_queue();
+
+   return success;
+}
+
+
+boolean
+test_single(unsigned verbose, FILE *fp)
+{
+   boolean success;
+
+   init_upload_queue();
+
+   /* A 1080p video frame */
+   success = test_one(MAX2(verbose, 1), fp, &test_cases[2], TRUE);
+
+   destroy_upload_queue();
+
+   return success;
+}
@@ -44,12 +44,14 @@
 #include "util/u_transfer.h"
 
 #include "lp_context.h"
+#include "lp_debug.h"
 #include "lp_flush.h"
 #include "lp_screen.h"
 #include "lp_texture.h"
 #include "lp_setup.h"
 #include "lp_state.h"
 #include "lp_rast.h"
+#include "lp_upload.h"
 
 #include "state_tracker/sw_winsys.h"
 
@@ -59,6 +61,73 @@ static struct llvmpipe_resource resource_list;
 #endif
 static unsigned id_counter = 0;
 
+/**
+ * Textures with at least this many texels in the first level get the tiled
+ * layout, smaller ones mostly fit into the caches anyway.
+ */
+#define LP_TILED_MIN_TEXELS (128 * 128)
+
+
+/**
+ * Whether a texture should use the tiled layout (see
+ * lp_build_sample_tiled_offset()). This is only done for textures which
+ * are just sampled from, as neither rendering nor direct (persistent)
+ * mappings know about tiling.
+ */
+static boolean
+llvmpipe_texture_use_tiled(const struct pipe_resource *pt)
+{
+   if (LP_PERF & PERF_NO_TILED)
+      return FALSE;
+
+   if (pt->bind != PIPE_BIND_SAMPLER_VIEW ||
+       (pt->flags & (PIPE_RESOURCE_FLAG_MAP_PERSISTENT |
+                     PIPE_RESOURCE_FLAG_MAP_COHERENT)))
+      return FALSE;
+
+   if (llvmpipe_resource_is_1d(pt) || pt->nr_samples > 1)
+      return FALSE;
+
+   if (util_format_get_blockwidth(pt->format) != 1 ||
+       util_format_get_blockheight(pt->format) != 1)
+      return FALSE;
+
+   return pt->width0 * pt->height0 >= LP_TILED_MIN_TEXELS;
+}
+
+
+/**
+ * Copy a rectangle of texels between a tiled image and a linear one.
+ * Both images use the same row stride conventions, so this is simply
+ * the tiled offset computation of lp_build_sample_tiled_offset() in C.
+ */
+static void
+lp_tiled_copy_rect(ubyte *tiled, unsigned tiled_stride,
+                   ubyte *linear, unsigned linear_stride,
+                   unsigned x, unsigned y,
+                   unsigned width, unsigned height,
+                   unsigned bpp, boolean to_tiled)
+{
+   unsigned i, j;
+
+   for (j = 0; j < height; j++) {
+      unsigned ty = y + j;
+      ubyte *tiled_row = tiled + (ty & ~3) * tiled_stride +
+                         ((ty & 1) * 2 + (ty & 2) * 4) * bpp;
+      ubyte *linear_row = linear + j * linear_stride;
+
+      for (i = 0; i < width; i++) {
+         unsigned tx = x + i;
+         ubyte *texel = tiled_row + ((tx & ~3) * 4 + (tx & 1) + (tx & 2) * 2) * bpp;
+
+         if (to_tiled)
+            memcpy(texel, linear_row + i * bpp, bpp);
+         else
+            memcpy(linear_row + i * bpp, texel, bpp);
+      }
+   }
+}
+
 
 /**
  * Conventional allocation path for non-display textures:
@@ -123,14 +192,25 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
       else
          lpr->row_stride[level] = align(nblocksx * block_size, util_cpu_caps.cacheline);
 
-      /* if row_stride * height > LP_MAX_TEXTURE_SIZE */
-      if ((uint64_t)lpr->row_stride[level] * nblocksy > LP_MAX_TEXTURE_SIZE) {
+      /* if row_stride * height * samples > LP_MAX_TEXTURE_SIZE */
+      if ((uint64_t)lpr->row_stride[level] * nblocksy *
+          MAX2(pt->nr_samples, 1) > LP_MAX_TEXTURE_SIZE) {
          /* image too large */
          goto fail;
       }
 
       lpr->img_stride[level] = lpr->row_stride[level] * nblocksy;
 
+      /*
+       * The samples of each layer are stored as consecutive images, so
+       * rendering to a single sample is just like rendering to a regular
+       * surface and the samplers can fetch them as extra layers.
+       */
+      if (pt->nr_samples > 1) {
+         lpr->sample_stride = lpr->img_stride[level];
+         lpr->img_stride[level] *= pt->nr_samples;
+      }
+
       /* Number of 3D image slices, cube faces or texture array layers */
       if (lpr->base.target == PIPE_TEXTURE_CUBE) {
          assert(layers == 6);
@@ -174,6 +254,7 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
       else {
          memset(lpr->tex_data, 0, total_size);
       }
+      lpr->total_alloc_size = total_size;
    }
 
    return TRUE;
@@ -262,6 +343,7 @@ llvmpipe_resource_create_front(struct pipe_screen *_screen,
       }
       else {
          /* texture map */
+         lpr->tiled = llvmpipe_texture_use_tiled(&lpr->base);
          if (!llvmpipe_texture_layout(screen, lpr, true))
             goto fail;
       }
@@ -331,6 +413,10 @@ llvmpipe_resource_destroy(struct pipe_screen *pscreen,
          align_free(lpr->tex_data);
          lpr->tex_data = NULL;
       }
+      if (lpr->old_tex_data) {
+         align_free(lpr->old_tex_data);
+         lpr->old_tex_data = NULL;
+      }
    }
    else if (!lpr->userBuffer) {
       assert(lpr->data);
@@ -559,6 +645,10 @@ llvmpipe_transfer_map( struct pipe_context *pipe,
       }
    }
 
+   /* tiled textures can only be mapped through a staging copy */
+   if (lpr->tiled && (usage & PIPE_TRANSFER_MAP_DIRECTLY))
+      return NULL;
+
    lpt = CALLOC_STRUCT(llvmpipe_transfer);
    if (!lpt)
       return NULL;
@@ -611,6 +701,34 @@ llvmpipe_transfer_map( struct pipe_context *pipe,
       screen->timestamp++;
    }
 
+   if (lpr->tiled) {
+      unsigned bpp = util_format_get_blocksize(format);
+      int z;
+
+      pt->stride = box->width * bpp;
+      pt->layer_stride = pt->stride * box->height;
+      lpt->staging = MALLOC(pt->layer_stride * box->depth);
+      if (!lpt->staging) {
+         pipe_resource_reference(&pt->resource, NULL);
+         FREE(lpt);
+         return NULL;
+      }
+
+      if (!(usage & (PIPE_TRANSFER_DISCARD_RANGE |
+                     PIPE_TRANSFER_DISCARD_WHOLE_RESOURCE))) {
+         for (z = 0; z < box->depth; z++) {
+            lp_tiled_copy_rect(map + z * lpr->img_stride[level],
+                               lpr->row_stride[level],
+                               lpt->staging + z * pt->layer_stride,
+                               pt->stride,
+                               box->x, box->y, box->width, box->height,
+                               bpp, FALSE);
+         }
+      }
+
+      return lpt->staging;
+   }
+
    map +=
       box->y / util_format_get_blockheight(format) * pt->stride +
       box->x / util_format_get_blockwidth(format) * util_format_get_blocksize(format);
@@ -623,8 +741,31 @@ static void
 llvmpipe_transfer_unmap(struct pipe_context *pipe,
                         struct pipe_transfer *transfer)
 {
+   struct llvmpipe_transfer *lpt = llvmpipe_transfer(transfer);
+
    assert(transfer->resource);
 
+   if (lpt->staging) {
+      /* write back the linear copy of a tiled texture */
+      if (transfer->usage & PIPE_TRANSFER_WRITE) {
+         struct llvmpipe_resource *lpr = llvmpipe_resource(transfer->resource);
+         unsigned bpp = util_format_get_blocksize(lpr->base.format);
+         const struct pipe_box *box = &transfer->box;
+         int z;
+
+         for (z = 0; z < box->depth; z++) {
+            ubyte *map = llvmpipe_get_texture_image_address(lpr, box->z + z,
+                                                            transfer->level);
+            lp_tiled_copy_rect(map, lpr->row_stride[transfer->level],
+                               lpt->staging + z * transfer->layer_stride,
+                               transfer->stride,
+                               box->x, box->y, box->width, box->height,
+                               bpp, TRUE);
+         }
+      }
+      FREE(lpt->staging);
+   }
+
    llvmpipe_resource_unmap(transfer->resource,
                            transfer->level,
                            transfer->box.z);
@@ -638,6 +779,61 @@ llvmpipe_transfer_unmap(struct pipe_context *pipe,
    FREE(transfer);
 }
 
+/**
+ * Like u_default_texture_subdata(), but large uploads bypass the cache and
+ * may be split across the screen's worker threads (see lp_upload.h).
+ */
+static void
+llvmpipe_texture_subdata(struct pipe_context *pipe,
+                         struct pipe_resource *resource,
+                         unsigned level,
+                         unsigned usage,
+                         const struct pipe_box *box,
+                         const void *data,
+                         unsigned stride,
+                         unsigned layer_stride)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+   struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
+   enum pipe_format format = resource->format;
+   unsigned row_size = util_format_get_stride(format, box->width);
+   unsigned num_rows = util_format_get_nblocksy(format, box->height);
+   struct pipe_transfer *transfer = NULL;
+   const ubyte *src = data;
+   ubyte *map;
+   int z;
+
+   /* Tiled textures are written through a staging copy anyway. */
+   if (lpr->tiled ||
+       (uint64_t)row_size * num_rows * box->depth < LP_UPLOAD_STREAMING_MIN) {
+      u_default_texture_subdata(pipe, resource, level, usage, box,
+                                data, stride, layer_stride);
+      return;
+   }
+
+   assert(!(usage & PIPE_TRANSFER_READ));
+
+   /* the write flag is implicit by the nature of texture_subdata */
+   usage |= PIPE_TRANSFER_WRITE;
+
+   /* texture_subdata implicitly discards the rewritten buffer range */
+   usage |= PIPE_TRANSFER_DISCARD_RANGE;
+
+   map = pipe->transfer_map(pipe, resource, level, usage, box, &transfer);
+   if (!map)
+      return;
+
+   for (z = 0; z < box->depth; z++) {
+      lp_upload_copy_rows(&screen->cs_queue, screen->num_threads,
+                          map + z * transfer->layer_stride, transfer->stride,
+                          src + z * layer_stride, stride,
+                          row_size, num_rows);
+   }
+
+   pipe_transfer_unmap(pipe, transfer);
+}
+
+
 unsigned int
 llvmpipe_is_resource_referenced( struct pipe_context *pipe,
                                  struct pipe_resource *presource,
@@ -747,6 +943,71 @@ llvmpipe_get_texture_image_address(struct llvmpipe_resource *lpr,
 }
 
 
+/**
+ * Convert a tiled texture to the linear layout, for use by code which
+ * can't deal with tiling (rendering, images, and the vertex/geometry shader
+ * samplers of the draw module). It stays linear afterwards.
+ *
+ * Scenes never write to tiled textures, so no flush is needed to copy
+ * it.  Scenes of any context may still sample the tiled storage though,
+ * so it is kept until the resource is destroyed.
+ */
+void
+llvmpipe_resource_untile(struct pipe_context *pipe,
+                         struct pipe_resource *resource)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+   struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
+   unsigned bpp = util_format_get_blocksize(resource->format);
+   unsigned mip_align = MAX2(64, util_cpu_caps.cacheline);
+   unsigned level, slice;
+   ubyte *tiled_data = lpr->tex_data;
+   ubyte *data;
+
+   if (!lpr->tiled)
+      return;
+
+   data = align_malloc(lpr->total_alloc_size, mip_align);
+   if (!data)
+      return;
+
+   for (level = 0; level <= resource->last_level; level++) {
+      unsigned num_slices = resource->target == PIPE_TEXTURE_3D ?
+                               u_minify(resource->depth0, level) :
+                               resource->array_size;
+
+      for (slice = 0; slice < num_slices; slice++) {
+         unsigned offset = lpr->mip_offsets[level] +
+                           slice * lpr->img_stride[level];
+
+         lp_tiled_copy_rect(tiled_data + offset,
+                            lpr->row_stride[level],
+                            data + offset, lpr->row_stride[level],
+                            0, 0,
+                            u_minify(resource->width0, level),
+                            u_minify(resource->height0, level),
+                            bpp, FALSE);
+      }
+   }
+
+   /* another context may have converted it meanwhile */
+   if (p_atomic_cmpxchg(&lpr->old_tex_data, NULL, tiled_data) != NULL) {
+      align_free(data);
+      return;
+   }
+
+   lpr->tex_data = data;
+   lpr->tiled = FALSE;
+
+   /*
+    * Views of it may be bound to fragment shaders of any context, make
+    * them all re-derive their variants, which depend on the layout.
+    */
+   p_atomic_inc(&screen->timestamp);
+   llvmpipe_context(pipe)->dirty |= LP_NEW_SAMPLER_VIEW;
+}
+
+
 /**
  * Return size of resource in bytes
  */
@@ -821,5 +1082,5 @@ llvmpipe_init_context_resource_funcs(struct pipe_context *pipe)
 
    pipe->transfer_flush_region = u_default_transfer_flush_region;
    pipe->buffer_subdata = u_default_buffer_subdata;
-   pipe->texture_subdata = u_default_texture_subdata;
+   pipe->texture_subdata = llvmpipe_texture_subdata;
 }
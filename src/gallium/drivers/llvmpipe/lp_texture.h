@@ -68,6 +68,20 @@ struct llvmpipe_resource
    unsigned mip_offsets[LP_MAX_TEXTURE_LEVELS];
    /** allocated total size (for non-display target texture resources only) */
    unsigned total_alloc_size;
+   /**
+    * Distance in bytes between the samples of a multisample resource.
+    * The samples of a layer are stored as consecutive images, so
+    * img_stride is nr_samples times this.  Zero for single-sample resources.
+    */
+   unsigned sample_stride;
+
+   /**
+    * Images are stored in 4x4 texel tiles for better sampling cache
+    * locality (see lp_build_sample_tiled_offset()) rather than linearly.
+    * Only for textures which are never rendered to or mapped directly,
+    * transfers go through a linear staging copy.
+    */
+   boolean tiled;
 
    /**
     * Display target, for textures with the PIPE_BIND_DISPLAY_TARGET
@@ -80,6 +94,13 @@ struct llvmpipe_resource
     */
    void *tex_data;
 
+   /**
+    * Tiled storage replaced by llvmpipe_resource_untile().  Scenes and
+    * state of any context may still sample it, and they all hold a
+    * reference to the resource, so it is freed with the resource.
+    */
+   void *old_tex_data;
+
    /**
     * Data for non-texture resources.
     */
@@ -102,6 +123,9 @@ struct llvmpipe_transfer
    struct pipe_transfer base;
 
    unsigned long offset;
+
+   /** Linear copy of the mapped box of a tiled texture */
+   ubyte *staging;
 };
 
 
@@ -185,6 +209,14 @@ llvmpipe_layer_stride(struct pipe_resource *resource,
 }
 
 
+static inline unsigned
+llvmpipe_sample_stride(struct pipe_resource *resource)
+{
+   struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
+   return lpr->sample_stride;
+}
+
+
 static inline unsigned
 llvmpipe_resource_stride(struct pipe_resource *resource,
                          unsigned level)
@@ -220,6 +252,11 @@ llvmpipe_get_texture_image_address(struct llvmpipe_resource *lpr,
                                    unsigned face_slice, unsigned level);
 
 
+void
+llvmpipe_resource_untile(struct pipe_context *pipe,
+                         struct pipe_resource *resource);
+
+
 extern void
 llvmpipe_print_resources(void);
 
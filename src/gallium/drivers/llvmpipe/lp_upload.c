@@ -0,0 +1,237 @@
+/**************************************************************************
+ *
+ * Copyright 2018 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include "pipe/p_config.h"
+#include "util/u_math.h"
+#include "util/u_queue.h"
+#include "lp_upload.h"
+
+#if defined(PIPE_ARCH_SSE)
+#include <emmintrin.h>
+#endif
+
+
+/**
+ * The memory bandwidth is usually saturated well before this many threads
+ * copy concurrently.
+ */
+#define LP_UPLOAD_MAX_JOBS 8
+
+
+struct lp_upload_job
+{
+   ubyte *dst;
+   const ubyte *src;
+   unsigned dst_stride;
+   unsigned src_stride;
+   unsigned row_size;
+   unsigned num_rows;
+
+   struct util_queue_fence fence;
+};
+
+
+/**
+ * Copies memory from src to dst, using SSE2's MOVNTDQ to write it without
+ * pulling the destination into the cache.  The stores are weakly ordered,
+ * streaming_fence() must be called before the data is used elsewhere.
+ */
+static void
+streaming_copy(void *restrict dst, const void *restrict src, size_t len)
+{
+#if defined(PIPE_ARCH_SSE)
+   char *restrict d = dst;
+   const char *restrict s = src;
+
+   /* memcpy() the misaligned header. Afterwards <d> is aligned to a
+    * 16-byte boundary or <len> == 0.
+    */
+   if ((uintptr_t)d & 15) {
+      size_t bytes_before_alignment_boundary =
+         MIN2(16 - ((uintptr_t)d & 15), len);
+
+      memcpy(d, s, bytes_before_alignment_boundary);
+
+      d += bytes_before_alignment_boundary;
+      s += bytes_before_alignment_boundary;
+      len -= bytes_before_alignment_boundary;
+   }
+
+   while (len >= 64) {
+      __m128i *dst_cacheline = (__m128i *)d;
+      const __m128i *src_cacheline = (const __m128i *)s;
+
+      __m128i temp1 = _mm_loadu_si128(src_cacheline + 0);
+      __m128i temp2 = _mm_loadu_si128(src_cacheline + 1);
+      __m128i temp3 = _mm_loadu_si128(src_cacheline + 2);
+      __m128i temp4 = _mm_loadu_si128(src_cacheline + 3);
+
+      _mm_stream_si128(dst_cacheline + 0, temp1);
+      _mm_stream_si128(dst_cacheline + 1, temp2);
+      _mm_stream_si128(dst_cacheline + 2, temp3);
+      _mm_stream_si128(dst_cacheline + 3, temp4);
+
+      d += 64;
+      s += 64;
+      len -= 64;
+   }
+
+   /* memcpy() the tail. */
+   if (len) {
+      memcpy(d, s, len);
+   }
+#else
+   memcpy(dst, src, len);
+#endif
+}
+
+
+static inline void
+streaming_fence(void)
+{
+#if defined(PIPE_ARCH_SSE)
+   _mm_sfence();
+#endif
+}
+
+
+static void
+streaming_copy_rows(ubyte *dst, unsigned dst_stride,
+                    const ubyte *src, unsigned src_stride,
+                    unsigned row_size, unsigned num_rows)
+{
+   unsigned y;
+
+   if (dst_stride == row_size && src_stride == row_size) {
+      /* Whole rows, which are a single block of memory. */
+      streaming_copy(dst, src, (size_t)row_size * num_rows);
+   }
+   else {
+      for (y = 0; y < num_rows; y++) {
+         streaming_copy(dst, src, row_size);
+         dst += dst_stride;
+         src += src_stride;
+      }
+   }
+
+   streaming_fence();
+}
+
+
+static void
+upload_job_execute(void *data, int thread_index)
+{
+   struct lp_upload_job *job = data;
+
+   streaming_copy_rows(job->dst, job->dst_stride,
+                       job->src, job->src_stride,
+                       job->row_size, job->num_rows);
+}
+
+
+/**
+ * Copy memory with non-temporal stores.
+ */
+void
+lp_streaming_memcpy(void *dst, const void *src, size_t len)
+{
+   streaming_copy(dst, src, len);
+   streaming_fence();
+}
+
+
+/**
+ * Copy the rows of an upload to a texture.
+ *
+ * \param queue  workers for very large uploads, or NULL
+ * \param num_threads  number of threads to use, including the calling one
+ */
+void
+lp_upload_copy_rows(struct util_queue *queue, unsigned num_threads,
+                    ubyte *dst, unsigned dst_stride,
+                    const ubyte *src, unsigned src_stride,
+                    unsigned row_size, unsigned num_rows)
+{
+   struct lp_upload_job jobs[LP_UPLOAD_MAX_JOBS];
+   size_t size = (size_t)row_size * num_rows;
+   unsigned rows_per_job;
+   unsigned num_jobs = 1;
+   unsigned i;
+
+   if (size < LP_UPLOAD_STREAMING_MIN) {
+      for (i = 0; i < num_rows; i++) {
+         memcpy(dst, src, row_size);
+         dst += dst_stride;
+         src += src_stride;
+      }
+      return;
+   }
+
+   if (size >= LP_UPLOAD_THREADED_MIN &&
+       queue && util_queue_is_initialized(queue)) {
+      num_jobs = MIN3(num_threads, LP_UPLOAD_MAX_JOBS,
+                      size / LP_UPLOAD_THREAD_CHUNK);
+      num_jobs = MIN2(num_jobs, num_rows);
+   }
+
+   if (num_jobs <= 1) {
+      streaming_copy_rows(dst, dst_stride, src, src_stride,
+                          row_size, num_rows);
+      return;
+   }
+
+   rows_per_job = DIV_ROUND_UP(num_rows, num_jobs);
+   num_jobs = DIV_ROUND_UP(num_rows, rows_per_job);
+
+   for (i = 0; i < num_jobs; i++) {
+      struct lp_upload_job *job = &jobs[i];
+      unsigned first_row = i * rows_per_job;
+
+      job->dst = dst + (size_t)first_row * dst_stride;
+      job->src = src + (size_t)first_row * src_stride;
+      job->dst_stride = dst_stride;
+      job->src_stride = src_stride;
+      job->row_size = row_size;
+      job->num_rows = MIN2(rows_per_job, num_rows - first_row);
+      util_queue_fence_init(&job->fence);
+   }
+
+   /* Copy the first share on this thread */
+   for (i = 1; i < num_jobs; i++) {
+      util_queue_add_job(queue, &jobs[i], &jobs[i].fence,
+                         upload_job_execute, NULL);
+   }
+
+   upload_job_execute(&jobs[0], 0);
+
+   for (i = 0; i < num_jobs; i++) {
+      if (i > 0)
+         util_queue_fence_wait(&jobs[i].fence);
+      util_queue_fence_destroy(&jobs[i].fence);
+   }
+}
@@ -0,0 +1,70 @@
+/**************************************************************************
+ *
+ * Copyright 2018 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * Copies for large texture uploads.
+ *
+ * Uploads of a few megabytes (video frames, big images) would otherwise
+ * evict the whole cache contents of the calling thread, and of the
+ * rasterizer threads sharing the last level cache, for data which won't
+ * be sampled any time soon.  Such uploads are done with non-temporal
+ * stores instead, and split across worker threads when very large.
+ */
+
+#ifndef LP_UPLOAD_H
+#define LP_UPLOAD_H
+
+
+#include "pipe/p_compiler.h"
+
+
+struct util_queue;
+
+
+/** Uploads smaller than this are done with memcpy() */
+#define LP_UPLOAD_STREAMING_MIN (256 * 1024)
+
+/** Uploads larger than this are split across threads */
+#define LP_UPLOAD_THREADED_MIN (4 * 1024 * 1024)
+
+/** Minimum amount of data copied by a thread */
+#define LP_UPLOAD_THREAD_CHUNK (1024 * 1024)
+
+
+void
+lp_streaming_memcpy(void *dst, const void *src, size_t len);
+
+
+void
+lp_upload_copy_rows(struct util_queue *queue, unsigned num_threads,
+                    ubyte *dst, unsigned dst_stride,
+                    const ubyte *src, unsigned src_stride,
+                    unsigned row_size, unsigned num_rows);
+
+
+#endif /* LP_UPLOAD_H */
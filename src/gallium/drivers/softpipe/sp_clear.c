@@ -39,6 +39,7 @@
 #include "sp_context.h"
 #include "sp_query.h"
 #include "sp_tile_cache.h"
+#include "sp_tile_threads.h"
 
 
 /**
@@ -66,6 +67,9 @@ softpipe_clear(struct pipe_context *pipe, unsigned buffers,
    softpipe_update_derived(softpipe, PIPE_PRIM_TRIANGLES); /* not needed?? */
 #endif
 
+   if (softpipe->tile_threads)
+      sp_tile_threads_flush(softpipe->tile_threads, FALSE);
+
    if (buffers & PIPE_CLEAR_COLOR) {
       for (i = 0; i < softpipe->framebuffer.nr_cbufs; i++) {
          sp_tile_cache_clear(softpipe->cbuf_cache[i], color, 0);
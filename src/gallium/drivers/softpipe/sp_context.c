@@ -43,10 +43,12 @@
 #include "sp_clear.h"
 #include "sp_context.h"
 #include "sp_flush.h"
+#include "sp_limits.h"
 #include "sp_prim_vbuf.h"
 #include "sp_state.h"
 #include "sp_surface.h"
 #include "sp_tile_cache.h"
+#include "sp_tile_threads.h"
 #include "sp_tex_tile_cache.h"
 #include "sp_texture.h"
 #include "sp_query.h"
@@ -75,6 +77,9 @@ softpipe_destroy( struct pipe_context *pipe )
    if (softpipe->draw)
       draw_destroy( softpipe->draw );
 
+   if (softpipe->tile_threads)
+      sp_tile_threads_destroy(softpipe->tile_threads);
+
    if (softpipe->quad.shade)
       softpipe->quad.shade->destroy( softpipe->quad.shade );
 
@@ -199,6 +204,7 @@ softpipe_create_context(struct pipe_screen *screen,
    struct softpipe_screen *sp_screen = softpipe_screen(screen);
    struct softpipe_context *softpipe = CALLOC_STRUCT(softpipe_context);
    uint i, sh;
+   unsigned num_threads;
 
    util_init_math();
 
@@ -319,6 +325,15 @@ softpipe_create_context(struct pipe_screen *screen,
    if (debug_get_bool_option( "SOFTPIPE_NO_RAST", FALSE ))
       softpipe->no_rast = TRUE;
 
+   /* Must be before the vbuf backend, which sizes its buffers for it */
+   num_threads = debug_get_num_option("SOFTPIPE_NUM_THREADS", 0);
+   num_threads = MIN2(num_threads, SP_MAX_THREADS);
+   if (num_threads) {
+      softpipe->tile_threads = sp_tile_threads_create(softpipe, num_threads);
+      if (!softpipe->tile_threads)
+         goto fail;
+   }
+
    softpipe->vbuf_backend = sp_create_vbuf_backend(softpipe);
    if (!softpipe->vbuf_backend)
       goto fail;
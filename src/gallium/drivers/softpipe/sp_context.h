@@ -56,6 +56,7 @@ struct sp_fragment_shader;
 struct sp_vertex_shader;
 struct sp_velems_state;
 struct sp_so_state;
+struct sp_tile_threads;
 
 struct softpipe_context {
    struct pipe_context pipe;  /**< base class */
@@ -194,6 +195,9 @@ struct softpipe_context {
    struct softpipe_tile_cache *cbuf_cache[PIPE_MAX_COLOR_BUFS];
    struct softpipe_tile_cache *zsbuf_cache;
 
+   /** Rasterization worker threads, NULL if rasterizing on this thread */
+   struct sp_tile_threads *tile_threads;
+
    unsigned tex_timestamp;
 
    /*
@@ -40,6 +40,7 @@
 #include "sp_setup.h"
 #include "sp_state.h"
 #include "sp_prim_vbuf.h"
+#include "sp_tile_threads.h"
 #include "draw/draw_context.h"
 #include "draw/draw_vbuf.h"
 #include "util/u_memory.h"
@@ -49,6 +50,10 @@
 #define SP_MAX_VBUF_INDEXES 1024
 #define SP_MAX_VBUF_SIZE    4096
 
+/* Larger batches with tile threads, to amortize waking up the workers */
+#define SP_MAX_VBUF_INDEXES_THREADED (16 * 1024)
+#define SP_MAX_VBUF_SIZE_THREADED    (64 * 1024)
+
 typedef const float (*cptrf4)[4];
 
 /**
@@ -61,6 +66,7 @@ struct softpipe_vbuf_render
    struct setup_context *setup;
 
    enum pipe_prim_type prim;
+   boolean threaded;  /**< rasterize with the tile threads? */
    uint vertex_size;
    uint nr_vertices;
    uint vertex_buffer_size;
@@ -142,9 +148,27 @@ sp_vbuf_set_primitive(struct vbuf_render *vbr, enum pipe_prim_type prim)
 
    cvbr->softpipe->reduced_prim = u_reduced_prim(prim);
    cvbr->prim = prim;
+
+   cvbr->threaded = sp_tile_threads_can_draw(cvbr->softpipe);
+   if (!cvbr->threaded && cvbr->softpipe->tile_threads) {
+      /* we'll render with the context's own tile caches */
+      sp_tile_threads_flush(cvbr->softpipe->tile_threads, FALSE);
+   }
 }
 
 
+/**
+ * Work for the tile threads: the arguments of a draw_elements/arrays call.
+ */
+struct sp_vbuf_work
+{
+   struct softpipe_vbuf_render *cvbr;
+   const ushort *indices;
+   uint start;
+   uint nr;
+};
+
+
 static inline cptrf4 get_vert( const void *vertex_buffer,
                                int index,
                                int stride )
@@ -154,16 +178,15 @@ static inline cptrf4 get_vert( const void *vertex_buffer,
 
 
 /**
- * draw elements / indexed primitives
+ * Feed indexed primitives to the given setup context.
  */
 static void
-sp_vbuf_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
+emit_elements(struct softpipe_vbuf_render *cvbr, struct setup_context *setup,
+              const ushort *indices, uint nr)
 {
-   struct softpipe_vbuf_render *cvbr = softpipe_vbuf_render(vbr);
    struct softpipe_context *softpipe = cvbr->softpipe;
    const unsigned stride = softpipe->vertex_info.size * sizeof(float);
    const void *vertex_buffer = cvbr->vertex_buffer;
-   struct setup_context *setup = cvbr->setup;
    const boolean flatshade_first = softpipe->rasterizer->flatshade_first;
    unsigned i;
 
@@ -348,16 +371,41 @@ sp_vbuf_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
 }
 
 
+static void
+emit_elements_work(struct setup_context *setup, void *data)
+{
+   const struct sp_vbuf_work *work = (const struct sp_vbuf_work *) data;
+   emit_elements(work->cvbr, setup, work->indices, work->nr);
+}
+
+
 /**
- * This function is hit when the draw module is working in pass-through mode.
- * It's up to us to convert the vertex array into point/line/tri prims.
+ * draw elements / indexed primitives
  */
 static void
-sp_vbuf_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
+sp_vbuf_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
 {
    struct softpipe_vbuf_render *cvbr = softpipe_vbuf_render(vbr);
+
+   if (cvbr->threaded) {
+      struct sp_vbuf_work work = { cvbr, indices, 0, nr };
+      sp_tile_threads_run(cvbr->softpipe->tile_threads,
+                          emit_elements_work, &work);
+   }
+   else {
+      emit_elements(cvbr, cvbr->setup, indices, nr);
+   }
+}
+
+
+/**
+ * Feed the primitives of a vertex array range to the given setup context.
+ */
+static void
+emit_arrays(struct softpipe_vbuf_render *cvbr, struct setup_context *setup,
+            uint start, uint nr)
+{
    struct softpipe_context *softpipe = cvbr->softpipe;
-   struct setup_context *setup = cvbr->setup;
    const unsigned stride = softpipe->vertex_info.size * sizeof(float);
    const void *vertex_buffer =
       (void *) get_vert(cvbr->vertex_buffer, start, stride);
@@ -587,6 +635,33 @@ sp_vbuf_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
    }
 }
 
+static void
+emit_arrays_work(struct setup_context *setup, void *data)
+{
+   const struct sp_vbuf_work *work = (const struct sp_vbuf_work *) data;
+   emit_arrays(work->cvbr, setup, work->start, work->nr);
+}
+
+
+/**
+ * This function is hit when the draw module is working in pass-through mode.
+ * It's up to us to convert the vertex array into point/line/tri prims.
+ */
+static void
+sp_vbuf_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
+{
+   struct softpipe_vbuf_render *cvbr = softpipe_vbuf_render(vbr);
+
+   if (cvbr->threaded) {
+      struct sp_vbuf_work work = { cvbr, NULL, start, nr };
+      sp_tile_threads_run(cvbr->softpipe->tile_threads,
+                          emit_arrays_work, &work);
+   }
+   else {
+      emit_arrays(cvbr, cvbr->setup, start, nr);
+   }
+}
+
 /*
  * FIXME: it is unclear if primitives_storage_needed (which is generally
  * the same as pipe query num_primitives_generated) should increase
@@ -650,8 +725,14 @@ sp_create_vbuf_backend(struct softpipe_context *sp)
 
    assert(sp->draw);
 
-   cvbr->base.max_indices = SP_MAX_VBUF_INDEXES;
-   cvbr->base.max_vertex_buffer_bytes = SP_MAX_VBUF_SIZE;
+   if (sp->tile_threads) {
+      cvbr->base.max_indices = SP_MAX_VBUF_INDEXES_THREADED;
+      cvbr->base.max_vertex_buffer_bytes = SP_MAX_VBUF_SIZE_THREADED;
+   }
+   else {
+      cvbr->base.max_indices = SP_MAX_VBUF_INDEXES;
+      cvbr->base.max_vertex_buffer_bytes = SP_MAX_VBUF_SIZE;
+   }
 
    cvbr->base.get_vertex_info = sp_vbuf_get_vertex_info;
    cvbr->base.allocate_vertices = sp_vbuf_allocate_vertices;
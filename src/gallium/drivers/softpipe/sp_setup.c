@@ -37,6 +37,7 @@
 #include "sp_quad_pipe.h"
 #include "sp_setup.h"
 #include "sp_state.h"
+#include "sp_tile_threads.h"
 #include "draw/draw_context.h"
 #include "pipe/p_shader_tokens.h"
 #include "util/u_math.h"
@@ -113,9 +114,25 @@ struct setup_context {
 
    unsigned cull_face;		/* which faces cull */
    unsigned nr_vertex_attrs;
+
+   /** With tile threads, only quads of this thread's tiles are emitted */
+   unsigned thread_index;
+   unsigned num_threads;
 };
 
 
+/**
+ * Does this setup context rasterize the screen tile containing (x, y)?
+ */
+static inline boolean
+owns_tile(const struct setup_context *setup, int x, int y)
+{
+   return setup->num_threads <= 1 ||
+          sp_tile_thread_owner(x >> TILE_SIZE_LOG2, y >> TILE_SIZE_LOG2,
+                               setup->num_threads) == setup->thread_index;
+}
+
+
 
 
 
@@ -161,7 +178,8 @@ clip_emit_quad(struct setup_context *setup, struct quad_header *quad)
 {
    quad_clip(setup, quad);
 
-   if (quad->inout.mask) {
+   if (quad->inout.mask &&
+       owns_tile(setup, quad->input.x0, quad->input.y0)) {
       struct softpipe_context *sp = setup->softpipe;
 
 #if DEBUG_FRAGS
@@ -209,6 +227,12 @@ flush_spans(struct setup_context *setup)
    const int maxright = MAX2(xright0, xright1);
    int x;
 
+   /* A chunk never straddles screen tiles, so whole chunks are either
+    * emitted or skipped by tile threads, and the depth interpolation
+    * (which starts at the first quad of a chunk) is unaffected.
+    */
+   STATIC_ASSERT(TILE_SIZE % MAX_QUADS == 0);
+
    /* process quads in horizontal chunks of 16 */
    for (x = minleft; x < maxright; x += step) {
       unsigned skip_left0 = CLAMP(xleft0 - x, 0, step);
@@ -229,7 +253,7 @@ flush_spans(struct setup_context *setup)
       unsigned mask0 = ~skipmask_left0 & ~skipmask_right0;
       unsigned mask1 = ~skipmask_left1 & ~skipmask_right1;
 
-      if (mask0 | mask1) {
+      if ((mask0 | mask1) && owns_tile(setup, x, setup->span.y)) {
          do {
             unsigned quadmask = (mask0 & 3) | ((mask1 & 3) << 2);
             if (quadmask) {
@@ -1493,6 +1517,20 @@ sp_setup_prepare(struct setup_context *setup)
 }
 
 
+/**
+ * Make the setup context emit only the quads in the screen tiles owned by
+ * the given tile thread.  See sp_tile_threads.h.
+ */
+void
+sp_setup_set_tile_thread(struct setup_context *setup,
+                         unsigned thread_index,
+                         unsigned num_threads)
+{
+   setup->thread_index = thread_index;
+   setup->num_threads = num_threads;
+}
+
+
 void
 sp_setup_destroy_context(struct setup_context *setup)
 {
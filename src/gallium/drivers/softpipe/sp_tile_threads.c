@@ -0,0 +1,438 @@
+/**************************************************************************
+ *
+ * Copyright 2018 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/**
+ * Multi-threaded rasterization with screen tiles owned by worker threads.
+ * See sp_tile_threads.h.
+ */
+
+#include "os/os_thread.h"
+#include "tgsi/tgsi_exec.h"
+#include "util/u_memory.h"
+#include "util/u_string.h"
+#include "util/u_thread.h"
+#include "sp_context.h"
+#include "sp_limits.h"
+#include "sp_quad_pipe.h"
+#include "sp_setup.h"
+#include "sp_state.h"
+#include "sp_tex_sample.h"
+#include "sp_tex_tile_cache.h"
+#include "sp_texture.h"
+#include "sp_tile_cache.h"
+#include "sp_tile_threads.h"
+
+
+struct sp_tile_thread
+{
+   struct sp_tile_threads *tt;
+   unsigned index;
+
+   /**
+    * Private copy of the context, refreshed from the real one before each
+    * draw.  The quad stages and the setup context are bound to it, so they
+    * find this worker's caches and interpreter through it.
+    */
+   struct softpipe_context *sp;
+   struct setup_context *setup;
+
+   struct quad_stage *shade;
+   struct quad_stage *depth_test;
+   struct quad_stage *blend;
+   struct quad_stage *pstipple;
+
+   struct tgsi_exec_machine *fs_machine;
+   struct sp_tgsi_sampler *fs_sampler;
+
+   struct softpipe_tile_cache *cbuf_cache[PIPE_MAX_COLOR_BUFS];
+   struct softpipe_tile_cache *zsbuf_cache;
+   struct softpipe_tex_tile_cache *tex_cache[PIPE_MAX_SHADER_SAMPLER_VIEWS];
+
+   thrd_t thread;
+   boolean thread_created;
+   pipe_semaphore work_ready;
+};
+
+
+struct sp_tile_threads
+{
+   struct softpipe_context *softpipe;
+
+   unsigned num_threads;
+   struct sp_tile_thread threads[SP_MAX_THREADS];
+
+   pipe_semaphore work_done;
+
+   /** Current work, valid while the workers run */
+   sp_tile_threads_func func;
+   void *data;
+
+   boolean exit_flag;
+
+   /**
+    * The context's own render target caches may hold tiles, which must be
+    * written back before the workers read the surfaces.
+    */
+   boolean main_caches_dirty;
+};
+
+
+static int
+thread_function(void *init_data)
+{
+   struct sp_tile_thread *thread = (struct sp_tile_thread *) init_data;
+   struct sp_tile_threads *tt = thread->tt;
+   char thread_name[16];
+
+   util_snprintf(thread_name, sizeof thread_name, "softpipe-%u", thread->index);
+   u_thread_setname(thread_name);
+
+   while (1) {
+      pipe_semaphore_wait(&thread->work_ready);
+
+      if (tt->exit_flag)
+         break;
+
+      tt->func(thread->setup, tt->data);
+
+      pipe_semaphore_signal(&tt->work_done);
+   }
+
+   return 0;
+}
+
+
+static void
+destroy_thread_state(struct sp_tile_thread *thread)
+{
+   unsigned i;
+
+   if (thread->setup)
+      sp_setup_destroy_context(thread->setup);
+
+   if (thread->shade)
+      thread->shade->destroy(thread->shade);
+   if (thread->depth_test)
+      thread->depth_test->destroy(thread->depth_test);
+   if (thread->blend)
+      thread->blend->destroy(thread->blend);
+   if (thread->pstipple)
+      thread->pstipple->destroy(thread->pstipple);
+
+   if (thread->fs_machine)
+      tgsi_exec_machine_destroy(thread->fs_machine);
+   FREE(thread->fs_sampler);
+
+   for (i = 0; i < PIPE_MAX_COLOR_BUFS; i++)
+      sp_destroy_tile_cache(thread->cbuf_cache[i]);
+   sp_destroy_tile_cache(thread->zsbuf_cache);
+
+   for (i = 0; i < PIPE_MAX_SHADER_SAMPLER_VIEWS; i++) {
+      if (thread->tex_cache[i])
+         sp_destroy_tex_tile_cache(thread->tex_cache[i]);
+   }
+
+   FREE(thread->sp);
+}
+
+
+static boolean
+create_thread_state(struct sp_tile_threads *tt, struct sp_tile_thread *thread)
+{
+   struct pipe_context *pipe = &tt->softpipe->pipe;
+   unsigned i;
+
+   thread->sp = CALLOC_STRUCT(softpipe_context);
+   if (!thread->sp)
+      return FALSE;
+
+   /* Surfaces and textures are mapped through the real context. */
+   for (i = 0; i < PIPE_MAX_COLOR_BUFS; i++) {
+      thread->cbuf_cache[i] = sp_create_tile_cache(pipe);
+      if (!thread->cbuf_cache[i])
+         return FALSE;
+   }
+   thread->zsbuf_cache = sp_create_tile_cache(pipe);
+   if (!thread->zsbuf_cache)
+      return FALSE;
+
+   for (i = 0; i < PIPE_MAX_SHADER_SAMPLER_VIEWS; i++) {
+      thread->tex_cache[i] = sp_create_tex_tile_cache(pipe);
+      if (!thread->tex_cache[i])
+         return FALSE;
+   }
+
+   thread->fs_machine = tgsi_exec_machine_create(PIPE_SHADER_FRAGMENT);
+   thread->fs_sampler = sp_create_tgsi_sampler();
+   if (!thread->fs_machine || !thread->fs_sampler)
+      return FALSE;
+
+   thread->shade = sp_quad_shade_stage(thread->sp);
+   thread->depth_test = sp_quad_depth_test_stage(thread->sp);
+   thread->blend = sp_quad_blend_stage(thread->sp);
+   thread->pstipple = sp_quad_polygon_stipple_stage(thread->sp);
+   if (!thread->shade || !thread->depth_test ||
+       !thread->blend || !thread->pstipple)
+      return FALSE;
+
+   thread->setup = sp_setup_create_context(thread->sp);
+   if (!thread->setup)
+      return FALSE;
+
+   sp_setup_set_tile_thread(thread->setup, thread->index, tt->num_threads);
+
+   return TRUE;
+}
+
+
+/**
+ * Create the worker threads.
+ * \param num_threads  number of workers, at most SP_MAX_THREADS
+ */
+struct sp_tile_threads *
+sp_tile_threads_create(struct softpipe_context *sp, unsigned num_threads)
+{
+   struct sp_tile_threads *tt;
+   unsigned i;
+
+   assert(num_threads > 0 && num_threads <= SP_MAX_THREADS);
+
+   tt = CALLOC_STRUCT(sp_tile_threads);
+   if (!tt)
+      return NULL;
+
+   tt->softpipe = sp;
+   tt->num_threads = num_threads;
+   tt->main_caches_dirty = TRUE;
+
+   pipe_semaphore_init(&tt->work_done, 0);
+
+   for (i = 0; i < num_threads; i++) {
+      struct sp_tile_thread *thread = &tt->threads[i];
+
+      thread->tt = tt;
+      thread->index = i;
+
+      if (!create_thread_state(tt, thread))
+         goto fail;
+
+      pipe_semaphore_init(&thread->work_ready, 0);
+      thread->thread = u_thread_create(thread_function, thread);
+      thread->thread_created = TRUE;
+   }
+
+   return tt;
+
+fail:
+   sp_tile_threads_destroy(tt);
+   return NULL;
+}
+
+
+void
+sp_tile_threads_destroy(struct sp_tile_threads *tt)
+{
+   unsigned i;
+
+   tt->exit_flag = TRUE;
+   for (i = 0; i < tt->num_threads; i++) {
+      if (tt->threads[i].thread_created)
+         pipe_semaphore_signal(&tt->threads[i].work_ready);
+   }
+
+   for (i = 0; i < tt->num_threads; i++) {
+      struct sp_tile_thread *thread = &tt->threads[i];
+
+      if (thread->thread_created) {
+         thrd_join(thread->thread, NULL);
+         pipe_semaphore_destroy(&thread->work_ready);
+      }
+
+      destroy_thread_state(thread);
+   }
+
+   pipe_semaphore_destroy(&tt->work_done);
+
+   FREE(tt);
+}
+
+
+/**
+ * Can the current draw be rasterized by the tile threads?
+ * Shaders writing to memory must run in the application's order, which
+ * only the single-threaded path guarantees.
+ */
+boolean
+sp_tile_threads_can_draw(const struct softpipe_context *sp)
+{
+   return sp->tile_threads &&
+          sp->fs_variant &&
+          !sp->fs_variant->info.writes_memory;
+}
+
+
+/**
+ * Copy the context state to a worker before a draw and validate its
+ * caches against the currently bound surfaces and textures.
+ */
+static void
+update_thread_state(struct sp_tile_threads *tt, struct sp_tile_thread *thread)
+{
+   const struct softpipe_context *sp = tt->softpipe;
+   struct softpipe_context *tsp = thread->sp;
+   struct tgsi_sampler *sampler = (struct tgsi_sampler *) thread->fs_sampler;
+   unsigned i;
+
+   memcpy(tsp, sp, sizeof *tsp);
+
+   tsp->quad.shade = thread->shade;
+   tsp->quad.depth_test = thread->depth_test;
+   tsp->quad.blend = thread->blend;
+   tsp->quad.pstipple = thread->pstipple;
+   tsp->fs_machine = thread->fs_machine;
+   tsp->tgsi.sampler[PIPE_SHADER_FRAGMENT] = thread->fs_sampler;
+   tsp->occlusion_count = 0;
+   memset(&tsp->pipeline_statistics, 0, sizeof tsp->pipeline_statistics);
+   tsp->dirty = 0;
+
+   for (i = 0; i < PIPE_MAX_COLOR_BUFS; i++) {
+      sp_tile_cache_set_surface(thread->cbuf_cache[i],
+                                sp->framebuffer.cbufs[i]);
+      tsp->cbuf_cache[i] = thread->cbuf_cache[i];
+   }
+   sp_tile_cache_set_surface(thread->zsbuf_cache, sp->framebuffer.zsbuf);
+   tsp->zsbuf_cache = thread->zsbuf_cache;
+
+   /* Same samplers and views, but sampling through our own tile caches */
+   memcpy(thread->fs_sampler, sp->tgsi.sampler[PIPE_SHADER_FRAGMENT],
+          sizeof *thread->fs_sampler);
+
+   for (i = 0; i < sp->num_sampler_views[PIPE_SHADER_FRAGMENT]; i++) {
+      struct softpipe_tex_tile_cache *tc = thread->tex_cache[i];
+
+      sp_tex_tile_cache_set_sampler_view(tc,
+                                         sp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
+      if (tc->texture) {
+         struct softpipe_resource *spt = softpipe_resource(tc->texture);
+         if (spt->timestamp != tc->timestamp) {
+            sp_tex_tile_cache_validate_texture(tc);
+            tc->timestamp = spt->timestamp;
+         }
+      }
+
+      if (thread->fs_sampler->sp_sview[i].cache)
+         thread->fs_sampler->sp_sview[i].cache = tc;
+      tsp->tex_cache[PIPE_SHADER_FRAGMENT][i] = tc;
+   }
+
+   sp_build_quad_pipeline(tsp);
+
+   sp->fs_variant->prepare(sp->fs_variant,
+                           thread->fs_machine,
+                           sampler,
+                           (struct tgsi_image *) sp->tgsi.image[PIPE_SHADER_FRAGMENT],
+                           (struct tgsi_buffer *) sp->tgsi.buffer[PIPE_SHADER_FRAGMENT]);
+
+   sp_setup_prepare(thread->setup);
+}
+
+
+/**
+ * Run func on all workers and wait for them to finish.
+ * The func is given each worker's setup context, and is expected to feed
+ * the same primitives to all of them.
+ */
+void
+sp_tile_threads_run(struct sp_tile_threads *tt,
+                    sp_tile_threads_func func,
+                    void *data)
+{
+   struct softpipe_context *sp = tt->softpipe;
+   unsigned i;
+
+   if (tt->main_caches_dirty) {
+      for (i = 0; i < sp->framebuffer.nr_cbufs; i++)
+         sp_flush_tile_cache(sp->cbuf_cache[i]);
+      sp_flush_tile_cache(sp->zsbuf_cache);
+      tt->main_caches_dirty = FALSE;
+   }
+
+   for (i = 0; i < tt->num_threads; i++)
+      update_thread_state(tt, &tt->threads[i]);
+
+   tt->func = func;
+   tt->data = data;
+
+   for (i = 0; i < tt->num_threads; i++)
+      pipe_semaphore_signal(&tt->threads[i].work_ready);
+
+   for (i = 0; i < tt->num_threads; i++)
+      pipe_semaphore_wait(&tt->work_done);
+
+   for (i = 0; i < tt->num_threads; i++) {
+      const struct softpipe_context *tsp = tt->threads[i].sp;
+
+      sp->occlusion_count += tsp->occlusion_count;
+      sp->pipeline_statistics.ps_invocations +=
+         tsp->pipeline_statistics.ps_invocations;
+   }
+
+   /* Every worker sets up every primitive, count them once */
+   sp->pipeline_statistics.c_primitives +=
+      tt->threads[0].sp->pipeline_statistics.c_primitives;
+}
+
+
+/**
+ * Write back the tiles held by the workers and unbind their surfaces.
+ * Must be called before the context's own render target caches are used,
+ * or the surfaces are accessed otherwise.
+ * \param textures  also invalidate the workers' texture caches
+ */
+void
+sp_tile_threads_flush(struct sp_tile_threads *tt, boolean textures)
+{
+   unsigned i, j;
+
+   for (i = 0; i < tt->num_threads; i++) {
+      struct sp_tile_thread *thread = &tt->threads[i];
+
+      for (j = 0; j < PIPE_MAX_COLOR_BUFS; j++) {
+         sp_flush_tile_cache(thread->cbuf_cache[j]);
+         sp_tile_cache_set_surface(thread->cbuf_cache[j], NULL);
+      }
+      sp_flush_tile_cache(thread->zsbuf_cache);
+      sp_tile_cache_set_surface(thread->zsbuf_cache, NULL);
+
+      if (textures) {
+         for (j = 0; j < PIPE_MAX_SHADER_SAMPLER_VIEWS; j++)
+            sp_flush_tex_tile_cache(thread->tex_cache[j]);
+      }
+   }
+
+   tt->main_caches_dirty = TRUE;
+}
@@ -0,0 +1,91 @@
+/**************************************************************************
+ *
+ * Copyright 2018 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/**
+ * Optional multi-threaded rasterization.
+ *
+ * Screen tiles (TILE_SIZE x TILE_SIZE, the same tiles as the render target
+ * tile caches) are statically assigned to worker threads.  Each worker has
+ * a private copy of the rasterization state: setup context, quad pipeline,
+ * fragment shader interpreter and tile caches.  All workers set up every
+ * primitive of a draw, but only emit the quads which fall into their own
+ * tiles.  Since quads of a tile are rasterized by a single thread in
+ * primitive order, the results are identical to single-threaded rendering.
+ *
+ * Enabled with SOFTPIPE_NUM_THREADS=n.
+ */
+
+#ifndef SP_TILE_THREADS_H
+#define SP_TILE_THREADS_H
+
+#include "pipe/p_compiler.h"
+#include "sp_tile_cache.h"
+
+
+struct softpipe_context;
+struct setup_context;
+struct sp_tile_threads;
+
+
+/**
+ * Function run by every worker for a draw, with the worker's setup context.
+ */
+typedef void (*sp_tile_threads_func)(struct setup_context *setup,
+                                     void *data);
+
+
+/**
+ * Which of num_threads workers rasterizes the screen tile at (tx, ty),
+ * in tile units.  Diagonal interleaving spreads expensive screen regions
+ * over all workers.
+ */
+static inline unsigned
+sp_tile_thread_owner(unsigned tx, unsigned ty, unsigned num_threads)
+{
+   return (tx + ty) % num_threads;
+}
+
+
+struct sp_tile_threads *
+sp_tile_threads_create(struct softpipe_context *sp, unsigned num_threads);
+
+void
+sp_tile_threads_destroy(struct sp_tile_threads *tt);
+
+boolean
+sp_tile_threads_can_draw(const struct softpipe_context *sp);
+
+void
+sp_tile_threads_run(struct sp_tile_threads *tt,
+                    sp_tile_threads_func func,
+                    void *data);
+
+void
+sp_tile_threads_flush(struct sp_tile_threads *tt, boolean textures);
+
+
+#endif /* SP_TILE_THREADS_H */
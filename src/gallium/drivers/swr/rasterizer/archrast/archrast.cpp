@@ -68,6 +68,18 @@ namespace ArchRast
         uint32_t vertsInput;
     };
 
+    struct NumaStats
+    {
+        uint64_t localTileCount = 0;
+        uint64_t remoteTileCount = 0;
+    };
+
+    struct StealStats
+    {
+        uint64_t ownTileCount = 0;
+        uint64_t stolenTileCount = 0;
+    };
+
     //////////////////////////////////////////////////////////////////////////
     /// @brief Event handler that saves stat events to event files. This
     ///        handler filters out unwanted events.
@@ -227,11 +239,19 @@ namespace ArchRast
             EventHandlerFile::Handle(EarlyZNullPS(drawId, mDSNullPS.earlyZTestPassCount, mDSNullPS.earlyZTestFailCount));
             EventHandlerFile::Handle(EarlyStencilNullPS(drawId, mDSNullPS.earlyStencilTestPassCount, mDSNullPS.earlyStencilTestFailCount));
 
+            //NUMA
+            EventHandlerFile::Handle(NumaTiles(drawId, mNuma.localTileCount, mNuma.remoteTileCount));
+
+            //Tile work stealing
+            EventHandlerFile::Handle(TileSteals(drawId, mSteal.ownTileCount, mSteal.stolenTileCount));
+
             //Reset Internal Counters
             mDSSingleSample = {};
             mDSSampleRate = {};
             mDSPixelRate = {};
             mDSNullPS = {};
+            mNuma = {};
+            mSteal = {};
 
             mNeedFlush = false;
         }
@@ -267,6 +287,32 @@ namespace ArchRast
             mTS.inputPrims += event.data.primCount;
         }
 
+        virtual void Handle(const NumaTileInfo& event)
+        {
+            if (event.data.isRemote)
+            {
+                mNuma.remoteTileCount++;
+            }
+            else
+            {
+                mNuma.localTileCount++;
+            }
+            mNeedFlush = true;
+        }
+
+        virtual void Handle(const TileStealInfo& event)
+        {
+            if (event.data.isStolen)
+            {
+                mSteal.stolenTileCount++;
+            }
+            else
+            {
+                mSteal.ownTileCount++;
+            }
+            mNeedFlush = true;
+        }
+
     protected:
         bool mNeedFlush;
         // Per draw stats
@@ -278,6 +324,8 @@ namespace ArchRast
         CStats mClipper = {};
         TEStats mTS = {};
         GSStats mGS = {};
+        NumaStats mNuma = {};
+        StealStats mSteal = {};
 
     };
 
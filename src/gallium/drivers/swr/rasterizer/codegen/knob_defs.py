@@ -71,6 +71,26 @@ KNOBS = [
         'category'  : 'perf',
     }],
 
+    ['NUMA_WORK_STEALING', {
+        'type'      : 'bool',
+        'default'   : 'true',
+        'desc'      : ['Allow worker threads to work on macrotiles of other NUMA-nodes',
+                       'when their own NUMA-node has no work left in a draw.',
+                       'Hot tiles are allocated on the NUMA-node owning the macrotile,',
+                       'so such work accesses remote memory.'],
+        'category'  : 'perf',
+    }],
+
+    ['TILE_WORK_STEALING', {
+        'type'      : 'bool',
+        'default'   : 'true',
+        'desc'      : ['Give each backend worker thread a fixed set of macrotiles to work on',
+                       'first and let it steal macrotiles of other workers, in random order,',
+                       'once its own are done. When disabled, all workers scan the queued',
+                       'macrotiles of a draw in the same order.'],
+        'category'  : 'perf',
+    }],
+
     ['MAX_CORES_PER_NUMA_NODE', {
         'type'      : 'uint32_t',
         'default'   : '0',
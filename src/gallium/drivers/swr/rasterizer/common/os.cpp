@@ -34,6 +34,10 @@
 #include <pthread.h>
 #endif // Linux
 
+#if defined(__linux__) || defined(__gnu_linux__)
+#include <sys/syscall.h>
+#endif // Linux
+
 
 
 #if defined(_WIN32)
@@ -113,6 +117,29 @@ void SWR_API SetCurrentThreadName(const char* pThreadName)
 #endif // Linux
 }
 
+bool SWR_API BindMemoryToNumaNode(void* pMem, size_t size, uint32_t numaNode)
+{
+#if defined(__linux__) || defined(__gnu_linux__)
+    // Use the syscall directly rather than adding a libnuma dependency.
+    const int mpolPreferred = 1;            // MPOL_PREFERRED
+    const unsigned mpolMfMove = (1 << 1);   // MPOL_MF_MOVE
+    const uint32_t bitsPerLong = 8 * sizeof(unsigned long);
+    unsigned long nodeMask[256 / (8 * sizeof(unsigned long))] = {};
+
+    if (numaNode >= 256)
+    {
+        return false;
+    }
+    nodeMask[numaNode / bitsPerLong] |= 1UL << (numaNode % bitsPerLong);
+
+    // maxnode is the number of mask bits + 1
+    return syscall(SYS_mbind, pMem, size, mpolPreferred,
+                   nodeMask, sizeof(nodeMask) * 8 + 1, mpolMfMove) == 0;
+#else
+    return false;
+#endif // Linux
+}
+
 static void SplitString(std::vector<std::string>& out_segments, const std::string& input, char splitToken)
 {
     out_segments.clear();
@@ -280,6 +280,11 @@ typedef MEGABYTE    GIGABYTE[1024];
 void SWR_API SetCurrentThreadName(const char* pThreadName);
 void SWR_API CreateDirectoryPath(const std::string& path);
 
+/// Ask the OS to place the pages of a (page aligned) memory range on the
+/// given OS NUMA node, moving pages already touched.
+/// @returns false if not supported, placement is then first-touch.
+bool SWR_API BindMemoryToNumaNode(void* pMem, size_t size, uint32_t numaNode);
+
 /// Execute Command (block until finished)
 /// @returns process exit value
 int SWR_API  ExecCmd(
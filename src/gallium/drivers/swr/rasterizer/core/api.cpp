@@ -149,13 +149,21 @@ HANDLE SwrCreateContext(
     {
 #if defined(_WIN32)
         uint32_t numaNode = pContext->threadPool.pThreadData ?
-            pContext->threadPool.pThreadData[i].numaId : 0;
+            GetNumaOsNode(&pContext->threadPool, pContext->threadPool.pThreadData[i].numaId) :
+            SWR_NO_NUMA_NODE;
         pContext->ppScratch[i] = (uint8_t*)VirtualAllocExNuma(
             GetCurrentProcess(), nullptr, 32 * sizeof(KILOBYTE),
             MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE,
             numaNode);
 #else
-        pContext->ppScratch[i] = (uint8_t*)AlignedMalloc(32 * sizeof(KILOBYTE), KNOB_SIMD_WIDTH * 4);
+        uint32_t numaNode = pContext->threadPool.pThreadData ?
+            GetNumaOsNode(&pContext->threadPool, pContext->threadPool.pThreadData[i].numaId) :
+            SWR_NO_NUMA_NODE;
+        pContext->ppScratch[i] = (uint8_t*)AlignedMalloc(32 * sizeof(KILOBYTE), 4 * sizeof(KILOBYTE));
+        if (pContext->ppScratch[i])
+        {
+            BindMemoryToNumaNode(pContext->ppScratch[i], 32 * sizeof(KILOBYTE), numaNode);
+        }
 #endif
 
 #if defined(KNOB_ENABLE_AR)
@@ -62,6 +62,8 @@ BUCKET_DESC gCoreBuckets[] = {
     { "FEProcessInvalidateTiles", "", true, 0xffffffff },
     { "WorkerWorkOnFifoBE", "", false, 0xff40261c },
     { "WorkerFoundWork", "", false, 0xff573326 },
+    { "WorkerStolenWork", "", false, 0xff7a4a33 },
+    { "WorkerWaitForWork", "", false, 0xff808080 },
     { "BELoadTiles", "", true, 0xffb0e2ff },
     { "BEDispatch", "", true, 0xff00a2ff },
     { "BEClear", "", true, 0xff00ccbb },
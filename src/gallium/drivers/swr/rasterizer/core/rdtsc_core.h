@@ -67,6 +67,8 @@ enum CORE_BUCKETS
     FEProcessInvalidateTiles,
     WorkerWorkOnFifoBE,
     WorkerFoundWork,
+    WorkerStolenWork,
+    WorkerWaitForWork,
     BELoadTiles,
     BEDispatch,
     BEClear,
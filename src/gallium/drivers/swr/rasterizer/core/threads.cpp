@@ -36,6 +36,10 @@
 #include <unistd.h>
 #endif
 
+#if defined(__linux__) || defined(__gnu_linux__)
+#include <dirent.h>
+#endif
+
 #include "common/os.h"
 #include "context.h"
 #include "frontend.h"
@@ -57,11 +61,40 @@ struct Core
 struct NumaNode
 {
     uint32_t          numaId;
+    uint32_t          osNodeId = SWR_NO_NUMA_NODE; // node to bind memory to
     std::vector<Core> cores;
 };
 
 typedef std::vector<NumaNode> CPUNumaNodes;
 
+#if defined(__linux__) || defined(__gnu_linux__)
+// The NUMA node of a processor is given by the nodeN link in its sysfs
+// directory.
+static uint32_t GetProcessorNumaNode(uint32_t procId)
+{
+    std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(procId);
+    uint32_t node = SWR_NO_NUMA_NODE;
+
+    DIR* pDir = opendir(path.c_str());
+    if (pDir)
+    {
+        struct dirent* pEntry;
+        while ((pEntry = readdir(pDir)) != nullptr)
+        {
+            if (strncmp(pEntry->d_name, "node", 4) == 0 &&
+                pEntry->d_name[4] >= '0' && pEntry->d_name[4] <= '9')
+            {
+                node = std::strtoul(&pEntry->d_name[4], nullptr, 10);
+                break;
+            }
+        }
+        closedir(pDir);
+    }
+
+    return node;
+}
+#endif
+
 void CalculateProcessorTopology(CPUNumaNodes& out_nodes, uint32_t& out_numThreadsPerProcGroup)
 {
     out_nodes.clear();
@@ -141,6 +174,7 @@ void CalculateProcessorTopology(CPUNumaNodes& out_nodes, uint32_t& out_numThread
                 }
                 auto& numaNode = out_nodes[numaId];
                 numaNode.numaId = numaId;
+                numaNode.osNodeId = numaId;
 
                 uint32_t coreId = 0;
 
@@ -200,6 +234,18 @@ void CalculateProcessorTopology(CPUNumaNodes& out_nodes, uint32_t& out_numThread
             auto& numaNode = out_nodes[physId];
             numaNode.numaId = physId;
 
+            // Nodes are sockets here, only bind memory of those entirely
+            // on one OS NUMA node
+            uint32_t osNodeId = GetProcessorNumaNode(procId);
+            if (numaNode.cores.empty())
+            {
+                numaNode.osNodeId = osNodeId;
+            }
+            else if (numaNode.osNodeId != osNodeId)
+            {
+                numaNode.osNodeId = SWR_NO_NUMA_NODE;
+            }
+
             if (coreId + 1 > numaNode.cores.size())
                 numaNode.cores.resize(coreId + 1);
             auto& core = numaNode.cores[coreId];
@@ -451,6 +497,31 @@ INLINE bool FindFirstIncompleteDraw(SWR_CONTEXT* pContext, uint32_t workerId, ui
     return IDComparesLess(curDrawBE, drawEnqueued);
 }
 
+//////////////////////////////////////////////////////////////////////////
+/// @brief Returns the backend worker that owns a macrotile when tile work
+///        stealing is enabled. Neighbouring macrotiles belong to different
+///        workers, so expensive regions of the render target are shared.
+static INLINE uint32_t GetTileOwner(uint32_t x, uint32_t y, uint32_t numWorkers)
+{
+    return (x + y * 7) % numWorkers;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/// @brief Per thread xorshift generator used to pick where a worker starts
+///        stealing macrotiles of other workers.
+static INLINE uint32_t NextStealRandom()
+{
+    static THREAD uint32_t state = 0;
+    if (state == 0)
+    {
+        state = (uint32_t)__rdtsc() | 1;
+    }
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
 //////////////////////////////////////////////////////////////////////////
 /// @brief If there is any BE work then go work on it.
 /// @param pContext - pointer to SWR context.
@@ -465,6 +536,8 @@ INLINE bool FindFirstIncompleteDraw(SWR_CONTEXT* pContext, uint32_t workerId, ui
 ///                      still have work pending in a previous draw. Additionally, the lockedTiles is
 ///                      hueristic that can steer a worker back to the same macrotile that it had been
 ///                      working on in a previous draw.
+///                      With KNOB_TILE_WORK_STEALING, each worker first works on the macrotiles
+///                      it owns (see GetTileOwner) and then steals those of other workers.
 /// @returns        true if worker thread should shutdown
 bool WorkOnFifoBE(
     SWR_CONTEXT *pContext,
@@ -513,85 +586,149 @@ bool WorkOnFifoBE(
 
         // Grab the list of all dirty macrotiles. A tile is dirty if it has work queued to it.
         auto &macroTiles = pDC->pTileMgr->getDirtyTiles();
+        uint32_t numTiles = (uint32_t)macroTiles.size();
 
-        for (auto tile : macroTiles)
+        // Tiles of other numa nodes are only worked on if this node has nothing left
+        // to do in this draw, as their hot tiles live in the other node's memory.
+        bool stealRemote = false;
+        if (numaMask && KNOB_NUMA_WORK_STEALING)
         {
-            uint32_t tileID = tile->mId;
-
-            // Only work on tiles for this numa node
-            uint32_t x, y;
-            pDC->pTileMgr->getTileIndices(tileID, x, y);
-            if (((x ^ y) & numaMask) != numaNode)
+            stealRemote = true;
+            for (auto tile : macroTiles)
             {
-                continue;
-            }
-
-            if (!tile->getNumQueued())
-            {
-                continue;
+                uint32_t x, y;
+                pDC->pTileMgr->getTileIndices(tile->mId, x, y);
+                if (((x ^ y) & numaMask) == numaNode && tile->getNumQueued())
+                {
+                    stealRemote = false;
+                    break;
+                }
             }
+        }
 
-            // can only work on this draw if it's not in use by other threads
-            if (lockedTiles.find(tileID) != lockedTiles.end())
-            {
-                continue;
-            }
+        // With tile work stealing, the first pass only visits the tiles owned by this
+        // worker. The second pass visits the tiles of all other workers, starting at a
+        // random position so idle workers don't all contend for the same tiles.
+        // Every tile is still visited once per draw, so the lockedTiles history stays
+        // complete and draw order is preserved.
+        bool ownTilesFirst = KNOB_TILE_WORK_STEALING && pContext->NumBEThreads > 1;
+        uint32_t stealStart = (ownTilesFirst && numTiles) ? (NextStealRandom() % numTiles) : 0;
+        bool bDrawDone = false;
 
-            if (tile->tryLock())
+        for (uint32_t pass = ownTilesFirst ? 0 : 1; pass < 2 && !bDrawDone; ++pass)
+        {
+            for (uint32_t t = 0; t < numTiles; ++t)
             {
-                BE_WORK *pWork;
+                MacroTileQueue *tile = macroTiles[pass ? (stealStart + t) % numTiles : t];
+                uint32_t tileID = tile->mId;
 
-                RDTSC_BEGIN(WorkerFoundWork, pDC->drawId);
+                if (!tile->getNumQueued())
+                {
+                    continue;
+                }
 
-                uint32_t numWorkItems = tile->getNumQueued();
-                SWR_ASSERT(numWorkItems);
+                uint32_t x, y;
+                pDC->pTileMgr->getTileIndices(tileID, x, y);
 
-                pWork = tile->peek();
-                SWR_ASSERT(pWork);
-                if (pWork->type == DRAW)
+                bool isStolen = false;
+                if (ownTilesFirst)
                 {
-                    pContext->pHotTileMgr->InitializeHotTiles(pContext, pDC, workerId, tileID);
+                    bool isOwn = GetTileOwner(x, y, pContext->NumBEThreads) == (workerId % pContext->NumBEThreads);
+                    if (isOwn != (pass == 0))
+                    {
+                        continue;
+                    }
+                    isStolen = !isOwn;
                 }
-                else if (pWork->type == SHUTDOWN)
+
+                // Only work on tiles for this numa node, unless stealing
+                bool isRemote = ((x ^ y) & numaMask) != numaNode;
+                if (isRemote && !stealRemote)
                 {
-                    bShutdown = true;
+                    // With stealing, tiles of other nodes may be worked on in later draws,
+                    // so treat them like tiles locked by other threads to keep draw order.
+                    if (KNOB_NUMA_WORK_STEALING)
+                    {
+                        lockedTiles.insert(tileID);
+                    }
+                    continue;
                 }
 
-                while ((pWork = tile->peek()) != nullptr)
+                // can only work on this draw if it's not in use by other threads
+                if (lockedTiles.find(tileID) != lockedTiles.end())
                 {
-                    pWork->pfnWork(pDC, workerId, tileID, &pWork->desc);
-                    tile->dequeue();
+                    continue;
                 }
-                RDTSC_END(WorkerFoundWork, numWorkItems);
 
-                _ReadWriteBarrier();
+                if (tile->tryLock())
+                {
+                    BE_WORK *pWork;
 
-                pDC->pTileMgr->markTileComplete(tileID);
+                    RDTSC_BEGIN(WorkerFoundWork, pDC->drawId);
+                    if (isStolen)
+                    {
+                        RDTSC_BEGIN(WorkerStolenWork, pDC->drawId);
+                    }
 
-                // Optimization: If the draw is complete and we're the last one to have worked on it then
-                // we can reset the locked list as we know that all previous draws before the next are guaranteed to be complete.
-                if ((curDrawBE == i) && (bShutdown || pDC->pTileMgr->isWorkComplete()))
-                {
-                    // We can increment the current BE and safely move to next draw since we know this draw is complete.
-                    curDrawBE++;
-                    CompleteDrawContextInl(pContext, workerId, pDC);
+                    AR_EVENT(NumaTileInfo(isRemote));
+                    AR_EVENT(TileStealInfo(isStolen));
 
-                    lastRetiredDraw++;
+                    uint32_t numWorkItems = tile->getNumQueued();
+                    SWR_ASSERT(numWorkItems);
 
-                    lockedTiles.clear();
-                    break;
-                }
+                    pWork = tile->peek();
+                    SWR_ASSERT(pWork);
+                    if (pWork->type == DRAW)
+                    {
+                        pContext->pHotTileMgr->InitializeHotTiles(pContext, pDC, workerId, tileID);
+                    }
+                    else if (pWork->type == SHUTDOWN)
+                    {
+                        bShutdown = true;
+                    }
+
+                    while ((pWork = tile->peek()) != nullptr)
+                    {
+                        pWork->pfnWork(pDC, workerId, tileID, &pWork->desc);
+                        tile->dequeue();
+                    }
+                    if (isStolen)
+                    {
+                        RDTSC_END(WorkerStolenWork, numWorkItems);
+                    }
+                    RDTSC_END(WorkerFoundWork, numWorkItems);
+
+                    _ReadWriteBarrier();
+
+                    pDC->pTileMgr->markTileComplete(tileID);
+
+                    // Optimization: If the draw is complete and we're the last one to have worked on it then
+                    // we can reset the locked list as we know that all previous draws before the next are guaranteed to be complete.
+                    if ((curDrawBE == i) && (bShutdown || pDC->pTileMgr->isWorkComplete()))
+                    {
+                        // We can increment the current BE and safely move to next draw since we know this draw is complete.
+                        curDrawBE++;
+                        CompleteDrawContextInl(pContext, workerId, pDC);
+
+                        lastRetiredDraw++;
 
-                if (bShutdown)
+                        lockedTiles.clear();
+                        bDrawDone = true;
+                        break;
+                    }
+
+                    if (bShutdown)
+                    {
+                        bDrawDone = true;
+                        break;
+                    }
+                }
+                else
                 {
-                    break;
+                    // This tile is already locked. So let's add it to our locked tiles set. This way we don't try locking this one again.
+                    lockedTiles.insert(tileID);
                 }
             }
-            else
-            {
-                // This tile is already locked. So let's add it to our locked tiles set. This way we don't try locking this one again.
-                lockedTiles.insert(tileID);
-            }
         }
     }
 
@@ -826,6 +963,7 @@ DWORD workerThreadMain(LPVOID pData)
             break;
         }
 
+        RDTSC_BEGIN(WorkerWaitForWork, 0);
         uint32_t loop = 0;
         while (loop++ < KNOB_WORKER_SPIN_LOOP_COUNT && !threadHasWork(curDrawBE))
         {
@@ -840,12 +978,14 @@ DWORD workerThreadMain(LPVOID pData)
             if (threadHasWork(curDrawBE))
             {
                 lock.unlock();
+                RDTSC_END(WorkerWaitForWork, 0);
                 continue;
             }
 
             pContext->FifosNotEmpty.wait(lock);
             lock.unlock();
         }
+        RDTSC_END(WorkerWaitForWork, 0);
 
         if (IsBEThread)
         {
@@ -1132,6 +1272,16 @@ void CreateThreadPool(SWR_CONTEXT* pContext, THREAD_POOL* pPool)
         if (useNuma)
         {
             pPool->numaMask = numNodes - 1; // Only works for 2**n numa nodes (1, 2, 4, etc.)
+
+            pPool->pNumaOsNodes = new (std::nothrow) uint32_t[nodes.size()];
+            if (pPool->pNumaOsNodes)
+            {
+                pPool->numNumaNodes = (uint32_t)nodes.size();
+                for (uint32_t n = 0; n < pPool->numNumaNodes; ++n)
+                {
+                    pPool->pNumaOsNodes[n] = nodes[n].osNodeId;
+                }
+            }
         }
         else
         {
@@ -1258,5 +1408,20 @@ void DestroyThreadPool(SWR_CONTEXT *pContext, THREAD_POOL *pPool)
         // Clean up data used by threads
         delete[] pPool->pThreadData;
         delete[] pPool->pApiThreadData;
+        delete[] pPool->pNumaOsNodes;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/// @brief Returns the OS NUMA node to place memory of a node on.
+/// @param pPool - pointer to thread pool object.
+/// @param numaId - node index, as in THREAD_DATA::numaId.
+uint32_t GetNumaOsNode(const THREAD_POOL* pPool, uint32_t numaId)
+{
+    if (numaId >= pPool->numNumaNodes)
+    {
+        return SWR_NO_NUMA_NODE;
     }
+
+    return pPool->pNumaOsNodes[numaId];
 }
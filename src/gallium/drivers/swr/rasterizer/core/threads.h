@@ -33,6 +33,9 @@
 #include <thread>
 typedef std::thread* THREAD_PTR;
 
+// Memory isn't bound to a NUMA node (same value as NUMA_NO_PREFERRED_NODE)
+static const uint32_t SWR_NO_NUMA_NODE = 0xFFFFFFFFU;
+
 struct SWR_CONTEXT;
 struct DRAW_CONTEXT;
 
@@ -54,6 +57,8 @@ struct THREAD_POOL
     THREAD_PTR* pThreads;
     uint32_t numThreads;
     uint32_t numaMask;
+    uint32_t numNumaNodes;
+    uint32_t* pNumaOsNodes;     // OS NUMA node of each numaId, for memory binding
     THREAD_DATA *pThreadData;
     uint32_t numReservedThreads; // Number of threads reserved for API use
     THREAD_DATA *pApiThreadData;
@@ -64,6 +69,7 @@ typedef std::unordered_set<uint32_t> TileSet;
 void CreateThreadPool(SWR_CONTEXT *pContext, THREAD_POOL *pPool);
 void StartThreadPool(SWR_CONTEXT* pContext, THREAD_POOL* pPool);
 void DestroyThreadPool(SWR_CONTEXT *pContext, THREAD_POOL *pPool);
+uint32_t GetNumaOsNode(const THREAD_POOL* pPool, uint32_t numaId);
 
 // Expose FE and BE worker functions to the API thread if single threaded
 void WorkOnFifoFE(SWR_CONTEXT *pContext, uint32_t workerId, uint32_t &curDrawFE);
@@ -325,7 +325,14 @@ private:
         HANDLE hProcess = GetCurrentProcess();
         p = VirtualAllocExNuma(hProcess, nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE, numaNode);
 #else
-        p = AlignedMalloc(size, align);
+        // Page aligned so the whole hot tile can be bound to its node. If that
+        // fails, first-touch still places it right most of the time as hot
+        // tiles are initialized by worker threads of the node.
+        p = AlignedMalloc(size, std::max<size_t>(align, 4 * sizeof(KILOBYTE)));
+        if (p)
+        {
+            BindMemoryToNumaNode(p, size, numaNode);
+        }
 #endif
 
         return p;
@@ -0,0 +1,259 @@
+/**************************************************************************
+ *
+ * Copyright 2018 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Micro-benchmark for the TGSI interpreter.
+ *
+ * Runs a small corpus of shaders over random inputs and prints the
+ * throughput along with a checksum of all the outputs.  The checksums
+ * must not change when running with TGSI_EXEC_NO_FAST_PATH=1, which
+ * disables the pre-decoded fast path of tgsi_exec.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "tgsi/tgsi_exec.h"
+#include "tgsi/tgsi_text.h"
+#include "util/os_time.h"
+#include "util/u_memory.h"
+
+
+#define NUM_INPUT_QUADS 256
+#define NUM_RUNS 20000
+#define NUM_CONSTS 16
+
+
+struct bench_shader
+{
+   const char *name;
+   const char *text;
+};
+
+
+static const struct bench_shader shaders[] = {
+   {
+      "transform",
+      "VERT\n"
+      "DCL IN[0]\n"
+      "DCL IN[1]\n"
+      "DCL OUT[0], POSITION\n"
+      "DCL OUT[1], COLOR\n"
+      "DCL CONST[0][0..15]\n"
+      "DCL TEMP[0]\n"
+      "MUL TEMP[0], CONST[0][0], IN[0].xxxx\n"
+      "MAD TEMP[0], CONST[0][1], IN[0].yyyy, TEMP[0]\n"
+      "MAD TEMP[0], CONST[0][2], IN[0].zzzz, TEMP[0]\n"
+      "MAD OUT[0], CONST[0][3], IN[0].wwww, TEMP[0]\n"
+      "MOV OUT[1], IN[1]\n"
+      "END\n"
+   },
+   {
+      "lighting",
+      "VERT\n"
+      "DCL IN[0]\n"
+      "DCL IN[1]\n"
+      "DCL OUT[0], POSITION\n"
+      "DCL OUT[1], COLOR\n"
+      "DCL CONST[0][0..15]\n"
+      "DCL TEMP[0..3]\n"
+      "IMM[0] FLT32 { 0.0, 1.0, 0.5, 16.0 }\n"
+      "DP4 OUT[0].x, CONST[0][0], IN[0]\n"
+      "DP4 OUT[0].y, CONST[0][1], IN[0]\n"
+      "DP4 OUT[0].z, CONST[0][2], IN[0]\n"
+      "DP4 OUT[0].w, CONST[0][3], IN[0]\n"
+      "DP3 TEMP[0].x, CONST[0][4], IN[1]\n"
+      "DP3 TEMP[0].y, CONST[0][5], IN[1]\n"
+      "DP3 TEMP[0].z, CONST[0][6], IN[1]\n"
+      "DP3 TEMP[1].x, TEMP[0], TEMP[0]\n"
+      "RSQ TEMP[1].x, TEMP[1].xxxx\n"
+      "MUL TEMP[0].xyz, TEMP[0], TEMP[1].xxxx\n"
+      "DP3 TEMP[2].x, TEMP[0], CONST[0][8]\n"
+      "MAX TEMP[2].x, TEMP[2].xxxx, IMM[0].xxxx\n"
+      "DP3 TEMP[2].y, TEMP[0], CONST[0][9]\n"
+      "MAX TEMP[2].y, TEMP[2].yyyy, IMM[0].xxxx\n"
+      "POW TEMP[2].y, TEMP[2].yyyy, IMM[0].wwww\n"
+      "MAD TEMP[3], CONST[0][10], TEMP[2].xxxx, CONST[0][12]\n"
+      "MAD_SAT OUT[1], CONST[0][11], TEMP[2].yyyy, TEMP[3]\n"
+      "END\n"
+   },
+   {
+      "combine",
+      "VERT\n"
+      "DCL IN[0]\n"
+      "DCL IN[1]\n"
+      "DCL OUT[0], GENERIC[0]\n"
+      "DCL OUT[1], GENERIC[1]\n"
+      "DCL CONST[0][0..15]\n"
+      "DCL TEMP[0..3]\n"
+      "IMM[0] FLT32 { 0.0, 1.0, 0.5, 2.0 }\n"
+      "MUL TEMP[0], IN[0], CONST[0][0]\n"
+      "ADD TEMP[1], IN[1], -CONST[0][1]\n"
+      "MAD TEMP[1], |TEMP[1]|, IMM[0].wwww, -IMM[0].yyyy\n"
+      "LRP TEMP[2], IN[0].wwww, TEMP[0], TEMP[1]\n"
+      "SLT TEMP[3], TEMP[2], IMM[0].zzzz\n"
+      "SGE TEMP[0], TEMP[2], CONST[0][2]\n"
+      "MIN TEMP[1], TEMP[3], TEMP[0].wzyx\n"
+      "MAX TEMP[2], TEMP[2], -TEMP[1]\n"
+      "ADD_SAT OUT[0], TEMP[2], TEMP[1].yxwz\n"
+      "CMP TEMP[3], -TEMP[2], TEMP[0], TEMP[3]\n"
+      "MUL_SAT OUT[1].xy, TEMP[3], CONST[0][3]\n"
+      "MOV OUT[1].zw, TEMP[2].xxxy\n"
+      "END\n"
+   },
+   {
+      "branch",
+      "VERT\n"
+      "DCL IN[0]\n"
+      "DCL IN[1]\n"
+      "DCL OUT[0], GENERIC[0]\n"
+      "DCL CONST[0][0..15]\n"
+      "DCL TEMP[0..1]\n"
+      "IMM[0] FLT32 { 0.0, 1.0, 0.5, 2.0 }\n"
+      "MOV TEMP[1], IN[1]\n"
+      "SLT TEMP[0].x, IN[0].xxxx, IMM[0].zzzz\n"
+      "IF TEMP[0].xxxx\n"
+      "   MAD TEMP[1], TEMP[1], CONST[0][4], CONST[0][5]\n"
+      "   DP4 TEMP[1].w, TEMP[1], IN[0]\n"
+      "ELSE\n"
+      "   MUL TEMP[1], TEMP[1].wzyx, CONST[0][6]\n"
+      "   MIN TEMP[1].xy, TEMP[1], IN[0]\n"
+      "ENDIF\n"
+      "MOV OUT[0], TEMP[1]\n"
+      "END\n"
+   },
+};
+
+
+static float
+rand_float(void)
+{
+   return (float) rand() / RAND_MAX * 4.0f - 2.0f;
+}
+
+
+static void
+fill_random(union tgsi_exec_channel *chan)
+{
+   unsigned i;
+
+   for (i = 0; i < TGSI_QUAD_SIZE; i++)
+      chan->f[i] = rand_float();
+}
+
+
+static uint32_t
+hash_outputs(uint32_t hash, const struct tgsi_exec_vector *outputs,
+             unsigned num_outputs)
+{
+   const uint32_t *dwords = (const uint32_t *) outputs;
+   unsigned i;
+
+   for (i = 0; i < num_outputs * sizeof(*outputs) / 4; i++)
+      hash = (hash ^ dwords[i]) * 16777619;
+   return hash;
+}
+
+
+static boolean
+bench_shader(const struct bench_shader *shader,
+             const float *consts,
+             const struct tgsi_exec_vector (*inputs)[2])
+{
+   struct tgsi_token tokens[1024];
+   struct tgsi_exec_machine *mach;
+   const void *const_bufs[1] = { consts };
+   const unsigned const_sizes[1] = { NUM_CONSTS * 4 * sizeof(float) };
+   uint32_t hash = 2166136261u;
+   int64_t start, elapsed;
+   unsigned run;
+
+   if (!tgsi_text_translate(shader->text, tokens, ARRAY_SIZE(tokens))) {
+      printf("%s: failed to parse shader\n", shader->name);
+      return FALSE;
+   }
+
+   mach = tgsi_exec_machine_create(PIPE_SHADER_VERTEX);
+   if (!mach)
+      return FALSE;
+
+   tgsi_exec_machine_bind_shader(mach, tokens, NULL, NULL, NULL);
+   tgsi_exec_set_constant_buffers(mach, 1, const_bufs, const_sizes);
+
+   start = os_time_get_nano();
+   for (run = 0; run < NUM_RUNS; run++) {
+      const unsigned quad = run % NUM_INPUT_QUADS;
+
+      memcpy(mach->Inputs, inputs[quad], sizeof(inputs[quad]));
+      memset(mach->Outputs, 0, 2 * sizeof(struct tgsi_exec_vector));
+      tgsi_exec_machine_run(mach, 0);
+
+      if (run < NUM_INPUT_QUADS)
+         hash = hash_outputs(hash, mach->Outputs, 2);
+   }
+   elapsed = os_time_get_nano() - start;
+
+   printf("%-12s %8.2f Mquads/s  checksum 0x%08x\n", shader->name,
+          NUM_RUNS * 1000.0 / elapsed, hash);
+
+   tgsi_exec_machine_bind_shader(mach, NULL, NULL, NULL, NULL);
+   tgsi_exec_machine_destroy(mach);
+   return TRUE;
+}
+
+
+int
+main(int argc, char **argv)
+{
+   float consts[NUM_CONSTS * 4];
+   struct tgsi_exec_vector (*inputs)[2];
+   boolean success = TRUE;
+   unsigned i, j, chan;
+
+   srand(0);
+
+   for (i = 0; i < ARRAY_SIZE(consts); i++)
+      consts[i] = rand_float();
+
+   inputs = MALLOC(NUM_INPUT_QUADS * sizeof(*inputs));
+   if (!inputs)
+      return 1;
+
+   for (i = 0; i < NUM_INPUT_QUADS; i++) {
+      for (j = 0; j < 2; j++) {
+         for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++)
+            fill_random(&inputs[i][j].xyzw[chan]);
+      }
+   }
+
+   for (i = 0; i < ARRAY_SIZE(shaders); i++)
+      success = bench_shader(&shaders[i], consts, inputs) && success;
+
+   FREE(inputs);
+
+   return success ? 0 : 1;
+}
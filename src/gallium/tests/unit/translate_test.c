@@ -60,7 +60,8 @@ int main(int argc, char** argv)
    double* double_buffer;
    uint16_t *half_buffer;
    unsigned * elts;
-   unsigned count = 4;
+   /* more vertices than the widest llvm vector, and not a multiple of it */
+   unsigned count = 21;
    unsigned i, j, k;
    unsigned passed = 0;
    unsigned total = 0;
@@ -77,6 +78,10 @@ int main(int argc, char** argv)
       create_fn = translate_generic_create;
    else if (!strcmp(argv[1], "x86"))
       create_fn = translate_sse2_create;
+#if HAVE_LLVM
+   else if (!strcmp(argv[1], "llvm"))
+      create_fn = translate_llvm_create;
+#endif
    else if (!strcmp(argv[1], "nosse"))
    {
       util_cpu_caps.has_sse = 0;
@@ -130,7 +135,7 @@ int main(int argc, char** argv)
 
    if (!create_fn)
    {
-      printf("Usage: ./translate_test [default|generic|x86|nosse|sse|sse2|sse3|sse4.1]\n");
+      printf("Usage: ./translate_test [default|generic|x86|llvm|nosse|sse|sse2|sse3|sse4.1]\n");
       return 2;
    }
 
@@ -276,7 +281,7 @@ int main(int argc, char** argv)
             input_format_desc->fetch_rgba_float(a, buffer[2] + i * input_format_size, 0, 0);
             input_format_desc->fetch_rgba_float(b, buffer[4] + i * input_format_size, 0, 0);
 
-            for (j = 0; j < count; ++j)
+            for (j = 0; j < 4; ++j)
             {
                float d = a[j] - b[j];
                if (d > error || d < -error)
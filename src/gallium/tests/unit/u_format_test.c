@@ -29,11 +29,15 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <float.h>
+#include <string.h>
 
+#include "util/os_time.h"
+#include "util/u_cpu_detect.h"
 #include "util/u_half.h"
 #include "util/u_format.h"
 #include "util/u_format_tests.h"
 #include "util/u_format_s3tc.h"
+#include "util/u_memory.h"
 
 
 static boolean
@@ -749,11 +753,224 @@ test_all(void)
 }
 
 
+/*
+ * The formats with vectorized row functions (see u_format_simd.c) are
+ * checked against the plain C functions over whole rows, and optionally
+ * benchmarked.
+ */
+
+#define ROW_WIDTH 259    /* not a multiple of the vector width */
+#define ROW_COUNT 4
+#define ROW_STRIDE (ROW_WIDTH * 4 * sizeof(float) + 16)
+#define BENCH_RUNS 2000
+
+
+enum row_func {
+   UNPACK_RGBA_8UNORM,
+   PACK_RGBA_8UNORM,
+   UNPACK_RGBA_FLOAT,
+   PACK_RGBA_FLOAT,
+   UNPACK_Z_32UNORM,
+   UNPACK_Z_FLOAT,
+   PACK_Z_FLOAT,
+   NUM_ROW_FUNCS
+};
+
+
+static const char *row_func_names[NUM_ROW_FUNCS] = {
+   "unpack_rgba_8unorm",
+   "pack_rgba_8unorm",
+   "unpack_rgba_float",
+   "pack_rgba_float",
+   "unpack_z_32unorm",
+   "unpack_z_float",
+   "pack_z_float",
+};
+
+
+static boolean
+run_row_func(const struct util_format_description *format_desc,
+             enum row_func func,
+             void *dst,
+             const void *src)
+{
+   switch (func) {
+   case UNPACK_RGBA_8UNORM:
+      if (!format_desc->unpack_rgba_8unorm)
+         return FALSE;
+      format_desc->unpack_rgba_8unorm(dst, ROW_STRIDE, src, ROW_STRIDE,
+                                      ROW_WIDTH, ROW_COUNT);
+      return TRUE;
+   case PACK_RGBA_8UNORM:
+      if (!format_desc->pack_rgba_8unorm)
+         return FALSE;
+      format_desc->pack_rgba_8unorm(dst, ROW_STRIDE, src, ROW_STRIDE,
+                                    ROW_WIDTH, ROW_COUNT);
+      return TRUE;
+   case UNPACK_RGBA_FLOAT:
+      if (!format_desc->unpack_rgba_float)
+         return FALSE;
+      format_desc->unpack_rgba_float(dst, ROW_STRIDE, src, ROW_STRIDE,
+                                     ROW_WIDTH, ROW_COUNT);
+      return TRUE;
+   case PACK_RGBA_FLOAT:
+      if (!format_desc->pack_rgba_float)
+         return FALSE;
+      format_desc->pack_rgba_float(dst, ROW_STRIDE, src, ROW_STRIDE,
+                                   ROW_WIDTH, ROW_COUNT);
+      return TRUE;
+   case UNPACK_Z_32UNORM:
+      if (!format_desc->unpack_z_32unorm)
+         return FALSE;
+      format_desc->unpack_z_32unorm(dst, ROW_STRIDE, src, ROW_STRIDE,
+                                    ROW_WIDTH, ROW_COUNT);
+      return TRUE;
+   case UNPACK_Z_FLOAT:
+      if (!format_desc->unpack_z_float)
+         return FALSE;
+      format_desc->unpack_z_float(dst, ROW_STRIDE, src, ROW_STRIDE,
+                                  ROW_WIDTH, ROW_COUNT);
+      return TRUE;
+   case PACK_Z_FLOAT:
+      if (!format_desc->pack_z_float)
+         return FALSE;
+      format_desc->pack_z_float(dst, ROW_STRIDE, src, ROW_STRIDE,
+                                ROW_WIDTH, ROW_COUNT);
+      return TRUE;
+   default:
+      assert(0);
+      return FALSE;
+   }
+}
+
+
+static void
+fill_row_source(enum row_func func, uint8_t *src)
+{
+   unsigned i;
+
+   if (func == PACK_RGBA_FLOAT) {
+      static const float special[] = {
+         0.0f, -0.0f, 1.0f, 0.5f / 255.0f, 0.5f / 1023.0f, 65504.0f,
+         1.0e-6f, -1.0e-6f, INFINITY, -INFINITY, NAN
+      };
+      float *values = (float *)src;
+
+      for (i = 0; i < ROW_STRIDE * ROW_COUNT / sizeof(float); ++i) {
+         if (i % 16 == 5)
+            values[i] = special[(i / 16) % ARRAY_SIZE(special)];
+         else
+            values[i] = (float)rand() / RAND_MAX * 1.5f - 0.25f;
+      }
+   }
+   else if (func == PACK_Z_FLOAT) {
+      /* Depth values outside [0, 1] have undefined conversions. */
+      float *values = (float *)src;
+
+      for (i = 0; i < ROW_STRIDE * ROW_COUNT / sizeof(float); ++i)
+         values[i] = (float)rand() / RAND_MAX;
+      values[0] = 0.0f;
+      values[1] = 1.0f;
+   }
+   else {
+      for (i = 0; i < ROW_STRIDE * ROW_COUNT; ++i)
+         src[i] = rand() & 0xff;
+   }
+}
+
+
+static double
+bench_row_func(const struct util_format_description *format_desc,
+               enum row_func func,
+               void *dst,
+               const void *src)
+{
+   int64_t start = os_time_get_nano();
+   unsigned i;
+
+   for (i = 0; i < BENCH_RUNS; ++i)
+      run_row_func(format_desc, func, dst, src);
+
+   /* Mpixels/s */
+   return (double)BENCH_RUNS * ROW_WIDTH * ROW_COUNT * 1000.0 /
+          (os_time_get_nano() - start);
+}
+
+
+static boolean
+test_simd_row_funcs(boolean bench)
+{
+   static const enum pipe_format formats[] = {
+      PIPE_FORMAT_R8G8B8A8_UNORM,
+      PIPE_FORMAT_B8G8R8A8_UNORM,
+      PIPE_FORMAT_R10G10B10A2_UNORM,
+      PIPE_FORMAT_R16G16B16A16_FLOAT,
+      PIPE_FORMAT_Z16_UNORM,
+      PIPE_FORMAT_Z24_UNORM_S8_UINT,
+   };
+   const struct util_cpu_caps caps = util_cpu_caps;
+   uint8_t *src = MALLOC(ROW_STRIDE * ROW_COUNT);
+   uint8_t *dst_ref = MALLOC(ROW_STRIDE * ROW_COUNT);
+   uint8_t *dst = MALLOC(ROW_STRIDE * ROW_COUNT);
+   boolean success = TRUE;
+   unsigned i;
+   enum row_func func;
+
+   for (i = 0; i < ARRAY_SIZE(formats); ++i) {
+      const struct util_format_description *format_desc =
+         util_format_description(formats[i]);
+
+      for (func = 0; func < NUM_ROW_FUNCS; ++func) {
+         double c_rate = 0.0, simd_rate = 0.0;
+
+         fill_row_source(func, src);
+         memset(dst_ref, 0x5a, ROW_STRIDE * ROW_COUNT);
+         memset(dst, 0x5a, ROW_STRIDE * ROW_COUNT);
+
+         util_cpu_caps.has_sse2 = 0;
+         if (!run_row_func(format_desc, func, dst_ref, src)) {
+            util_cpu_caps = caps;
+            continue;
+         }
+         if (bench)
+            c_rate = bench_row_func(format_desc, func, dst_ref, src);
+         util_cpu_caps = caps;
+
+         printf("Testing util_format_%s_%s rows ...\n",
+                format_desc->short_name, row_func_names[func]);
+         fflush(stdout);
+
+         run_row_func(format_desc, func, dst, src);
+         if (memcmp(dst, dst_ref, ROW_STRIDE * ROW_COUNT) != 0) {
+            printf("FAILED: vectorized and C results differ\n");
+            success = FALSE;
+         }
+
+         if (bench) {
+            simd_rate = bench_row_func(format_desc, func, dst, src);
+            printf("   C %8.1f Mpixels/s, vectorized %8.1f Mpixels/s\n",
+                   c_rate, simd_rate);
+         }
+      }
+   }
+
+   FREE(src);
+   FREE(dst_ref);
+   FREE(dst);
+
+   return success;
+}
+
+
 int main(int argc, char **argv)
 {
+   boolean bench = argc > 1 && strcmp(argv[1], "bench") == 0;
    boolean success;
 
+   util_cpu_detect();
+
    success = test_all();
+   success = test_simd_row_funcs(bench) && success;
 
    return success ? 0 : 1;
 }
@@ -41,6 +41,8 @@
 
 #include "util/crc32.h"
 #include "util/debug.h"
+#include "util/hash_table.h"
+#include "util/list.h"
 #include "util/rand_xor.h"
 #include "util/u_atomic.h"
 #include "util/u_queue.h"
@@ -50,6 +52,7 @@
 #include "main/errors.h"
 
 #include "disk_cache.h"
+#include "disk_cache_pack.h"
 
 /* Number of bits to mask off from a cache key to get an index. */
 #define CACHE_INDEX_KEY_BITS 16
@@ -98,6 +101,19 @@ struct disk_cache {
    /* Maximum size of all cached objects (in bytes). */
    uint64_t max_size;
 
+   /* Pack-file storage, used instead of one file per entry if not NULL. */
+   struct disk_cache_pack *pack;
+
+   /* In-memory LRU of the entries recently loaded or stored by this
+    * process, in front of the disk.  The list is most recently used first.
+    * A maximum size of 0 disables it.
+    */
+   mtx_t mem_cache_mutex;
+   struct hash_table *mem_cache_ht;
+   struct list_head mem_cache_lru;
+   uint64_t mem_cache_size;
+   uint64_t mem_cache_max_size;
+
    /* Driver cache keys. */
    uint8_t *driver_keys_blob;
    size_t driver_keys_blob_size;
@@ -122,6 +138,25 @@ struct disk_cache_put_job {
    struct cache_item_metadata cache_item_metadata;
 };
 
+struct disk_cache_prefetch_job {
+   struct util_queue_fence fence;
+
+   struct disk_cache *cache;
+
+   /* Keys of the entries to load into the memory cache. */
+   cache_key *keys;
+   unsigned num_keys;
+};
+
+struct mem_cache_entry {
+   struct list_head link;
+
+   cache_key key;
+
+   void *data;
+   size_t size;
+};
+
 /* Create a directory named 'path' if it does not already exist.
  *
  * Returns: 0 if path already exists as a directory or if created.
@@ -182,6 +217,186 @@ concatenate_and_mkdir(void *ctx, const char *path, const char *name)
       return NULL;
 }
 
+/* Reads a size in bytes from the environment variable \name: a number
+ * optionally followed by 'K', 'M', or 'G', gigabytes being assumed otherwise.
+ *
+ * Returns default_size if the variable is unset or not a number.
+ */
+static uint64_t
+get_size_from_env(const char *name, uint64_t default_size)
+{
+   const char *str = getenv(name);
+   uint64_t size;
+   char *end;
+
+   if (!str)
+      return default_size;
+
+   size = strtoul(str, &end, 10);
+   if (end == str)
+      return default_size;
+
+   switch (*end) {
+   case 'K':
+   case 'k':
+      size *= 1024;
+      break;
+   case 'M':
+   case 'm':
+      size *= 1024*1024;
+      break;
+   case '\0':
+   case 'G':
+   case 'g':
+   default:
+      size *= 1024*1024*1024;
+      break;
+   }
+
+   return size;
+}
+
+static uint32_t
+mem_cache_key_hash(const void *key)
+{
+   /* Keys are SHA-1 hashes, any part of them is a good hash already. */
+   uint32_t hash;
+   memcpy(&hash, key, sizeof(hash));
+   return hash;
+}
+
+static bool
+mem_cache_key_equal(const void *a, const void *b)
+{
+   return memcmp(a, b, sizeof(cache_key)) == 0;
+}
+
+static void
+mem_cache_evict(struct disk_cache *cache, struct mem_cache_entry *entry)
+{
+   struct hash_entry *he = _mesa_hash_table_search(cache->mem_cache_ht,
+                                                   entry->key);
+
+   _mesa_hash_table_remove(cache->mem_cache_ht, he);
+   list_del(&entry->link);
+   cache->mem_cache_size -= entry->size;
+   free(entry->data);
+   free(entry);
+}
+
+/* Returns a malloc'ed copy of the entry stored in memory under 'key', or
+ * NULL.
+ */
+static void *
+mem_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
+{
+   struct mem_cache_entry *entry;
+   struct hash_entry *he;
+   void *data = NULL;
+
+   if (cache->mem_cache_max_size == 0)
+      return NULL;
+
+   mtx_lock(&cache->mem_cache_mutex);
+
+   he = _mesa_hash_table_search(cache->mem_cache_ht, key);
+   if (he) {
+      entry = (struct mem_cache_entry *) he->data;
+
+      data = malloc(entry->size);
+      if (data) {
+         memcpy(data, entry->data, entry->size);
+         if (size)
+            *size = entry->size;
+
+         list_del(&entry->link);
+         list_add(&entry->link, &cache->mem_cache_lru);
+      }
+   }
+
+   mtx_unlock(&cache->mem_cache_mutex);
+
+   return data;
+}
+
+static bool
+mem_cache_contains(struct disk_cache *cache, const cache_key key)
+{
+   bool found;
+
+   if (cache->mem_cache_max_size == 0)
+      return false;
+
+   mtx_lock(&cache->mem_cache_mutex);
+   found = _mesa_hash_table_search(cache->mem_cache_ht, key) != NULL;
+   mtx_unlock(&cache->mem_cache_mutex);
+
+   return found;
+}
+
+/* Stores a copy of 'data' in memory under 'key', evicting the least recently
+ * used entries to make room for it.
+ */
+static void
+mem_cache_put(struct disk_cache *cache, const cache_key key,
+              const void *data, size_t size)
+{
+   struct mem_cache_entry *entry;
+   struct hash_entry *he;
+
+   /* Don't flush the whole cache for a single huge entry. */
+   if (cache->mem_cache_max_size == 0 || size > cache->mem_cache_max_size / 2)
+      return;
+
+   entry = (struct mem_cache_entry *) malloc(sizeof(*entry));
+   if (entry == NULL)
+      return;
+
+   entry->data = malloc(size);
+   if (entry->data == NULL) {
+      free(entry);
+      return;
+   }
+
+   memcpy(entry->key, key, sizeof(cache_key));
+   memcpy(entry->data, data, size);
+   entry->size = size;
+
+   mtx_lock(&cache->mem_cache_mutex);
+
+   he = _mesa_hash_table_search(cache->mem_cache_ht, key);
+   if (he)
+      mem_cache_evict(cache, (struct mem_cache_entry *) he->data);
+
+   while (cache->mem_cache_size + size > cache->mem_cache_max_size) {
+      mem_cache_evict(cache, LIST_ENTRY(struct mem_cache_entry,
+                                        cache->mem_cache_lru.prev, link));
+   }
+
+   _mesa_hash_table_insert(cache->mem_cache_ht, entry->key, entry);
+   list_add(&entry->link, &cache->mem_cache_lru);
+   cache->mem_cache_size += size;
+
+   mtx_unlock(&cache->mem_cache_mutex);
+}
+
+static void
+mem_cache_remove(struct disk_cache *cache, const cache_key key)
+{
+   struct hash_entry *he;
+
+   if (cache->mem_cache_max_size == 0)
+      return;
+
+   mtx_lock(&cache->mem_cache_mutex);
+
+   he = _mesa_hash_table_search(cache->mem_cache_ht, key);
+   if (he)
+      mem_cache_evict(cache, (struct mem_cache_entry *) he->data);
+
+   mtx_unlock(&cache->mem_cache_mutex);
+}
+
 #define DRV_KEY_CPY(_dst, _src, _src_size) \
 do {                                       \
    memcpy(_dst, _src, _src_size);          \
@@ -194,7 +409,7 @@ disk_cache_create(const char *gpu_name, const char *timestamp,
 {
    void *local;
    struct disk_cache *cache = NULL;
-   char *path, *max_size_str;
+   char *path;
    uint64_t max_size;
    int fd = -1;
    struct stat sb;
@@ -335,41 +550,18 @@ disk_cache_create(const char *gpu_name, const char *timestamp,
    cache->size = (uint64_t *) cache->index_mmap;
    cache->stored_keys = cache->index_mmap + sizeof(uint64_t);
 
-   max_size = 0;
-
-   max_size_str = getenv("MESA_GLSL_CACHE_MAX_SIZE");
-   if (max_size_str) {
-      char *end;
-      max_size = strtoul(max_size_str, &end, 10);
-      if (end == max_size_str) {
-         max_size = 0;
-      } else {
-         switch (*end) {
-         case 'K':
-         case 'k':
-            max_size *= 1024;
-            break;
-         case 'M':
-         case 'm':
-            max_size *= 1024*1024;
-            break;
-         case '\0':
-         case 'G':
-         case 'g':
-         default:
-            max_size *= 1024*1024*1024;
-            break;
-         }
-      }
-   }
-
    /* Default to 1GB for maximum cache size. */
+   max_size = get_size_from_env("MESA_GLSL_CACHE_MAX_SIZE", 0);
    if (max_size == 0) {
       max_size = 1024*1024*1024;
    }
 
    cache->max_size = max_size;
 
+   /* At user request, store all the entries in a single pack file. */
+   if (env_var_as_boolean("MESA_GLSL_CACHE_PACK", false))
+      cache->pack = disk_cache_pack_open(cache, cache->path, max_size);
+
    /* 1 thread was chosen because we don't really care about getting things
     * to disk quickly just that it's not blocking other tasks.
     *
@@ -380,6 +572,16 @@ disk_cache_create(const char *gpu_name, const char *timestamp,
                    UTIL_QUEUE_INIT_RESIZE_IF_FULL |
                    UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY);
 
+   /* Default to 32MB for the in-memory cache, 0 disables it. */
+   cache->mem_cache_max_size =
+      get_size_from_env("MESA_GLSL_CACHE_MEM_SIZE", 32*1024*1024);
+   cache->mem_cache_ht = _mesa_hash_table_create(cache, mem_cache_key_hash,
+                                                 mem_cache_key_equal);
+   if (cache->mem_cache_ht == NULL)
+      cache->mem_cache_max_size = 0;
+   list_inithead(&cache->mem_cache_lru);
+   mtx_init(&cache->mem_cache_mutex, mtx_plain);
+
    cache->path_init_failed = false;
 
  path_fail:
@@ -436,6 +638,15 @@ disk_cache_destroy(struct disk_cache *cache)
 {
    if (cache && !cache->path_init_failed) {
       util_queue_destroy(&cache->cache_queue);
+      if (cache->pack)
+         disk_cache_pack_close(cache->pack);
+
+      list_for_each_entry_safe(struct mem_cache_entry, entry,
+                               &cache->mem_cache_lru, link) {
+         free(entry->data);
+         free(entry);
+      }
+      mtx_destroy(&cache->mem_cache_mutex);
       munmap(cache->index_mmap, cache->index_mmap_size);
    }
 
@@ -671,6 +882,13 @@ disk_cache_remove(struct disk_cache *cache, const cache_key key)
 {
    struct stat sb;
 
+   mem_cache_remove(cache, key);
+
+   if (cache->pack) {
+      disk_cache_pack_remove(cache->pack, key);
+      return;
+   }
+
    char *filename = get_cache_file(cache, key);
    if (filename == NULL) {
       return;
@@ -858,6 +1076,16 @@ cache_put(void *job, int thread_index)
    char *filename = NULL, *filename_tmp = NULL;
    struct disk_cache_put_job *dc_job = (struct disk_cache_put_job *) job;
 
+   if (dc_job->cache->pack) {
+      disk_cache_pack_put(dc_job->cache->pack, dc_job->key,
+                          dc_job->cache->driver_keys_blob,
+                          dc_job->cache->driver_keys_blob_size,
+                          &dc_job->cache_item_metadata,
+                          dc_job->data, dc_job->size);
+      mem_cache_put(dc_job->cache, dc_job->key, dc_job->data, dc_job->size);
+      return;
+   }
+
    filename = get_cache_file(dc_job->cache, dc_job->key);
    if (filename == NULL)
       goto done;
@@ -1004,6 +1232,11 @@ cache_put(void *job, int thread_index)
       close(fd);
    free(filename_tmp);
    free(filename);
+
+   /* Only now that the entry can be read back from disk, so that a
+    * disk_cache_get() hitting in memory implies it is stored.
+    */
+   mem_cache_put(dc_job->cache, dc_job->key, dc_job->data, dc_job->size);
 }
 
 void
@@ -1068,8 +1301,9 @@ inflate_cache_data(uint8_t *in_data, size_t in_data_size,
    return true;
 }
 
-void *
-disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
+/* Loads an entry from the disk, bypassing the memory cache. */
+static void *
+load_from_disk(struct disk_cache *cache, const cache_key key, size_t *size)
 {
    int fd = -1, ret;
    struct stat sb;
@@ -1078,29 +1312,9 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
    uint8_t *uncompressed_data = NULL;
    uint8_t *file_header = NULL;
 
-   if (size)
-      *size = 0;
-
-   if (cache->blob_get_cb) {
-      /* This is what Android EGL defines as the maxValueSize in egl_cache_t
-       * class implementation.
-       */
-      const signed long max_blob_size = 64 * 1024;
-      void *blob = malloc(max_blob_size);
-      if (!blob)
-         return NULL;
-
-      signed long bytes =
-         cache->blob_get_cb(key, CACHE_KEY_SIZE, blob, max_blob_size);
-
-      if (!bytes) {
-         free(blob);
-         return NULL;
-      }
-
-      if (size)
-         *size = bytes;
-      return blob;
+   if (cache->pack) {
+      return disk_cache_pack_get(cache->pack, key, cache->driver_keys_blob,
+                                 cache->driver_keys_blob_size, size);
    }
 
    filename = get_cache_file(cache, key);
@@ -1211,6 +1425,115 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
    return NULL;
 }
 
+void *
+disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
+{
+   size_t data_size;
+   void *data;
+
+   if (size)
+      *size = 0;
+
+   if (cache->blob_get_cb) {
+      /* This is what Android EGL defines as the maxValueSize in egl_cache_t
+       * class implementation.
+       */
+      const signed long max_blob_size = 64 * 1024;
+      void *blob = malloc(max_blob_size);
+      if (!blob)
+         return NULL;
+
+      signed long bytes =
+         cache->blob_get_cb(key, CACHE_KEY_SIZE, blob, max_blob_size);
+
+      if (!bytes) {
+         free(blob);
+         return NULL;
+      }
+
+      if (size)
+         *size = bytes;
+      return blob;
+   }
+
+   data = mem_cache_get(cache, key, &data_size);
+   if (data == NULL) {
+      data = load_from_disk(cache, key, &data_size);
+      if (data)
+         mem_cache_put(cache, key, data, data_size);
+   }
+
+   if (data && size)
+      *size = data_size;
+
+   return data;
+}
+
+static void
+cache_prefetch(void *job, int thread_index)
+{
+   struct disk_cache_prefetch_job *dc_job =
+      (struct disk_cache_prefetch_job *) job;
+   struct disk_cache *cache = dc_job->cache;
+
+   for (unsigned i = 0; i < dc_job->num_keys; i++) {
+      void *data;
+      size_t size;
+
+      if (mem_cache_contains(cache, dc_job->keys[i]))
+         continue;
+
+      data = load_from_disk(cache, dc_job->keys[i], &size);
+      if (data) {
+         mem_cache_put(cache, dc_job->keys[i], data, size);
+         free(data);
+      }
+   }
+}
+
+static void
+destroy_prefetch_job(void *job, int thread_index)
+{
+   free(job);
+}
+
+void
+disk_cache_prefetch(struct disk_cache *cache, const cache_key *keys,
+                    unsigned num_keys)
+{
+   /* Nothing to load into without the memory cache, and the blob cache of
+    * Android is in memory already.
+    */
+   if (cache->blob_get_cb || cache->path_init_failed ||
+       cache->mem_cache_max_size == 0 || num_keys == 0)
+      return;
+
+   struct disk_cache_prefetch_job *dc_job = (struct disk_cache_prefetch_job *)
+      malloc(sizeof(struct disk_cache_prefetch_job) +
+             num_keys * sizeof(cache_key));
+
+   if (dc_job) {
+      dc_job->cache = cache;
+      dc_job->keys = (cache_key *) (dc_job + 1);
+      memcpy(dc_job->keys, keys, num_keys * sizeof(cache_key));
+      dc_job->num_keys = num_keys;
+
+      /* Ahead of the writes, the entries are about to be needed. */
+      util_queue_fence_init(&dc_job->fence);
+      util_queue_add_job_with_priority(&cache->cache_queue, dc_job,
+                                       &dc_job->fence, cache_prefetch,
+                                       destroy_prefetch_job,
+                                       UTIL_QUEUE_PRIORITY_HIGH);
+   }
+}
+
+void
+disk_cache_wait_for_idle(struct disk_cache *cache)
+{
+   if (!cache->path_init_failed)
+      util_queue_finish(&cache->cache_queue);
+}
+
 void
 disk_cache_put_key(struct disk_cache *cache, const cache_key key)
 {
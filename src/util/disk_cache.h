@@ -175,6 +175,9 @@ disk_cache_put(struct disk_cache *cache, const cache_key key,
  * If \size is non-NULL, then, on successful return, it will be set to the
  * size of the object.
  *
+ * Items recently stored, loaded or prefetched by this process are returned
+ * from memory, up to MESA_GLSL_CACHE_MEM_SIZE bytes of them.
+ *
  * \return A pointer to the stored object if found. NULL if the object
  * is not found, or if any error occurs, (memory allocation failure,
  * filesystem error, etc.). The returned data is malloc'ed so the
@@ -183,6 +186,25 @@ disk_cache_put(struct disk_cache *cache, const cache_key key,
 void *
 disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size);
 
+/**
+ * Load the items stored under the \num_keys names \keys into memory, in
+ * the background, so that later calls to disk_cache_get() for them don't
+ * have to read from the disk.
+ *
+ * Keys of items which are not in the cache are ignored.  This does nothing
+ * when the in-memory cache is disabled, (MESA_GLSL_CACHE_MEM_SIZE=0).
+ */
+void
+disk_cache_prefetch(struct disk_cache *cache, const cache_key *keys,
+                    unsigned num_keys);
+
+/**
+ * Wait for all the pending disk_cache_put() and disk_cache_prefetch() calls
+ * to complete.
+ */
+void
+disk_cache_wait_for_idle(struct disk_cache *cache);
+
 /**
  * Store the name \key within the cache, (without any associated data).
  *
@@ -253,6 +275,19 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
    return NULL;
 }
 
+static inline void
+disk_cache_prefetch(struct disk_cache *cache, const cache_key *keys,
+                    unsigned num_keys)
+{
+   return;
+}
+
+static inline void
+disk_cache_wait_for_idle(struct disk_cache *cache)
+{
+   return;
+}
+
 static inline void
 disk_cache_put_key(struct disk_cache *cache, const cache_key key)
 {
@@ -0,0 +1,929 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifdef ENABLE_SHADER_CACHE
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/file.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "zlib.h"
+
+#include "c11/threads.h"
+#include "util/crc32.h"
+#include "util/macros.h"
+#include "util/ralloc.h"
+#include "util/u_atomic.h"
+
+#include "disk_cache_pack.h"
+
+#define PACK_FILE_MAGIC   0x4b43504d  /* "MPCK" */
+#define PACK_RECORD_MAGIC 0x5243504d  /* "MPCR" */
+#define PACK_INDEX_MAGIC  0x4943504d  /* "MPCI" */
+
+/* Should be bumped whenever the layout of the pack, its records or its
+ * index changes.  An index of another version is reset, (dropping all the
+ * entries).
+ */
+#define PACK_VERSION 1
+
+/* Number of slots of the index hash table.  The pack is compacted once
+ * three quarters of them are used, which keeps the probe sequences short.
+ */
+#define PACK_INDEX_NUM_SLOTS (1 << 17)
+#define PACK_INDEX_MAX_USED_SLOTS (PACK_INDEX_NUM_SLOTS / 4 * 3)
+
+/* Records start on 8-byte boundaries in the pack. */
+#define PACK_RECORD_ALIGNMENT 8
+
+/* Room left past the end of the pack when mapping it, so that it can grow
+ * a little before it has to be mapped again.
+ */
+#define PACK_MAP_GROWTH (1024 * 1024)
+
+/* Record flags */
+#define PACK_RECORD_DEFLATE (1 << 0)
+
+struct pack_file_header {
+   uint32_t magic;
+   uint32_t version;
+
+   /* Must match the generation in the index for its offsets to be used. */
+   uint64_t generation;
+};
+
+struct pack_record_header {
+   uint32_t magic;
+   uint32_t record_size;
+   uint8_t key[CACHE_KEY_SIZE];
+
+   /* CRC of the driver keys blob of the cache which wrote the entry. */
+   uint32_t driver_keys_crc32;
+
+   uint32_t flags;
+   uint32_t crc32;               /* of the uncompressed data */
+   uint32_t uncompressed_size;
+   uint32_t stored_size;
+
+   /* The cache item metadata, followed by num_keys cache keys and then
+    * by the stored data.
+    */
+   uint32_t metadata_type;
+   uint32_t metadata_num_keys;
+};
+
+struct pack_index_slot {
+   uint8_t key[CACHE_KEY_SIZE];
+
+   /* Size of the record, 0 once the entry was removed. */
+   uint32_t record_size;
+
+   /* Offset of the record in the pack, 0 for empty slots. */
+   uint64_t offset;
+
+   /* Value of the access clock at the last put or get of the entry. */
+   uint32_t last_access;
+
+   /* Unused in the index, holds the age of the entry during compaction. */
+   uint32_t age;
+};
+
+struct pack_index_header {
+   uint32_t magic;
+   uint32_t version;
+   uint32_t num_slots;
+   uint32_t num_used_slots;
+
+   /* Generation of the pack file the offsets refer to. */
+   uint64_t generation;
+
+   /* End of the records in the pack. */
+   uint64_t pack_size;
+
+   /* Total size of the records which weren't removed. */
+   uint64_t live_size;
+
+   /* Incremented on each access, orders entries for compaction. */
+   uint32_t access_clock;
+
+   uint32_t pad[5];
+};
+
+/* A read-only mapping of one generation of the pack.
+ *
+ * The mapping is replaced when the pack is compacted (or grows past it),
+ * and is unmapped when the last reader using it is done.
+ */
+struct pack_mapping {
+   int fd;
+   uint8_t *map;
+   size_t map_size;
+   uint64_t file_size;
+   uint64_t generation;
+   unsigned refcount;
+};
+
+struct disk_cache_pack {
+   char *pack_path;
+   char *tmp_path;
+
+   /* The index, mapped shared so that all processes see the updates. */
+   int index_fd;
+   struct pack_index_header *index;
+   struct pack_index_slot *slots;
+   size_t index_size;
+
+   uint64_t max_size;
+
+   /* Taken around the flock of the index, which only excludes other
+    * processes, not the other threads sharing index_fd.
+    */
+   mtx_t index_mutex;
+
+   /* Protects mapping, which is shared by all the reader threads. */
+   mtx_t mutex;
+   struct pack_mapping *mapping;
+
+   /* The pack opened for appends, only used with the index locked. */
+   int write_fd;
+   uint64_t write_generation;
+};
+
+/* Locks the index against the other processes and threads. */
+static bool
+lock_index(struct disk_cache_pack *pack)
+{
+   mtx_lock(&pack->index_mutex);
+
+   if (flock(pack->index_fd, LOCK_EX) == -1) {
+      mtx_unlock(&pack->index_mutex);
+      return false;
+   }
+
+   return true;
+}
+
+static void
+unlock_index(struct disk_cache_pack *pack)
+{
+   flock(pack->index_fd, LOCK_UN);
+   mtx_unlock(&pack->index_mutex);
+}
+
+static ssize_t
+pread_all(int fd, void *buf, size_t count, off_t offset)
+{
+   char *in = buf;
+   ssize_t read_ret;
+   size_t done;
+
+   for (done = 0; done < count; done += read_ret) {
+      read_ret = pread(fd, in + done, count - done, offset + done);
+      if (read_ret == -1 || read_ret == 0)
+         return -1;
+   }
+   return done;
+}
+
+static ssize_t
+pwrite_all(int fd, const void *buf, size_t count, off_t offset)
+{
+   const char *out = buf;
+   ssize_t written;
+   size_t done;
+
+   for (done = 0; done < count; done += written) {
+      written = pwrite(fd, out + done, count - done, offset + done);
+      if (written == -1)
+         return -1;
+   }
+   return done;
+}
+
+static inline uint32_t
+align_record_size(size_t size)
+{
+   return (size + PACK_RECORD_ALIGNMENT - 1) & ~(PACK_RECORD_ALIGNMENT - 1);
+}
+
+static inline uint32_t
+slot_hash(const cache_key key)
+{
+   uint32_t hash;
+
+   /* Keys are SHA-1 hashes, any of their bits are well distributed. */
+   memcpy(&hash, key, sizeof(hash));
+   return hash;
+}
+
+/* Returns the slot of \key, which may have been removed, or NULL.
+ *
+ * This may race with writers from other processes, so the caller has to
+ * validate the record the slot points to.
+ */
+static struct pack_index_slot *
+find_slot(struct disk_cache_pack *pack, const cache_key key)
+{
+   const uint32_t mask = PACK_INDEX_NUM_SLOTS - 1;
+   uint32_t i = slot_hash(key) & mask;
+
+   for (unsigned n = 0; n < PACK_INDEX_NUM_SLOTS; n++) {
+      struct pack_index_slot *slot = &pack->slots[i];
+
+      if (p_atomic_read(&slot->offset) == 0)
+         return NULL;
+
+      if (memcmp(slot->key, key, CACHE_KEY_SIZE) == 0)
+         return slot;
+
+      i = (i + 1) & mask;
+   }
+
+   return NULL;
+}
+
+/* Adds \key to the index.  The index must be locked, and have less than
+ * PACK_INDEX_MAX_USED_SLOTS slots in use.
+ */
+static void
+insert_slot(struct disk_cache_pack *pack, const cache_key key,
+            uint64_t offset, uint32_t record_size, uint32_t last_access)
+{
+   const uint32_t mask = PACK_INDEX_NUM_SLOTS - 1;
+   uint32_t i = slot_hash(key) & mask;
+
+   while (pack->slots[i].offset != 0)
+      i = (i + 1) & mask;
+
+   struct pack_index_slot *slot = &pack->slots[i];
+   memcpy(slot->key, key, CACHE_KEY_SIZE);
+   slot->record_size = record_size;
+   slot->last_access = last_access;
+
+   /* Publish the slot to the readers last. */
+   p_atomic_set(&slot->offset, offset);
+
+   pack->index->num_used_slots++;
+}
+
+static bool
+index_is_valid(struct disk_cache_pack *pack)
+{
+   return pack->index->magic == PACK_INDEX_MAGIC &&
+          pack->index->version == PACK_VERSION &&
+          pack->index->num_slots == PACK_INDEX_NUM_SLOTS &&
+          pack->index->num_used_slots < PACK_INDEX_NUM_SLOTS;
+}
+
+/* Writes the header of a new, empty, pack to \fd. */
+static bool
+write_pack_header(int fd, uint64_t generation)
+{
+   struct pack_file_header header;
+
+   header.magic = PACK_FILE_MAGIC;
+   header.version = PACK_VERSION;
+   header.generation = generation;
+
+   return pwrite_all(fd, &header, sizeof(header), 0) != -1;
+}
+
+static void
+close_write_fd(struct disk_cache_pack *pack)
+{
+   if (pack->write_fd != -1) {
+      close(pack->write_fd);
+      pack->write_fd = -1;
+   }
+}
+
+/* Empties the index and starts a new pack.  The index must be locked. */
+static bool
+reset_pack(struct disk_cache_pack *pack)
+{
+   struct pack_file_header old_header;
+   uint64_t generation = 1;
+   int fd;
+
+   /* Keep the generations increasing, so that no reader can mistake the
+    * new pack for the one it has mapped.
+    */
+   fd = open(pack->pack_path, O_RDONLY | O_CLOEXEC);
+   if (fd != -1) {
+      if (pread_all(fd, &old_header, sizeof(old_header), 0) != -1 &&
+          old_header.magic == PACK_FILE_MAGIC)
+         generation = old_header.generation + 1;
+      close(fd);
+   }
+   if (pack->index->magic == PACK_INDEX_MAGIC &&
+       pack->index->generation >= generation)
+      generation = pack->index->generation + 1;
+
+   fd = open(pack->tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+   if (fd == -1)
+      return false;
+
+   if (!write_pack_header(fd, generation) ||
+       rename(pack->tmp_path, pack->pack_path) == -1) {
+      close(fd);
+      unlink(pack->tmp_path);
+      return false;
+   }
+   close(fd);
+
+   close_write_fd(pack);
+
+   p_atomic_set(&pack->index->generation, generation);
+   memset(pack->slots, 0, PACK_INDEX_NUM_SLOTS * sizeof(*pack->slots));
+   pack->index->num_slots = PACK_INDEX_NUM_SLOTS;
+   pack->index->num_used_slots = 0;
+   pack->index->pack_size = sizeof(struct pack_file_header);
+   pack->index->live_size = 0;
+   pack->index->access_clock = 0;
+   pack->index->version = PACK_VERSION;
+   pack->index->magic = PACK_INDEX_MAGIC;
+
+   return true;
+}
+
+static int
+compare_slot_age(const void *a, const void *b)
+{
+   const struct pack_index_slot *slot_a = a;
+   const struct pack_index_slot *slot_b = b;
+
+   return slot_a->age < slot_b->age ? -1 : slot_a->age > slot_b->age;
+}
+
+/* Rewrites the pack with the most recently used entries which fit in 3/4
+ * of the maximum size, leaving room for \incoming_size bytes.  Removed
+ * entries and records left over by failed writes are dropped as well.
+ *
+ * This replaces the per-file eviction: the cost of finding what to evict
+ * is paid once every many puts instead of a directory scan on each.
+ *
+ * The index must be locked.
+ */
+static bool
+compact_pack(struct disk_cache_pack *pack, uint32_t incoming_size)
+{
+   struct pack_index_slot *live;
+   unsigned num_live = 0, num_kept = 0;
+   uint64_t budget = pack->max_size / 4 * 3;
+   uint64_t generation = pack->index->generation + 1;
+   uint64_t offset = sizeof(struct pack_file_header);
+   uint64_t live_size = 0;
+   uint32_t clock = pack->index->access_clock;
+   uint8_t *buf = NULL;
+   size_t buf_size = 0;
+   int old_fd, new_fd;
+   bool success = false;
+
+   budget = budget > incoming_size ? budget - incoming_size : 0;
+
+   live = malloc((pack->index->num_used_slots + 1) * sizeof(*live));
+   if (!live)
+      return false;
+
+   for (unsigned i = 0; i < PACK_INDEX_NUM_SLOTS; i++) {
+      if (pack->slots[i].offset != 0 && pack->slots[i].record_size != 0 &&
+          num_live < pack->index->num_used_slots) {
+         live[num_live] = pack->slots[i];
+         /* Ages rather than access times, to be correct across the
+          * wraparounds of the clock.
+          */
+         live[num_live].age = clock - pack->slots[i].last_access;
+         num_live++;
+      }
+   }
+
+   qsort(live, num_live, sizeof(*live), compare_slot_age);
+
+   old_fd = open(pack->pack_path, O_RDONLY | O_CLOEXEC);
+   new_fd = open(pack->tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                 0644);
+   if (new_fd == -1 || !write_pack_header(new_fd, generation))
+      goto fail;
+
+   for (unsigned i = 0; i < num_live && old_fd != -1; i++) {
+      struct pack_record_header *header;
+      uint32_t size = live[i].record_size;
+
+      if (live_size + size > budget)
+         continue;
+
+      if (size > buf_size) {
+         uint8_t *tmp = realloc(buf, size);
+         if (!tmp)
+            continue;
+         buf = tmp;
+         buf_size = size;
+      }
+
+      /* Skip what doesn't look like the record the slot points to. */
+      header = (struct pack_record_header *) buf;
+      if (size < sizeof(*header) ||
+          pread_all(old_fd, buf, size, live[i].offset) == -1 ||
+          header->magic != PACK_RECORD_MAGIC ||
+          header->record_size != size ||
+          memcmp(header->key, live[i].key, CACHE_KEY_SIZE) != 0)
+         continue;
+
+      if (pwrite_all(new_fd, buf, size, offset) == -1)
+         goto fail;
+
+      live[num_kept] = live[i];
+      live[num_kept].offset = offset;
+      num_kept++;
+
+      offset += size;
+      live_size += size;
+   }
+
+   if (rename(pack->tmp_path, pack->pack_path) == -1)
+      goto fail;
+
+   close_write_fd(pack);
+
+   /* Readers see the new generation before any new offset, and remap. */
+   p_atomic_set(&pack->index->generation, generation);
+   memset(pack->slots, 0, PACK_INDEX_NUM_SLOTS * sizeof(*pack->slots));
+   pack->index->num_used_slots = 0;
+   for (unsigned i = 0; i < num_kept; i++) {
+      insert_slot(pack, live[i].key, live[i].offset, live[i].record_size,
+                  live[i].last_access);
+   }
+   pack->index->pack_size = offset;
+   pack->index->live_size = live_size;
+
+   success = true;
+
+ fail:
+   if (!success && new_fd != -1)
+      unlink(pack->tmp_path);
+   if (new_fd != -1)
+      close(new_fd);
+   if (old_fd != -1)
+      close(old_fd);
+   free(buf);
+   free(live);
+
+   return success;
+}
+
+/* Opens the pack for appending, if not already open for the current
+ * generation.  The index must be locked.
+ */
+static bool
+open_write_fd(struct disk_cache_pack *pack)
+{
+   struct pack_file_header header;
+
+   if (pack->write_fd != -1 &&
+       pack->write_generation == pack->index->generation)
+      return true;
+
+   close_write_fd(pack);
+
+   pack->write_fd = open(pack->pack_path, O_RDWR | O_CLOEXEC);
+   if (pack->write_fd == -1)
+      return false;
+
+   if (pread_all(pack->write_fd, &header, sizeof(header), 0) == -1 ||
+       header.magic != PACK_FILE_MAGIC ||
+       header.generation != pack->index->generation) {
+      close_write_fd(pack);
+      return false;
+   }
+
+   pack->write_generation = header.generation;
+
+   return true;
+}
+
+static void
+release_mapping_locked(struct pack_mapping *mapping)
+{
+   if (--mapping->refcount == 0) {
+      munmap(mapping->map, mapping->map_size);
+      close(mapping->fd);
+      free(mapping);
+   }
+}
+
+static void
+release_mapping(struct disk_cache_pack *pack, struct pack_mapping *mapping)
+{
+   mtx_lock(&pack->mutex);
+   release_mapping_locked(mapping);
+   mtx_unlock(&pack->mutex);
+}
+
+static struct pack_mapping *
+map_pack(struct disk_cache_pack *pack, uint64_t generation)
+{
+   struct pack_mapping *mapping;
+   struct pack_file_header header;
+   struct stat sb;
+   long page_size = sysconf(_SC_PAGESIZE);
+
+   mapping = calloc(1, sizeof(*mapping));
+   if (!mapping)
+      return NULL;
+
+   mapping->fd = open(pack->pack_path, O_RDONLY | O_CLOEXEC);
+   if (mapping->fd == -1)
+      goto fail;
+
+   if (fstat(mapping->fd, &sb) == -1 ||
+       pread_all(mapping->fd, &header, sizeof(header), 0) == -1 ||
+       header.magic != PACK_FILE_MAGIC || header.generation != generation)
+      goto fail_close;
+
+   /* Only map a little past the end of the file, a mapping of the whole
+    * maximum cache size would eat up 32-bit address spaces.  Only the part
+    * below file_size is ever accessed, the pack is mapped again once a
+    * record ends past the mapping.
+    */
+   if ((uint64_t) sb.st_size > SIZE_MAX - PACK_MAP_GROWTH - page_size)
+      goto fail_close;
+
+   mapping->file_size = sb.st_size;
+   mapping->map_size = sb.st_size + PACK_MAP_GROWTH;
+   mapping->map_size = (mapping->map_size + page_size - 1) & ~(page_size - 1);
+   mapping->map = mmap(NULL, mapping->map_size, PROT_READ, MAP_SHARED,
+                       mapping->fd, 0);
+   if (mapping->map == MAP_FAILED)
+      goto fail_close;
+
+   mapping->generation = generation;
+   mapping->refcount = 1;
+
+   return mapping;
+
+ fail_close:
+   close(mapping->fd);
+ fail:
+   free(mapping);
+   return NULL;
+}
+
+/* Returns a reference to a mapping of the current generation of the pack
+ * which covers [0, end), or NULL.
+ */
+static struct pack_mapping *
+acquire_mapping(struct disk_cache_pack *pack, uint64_t end)
+{
+   uint64_t generation = p_atomic_read(&pack->index->generation);
+   struct pack_mapping *mapping;
+
+   mtx_lock(&pack->mutex);
+
+   mapping = pack->mapping;
+   if (mapping && mapping->generation == generation &&
+       end > mapping->file_size && end <= mapping->map_size) {
+      /* The record may have been appended since the last lookup. */
+      struct stat sb;
+      if (fstat(mapping->fd, &sb) == 0)
+         mapping->file_size = sb.st_size;
+   }
+
+   if (!mapping || mapping->generation != generation ||
+       end > mapping->map_size) {
+      mapping = map_pack(pack, generation);
+      if (mapping) {
+         if (pack->mapping)
+            release_mapping_locked(pack->mapping);
+         pack->mapping = mapping;
+      }
+   }
+
+   if (mapping && end <= mapping->file_size) {
+      mapping->refcount++;
+   } else {
+      mapping = NULL;
+   }
+
+   mtx_unlock(&pack->mutex);
+
+   return mapping;
+}
+
+struct disk_cache_pack *
+disk_cache_pack_open(void *mem_ctx, const char *path, uint64_t max_size)
+{
+   struct disk_cache_pack *pack;
+   struct stat sb;
+   char *index_path;
+
+   pack = rzalloc(mem_ctx, struct disk_cache_pack);
+   if (!pack)
+      return NULL;
+
+   pack->index_fd = -1;
+   pack->write_fd = -1;
+   pack->max_size = max_size;
+
+   pack->pack_path = ralloc_asprintf(pack, "%s/pack", path);
+   pack->tmp_path = ralloc_asprintf(pack, "%s/pack.tmp", path);
+   index_path = ralloc_asprintf(pack, "%s/pack_index", path);
+   if (!pack->pack_path || !pack->tmp_path || !index_path)
+      goto fail;
+
+   pack->index_fd = open(index_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+   if (pack->index_fd == -1)
+      goto fail;
+
+   if (flock(pack->index_fd, LOCK_EX) == -1)
+      goto fail;
+
+   /* Force the index file to be the expected size. */
+   pack->index_size = sizeof(struct pack_index_header) +
+                      PACK_INDEX_NUM_SLOTS * sizeof(struct pack_index_slot);
+   if (fstat(pack->index_fd, &sb) == -1 ||
+       (sb.st_size != pack->index_size &&
+        ftruncate(pack->index_fd, pack->index_size) == -1))
+      goto fail_unlock;
+
+   pack->index = mmap(NULL, pack->index_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, pack->index_fd, 0);
+   if (pack->index == MAP_FAILED) {
+      pack->index = NULL;
+      goto fail_unlock;
+   }
+   pack->slots = (struct pack_index_slot *) (pack->index + 1);
+
+   if (!index_is_valid(pack) && !reset_pack(pack))
+      goto fail_unlock;
+
+   flock(pack->index_fd, LOCK_UN);
+
+   if (mtx_init(&pack->index_mutex, mtx_plain) != thrd_success)
+      goto fail;
+
+   if (mtx_init(&pack->mutex, mtx_plain) != thrd_success) {
+      mtx_destroy(&pack->index_mutex);
+      goto fail;
+   }
+
+   return pack;
+
+ fail_unlock:
+   flock(pack->index_fd, LOCK_UN);
+ fail:
+   if (pack->index)
+      munmap(pack->index, pack->index_size);
+   if (pack->index_fd != -1)
+      close(pack->index_fd);
+   ralloc_free(pack);
+
+   return NULL;
+}
+
+void
+disk_cache_pack_close(struct disk_cache_pack *pack)
+{
+   if (pack->mapping)
+      release_mapping_locked(pack->mapping);
+
+   close_write_fd(pack);
+   munmap(pack->index, pack->index_size);
+   close(pack->index_fd);
+   mtx_destroy(&pack->mutex);
+   mtx_destroy(&pack->index_mutex);
+   ralloc_free(pack);
+}
+
+void
+disk_cache_pack_put(struct disk_cache_pack *pack, const cache_key key,
+                    const void *driver_keys, size_t driver_keys_size,
+                    const struct cache_item_metadata *metadata,
+                    const void *data, size_t size)
+{
+   struct pack_record_header *header;
+   struct pack_index_slot *slot;
+   uint32_t num_keys = 0;
+   uLongf stored_size;
+   size_t header_size;
+   uint32_t record_size;
+   uint8_t *record;
+
+   if (metadata && metadata->type == CACHE_ITEM_TYPE_GLSL)
+      num_keys = metadata->num_keys;
+
+   header_size = sizeof(*header) + num_keys * sizeof(cache_key);
+   stored_size = compressBound(size);
+   if (size > UINT32_MAX || header_size + stored_size > UINT32_MAX / 2)
+      return;
+
+   record = calloc(1, align_record_size(header_size + stored_size));
+   if (!record)
+      return;
+
+   header = (struct pack_record_header *) record;
+   header->magic = PACK_RECORD_MAGIC;
+   memcpy(header->key, key, CACHE_KEY_SIZE);
+   header->driver_keys_crc32 = util_hash_crc32(driver_keys, driver_keys_size);
+   header->crc32 = util_hash_crc32(data, size);
+   header->uncompressed_size = size;
+   header->metadata_type = metadata ? metadata->type : CACHE_ITEM_TYPE_UNKNOWN;
+   header->metadata_num_keys = num_keys;
+   if (num_keys)
+      memcpy(header + 1, metadata->keys, num_keys * sizeof(cache_key));
+
+   /* Compress for speed rather than size, and don't bother when it gains
+    * little: small entries are read back faster with a plain memcpy.
+    */
+   if (compress2(record + header_size, &stored_size, data, size,
+                 Z_BEST_SPEED) == Z_OK && stored_size < size - size / 8) {
+      header->flags = PACK_RECORD_DEFLATE;
+   } else {
+      memcpy(record + header_size, data, size);
+      stored_size = size;
+   }
+   header->stored_size = stored_size;
+
+   record_size = align_record_size(header_size + stored_size);
+   header->record_size = record_size;
+
+   /* Compaction leaves 3/4 of the maximum size for the old entries and the
+    * new one.
+    */
+   if (record_size > pack->max_size / 4 * 3)
+      goto out;
+
+   if (!lock_index(pack))
+      goto out;
+
+   /* Another process may have stomped on the index, (e.g. one of another
+    * version).
+    */
+   if (!index_is_valid(pack) && !reset_pack(pack))
+      goto unlock;
+
+   slot = find_slot(pack, key);
+   if (slot && slot->record_size != 0)
+      goto unlock;
+
+   if (pack->index->pack_size + record_size > pack->max_size ||
+       pack->index->num_used_slots >= PACK_INDEX_MAX_USED_SLOTS) {
+      if (!compact_pack(pack, record_size))
+         goto unlock;
+
+      slot = find_slot(pack, key);
+   }
+
+   if (!open_write_fd(pack))
+      goto unlock;
+
+   uint64_t offset = pack->index->pack_size;
+   if (pwrite_all(pack->write_fd, record, record_size, offset) == -1)
+      goto unlock;
+
+   uint32_t now = p_atomic_inc_return(&pack->index->access_clock);
+   if (slot) {
+      /* Reuse the slot of a removed entry. */
+      slot->record_size = record_size;
+      slot->last_access = now;
+      p_atomic_set(&slot->offset, offset);
+   } else {
+      insert_slot(pack, key, offset, record_size, now);
+   }
+
+   pack->index->pack_size = offset + record_size;
+   pack->index->live_size += record_size;
+
+ unlock:
+   unlock_index(pack);
+ out:
+   free(record);
+}
+
+void *
+disk_cache_pack_get(struct disk_cache_pack *pack, const cache_key key,
+                    const void *driver_keys, size_t driver_keys_size,
+                    size_t *size)
+{
+   const struct pack_record_header *header;
+   struct pack_index_slot *slot;
+   struct pack_mapping *mapping;
+   uint64_t offset;
+   uint32_t record_size;
+   uint8_t *data = NULL;
+
+   slot = find_slot(pack, key);
+   if (!slot)
+      return NULL;
+
+   offset = p_atomic_read(&slot->offset);
+   record_size = slot->record_size;
+   if (record_size < sizeof(*header))
+      return NULL;
+
+   mapping = acquire_mapping(pack, offset + record_size);
+   if (!mapping)
+      return NULL;
+
+   /* The slot may have changed under us, check that this is the record we
+    * are looking for, and that it is consistent.
+    */
+   header = (const struct pack_record_header *) (mapping->map + offset);
+   if (header->magic != PACK_RECORD_MAGIC ||
+       header->record_size != record_size ||
+       memcmp(header->key, key, CACHE_KEY_SIZE) != 0 ||
+       header->metadata_num_keys > record_size / sizeof(cache_key))
+      goto done;
+
+   /* Check for extremely unlikely hash collisions */
+   if (header->driver_keys_crc32 !=
+       util_hash_crc32(driver_keys, driver_keys_size))
+      goto done;
+
+   size_t header_size = sizeof(*header) +
+                        header->metadata_num_keys * sizeof(cache_key);
+   if (header_size + header->stored_size > record_size)
+      goto done;
+
+   const uint8_t *stored = (const uint8_t *) header + header_size;
+
+   data = malloc(header->uncompressed_size);
+   if (!data)
+      goto done;
+
+   if (header->flags & PACK_RECORD_DEFLATE) {
+      uLongf uncompressed_size = header->uncompressed_size;
+
+      if (uncompress(data, &uncompressed_size, stored,
+                     header->stored_size) != Z_OK ||
+          uncompressed_size != header->uncompressed_size)
+         goto fail;
+   } else {
+      if (header->stored_size != header->uncompressed_size)
+         goto fail;
+
+      memcpy(data, stored, header->stored_size);
+   }
+
+   /* Check the data for corruption */
+   if (header->crc32 != util_hash_crc32(data, header->uncompressed_size))
+      goto fail;
+
+   if (size)
+      *size = header->uncompressed_size;
+
+   slot->last_access = p_atomic_inc_return(&pack->index->access_clock);
+
+ done:
+   release_mapping(pack, mapping);
+   return data;
+
+ fail:
+   free(data);
+   data = NULL;
+   goto done;
+}
+
+void
+disk_cache_pack_remove(struct disk_cache_pack *pack, const cache_key key)
+{
+   struct pack_index_slot *slot;
+
+   if (!lock_index(pack))
+      return;
+
+   slot = find_slot(pack, key);
+   if (slot && slot->record_size != 0 && index_is_valid(pack)) {
+      pack->index->live_size -= slot->record_size;
+      slot->record_size = 0;
+   }
+
+   unlock_index(pack);
+}
+
+#endif /* ENABLE_SHADER_CACHE */
@@ -0,0 +1,93 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Pack-file storage for the disk cache.
+ *
+ * Instead of one file per entry, entries are appended to a single "pack"
+ * file in the cache directory, and located through a hash table kept in a
+ * shared mapping of the "pack_index" file, so that a lookup costs no
+ * syscalls and a hit at most a memcpy or an inflate out of the mapped pack.
+ *
+ * Appends, removals and compactions are serialized with a flock on the
+ * index file between processes, and a mutex within one.  Readers take no
+ * lock: every record carries its key and checksums, so a read racing with
+ * a writer is just a cache miss.
+ *
+ * This is only used by disk_cache.c, when MESA_GLSL_CACHE_PACK is set.
+ */
+
+#ifndef DISK_CACHE_PACK_H
+#define DISK_CACHE_PACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "disk_cache.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct disk_cache_pack;
+
+/**
+ * Opens (or creates) the pack and its index in the directory \path.
+ *
+ * Returns NULL on any error.  The pack is allocated off \mem_ctx.
+ */
+struct disk_cache_pack *
+disk_cache_pack_open(void *mem_ctx, const char *path, uint64_t max_size);
+
+void
+disk_cache_pack_close(struct disk_cache_pack *pack);
+
+/**
+ * Appends an entry, compacting the pack first if that's needed to stay
+ * under the maximum cache size.  Does nothing if \key is already stored.
+ *
+ * \driver_keys is the driver keys blob of the cache, which is checked on
+ * reads to catch (extremely unlikely) hash collisions.
+ */
+void
+disk_cache_pack_put(struct disk_cache_pack *pack, const cache_key key,
+                    const void *driver_keys, size_t driver_keys_size,
+                    const struct cache_item_metadata *metadata,
+                    const void *data, size_t size);
+
+/**
+ * Looks up an entry, returning a malloc'ed copy of its data, or NULL.
+ */
+void *
+disk_cache_pack_get(struct disk_cache_pack *pack, const cache_key key,
+                    const void *driver_keys, size_t driver_keys_size,
+                    size_t *size);
+
+void
+disk_cache_pack_remove(struct disk_cache_pack *pack, const cache_key key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DISK_CACHE_PACK_H */
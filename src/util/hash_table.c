@@ -44,9 +44,14 @@
 #include <string.h>
 #include <assert.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "hash_table.h"
 #include "ralloc.h"
 #include "macros.h"
+#include "bitscan.h"
 #include "main/hash.h"
 
 static const uint32_t deleted_key_value;
@@ -110,6 +115,334 @@ entry_is_present(const struct hash_table *ht, struct hash_entry *entry)
    return entry->key != NULL && entry->key != ht->deleted_key;
 }
 
+/**
+ * Tagged tables, created with _mesa_hash_table_create_tagged().
+ *
+ * They hold the same entries, but in a power-of-two sized table, next to
+ * an array with a one byte tag per slot: 7 bits of the hash of a present
+ * entry, or TAG_EMPTY/TAG_DELETED.  Lookups probe groups of
+ * TAG_GROUP_SIZE consecutive slots, comparing the tag of the key against
+ * the whole group at once, and only read the entries whose tag matches.
+ * Most lookups so touch one line of tags and the entry they return, while
+ * the double hashing of other tables reads a full entry, usually from a
+ * different cache line, at each probe.
+ *
+ * The tag array has TAG_GROUP_SIZE extra tags mirroring the first ones, so
+ * that the group starting at any slot can be loaded without wrapping.
+ */
+
+#define TAG_GROUP_SIZE 16
+#define TAG_EMPTY 0x80
+#define TAG_DELETED 0xfe
+#define TAG_MIN_SIZE_LOG2 4
+#define TAG_MAX_SIZE_LOG2 31
+
+static inline bool
+tag_is_full(uint8_t tag)
+{
+   return tag < 0x80;
+}
+
+/* Returns the bitmask of the tags of the group equal to tag. */
+static inline unsigned
+tag_group_match(const uint8_t *group, uint8_t tag)
+{
+#ifdef __SSE2__
+   __m128i tags = _mm_loadu_si128((const __m128i *)group);
+   return _mm_movemask_epi8(_mm_cmpeq_epi8(tags, _mm_set1_epi8(tag)));
+#else
+   unsigned mask = 0;
+
+   for (unsigned i = 0; i < TAG_GROUP_SIZE; i++)
+      mask |= (unsigned)(group[i] == tag) << i;
+   return mask;
+#endif
+}
+
+/* Returns the bitmask of the empty or deleted slots of the group. */
+static inline unsigned
+tag_group_match_free(const uint8_t *group)
+{
+#ifdef __SSE2__
+   return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+#else
+   unsigned mask = 0;
+
+   for (unsigned i = 0; i < TAG_GROUP_SIZE; i++)
+      mask |= (unsigned)(group[i] >> 7) << i;
+   return mask;
+#endif
+}
+
+/* The hashes of the users are often weak in their low bits (pointers), or
+ * in their high bits (small integers), so spread them with a multiplicative
+ * hash: the slot comes from the top bits of the product, the tag from bits
+ * below them.
+ */
+static inline uint64_t
+tagged_mix(uint32_t hash)
+{
+   return hash * 0x9e3779b97f4a7c15ull;
+}
+
+static inline uint32_t
+tagged_start(const struct hash_table *ht, uint64_t mix)
+{
+   return mix >> (64 - ht->size_index);
+}
+
+static inline uint8_t
+tagged_tag(uint64_t mix)
+{
+   return (mix >> 25) & 0x7f;
+}
+
+static inline void
+tagged_set_tag(struct hash_table *ht, uint32_t i, uint8_t tag)
+{
+   ht->tags[i] = tag;
+   if (i < TAG_GROUP_SIZE)
+      ht->tags[ht->size + i] = tag;
+}
+
+static bool
+tagged_alloc(struct hash_table *ht, unsigned size_log2)
+{
+   uint32_t size = 1u << size_log2;
+   uint8_t *tags;
+   struct hash_entry *table;
+
+   tags = ralloc_array(ht, uint8_t, size + TAG_GROUP_SIZE);
+   table = ralloc_array(ht, struct hash_entry, size);
+   if (tags == NULL || table == NULL) {
+      ralloc_free(tags);
+      ralloc_free(table);
+      return false;
+   }
+
+   memset(tags, TAG_EMPTY, size + TAG_GROUP_SIZE);
+
+   ht->tags = tags;
+   ht->table = table;
+   ht->size_index = size_log2;
+   ht->size = size;
+   ht->rehash = 0;
+   ht->max_entries = size - size / 8;
+   ht->entries = 0;
+   ht->deleted_entries = 0;
+
+   return true;
+}
+
+/* Groups are probed at triangular offsets from the start slot, which visits
+ * every group of a power-of-two table.
+ */
+static struct hash_entry *
+tagged_search(struct hash_table *ht, uint32_t hash, const void *key)
+{
+   uint64_t mix = tagged_mix(hash);
+   uint8_t tag = tagged_tag(mix);
+   uint32_t mask = ht->size - 1;
+   uint32_t pos = tagged_start(ht, mix);
+
+   for (uint32_t stride = 0; stride < ht->size; ) {
+      const uint8_t *group = ht->tags + pos;
+      unsigned match = tag_group_match(group, tag);
+
+      while (match) {
+         struct hash_entry *entry =
+            ht->table + ((pos + u_bit_scan(&match)) & mask);
+
+         if (entry->hash == hash && ht->key_equals_function(key, entry->key))
+            return entry;
+      }
+
+      if (tag_group_match(group, TAG_EMPTY))
+         return NULL;
+
+      stride += TAG_GROUP_SIZE;
+      pos = (pos + stride) & mask;
+   }
+
+   return NULL;
+}
+
+static struct hash_entry *
+tagged_fill(struct hash_table *ht, uint32_t i, uint8_t tag,
+            uint32_t hash, const void *key, void *data)
+{
+   struct hash_entry *entry = ht->table + i;
+
+   if (ht->tags[i] == TAG_DELETED)
+      ht->deleted_entries--;
+   tagged_set_tag(ht, i, tag);
+   entry->hash = hash;
+   entry->key = key;
+   entry->data = data;
+   ht->entries++;
+
+   return entry;
+}
+
+static void
+tagged_rehash(struct hash_table *ht, unsigned new_size_log2)
+{
+   struct hash_table old_ht;
+
+   if (new_size_log2 > TAG_MAX_SIZE_LOG2)
+      return;
+
+   old_ht = *ht;
+   if (!tagged_alloc(ht, new_size_log2))
+      return;
+
+   /* The keys are known to be unique, so just take the first empty slot. */
+   for (uint32_t i = 0; i < old_ht.size; i++) {
+      const struct hash_entry *entry = old_ht.table + i;
+      uint64_t mix;
+      uint32_t pos, stride = 0;
+      unsigned empty;
+
+      if (!tag_is_full(old_ht.tags[i]))
+         continue;
+
+      mix = tagged_mix(entry->hash);
+      pos = tagged_start(ht, mix);
+      while (!(empty = tag_group_match(ht->tags + pos, TAG_EMPTY))) {
+         stride += TAG_GROUP_SIZE;
+         pos = (pos + stride) & (ht->size - 1);
+      }
+
+      tagged_fill(ht, (pos + ffs(empty) - 1) & (ht->size - 1),
+                  tagged_tag(mix), entry->hash, entry->key, entry->data);
+   }
+
+   ralloc_free(old_ht.tags);
+   ralloc_free(old_ht.table);
+}
+
+static struct hash_entry *
+tagged_insert(struct hash_table *ht, uint32_t hash,
+              const void *key, void *data)
+{
+   uint64_t mix;
+   uint8_t tag;
+   uint32_t mask, pos;
+   int64_t available = -1;
+
+   assert(key != NULL);
+
+   /* Grow if at least half the slots in use are live entries, or else
+    * just clean up the tombstones.
+    */
+   if (ht->entries + ht->deleted_entries >= ht->max_entries) {
+      tagged_rehash(ht, ht->entries >= ht->max_entries / 2 ?
+                        ht->size_index + 1 : ht->size_index);
+   }
+
+   mix = tagged_mix(hash);
+   tag = tagged_tag(mix);
+   mask = ht->size - 1;
+   pos = tagged_start(ht, mix);
+
+   for (uint32_t stride = 0; stride < ht->size; ) {
+      const uint8_t *group = ht->tags + pos;
+      unsigned match = tag_group_match(group, tag);
+
+      /* Replace the entry with a matching key, like hash_table_insert(). */
+      while (match) {
+         struct hash_entry *entry =
+            ht->table + ((pos + u_bit_scan(&match)) & mask);
+
+         if (entry->hash == hash && ht->key_equals_function(key, entry->key)) {
+            entry->key = key;
+            entry->data = data;
+            return entry;
+         }
+      }
+
+      if (available < 0) {
+         unsigned free_slots = tag_group_match_free(group);
+
+         if (free_slots)
+            available = (pos + ffs(free_slots) - 1) & mask;
+      }
+
+      if (tag_group_match(group, TAG_EMPTY))
+         break;
+
+      stride += TAG_GROUP_SIZE;
+      pos = (pos + stride) & mask;
+   }
+
+   /* We could only get here if a required resize failed. */
+   if (available < 0)
+      return NULL;
+
+   return tagged_fill(ht, available, tag, hash, key, data);
+}
+
+static void
+tagged_remove(struct hash_table *ht, struct hash_entry *entry)
+{
+   uint32_t i = entry - ht->table;
+   uint32_t mask = ht->size - 1;
+   unsigned empty_before, empty_after;
+
+   ht->entries--;
+
+   /* A lookup only probes past this slot if it saw it within a group
+    * without any empty slot.  If the run of non-empty slots around it is
+    * shorter than a group, that never happened and the slot can be made
+    * empty again rather than a tombstone.
+    */
+   empty_before = tag_group_match(ht->tags + ((i - TAG_GROUP_SIZE) & mask),
+                                  TAG_EMPTY);
+   empty_after = tag_group_match(ht->tags + i, TAG_EMPTY);
+
+   if (empty_before && empty_after &&
+       (TAG_GROUP_SIZE - util_last_bit(empty_before)) +
+       (ffs(empty_after) - 1) < TAG_GROUP_SIZE) {
+      tagged_set_tag(ht, i, TAG_EMPTY);
+   } else {
+      tagged_set_tag(ht, i, TAG_DELETED);
+      ht->deleted_entries++;
+   }
+}
+
+/* entry_is_present() for both layouts */
+static inline bool
+any_entry_is_present(const struct hash_table *ht, struct hash_entry *entry)
+{
+   if (ht->tags)
+      return tag_is_full(ht->tags[entry - ht->table]);
+
+   return entry_is_present(ht, entry);
+}
+
+static struct hash_entry *
+tagged_next_entry(struct hash_table *ht, struct hash_entry *entry)
+{
+   uint32_t i = entry == NULL ? 0 : entry - ht->table + 1;
+
+   /* Any full slot found in the mirrored tags past the end was already
+    * visited.
+    */
+   while (i < ht->size) {
+      unsigned full = ~tag_group_match_free(ht->tags + i) &
+                      ((1u << TAG_GROUP_SIZE) - 1);
+
+      if (full) {
+         i += ffs(full) - 1;
+         return i < ht->size ? ht->table + i : NULL;
+      }
+
+      i += TAG_GROUP_SIZE;
+   }
+
+   return NULL;
+}
+
 struct hash_table *
 _mesa_hash_table_create(void *mem_ctx,
                         uint32_t (*key_hash_function)(const void *key),
@@ -132,6 +465,7 @@ _mesa_hash_table_create(void *mem_ctx,
    ht->entries = 0;
    ht->deleted_entries = 0;
    ht->deleted_key = &deleted_key_value;
+   ht->tags = NULL;
 
    if (ht->table == NULL) {
       ralloc_free(ht);
@@ -141,6 +475,35 @@ _mesa_hash_table_create(void *mem_ctx,
    return ht;
 }
 
+/**
+ * Creates a hash table with the tagged layout described above, for the
+ * tables on hot paths.  It is used through the same functions as the ones
+ * from _mesa_hash_table_create().
+ */
+struct hash_table *
+_mesa_hash_table_create_tagged(void *mem_ctx,
+                               uint32_t (*key_hash_function)(const void *key),
+                               bool (*key_equals_function)(const void *a,
+                                                           const void *b))
+{
+   struct hash_table *ht;
+
+   ht = ralloc(mem_ctx, struct hash_table);
+   if (ht == NULL)
+      return NULL;
+
+   ht->key_hash_function = key_hash_function;
+   ht->key_equals_function = key_equals_function;
+   ht->deleted_key = &deleted_key_value;
+
+   if (!tagged_alloc(ht, TAG_MIN_SIZE_LOG2)) {
+      ralloc_free(ht);
+      return NULL;
+   }
+
+   return ht;
+}
+
 /**
  * Frees the given hash table.
  *
@@ -176,6 +539,18 @@ _mesa_hash_table_clear(struct hash_table *ht,
 {
    struct hash_entry *entry;
 
+   if (ht->tags) {
+      if (delete_function) {
+         hash_table_foreach(ht, entry)
+            delete_function(entry);
+      }
+
+      memset(ht->tags, TAG_EMPTY, ht->size + TAG_GROUP_SIZE);
+      ht->entries = 0;
+      ht->deleted_entries = 0;
+      return;
+   }
+
    for (entry = ht->table; entry != ht->table + ht->size; entry++) {
       if (entry->key == NULL)
          continue;
@@ -209,9 +584,13 @@ _mesa_hash_table_set_deleted_key(struct hash_table *ht, const void *deleted_key)
 static struct hash_entry *
 hash_table_search(struct hash_table *ht, uint32_t hash, const void *key)
 {
-   uint32_t start_hash_address = hash % ht->size;
-   uint32_t hash_address = start_hash_address;
+   uint32_t start_hash_address, hash_address;
+
+   if (ht->tags)
+      return tagged_search(ht, hash, key);
 
+   start_hash_address = hash % ht->size;
+   hash_address = start_hash_address;
    do {
       uint32_t double_hash;
 
@@ -296,6 +675,9 @@ hash_table_insert(struct hash_table *ht, uint32_t hash,
    uint32_t start_hash_address, hash_address;
    struct hash_entry *available_entry = NULL;
 
+   if (ht->tags)
+      return tagged_insert(ht, hash, key, data);
+
    assert(key != NULL);
 
    if (ht->entries >= ht->max_entries) {
@@ -393,6 +775,11 @@ _mesa_hash_table_remove(struct hash_table *ht,
    if (!entry)
       return;
 
+   if (ht->tags) {
+      tagged_remove(ht, entry);
+      return;
+   }
+
    entry->key = ht->deleted_key;
    ht->entries--;
    ht->deleted_entries++;
@@ -408,6 +795,9 @@ struct hash_entry *
 _mesa_hash_table_next_entry(struct hash_table *ht,
                             struct hash_entry *entry)
 {
+   if (ht->tags)
+      return tagged_next_entry(ht, entry);
+
    if (entry == NULL)
       entry = ht->table;
    else
@@ -441,14 +831,14 @@ _mesa_hash_table_random_entry(struct hash_table *ht,
       return NULL;
 
    for (entry = ht->table + i; entry != ht->table + ht->size; entry++) {
-      if (entry_is_present(ht, entry) &&
+      if (any_entry_is_present(ht, entry) &&
           (!predicate || predicate(entry))) {
          return entry;
       }
    }
 
    for (entry = ht->table; entry != ht->table + i; entry++) {
-      if (entry_is_present(ht, entry) &&
+      if (any_entry_is_present(ht, entry) &&
           (!predicate || predicate(entry))) {
          return entry;
       }
@@ -55,6 +55,13 @@ struct hash_table {
    uint32_t size_index;
    uint32_t entries;
    uint32_t deleted_entries;
+
+   /**
+    * One tag per slot of \c table, for tables made with
+    * _mesa_hash_table_create_tagged(), or NULL.  size_index is then the
+    * log2 of size, and rehash unused.
+    */
+   uint8_t *tags;
 };
 
 struct hash_table *
@@ -62,6 +69,11 @@ _mesa_hash_table_create(void *mem_ctx,
                         uint32_t (*key_hash_function)(const void *key),
                         bool (*key_equals_function)(const void *a,
                                                     const void *b));
+struct hash_table *
+_mesa_hash_table_create_tagged(void *mem_ctx,
+                               uint32_t (*key_hash_function)(const void *key),
+                               bool (*key_equals_function)(const void *a,
+                                                           const void *b));
 void _mesa_hash_table_destroy(struct hash_table *ht,
                               void (*delete_function)(struct hash_entry *entry));
 void _mesa_hash_table_clear(struct hash_table *ht,
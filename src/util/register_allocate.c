@@ -80,6 +80,14 @@
 #include "register_allocate.h"
 
 #define NO_REG ~0U
+#define NO_HEAP_INDEX ~0U
+
+/**
+ * Interference graphs with at least this many nodes don't get an adjacency
+ * matrix, which would take count^2 bits.  Duplicate interferences are
+ * detected with small per-node hash sets instead, see struct ra_node_set.
+ */
+#define RA_SPARSE_ADJACENCY_MIN_NODES 4096
 
 struct ra_reg {
    BITSET_WORD *conflicts;
@@ -121,13 +129,30 @@ struct ra_class {
    unsigned int *q;
 };
 
+/**
+ * Open-addressed hash set of node numbers, with linear probing.
+ *
+ * Each interference of a sparse graph is stored once, as the higher node
+ * number in the set of the lower one.  0 is thus never stored, and marks
+ * the empty slots.
+ */
+struct ra_node_set {
+   unsigned int *nodes;
+   unsigned int size_log2;
+   unsigned int count;
+};
+
 struct ra_node {
    /** @{
     *
     * List of which nodes this node interferes with.  This should be
     * symmetric with the other node.
+    *
+    * The adjacency bitset is NULL for graphs with sparse adjacency, which
+    * use the neighbors set instead.
     */
    BITSET_WORD *adjacency;
+   struct ra_node_set neighbors;
    unsigned int *adjacency_list;
    unsigned int adjacency_list_size;
    unsigned int adjacency_count;
@@ -152,6 +177,12 @@ struct ra_node {
     */
    unsigned int q_total;
 
+   /**
+    * Position of the node in the ra_simplify() heap of the nodes which
+    * aren't trivially colorable, or NO_HEAP_INDEX.
+    */
+   unsigned int heap_index;
+
    /* For an implementation that needs register spilling, this is the
     * approximate cost of spilling this node.
     */
@@ -175,6 +206,22 @@ struct ra_graph {
     */
    unsigned int stack_optimistic_start;
 
+   /** Whether the nodes have neighbors sets instead of adjacency bitsets. */
+   bool sparse_adjacency;
+
+   /** @{
+    * ra_simplify() work lists, only allocated during the call.
+    *
+    * The worklist is a FIFO of the trivially colorable nodes waiting to be
+    * pushed on the stack, and the heap is a binary min-heap of the other
+    * remaining nodes, ordered by q_total.
+    */
+   unsigned int *worklist;
+   unsigned int worklist_count;
+   unsigned int *heap;
+   unsigned int heap_count;
+   /** @} */
+
    unsigned int (*select_reg_callback)(struct ra_graph *g, BITSET_WORD *regs,
                                        void *data);
    void *select_reg_callback_data;
@@ -394,8 +441,6 @@ ra_set_finalize(struct ra_regs *regs, unsigned int **q_values)
 static void
 ra_add_node_adjacency(struct ra_graph *g, unsigned int n1, unsigned int n2)
 {
-   BITSET_SET(g->nodes[n1].adjacency, n2);
-
    assert(n1 != n2);
 
    int n1_class = g->nodes[n1].class;
@@ -427,9 +472,13 @@ ra_alloc_interference_graph(struct ra_regs *regs, unsigned int count)
 
    g->stack = rzalloc_array(g, unsigned int, count);
 
+   g->sparse_adjacency = count >= RA_SPARSE_ADJACENCY_MIN_NODES;
+
    for (i = 0; i < count; i++) {
-      int bitset_count = BITSET_WORDS(count);
-      g->nodes[i].adjacency = rzalloc_array(g, BITSET_WORD, bitset_count);
+      if (!g->sparse_adjacency) {
+         int bitset_count = BITSET_WORDS(count);
+         g->nodes[i].adjacency = rzalloc_array(g, BITSET_WORD, bitset_count);
+      }
 
       g->nodes[i].adjacency_list_size = 4;
       g->nodes[i].adjacency_list =
@@ -438,6 +487,7 @@ ra_alloc_interference_graph(struct ra_regs *regs, unsigned int count)
       g->nodes[i].q_total = 0;
 
       g->nodes[i].reg = NO_REG;
+      g->nodes[i].heap_index = NO_HEAP_INDEX;
    }
 
    return g;
@@ -460,11 +510,86 @@ ra_set_node_class(struct ra_graph *g,
    g->nodes[n].class = class;
 }
 
+static inline unsigned int
+ra_node_set_hash(unsigned int n, unsigned int size_log2)
+{
+   /* Fibonacci hashing, the high bits of the product are well mixed. */
+   return (n * 0x9e3779b9u) >> (32 - size_log2);
+}
+
+/**
+ * Inserts a node in the set, unless already present.
+ *
+ * Returns true if the node was added.
+ */
+static bool
+ra_node_set_add(void *mem_ctx, struct ra_node_set *set, unsigned int n)
+{
+   unsigned int mask = (1u << set->size_log2) - 1;
+   unsigned int i;
+
+   /* Keep the load factor under 1/2, so that probe sequences stay short. */
+   if (!set->nodes || set->count >= (mask + 1) / 2) {
+      unsigned int *old_nodes = set->nodes;
+      unsigned int old_size = set->nodes ? mask + 1 : 0;
+
+      set->size_log2 = set->nodes ? set->size_log2 + 1 : 3;
+      set->nodes = rzalloc_array(mem_ctx, unsigned int, 1u << set->size_log2);
+      mask = (1u << set->size_log2) - 1;
+
+      for (unsigned int j = 0; j < old_size; j++) {
+         if (!old_nodes[j])
+            continue;
+
+         i = ra_node_set_hash(old_nodes[j], set->size_log2);
+         while (set->nodes[i])
+            i = (i + 1) & mask;
+         set->nodes[i] = old_nodes[j];
+      }
+
+      ralloc_free(old_nodes);
+   }
+
+   i = ra_node_set_hash(n, set->size_log2);
+   while (set->nodes[i]) {
+      if (set->nodes[i] == n)
+         return false;
+      i = (i + 1) & mask;
+   }
+
+   set->nodes[i] = n;
+   set->count++;
+
+   return true;
+}
+
+/**
+ * Records the interference between two nodes.
+ *
+ * Returns false if it was already known.
+ */
+static bool
+ra_set_interference(struct ra_graph *g, unsigned int n1, unsigned int n2)
+{
+   if (g->sparse_adjacency) {
+      return ra_node_set_add(g, &g->nodes[MIN2(n1, n2)].neighbors,
+                             MAX2(n1, n2));
+   }
+
+   if (BITSET_TEST(g->nodes[n1].adjacency, n2))
+      return false;
+
+   BITSET_SET(g->nodes[n1].adjacency, n2);
+   BITSET_SET(g->nodes[n2].adjacency, n1);
+
+   return true;
+}
+
 void
 ra_add_node_interference(struct ra_graph *g,
                          unsigned int n1, unsigned int n2)
 {
-   if (n1 != n2 && !BITSET_TEST(g->nodes[n1].adjacency, n2)) {
+   if (n1 != n2 && ra_set_interference(g, n1, n2)) {
       ra_add_node_adjacency(g, n1, n2);
       ra_add_node_adjacency(g, n2, n1);
    }
@@ -478,6 +603,95 @@ pq_test(struct ra_graph *g, unsigned int n)
    return g->nodes[n].q_total < g->regs->classes[n_class]->p;
 }
 
+/**
+ * Returns whether node a should be optimistically pushed before node b.
+ *
+ * Ties go to the higher numbered node, which is the one the allocator has
+ * always picked.
+ */
+static bool
+ra_heap_less(struct ra_graph *g, unsigned int a, unsigned int b)
+{
+   if (g->nodes[a].q_total != g->nodes[b].q_total)
+      return g->nodes[a].q_total < g->nodes[b].q_total;
+
+   return a > b;
+}
+
+static inline void
+ra_heap_set(struct ra_graph *g, unsigned int i, unsigned int n)
+{
+   g->heap[i] = n;
+   g->nodes[n].heap_index = i;
+}
+
+static void
+ra_heap_sift_up(struct ra_graph *g, unsigned int i)
+{
+   unsigned int n = g->heap[i];
+
+   while (i > 0) {
+      unsigned int parent = (i - 1) / 2;
+
+      if (!ra_heap_less(g, n, g->heap[parent]))
+         break;
+
+      ra_heap_set(g, i, g->heap[parent]);
+      i = parent;
+   }
+
+   ra_heap_set(g, i, n);
+}
+
+static void
+ra_heap_sift_down(struct ra_graph *g, unsigned int i)
+{
+   unsigned int n = g->heap[i];
+
+   while (2 * i + 1 < g->heap_count) {
+      unsigned int child = 2 * i + 1;
+
+      if (child + 1 < g->heap_count &&
+          ra_heap_less(g, g->heap[child + 1], g->heap[child]))
+         child++;
+
+      if (!ra_heap_less(g, g->heap[child], n))
+         break;
+
+      ra_heap_set(g, i, g->heap[child]);
+      i = child;
+   }
+
+   ra_heap_set(g, i, n);
+}
+
+static void
+ra_heap_insert(struct ra_graph *g, unsigned int n)
+{
+   ra_heap_set(g, g->heap_count++, n);
+   ra_heap_sift_up(g, g->nodes[n].heap_index);
+}
+
+static void
+ra_heap_remove(struct ra_graph *g, unsigned int n)
+{
+   unsigned int i = g->nodes[n].heap_index;
+   unsigned int last = g->heap[--g->heap_count];
+
+   g->nodes[n].heap_index = NO_HEAP_INDEX;
+
+   if (i < g->heap_count) {
+      ra_heap_set(g, i, last);
+      ra_heap_sift_up(g, i);
+      ra_heap_sift_down(g, g->nodes[last].heap_index);
+   }
+}
+
+/**
+ * Removes the edges of node n from the graph, by updating the q totals of
+ * its neighbors.  Neighbors which become trivially colorable move from the
+ * heap to the worklist.
+ */
 static void
 decrement_q(struct ra_graph *g, unsigned int n)
 {
@@ -491,10 +705,28 @@ decrement_q(struct ra_graph *g, unsigned int n)
       if (!g->nodes[n2].in_stack) {
          assert(g->nodes[n2].q_total >= g->regs->classes[n2_class]->q[n_class]);
          g->nodes[n2].q_total -= g->regs->classes[n2_class]->q[n_class];
+
+         if (g->nodes[n2].heap_index != NO_HEAP_INDEX) {
+            if (pq_test(g, n2)) {
+               ra_heap_remove(g, n2);
+               g->worklist[g->worklist_count++] = n2;
+            } else {
+               ra_heap_sift_up(g, g->nodes[n2].heap_index);
+            }
+         }
       }
    }
 }
 
+static void
+ra_push_node(struct ra_graph *g, unsigned int n)
+{
+   decrement_q(g, n);
+   g->stack[g->stack_count] = n;
+   g->stack_count++;
+   g->nodes[n].in_stack = true;
+}
+
 /**
  * Simplifies the interference graph by pushing all
  * trivially-colorable nodes into a stack of nodes to be colored,
@@ -504,51 +736,55 @@ decrement_q(struct ra_graph *g, unsigned int n)
  * we optimistically choose a node and push it on the stack. We heuristically
  * push the node with the lowest total q value, since it has the fewest
  * neighbors and therefore is most likely to be allocated.
+ *
+ * Rather than rescanning the whole graph after each push, the trivially
+ * colorable nodes are kept in a worklist and the others in a heap ordered
+ * by q value, so that the cost is O((n + e) log n) instead of O(n^2).
  */
 static void
 ra_simplify(struct ra_graph *g)
 {
-   bool progress = true;
    unsigned int stack_optimistic_start = UINT_MAX;
+   unsigned int worklist_start = 0;
    int i;
 
-   while (progress) {
-      unsigned int best_optimistic_node = ~0;
-      unsigned int lowest_q_total = ~0;
-
-      progress = false;
-
-      for (i = g->count - 1; i >= 0; i--) {
-	 if (g->nodes[i].in_stack || g->nodes[i].reg != NO_REG)
-	    continue;
-
-	 if (pq_test(g, i)) {
-	    decrement_q(g, i);
-	    g->stack[g->stack_count] = i;
-	    g->stack_count++;
-	    g->nodes[i].in_stack = true;
-	    progress = true;
-	 } else {
-	    unsigned int new_q_total = g->nodes[i].q_total;
-	    if (new_q_total < lowest_q_total) {
-	       best_optimistic_node = i;
-	       lowest_q_total = new_q_total;
-	    }
-	 }
-      }
+   g->worklist = malloc(g->count * sizeof(unsigned int));
+   g->worklist_count = 0;
+   g->heap = malloc(g->count * sizeof(unsigned int));
+   g->heap_count = 0;
 
-      if (!progress && best_optimistic_node != ~0U) {
-         if (stack_optimistic_start == UINT_MAX)
-            stack_optimistic_start = g->stack_count;
+   for (i = g->count - 1; i >= 0; i--) {
+      g->nodes[i].heap_index = NO_HEAP_INDEX;
 
-	 decrement_q(g, best_optimistic_node);
-	 g->stack[g->stack_count] = best_optimistic_node;
-	 g->stack_count++;
-	 g->nodes[best_optimistic_node].in_stack = true;
-	 progress = true;
-      }
+      if (g->nodes[i].in_stack || g->nodes[i].reg != NO_REG)
+         continue;
+
+      if (pq_test(g, i))
+         g->worklist[g->worklist_count++] = i;
+      else
+         ra_heap_insert(g, i);
    }
 
+   while (true) {
+      while (worklist_start < g->worklist_count)
+         ra_push_node(g, g->worklist[worklist_start++]);
+
+      if (g->heap_count == 0)
+         break;
+
+      if (stack_optimistic_start == UINT_MAX)
+         stack_optimistic_start = g->stack_count;
+
+      unsigned int best_optimistic_node = g->heap[0];
+      ra_heap_remove(g, best_optimistic_node);
+      ra_push_node(g, best_optimistic_node);
+   }
+
+   free(g->worklist);
+   g->worklist = NULL;
+   free(g->heap);
+   g->heap = NULL;
+
    g->stack_optimistic_start = stack_optimistic_start;
 }
 
@@ -0,0 +1,377 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Checks tables made with _mesa_hash_table_create_tagged() against the
+ * default ones on random operations, and compares their speed.
+ *
+ * The benchmark keys follow the two main users of hash tables in the
+ * compiler: NIR passes mapping ralloc'ed instructions and SSA defs
+ * (pointer keys), and the GLSL linker looking up variable and block member
+ * names (string keys).
+ *
+ * Run with "bench" as the argument to print the timings.
+ */
+
+#undef NDEBUG
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "hash_table.h"
+#include "os_time.h"
+#include "ralloc.h"
+
+#define NUM_VALUES 4096
+
+/* Keeps the compiler from dropping the benchmarked lookups. */
+static uintptr_t sink;
+
+typedef struct hash_table *
+(*create_func)(void *mem_ctx,
+               uint32_t (*key_hash_function)(const void *key),
+               bool (*key_equals_function)(const void *a, const void *b));
+
+static uint32_t
+value_hash(const void *key)
+{
+   return *(const uint32_t *)key;
+}
+
+/* Puts many keys on the same slots and tags. */
+static uint32_t
+weak_value_hash(const void *key)
+{
+   return *(const uint32_t *)key & 0x1f;
+}
+
+static bool
+value_equal(const void *a, const void *b)
+{
+   return *(const uint32_t *)a == *(const uint32_t *)b;
+}
+
+static void
+check_same(struct hash_table *ref, struct hash_table *ht)
+{
+   struct hash_entry *entry;
+   uint32_t count = 0;
+
+   assert(ref->entries == ht->entries);
+
+   hash_table_foreach(ht, entry) {
+      struct hash_entry *ref_entry = _mesa_hash_table_search(ref, entry->key);
+
+      assert(ref_entry && ref_entry->data == entry->data);
+      count++;
+   }
+
+   assert(count == ht->entries);
+}
+
+/**
+ * Runs the same random inserts, replacements, lookups and removals on a
+ * default and a tagged table.  Keys are looked up through copies, so that
+ * only the equality function can find them.
+ */
+static void
+test_random(uint32_t (*hash)(const void *key))
+{
+   static uint32_t keys[NUM_VALUES], copies[NUM_VALUES];
+   struct hash_table *ref, *ht;
+
+   ref = _mesa_hash_table_create(NULL, hash, value_equal);
+   ht = _mesa_hash_table_create_tagged(NULL, hash, value_equal);
+
+   for (uint32_t i = 0; i < NUM_VALUES; i++)
+      keys[i] = copies[i] = i * 0x10001;
+
+   for (uint32_t op = 0; op < 200000; op++) {
+      uint32_t i = rand() % NUM_VALUES;
+      struct hash_entry *ref_entry = _mesa_hash_table_search(ref, &copies[i]);
+      struct hash_entry *entry = _mesa_hash_table_search(ht, &copies[i]);
+
+      assert(!ref_entry == !entry);
+      assert(!entry || (entry->key == &keys[i] &&
+                        entry->data == ref_entry->data));
+
+      switch (rand() % 4) {
+      case 0:
+      case 1: {
+         void *data = (void *)(uintptr_t)rand();
+
+         ref_entry = _mesa_hash_table_insert(ref, &keys[i], data);
+         entry = _mesa_hash_table_insert(ht, &keys[i], data);
+         assert(entry->key == &keys[i] && entry->data == data);
+         break;
+      }
+      default:
+         _mesa_hash_table_remove(ref, ref_entry);
+         _mesa_hash_table_remove(ht, entry);
+         assert(!_mesa_hash_table_search(ht, &copies[i]));
+         break;
+      }
+
+      if (op % 10000 == 0)
+         check_same(ref, ht);
+
+      /* Sometimes empty the tables, with removals from the iteration. */
+      if (op % 50000 == 25000) {
+         hash_table_foreach(ht, entry) {
+            _mesa_hash_table_remove(ref, _mesa_hash_table_search(ref,
+                                                                 entry->key));
+            _mesa_hash_table_remove(ht, entry);
+         }
+         assert(ht->entries == 0 && ref->entries == 0);
+      }
+   }
+
+   check_same(ref, ht);
+
+   for (uint32_t i = 0; i < 100; i++) {
+      struct hash_entry *entry = _mesa_hash_table_random_entry(ht, NULL);
+
+      assert(entry == _mesa_hash_table_search(ht, entry->key));
+   }
+
+   _mesa_hash_table_clear(ht, NULL);
+   assert(ht->entries == 0);
+   assert(_mesa_hash_table_next_entry(ht, NULL) == NULL);
+   assert(_mesa_hash_table_random_entry(ht, NULL) == NULL);
+   for (uint32_t i = 0; i < NUM_VALUES; i++)
+      assert(!_mesa_hash_table_search(ht, &copies[i]));
+
+   _mesa_hash_table_destroy(ref, NULL);
+   _mesa_hash_table_destroy(ht, NULL);
+}
+
+/**
+ * Checks growing to a large table, and that removing and reinserting keys
+ * doesn't grow it further.
+ */
+static void
+test_grow_and_churn(void)
+{
+   const uint32_t count = 100000;
+   uint32_t *keys = malloc(count * sizeof(uint32_t));
+   struct hash_table *ht =
+      _mesa_hash_table_create_tagged(NULL, value_hash, value_equal);
+   uint32_t size;
+
+   for (uint32_t i = 0; i < count; i++) {
+      keys[i] = i;
+      _mesa_hash_table_insert(ht, &keys[i], &keys[i]);
+   }
+   assert(ht->entries == count);
+
+   size = ht->size;
+   for (uint32_t round = 0; round < 8; round++) {
+      for (uint32_t i = round; i < count; i += 2) {
+         _mesa_hash_table_remove(ht, _mesa_hash_table_search(ht, &keys[i]));
+         assert(!_mesa_hash_table_search(ht, &keys[i]));
+      }
+      for (uint32_t i = round; i < count; i += 2)
+         _mesa_hash_table_insert(ht, &keys[i], &keys[i]);
+   }
+   assert(ht->entries == count);
+   assert(ht->size == size);
+
+   for (uint32_t i = 0; i < count; i++) {
+      struct hash_entry *entry = _mesa_hash_table_search(ht, &i);
+
+      assert(entry && entry->data == &keys[i]);
+   }
+
+   _mesa_hash_table_destroy(ht, NULL);
+   free(keys);
+}
+
+enum bench_op {
+   BENCH_INSERT,
+   BENCH_HIT,
+   BENCH_MISS,
+   BENCH_ITERATE,
+   BENCH_REMOVE,
+   BENCH_NUM_OPS
+};
+
+/**
+ * Times filling a table with keys, looking them up through lookup_keys,
+ * looking up absent keys, iterating and removing all the keys.
+ */
+static void
+bench(const char *name, create_func create,
+      uint32_t (*hash)(const void *key),
+      bool (*equals)(const void *a, const void *b),
+      void **keys, void **lookup_keys, void **misses, unsigned count)
+{
+   unsigned runs = MAX2((1 << 21) / count, 1);
+   int64_t time[BENCH_NUM_OPS] = { 0 };
+
+   for (unsigned r = 0; r < runs; r++) {
+      struct hash_table *ht;
+      struct hash_entry *entry;
+      int64_t start = os_time_get_nano(), end;
+
+      ht = create(NULL, hash, equals);
+      for (unsigned i = 0; i < count; i++)
+         _mesa_hash_table_insert(ht, keys[i], keys[i]);
+      end = os_time_get_nano();
+      time[BENCH_INSERT] += end - start;
+
+      start = end;
+      for (unsigned i = 0; i < count; i++)
+         sink += (uintptr_t)_mesa_hash_table_search(ht, lookup_keys[i])->data;
+      end = os_time_get_nano();
+      time[BENCH_HIT] += end - start;
+
+      start = end;
+      for (unsigned i = 0; i < count; i++)
+         sink += _mesa_hash_table_search(ht, misses[i]) != NULL;
+      end = os_time_get_nano();
+      time[BENCH_MISS] += end - start;
+
+      start = end;
+      hash_table_foreach(ht, entry)
+         sink += (uintptr_t)entry->data;
+      end = os_time_get_nano();
+      time[BENCH_ITERATE] += end - start;
+
+      start = end;
+      for (unsigned i = 0; i < count; i++) {
+         _mesa_hash_table_remove(ht,
+                                 _mesa_hash_table_search(ht, lookup_keys[i]));
+      }
+      end = os_time_get_nano();
+      time[BENCH_REMOVE] += end - start;
+
+      assert(ht->entries == 0);
+      _mesa_hash_table_destroy(ht, NULL);
+   }
+
+   printf("%-7s %6u keys  insert %6.1f  hit %6.1f  miss %6.1f  "
+          "iterate %5.1f  remove %6.1f ns/key\n",
+          name, count,
+          (double)time[BENCH_INSERT] / runs / count,
+          (double)time[BENCH_HIT] / runs / count,
+          (double)time[BENCH_MISS] / runs / count,
+          (double)time[BENCH_ITERATE] / runs / count,
+          (double)time[BENCH_REMOVE] / runs / count);
+}
+
+static void
+bench_both(const char *dist, uint32_t (*hash)(const void *key),
+           bool (*equals)(const void *a, const void *b),
+           void **keys, void **lookup_keys, void **misses, unsigned count)
+{
+   printf("%s\n", dist);
+   bench("default", _mesa_hash_table_create, hash, equals,
+         keys, lookup_keys, misses, count);
+   bench("tagged", _mesa_hash_table_create_tagged, hash, equals,
+         keys, lookup_keys, misses, count);
+}
+
+/**
+ * NIR-like keys: the instructions and SSA defs of a shader, allocated
+ * from the same context, with misses allocated among them.
+ */
+static void
+bench_pointers(void *mem_ctx, unsigned count)
+{
+   void **keys = ralloc_array(mem_ctx, void *, count);
+   void **misses = ralloc_array(mem_ctx, void *, count);
+
+   for (unsigned i = 0; i < count; i++) {
+      keys[i] = ralloc_size(mem_ctx, 32 + rand() % 128);
+      misses[i] = ralloc_size(mem_ctx, 32 + rand() % 128);
+   }
+
+   bench_both("pointers", _mesa_hash_pointer, _mesa_key_pointer_equal,
+              keys, keys, misses, count);
+}
+
+/**
+ * Linker-like keys: uniform, varying and interface block member names,
+ * looked up through other copies of the names.
+ */
+static void
+bench_strings(void *mem_ctx, unsigned count)
+{
+   static const char *const prefixes[] = {
+      "u_", "in_", "out_", "v_", "gl_", "_vs_", "ubo.",
+      NULL, /* array of structs */
+   };
+   static const char *const names[] = {
+      "position", "normal", "texcoord", "color", "tangent", "mvp",
+      "material.diffuse", "shadow_matrix", "bones", "weights",
+   };
+   void **keys = ralloc_array(mem_ctx, void *, count);
+   void **lookup_keys = ralloc_array(mem_ctx, void *, count);
+   void **misses = ralloc_array(mem_ctx, void *, count);
+
+   for (unsigned i = 0; i < count; i++) {
+      const char *prefix = prefixes[i % ARRAY_SIZE(prefixes)];
+      const char *name = names[(i / ARRAY_SIZE(prefixes)) % ARRAY_SIZE(names)];
+      unsigned index = i / (ARRAY_SIZE(prefixes) * ARRAY_SIZE(names));
+
+      if (prefix == NULL) {
+         keys[i] = ralloc_asprintf(mem_ctx, "lights[%u].%s%u",
+                                   index % 8, name, index);
+      } else {
+         keys[i] = ralloc_asprintf(mem_ctx, "%s%s%u", prefix, name, index);
+      }
+      lookup_keys[i] = ralloc_strdup(mem_ctx, keys[i]);
+      misses[i] = ralloc_asprintf(mem_ctx, "%s_", (char *)keys[i]);
+   }
+
+   bench_both("strings", _mesa_key_hash_string, _mesa_key_string_equal,
+              keys, lookup_keys, misses, count);
+}
+
+int
+main(int argc, char **argv)
+{
+   srand(0);
+
+   test_random(value_hash);
+   test_random(weak_value_hash);
+   test_grow_and_churn();
+
+   if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+      static const unsigned counts[] = { 16, 256, 4096, 65536 };
+
+      for (unsigned i = 0; i < ARRAY_SIZE(counts); i++) {
+         void *mem_ctx = ralloc_context(NULL);
+
+         bench_pointers(mem_ctx, counts[i]);
+         bench_strings(mem_ctx, counts[i]);
+
+         ralloc_free(mem_ctx);
+      }
+   }
+
+   return 0;
+}
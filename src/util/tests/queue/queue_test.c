@@ -0,0 +1,280 @@
+/*
+ * Copyright © 2018 Advanced Micro Devices, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NON-INFRINGEMENT. IN NO EVENT SHALL THE COPYRIGHT HOLDERS, AUTHORS
+ * AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ */
+
+/**
+ * @file
+ * Checks the job order of util_queue priorities, the scaling of its thread
+ * count and its statistics.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "u_atomic.h"
+#include "u_queue.h"
+
+#define NUM_JOBS 16
+
+struct test_job {
+   struct util_queue_fence fence;
+   int id;
+};
+
+static bool success = true;
+
+/* Jobs wait on this until the test lets them go. */
+static struct util_queue_fence gate;
+static int num_started;
+
+static int order[2 * NUM_JOBS];
+static int num_finished;
+
+static void
+expect(bool result, const char *test)
+{
+   if (!result) {
+      fprintf(stderr, "Error: Test '%s' failed\n", test);
+      success = false;
+   }
+}
+
+static void
+record_execute(void *data, int thread_index)
+{
+   struct test_job *job = data;
+
+   order[p_atomic_inc_return(&num_finished) - 1] = job->id;
+}
+
+static void
+gated_execute(void *data, int thread_index)
+{
+   p_atomic_inc(&num_started);
+   util_queue_fence_wait(&gate);
+}
+
+static void
+wait_for_started(int count)
+{
+   while (p_atomic_read(&num_started) < count)
+      os_time_sleep(100);
+}
+
+static void
+test_priorities(void)
+{
+   struct util_queue queue;
+   struct test_job blocker, normal[NUM_JOBS], high[NUM_JOBS];
+   struct util_queue_stats stats;
+   int expected[2 * NUM_JOBS];
+   int num_expected = 0;
+
+   util_queue_init(&queue, "test", 4, 1, UTIL_QUEUE_INIT_RESIZE_IF_FULL);
+
+   /* Keep the only thread busy while the jobs are queued. */
+   util_queue_fence_init(&gate);
+   util_queue_fence_reset(&gate);
+   num_started = 0;
+   util_queue_fence_init(&blocker.fence);
+   util_queue_add_job(&queue, &blocker, &blocker.fence, gated_execute, NULL);
+   wait_for_started(1);
+
+   num_finished = 0;
+   for (int i = 0; i < NUM_JOBS; i++) {
+      normal[i].id = i;
+      util_queue_fence_init(&normal[i].fence);
+      util_queue_add_job(&queue, &normal[i], &normal[i].fence,
+                         record_execute, NULL);
+
+      high[i].id = NUM_JOBS + i;
+      util_queue_fence_init(&high[i].fence);
+      util_queue_add_job_with_priority(&queue, &high[i], &high[i].fence,
+                                       record_execute, NULL,
+                                       UTIL_QUEUE_PRIORITY_HIGH);
+   }
+
+   /* Dropped jobs aren't executed. */
+   util_queue_drop_job(&queue, &high[1].fence);
+   util_queue_drop_job(&queue, &normal[1].fence);
+
+   util_queue_fence_signal(&gate);
+   util_queue_finish(&queue);
+
+   expect(num_finished == 2 * NUM_JOBS - 2, "all jobs executed");
+
+   /* High priority jobs first, then normal ones, each in FIFO order. */
+   for (int i = 0; i < NUM_JOBS; i++) {
+      if (i != 1)
+         expected[num_expected++] = NUM_JOBS + i;
+   }
+   for (int i = 0; i < NUM_JOBS; i++) {
+      if (i != 1)
+         expected[num_expected++] = i;
+   }
+   expect(num_finished == num_expected &&
+          memcmp(order, expected, num_expected * sizeof(int)) == 0,
+          "high priority jobs executed first, in order");
+
+   util_queue_get_stats(&queue, &stats);
+   expect(stats.num_added[UTIL_QUEUE_PRIORITY_NORMAL] == NUM_JOBS + 2,
+          "stats: normal priority jobs added, including finish");
+   expect(stats.num_added[UTIL_QUEUE_PRIORITY_HIGH] == NUM_JOBS,
+          "stats: high priority jobs added");
+   expect(stats.num_executed == 2 * NUM_JOBS,
+          "stats: jobs executed, not the dropped ones");
+   expect(stats.max_queued >= 2 * NUM_JOBS, "stats: most jobs queued");
+   expect(stats.num_threads == 1, "stats: number of threads");
+   expect(stats.thread_time_nano >= 0, "stats: thread time");
+
+   for (int i = 0; i < NUM_JOBS; i++) {
+      util_queue_fence_destroy(&normal[i].fence);
+      util_queue_fence_destroy(&high[i].fence);
+   }
+   util_queue_fence_destroy(&blocker.fence);
+   util_queue_fence_destroy(&gate);
+
+   util_queue_destroy(&queue);
+}
+
+static void
+test_scaling(void)
+{
+   struct util_queue queue;
+   struct test_job jobs[NUM_JOBS];
+   struct util_queue_stats stats;
+
+   util_queue_init(&queue, "test", 4, 4,
+                   UTIL_QUEUE_INIT_RESIZE_IF_FULL |
+                   UTIL_QUEUE_INIT_SCALE_THREADS);
+
+   util_queue_get_stats(&queue, &stats);
+   expect(stats.num_threads == 1, "scaling: one thread initially");
+
+   /* A thread is added for each job which can't start right away. */
+   util_queue_fence_init(&gate);
+   util_queue_fence_reset(&gate);
+   num_started = 0;
+   for (int i = 0; i < 6; i++) {
+      util_queue_fence_init(&jobs[i].fence);
+      util_queue_add_job(&queue, &jobs[i], &jobs[i].fence,
+                         gated_execute, NULL);
+      if (i < 4)
+         wait_for_started(i + 1);
+   }
+
+   util_queue_get_stats(&queue, &stats);
+   expect(stats.num_threads == 4, "scaling: up to the maximum of threads");
+
+   util_queue_fence_signal(&gate);
+   util_queue_finish(&queue);
+   expect(num_started == 6, "scaling: all jobs executed");
+
+   for (int i = 0; i < 6; i++)
+      util_queue_fence_destroy(&jobs[i].fence);
+
+   util_queue_adjust_num_threads(&queue, 2);
+   util_queue_get_stats(&queue, &stats);
+   expect(stats.num_threads == 2, "scaling: fewer threads");
+   expect(util_queue_get_thread_time_nano(&queue, 3) == 0,
+          "scaling: no time for a removed thread");
+
+   /* The remaining threads still run the jobs. */
+   num_finished = 0;
+   for (int i = 0; i < NUM_JOBS; i++) {
+      jobs[i].id = i;
+      util_queue_fence_init(&jobs[i].fence);
+      util_queue_add_job(&queue, &jobs[i], &jobs[i].fence,
+                         record_execute, NULL);
+   }
+   for (int i = 0; i < NUM_JOBS; i++)
+      util_queue_fence_wait(&jobs[i].fence);
+   expect(num_finished == NUM_JOBS, "scaling: jobs executed after shrinking");
+
+   util_queue_adjust_num_threads(&queue, 100);
+   util_queue_get_stats(&queue, &stats);
+   expect(stats.num_threads == 4, "scaling: at most the maximum of threads");
+
+   for (int i = 0; i < NUM_JOBS; i++)
+      util_queue_fence_destroy(&jobs[i].fence);
+   util_queue_fence_destroy(&gate);
+
+   util_queue_destroy(&queue);
+}
+
+static void
+gated_shrink_execute(void *data, int thread_index)
+{
+   gated_execute(NULL, thread_index);
+
+   /* The second thread would have to join itself. */
+   if (thread_index == 1)
+      util_queue_adjust_num_threads(data, 1);
+}
+
+static void
+test_shrink_from_job(void)
+{
+   struct util_queue queue;
+   struct util_queue_fence fences[2];
+   struct util_queue_stats stats;
+
+   util_queue_init(&queue, "test", 4, 2, 0);
+
+   /* Both threads take a job before any of them shrinks the queue. */
+   util_queue_fence_init(&gate);
+   util_queue_fence_reset(&gate);
+   num_started = 0;
+   for (int i = 0; i < 2; i++) {
+      util_queue_fence_init(&fences[i]);
+      util_queue_add_job(&queue, &queue, &fences[i],
+                         gated_shrink_execute, NULL);
+   }
+   wait_for_started(2);
+   util_queue_fence_signal(&gate);
+
+   for (int i = 0; i < 2; i++)
+      util_queue_fence_wait(&fences[i]);
+
+   util_queue_get_stats(&queue, &stats);
+   expect(stats.num_threads == 2, "shrinking from a job keeps its thread");
+
+   for (int i = 0; i < 2; i++)
+      util_queue_fence_destroy(&fences[i]);
+   util_queue_fence_destroy(&gate);
+
+   util_queue_destroy(&queue);
+}
+
+int
+main(void)
+{
+   test_priorities();
+   test_scaling();
+   test_shrink_from_job();
+
+   return success ? 0 : 1;
+}
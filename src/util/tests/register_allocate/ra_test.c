@@ -0,0 +1,328 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Checks the allocations made by register_allocate.c on interference
+ * graphs shaped like those of its users, and measures its compile time cost.
+ *
+ * The register sets mirror the ones set up by brw_fs_reg_allocate.cpp
+ * (128 GRFs, contiguous VGRFs of 1 to 16 registers) and
+ * vir_register_allocate.c (64 physical registers plus 5 accumulators).
+ * The graphs are those of random live ranges over a straight-line program,
+ * from small shaders to the very large compute shaders which made the
+ * allocator quadratic costs show up.
+ *
+ * Run with "bench" as the argument to print the timings.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ralloc.h"
+#include "os_time.h"
+#include "register_allocate.h"
+
+#define BRW_GRF_COUNT 128
+#define BRW_MAX_VGRF_SIZE 16
+
+#define V3D_ACC_COUNT 5
+#define V3D_PHYS_COUNT 64
+
+struct backend {
+   const char *name;
+   struct ra_regs *regs;
+   unsigned int class_count;
+   unsigned int *classes;
+
+   /** First GRF and size of each register, for checking conflicts */
+   unsigned int *reg_start;
+   unsigned int *reg_size;
+};
+
+struct live_range {
+   unsigned int start;
+   unsigned int end;
+   unsigned int class;
+};
+
+static void
+init_brw_fs(struct backend *b, void *mem_ctx)
+{
+   unsigned int reg_count = 0;
+   unsigned int reg = 0;
+
+   for (unsigned int size = 1; size <= BRW_MAX_VGRF_SIZE; size++)
+      reg_count += BRW_GRF_COUNT - (size - 1);
+
+   b->name = "brw_fs";
+   b->regs = ra_alloc_reg_set(mem_ctx, reg_count, false);
+   ra_set_allocate_round_robin(b->regs);
+   b->class_count = BRW_MAX_VGRF_SIZE;
+   b->classes = ralloc_array(mem_ctx, unsigned int, b->class_count);
+   b->reg_start = ralloc_array(mem_ctx, unsigned int, reg_count);
+   b->reg_size = ralloc_array(mem_ctx, unsigned int, reg_count);
+
+   unsigned int **q_values = ralloc_array(mem_ctx, unsigned int *,
+                                          b->class_count);
+
+   for (unsigned int i = 0; i < b->class_count; i++) {
+      unsigned int size = i + 1;
+
+      q_values[i] = ralloc_array(q_values, unsigned int, b->class_count);
+      for (unsigned int j = 0; j < b->class_count; j++)
+         q_values[i][j] = size + (j + 1) - 1;
+
+      b->classes[i] = ra_alloc_reg_class(b->regs);
+
+      for (unsigned int j = 0; j < BRW_GRF_COUNT - (size - 1); j++) {
+         ra_class_add_reg(b->regs, b->classes[i], reg);
+         b->reg_start[reg] = j;
+         b->reg_size[reg] = size;
+
+         for (unsigned int base_reg = j; base_reg < j + size; base_reg++)
+            ra_add_reg_conflict(b->regs, base_reg, reg);
+
+         reg++;
+      }
+   }
+
+   for (unsigned int r = 0; r < BRW_GRF_COUNT; r++)
+      ra_make_reg_conflicts_transitive(b->regs, r);
+
+   ra_set_finalize(b->regs, q_values);
+}
+
+static void
+init_v3d(struct backend *b, void *mem_ctx)
+{
+   unsigned int reg_count = V3D_ACC_COUNT + V3D_PHYS_COUNT;
+
+   b->name = "v3d";
+   b->regs = ra_alloc_reg_set(mem_ctx, reg_count, true);
+   b->class_count = 2;
+   b->classes = ralloc_array(mem_ctx, unsigned int, b->class_count);
+   b->reg_start = ralloc_array(mem_ctx, unsigned int, reg_count);
+   b->reg_size = ralloc_array(mem_ctx, unsigned int, reg_count);
+
+   /* Class 0 is phys_or_acc, class 1 is phys only */
+   b->classes[0] = ra_alloc_reg_class(b->regs);
+   b->classes[1] = ra_alloc_reg_class(b->regs);
+
+   for (unsigned int r = 0; r < reg_count; r++) {
+      b->reg_start[r] = r;
+      b->reg_size[r] = 1;
+
+      ra_class_add_reg(b->regs, b->classes[0], r);
+      if (r >= V3D_ACC_COUNT)
+         ra_class_add_reg(b->regs, b->classes[1], r);
+   }
+
+   ra_set_finalize(b->regs, NULL);
+}
+
+/**
+ * Picks the class of a value, mostly small ones, like in real shaders.
+ */
+static unsigned int
+random_class(const struct backend *b)
+{
+   if (b->class_count == 2)
+      return rand() % 4 == 0 ? 1 : 0;
+
+   switch (rand() % 8) {
+   case 0:
+      return 1 + rand() % (b->class_count - 1);
+   case 1:
+   case 2:
+      return 1;
+   default:
+      return 0;
+   }
+}
+
+/**
+ * Generates one value defined per instruction, with mostly short live
+ * ranges and a few long ones (uniforms, loop counters, ...).  mean_length
+ * controls the register pressure.
+ */
+static struct live_range *
+generate_live_ranges(const struct backend *b, unsigned int count,
+                     unsigned int mean_length)
+{
+   struct live_range *ranges = malloc(count * sizeof(*ranges));
+
+   for (unsigned int i = 0; i < count; i++) {
+      unsigned int length = 1 + rand() % mean_length;
+
+      if (rand() % 64 == 0)
+         length *= 16;
+
+      ranges[i].start = i;
+      ranges[i].end = i + length;
+      ranges[i].class = random_class(b);
+   }
+
+   return ranges;
+}
+
+static struct ra_graph *
+build_graph(const struct backend *b, const struct live_range *ranges,
+            unsigned int count, bool add_twice)
+{
+   struct ra_graph *g = ra_alloc_interference_graph(b->regs, count);
+   unsigned int *active = malloc(count * sizeof(unsigned int));
+   unsigned int active_count = 0;
+
+   for (unsigned int i = 0; i < count; i++) {
+      ra_set_node_class(g, i, b->classes[ranges[i].class]);
+      ra_set_node_spill_cost(g, i, 1.0f);
+   }
+
+   /* The ranges are sorted by start, sweep over them. */
+   for (unsigned int i = 0; i < count; i++) {
+      unsigned int j = 0;
+
+      while (j < active_count) {
+         if (ranges[active[j]].end <= ranges[i].start)
+            active[j] = active[--active_count];
+         else
+            j++;
+      }
+
+      for (j = 0; j < active_count; j++) {
+         ra_add_node_interference(g, i, active[j]);
+         if (add_twice)
+            ra_add_node_interference(g, active[j], i);
+      }
+
+      active[active_count++] = i;
+   }
+
+   free(active);
+
+   return g;
+}
+
+static bool
+regs_conflict(const struct backend *b, unsigned int r1, unsigned int r2)
+{
+   return b->reg_start[r1] < b->reg_start[r2] + b->reg_size[r2] &&
+          b->reg_start[r2] < b->reg_start[r1] + b->reg_size[r1];
+}
+
+/**
+ * Checks that no two interfering values got conflicting registers, with a
+ * quadratic walk independent of the allocator data structures.
+ */
+static bool
+check_allocation(const struct backend *b, struct ra_graph *g,
+                 const struct live_range *ranges, unsigned int count)
+{
+   for (unsigned int i = 0; i < count; i++) {
+      unsigned int ri = ra_get_node_reg(g, i);
+
+      for (unsigned int j = i + 1;
+           j < count && ranges[j].start < ranges[i].end; j++) {
+         if (regs_conflict(b, ri, ra_get_node_reg(g, j))) {
+            fprintf(stderr, "%s: nodes %u and %u both got reg %u/%u\n",
+                    b->name, i, j, ri, ra_get_node_reg(g, j));
+            return false;
+         }
+      }
+   }
+
+   return true;
+}
+
+static bool
+run(const struct backend *b, unsigned int count, unsigned int mean_length,
+    bool bench)
+{
+   struct live_range *ranges = generate_live_ranges(b, count, mean_length);
+   bool add_twice = !bench;
+   bool success = true;
+   int64_t start, built, allocated;
+
+   start = os_time_get_nano();
+   struct ra_graph *g = build_graph(b, ranges, count, add_twice);
+   built = os_time_get_nano();
+   bool colored = ra_allocate(g);
+   allocated = os_time_get_nano();
+
+   if (colored) {
+      success = check_allocation(b, g, ranges, count);
+   } else if (ra_get_best_spill_node(g) < 0) {
+      fprintf(stderr, "%s: allocation of %u nodes failed without spill "
+              "candidates\n", b->name, count);
+      success = false;
+   }
+
+   if (bench) {
+      printf("%-8s %6u nodes %4u length  %-7s  build %8.3f ms  "
+             "allocate %8.3f ms\n",
+             b->name, count, mean_length, colored ? "colored" : "spills",
+             (built - start) / 1000000.0, (allocated - built) / 1000000.0);
+   }
+
+   ralloc_free(g);
+   free(ranges);
+
+   return success;
+}
+
+int
+main(int argc, char **argv)
+{
+   void *mem_ctx = ralloc_context(NULL);
+   struct backend backends[2];
+   bool bench = argc > 1 && strcmp(argv[1], "bench") == 0;
+   bool success = true;
+
+   srand(0);
+
+   init_brw_fs(&backends[0], mem_ctx);
+   init_v3d(&backends[1], mem_ctx);
+
+   for (unsigned int i = 0; i < 2; i++) {
+      const struct backend *b = &backends[i];
+      /* Up to and past the size where the graph stops using an adjacency
+       * matrix.
+       */
+      static const unsigned int counts[] = { 100, 1000, 5000, 20000 };
+
+      for (unsigned int j = 0; j < sizeof(counts) / sizeof(counts[0]); j++) {
+         if (!bench && counts[j] > 5000)
+            continue;
+
+         /* Low pressure, and pressure high enough to need spilling */
+         success = run(b, counts[j], 16, bench) && success;
+         success = run(b, counts[j], 128, bench) && success;
+      }
+   }
+
+   ralloc_free(mem_ctx);
+
+   return success ? 0 : 1;
+}
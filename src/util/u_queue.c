@@ -32,7 +32,8 @@
 #include "util/u_string.h"
 #include "util/u_thread.h"
 
-static void util_queue_killall_and_wait(struct util_queue *queue);
+static void util_queue_killall_and_wait(struct util_queue *queue,
+                                        bool from_atexit);
 
 /****************************************************************************
  * Wait for all queues to assert idle when exit() is called.
@@ -53,7 +54,7 @@ atexit_handler(void)
    mtx_lock(&exit_mutex);
    /* Wait for all queues to assert idle. */
    LIST_FOR_EACH_ENTRY(iter, &queue_list, head) {
-      util_queue_killall_and_wait(iter);
+      util_queue_killall_and_wait(iter, true);
    }
    mtx_unlock(&exit_mutex);
 }
@@ -230,6 +231,13 @@ struct thread_input {
    int thread_index;
 };
 
+static void
+util_queue_finish_execute(void *data, int num_thread)
+{
+   util_barrier *barrier = data;
+   util_barrier_wait(barrier);
+}
+
 static int
 util_queue_thread_func(void *input)
 {
@@ -246,25 +254,52 @@ util_queue_thread_func(void *input)
 
    while (1) {
       struct util_queue_job job;
+      struct util_queue_lane *lane;
+      int p;
 
       mtx_lock(&queue->lock);
-      assert(queue->num_queued >= 0 && queue->num_queued <= queue->max_jobs);
+      assert(queue->num_queued >= 0);
 
       /* wait if the queue is empty */
-      while (!queue->kill_threads && queue->num_queued == 0)
+      while (!queue->kill_threads && thread_index < queue->num_threads &&
+             queue->num_queued == 0) {
+         queue->num_idle_threads++;
          cnd_wait(&queue->has_queued_cond, &queue->lock);
+         queue->num_idle_threads--;
+      }
 
       if (queue->kill_threads) {
          mtx_unlock(&queue->lock);
          break;
       }
 
-      job = queue->jobs[queue->read_idx];
-      memset(&queue->jobs[queue->read_idx], 0, sizeof(struct util_queue_job));
-      queue->read_idx = (queue->read_idx + 1) % queue->max_jobs;
+      /* This thread was removed by util_queue_adjust_num_threads. Pass on
+       * the wakeup it may have received for a job.
+       */
+      if (thread_index >= queue->num_threads) {
+         if (queue->num_queued)
+            cnd_signal(&queue->has_queued_cond);
+         mtx_unlock(&queue->lock);
+         break;
+      }
+
+      /* take the oldest job of the highest priority */
+      p = UTIL_QUEUE_NUM_PRIORITIES - 1;
+      while (queue->lanes[p].num_queued == 0)
+         p--;
+      lane = &queue->lanes[p];
 
+      job = lane->jobs[lane->read_idx];
+      memset(&lane->jobs[lane->read_idx], 0, sizeof(struct util_queue_job));
+      lane->read_idx = (lane->read_idx + 1) % lane->max_jobs;
+
+      if (lane->num_queued == lane->max_jobs)
+         cnd_broadcast(&queue->has_space_cond);
+
+      lane->num_queued--;
       queue->num_queued--;
-      cnd_signal(&queue->has_space_cond);
+      if (job.job)
+         queue->num_executed++;
       mtx_unlock(&queue->lock);
 
       if (job.job) {
@@ -275,21 +310,66 @@ util_queue_thread_func(void *input)
       }
    }
 
-   /* signal remaining jobs before terminating */
    mtx_lock(&queue->lock);
-   for (unsigned i = queue->read_idx; i != queue->write_idx;
-        i = (i + 1) % queue->max_jobs) {
-      if (queue->jobs[i].job) {
-         util_queue_fence_signal(queue->jobs[i].fence);
-         queue->jobs[i].job = NULL;
+
+   /* signal remaining jobs before terminating */
+   if (queue->kill_threads) {
+      for (unsigned p = 0; p < UTIL_QUEUE_NUM_PRIORITIES; p++) {
+         struct util_queue_lane *lane = &queue->lanes[p];
+
+         for (unsigned i = lane->read_idx; i != lane->write_idx;
+              i = (i + 1) % lane->max_jobs) {
+            if (lane->jobs[i].job) {
+               util_queue_fence_signal(lane->jobs[i].fence);
+               lane->jobs[i].job = NULL;
+            }
+         }
+         lane->read_idx = lane->write_idx;
+         lane->num_queued = 0;
       }
+      queue->num_queued = 0;
    }
-   queue->read_idx = queue->write_idx;
-   queue->num_queued = 0;
+
+   queue->exited_thread_time += u_thread_get_time_nano(thrd_current());
    mtx_unlock(&queue->lock);
    return 0;
 }
 
+static bool
+util_queue_create_thread(struct util_queue *queue, unsigned index)
+{
+   struct thread_input *input =
+      (struct thread_input *) malloc(sizeof(struct thread_input));
+   if (!input)
+      return false;
+
+   input->queue = queue;
+   input->thread_index = index;
+
+   queue->threads[index] = u_thread_create(util_queue_thread_func, input);
+
+   if (!queue->threads[index]) {
+      free(input);
+      return false;
+   }
+
+   if (queue->flags & UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY) {
+#if defined(__linux__) && defined(SCHED_IDLE)
+      struct sched_param sched_param = {0};
+
+      /* The nice() function can only set a maximum of 19.
+       * SCHED_IDLE is the same as nice = 20.
+       *
+       * Note that Linux only allows decreasing the priority. The original
+       * priority can't be restored.
+       */
+      pthread_setschedparam(queue->threads[index], SCHED_IDLE, &sched_param);
+#endif
+   }
+
+   return true;
+}
+
 bool
 util_queue_init(struct util_queue *queue,
                 const char *name,
@@ -302,59 +382,43 @@ util_queue_init(struct util_queue *queue,
    memset(queue, 0, sizeof(*queue));
    queue->name = name;
    queue->flags = flags;
-   queue->num_threads = num_threads;
-   queue->max_jobs = max_jobs;
-
-   queue->jobs = (struct util_queue_job*)
-                 calloc(max_jobs, sizeof(struct util_queue_job));
-   if (!queue->jobs)
-      goto fail;
+   queue->max_threads = num_threads;
+   queue->num_threads = flags & UTIL_QUEUE_INIT_SCALE_THREADS ?
+                        MIN2(num_threads, 1) : num_threads;
+
+   for (i = 0; i < UTIL_QUEUE_NUM_PRIORITIES; i++) {
+      queue->lanes[i].max_jobs = max_jobs;
+      queue->lanes[i].jobs = (struct util_queue_job*)
+                             calloc(max_jobs, sizeof(struct util_queue_job));
+      if (!queue->lanes[i].jobs)
+         goto fail;
+   }
 
    (void) mtx_init(&queue->lock, mtx_plain);
+   (void) mtx_init(&queue->finish_lock, mtx_plain);
 
    queue->num_queued = 0;
    cnd_init(&queue->has_queued_cond);
    cnd_init(&queue->has_space_cond);
 
-   queue->threads = (thrd_t*) calloc(num_threads, sizeof(thrd_t));
+   queue->threads = (thrd_t*) calloc(queue->max_threads, sizeof(thrd_t));
    if (!queue->threads)
       goto fail;
 
    /* start threads */
-   for (i = 0; i < num_threads; i++) {
-      struct thread_input *input =
-         (struct thread_input *) malloc(sizeof(struct thread_input));
-      input->queue = queue;
-      input->thread_index = i;
-
-      queue->threads[i] = u_thread_create(util_queue_thread_func, input);
-
-      if (!queue->threads[i]) {
-         free(input);
-
+   for (i = 0; i < queue->num_threads; i++) {
+      if (!util_queue_create_thread(queue, i)) {
          if (i == 0) {
             /* no threads created, fail */
             goto fail;
          } else {
             /* at least one thread created, so use it */
+            mtx_lock(&queue->lock);
             queue->num_threads = i;
+            mtx_unlock(&queue->lock);
             break;
          }
       }
-
-      if (flags & UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY) {
-   #if defined(__linux__) && defined(SCHED_IDLE)
-         struct sched_param sched_param = {0};
-
-         /* The nice() function can only set a maximum of 19.
-          * SCHED_IDLE is the same as nice = 20.
-          *
-          * Note that Linux only allows decreasing the priority. The original
-          * priority can't be restored.
-          */
-         pthread_setschedparam(queue->threads[i], SCHED_IDLE, &sched_param);
-   #endif
-      }
    }
 
    add_to_atexit_list(queue);
@@ -363,46 +427,159 @@ util_queue_init(struct util_queue *queue,
 fail:
    free(queue->threads);
 
-   if (queue->jobs) {
+   if (queue->lanes[UTIL_QUEUE_NUM_PRIORITIES - 1].jobs) {
       cnd_destroy(&queue->has_space_cond);
       cnd_destroy(&queue->has_queued_cond);
+      mtx_destroy(&queue->finish_lock);
       mtx_destroy(&queue->lock);
-      free(queue->jobs);
    }
+   for (i = 0; i < UTIL_QUEUE_NUM_PRIORITIES; i++)
+      free(queue->lanes[i].jobs);
    /* also util_queue_is_initialized can be used to check for success */
    memset(queue, 0, sizeof(*queue));
    return false;
 }
 
+/* Returns the index of the calling thread if it is one of the queue's
+ * threads, or -1.  Must be called with the queue lock or finish_lock held.
+ */
+static int
+get_current_thread_index(struct util_queue *queue)
+{
+   thrd_t current = thrd_current();
+
+   for (unsigned i = 0; i < queue->num_threads; i++) {
+      if (thrd_equal(queue->threads[i], current))
+         return i;
+   }
+   return -1;
+}
+
 static void
-util_queue_killall_and_wait(struct util_queue *queue)
+util_queue_killall_and_wait(struct util_queue *queue, bool from_atexit)
 {
+   unsigned num_threads;
    unsigned i;
+   bool joinable;
+   int current;
+
+   /* exit() may be called while another thread is in util_queue_finish
+    * with finish_lock held, waiting for jobs which may never complete.
+    * The threads are then only told to terminate, as joining them could
+    * race with util_queue_adjust_num_threads.
+    */
+   if (from_atexit) {
+      joinable = mtx_trylock(&queue->finish_lock) == thrd_success;
+   } else {
+      mtx_lock(&queue->finish_lock);
+      joinable = true;
+   }
 
    /* Signal all threads to terminate. */
    mtx_lock(&queue->lock);
+   current = get_current_thread_index(queue);
    queue->kill_threads = 1;
+   num_threads = queue->num_threads;
+   queue->num_threads = 0;
    cnd_broadcast(&queue->has_queued_cond);
    mtx_unlock(&queue->lock);
 
-   for (i = 0; i < queue->num_threads; i++)
-      thrd_join(queue->threads[i], NULL);
-   queue->num_threads = 0;
+   if (!joinable)
+      return;
+
+   /* exit() can also be called by a job. */
+   for (i = 0; i < num_threads; i++) {
+      if ((int) i != current)
+         thrd_join(queue->threads[i], NULL);
+   }
+
+   mtx_unlock(&queue->finish_lock);
 }
 
 void
 util_queue_destroy(struct util_queue *queue)
 {
-   util_queue_killall_and_wait(queue);
+   util_queue_killall_and_wait(queue, false);
    remove_from_atexit_list(queue);
 
    cnd_destroy(&queue->has_space_cond);
    cnd_destroy(&queue->has_queued_cond);
+   mtx_destroy(&queue->finish_lock);
    mtx_destroy(&queue->lock);
-   free(queue->jobs);
+   for (unsigned i = 0; i < UTIL_QUEUE_NUM_PRIORITIES; i++)
+      free(queue->lanes[i].jobs);
    free(queue->threads);
 }
 
+/* Must be called with finish_lock held.
+ *
+ * The threads below num_threads are always running, so that they can be
+ * inspected with only the queue lock held.
+ */
+static void
+adjust_num_threads_locked(struct util_queue *queue, unsigned num_threads)
+{
+   unsigned old_num_threads = queue->num_threads;
+   unsigned i;
+
+   if (queue->kill_threads)
+      return;
+
+   if (num_threads < old_num_threads) {
+      /* The threads exit when they see their index is past num_threads. */
+      mtx_lock(&queue->lock);
+      queue->num_threads = num_threads;
+      cnd_broadcast(&queue->has_queued_cond);
+      mtx_unlock(&queue->lock);
+
+      for (i = num_threads; i < old_num_threads; i++)
+         thrd_join(queue->threads[i], NULL);
+   }
+
+   for (i = old_num_threads; i < num_threads; i++) {
+      bool created;
+
+      /* The new thread waits for the lock, and so sees its index below
+       * num_threads.
+       */
+      mtx_lock(&queue->lock);
+      created = util_queue_create_thread(queue, i);
+      if (created)
+         queue->num_threads = i + 1;
+      mtx_unlock(&queue->lock);
+
+      if (!created)
+         break;
+   }
+}
+
+void
+util_queue_adjust_num_threads(struct util_queue *queue, unsigned num_threads)
+{
+   int current;
+
+   num_threads = CLAMP(num_threads, 1, queue->max_threads);
+
+   mtx_lock(&queue->lock);
+   current = get_current_thread_index(queue);
+   mtx_unlock(&queue->lock);
+
+   if (current >= 0) {
+      /* Called by a job.  Its thread can't join itself, so it is kept, and
+       * util_queue_finish may hold finish_lock waiting for this job.
+       */
+      num_threads = MAX2(num_threads, current + 1);
+      if (mtx_trylock(&queue->finish_lock) != thrd_success)
+         return;
+   } else {
+      mtx_lock(&queue->finish_lock);
+   }
+
+   if (num_threads != queue->num_threads)
+      adjust_num_threads_locked(queue, num_threads);
+   mtx_unlock(&queue->finish_lock);
+}
+
 void
 util_queue_add_job(struct util_queue *queue,
                    void *job,
@@ -410,7 +587,21 @@ util_queue_add_job(struct util_queue *queue,
                    util_queue_execute_func execute,
                    util_queue_execute_func cleanup)
 {
+   util_queue_add_job_with_priority(queue, job, fence, execute, cleanup,
+                                    UTIL_QUEUE_PRIORITY_NORMAL);
+}
+
+void
+util_queue_add_job_with_priority(struct util_queue *queue,
+                                 void *job,
+                                 struct util_queue_fence *fence,
+                                 util_queue_execute_func execute,
+                                 util_queue_execute_func cleanup,
+                                 enum util_queue_priority priority)
+{
+   struct util_queue_lane *lane = &queue->lanes[priority];
    struct util_queue_job *ptr;
+   bool wake_thread, add_thread;
 
    mtx_lock(&queue->lock);
    if (queue->kill_threads) {
@@ -423,14 +614,14 @@ util_queue_add_job(struct util_queue *queue,
 
    util_queue_fence_reset(fence);
 
-   assert(queue->num_queued >= 0 && queue->num_queued <= queue->max_jobs);
+   assert(lane->num_queued >= 0 && lane->num_queued <= lane->max_jobs);
 
-   if (queue->num_queued == queue->max_jobs) {
+   if (lane->num_queued == lane->max_jobs) {
       if (queue->flags & UTIL_QUEUE_INIT_RESIZE_IF_FULL) {
          /* If the queue is full, make it larger to avoid waiting for a free
           * slot.
           */
-         unsigned new_max_jobs = queue->max_jobs + 8;
+         unsigned new_max_jobs = lane->max_jobs + 8;
          struct util_queue_job *jobs =
             (struct util_queue_job*)calloc(new_max_jobs,
                                            sizeof(struct util_queue_job));
@@ -438,38 +629,63 @@ util_queue_add_job(struct util_queue *queue,
 
          /* Copy all queued jobs into the new list. */
          unsigned num_jobs = 0;
-         unsigned i = queue->read_idx;
+         unsigned i = lane->read_idx;
 
          do {
-            jobs[num_jobs++] = queue->jobs[i];
-            i = (i + 1) % queue->max_jobs;
-         } while (i != queue->write_idx);
+            jobs[num_jobs++] = lane->jobs[i];
+            i = (i + 1) % lane->max_jobs;
+         } while (i != lane->write_idx);
 
-         assert(num_jobs == queue->num_queued);
+         assert(num_jobs == lane->num_queued);
 
-         free(queue->jobs);
-         queue->jobs = jobs;
-         queue->read_idx = 0;
-         queue->write_idx = num_jobs;
-         queue->max_jobs = new_max_jobs;
+         free(lane->jobs);
+         lane->jobs = jobs;
+         lane->read_idx = 0;
+         lane->write_idx = num_jobs;
+         lane->max_jobs = new_max_jobs;
       } else {
          /* Wait until there is a free slot. */
-         while (queue->num_queued == queue->max_jobs)
+         while (lane->num_queued == lane->max_jobs)
             cnd_wait(&queue->has_space_cond, &queue->lock);
       }
    }
 
-   ptr = &queue->jobs[queue->write_idx];
+   ptr = &lane->jobs[lane->write_idx];
    assert(ptr->job == NULL);
    ptr->job = job;
    ptr->fence = fence;
    ptr->execute = execute;
    ptr->cleanup = cleanup;
-   queue->write_idx = (queue->write_idx + 1) % queue->max_jobs;
+   lane->write_idx = (lane->write_idx + 1) % lane->max_jobs;
 
+   lane->num_queued++;
    queue->num_queued++;
-   cnd_signal(&queue->has_queued_cond);
+   queue->num_added[priority]++;
+   queue->max_queued = MAX2(queue->max_queued, queue->num_queued);
+
+   /* Busy threads look for queued jobs before waiting, so only wake up a
+    * thread if one is waiting.  Otherwise, add a thread if allowed, except
+    * for the jobs of util_queue_finish, which holds finish_lock and needs
+    * exactly one job per thread.
+    */
+   wake_thread = queue->num_idle_threads > 0;
+   add_thread = !wake_thread &&
+                (queue->flags & UTIL_QUEUE_INIT_SCALE_THREADS) &&
+                queue->num_threads < queue->max_threads &&
+                execute != util_queue_finish_execute;
    mtx_unlock(&queue->lock);
+
+   if (wake_thread)
+      cnd_signal(&queue->has_queued_cond);
+
+   /* Don't wait if util_queue_finish or another resize is in progress, the
+    * caller might be a job of this queue.
+    */
+   if (add_thread && mtx_trylock(&queue->finish_lock) == thrd_success) {
+      if (queue->num_threads < queue->max_threads)
+         adjust_num_threads_locked(queue, queue->num_threads + 1);
+      mtx_unlock(&queue->finish_lock);
+   }
 }
 
 /**
@@ -491,16 +707,20 @@ util_queue_drop_job(struct util_queue *queue, struct util_queue_fence *fence)
       return;
 
    mtx_lock(&queue->lock);
-   for (unsigned i = queue->read_idx; i != queue->write_idx;
-        i = (i + 1) % queue->max_jobs) {
-      if (queue->jobs[i].fence == fence) {
-         if (queue->jobs[i].cleanup)
-            queue->jobs[i].cleanup(queue->jobs[i].job, -1);
-
-         /* Just clear it. The threads will treat as a no-op job. */
-         memset(&queue->jobs[i], 0, sizeof(queue->jobs[i]));
-         removed = true;
-         break;
+   for (unsigned p = 0; p < UTIL_QUEUE_NUM_PRIORITIES && !removed; p++) {
+      struct util_queue_lane *lane = &queue->lanes[p];
+
+      for (unsigned i = lane->read_idx; i != lane->write_idx;
+           i = (i + 1) % lane->max_jobs) {
+         if (lane->jobs[i].fence == fence) {
+            if (lane->jobs[i].cleanup)
+               lane->jobs[i].cleanup(lane->jobs[i].job, -1);
+
+            /* Just clear it. The threads will treat as a no-op job. */
+            memset(&lane->jobs[i], 0, sizeof(lane->jobs[i]));
+            removed = true;
+            break;
+         }
       }
    }
    mtx_unlock(&queue->lock);
@@ -511,13 +731,6 @@ util_queue_drop_job(struct util_queue *queue, struct util_queue_fence *fence)
       util_queue_fence_wait(fence);
 }
 
-static void
-util_queue_finish_execute(void *data, int num_thread)
-{
-   util_barrier *barrier = data;
-   util_barrier_wait(barrier);
-}
-
 /**
  * Wait until all previously added jobs have completed.
  */
@@ -525,8 +738,12 @@ void
 util_queue_finish(struct util_queue *queue)
 {
    util_barrier barrier;
-   struct util_queue_fence *fences = malloc(queue->num_threads * sizeof(*fences));
+   struct util_queue_fence *fences;
 
+   /* The number of threads can't change while they wait on the barrier. */
+   mtx_lock(&queue->finish_lock);
+
+   fences = malloc(queue->num_threads * sizeof(*fences));
    util_barrier_init(&barrier, queue->num_threads);
 
    for (unsigned i = 0; i < queue->num_threads; ++i) {
@@ -538,6 +755,7 @@ util_queue_finish(struct util_queue *queue)
       util_queue_fence_wait(&fences[i]);
       util_queue_fence_destroy(&fences[i]);
    }
+   mtx_unlock(&queue->finish_lock);
 
    util_barrier_destroy(&barrier);
 
@@ -547,9 +765,28 @@ util_queue_finish(struct util_queue *queue)
 int64_t
 util_queue_get_thread_time_nano(struct util_queue *queue, unsigned thread_index)
 {
+   int64_t time = 0;
+
    /* Allow some flexibility by not raising an error. */
-   if (thread_index >= queue->num_threads)
-      return 0;
+   mtx_lock(&queue->lock);
+   if (thread_index < queue->num_threads)
+      time = u_thread_get_time_nano(queue->threads[thread_index]);
+   mtx_unlock(&queue->lock);
+
+   return time;
+}
 
-   return u_thread_get_time_nano(queue->threads[thread_index]);
+void
+util_queue_get_stats(struct util_queue *queue, struct util_queue_stats *stats)
+{
+   mtx_lock(&queue->lock);
+   memcpy(stats->num_added, queue->num_added, sizeof(stats->num_added));
+   stats->num_executed = queue->num_executed;
+   stats->max_queued = queue->max_queued;
+   stats->num_threads = queue->num_threads;
+   stats->thread_time_nano = queue->exited_thread_time;
+
+   for (unsigned i = 0; i < queue->num_threads; i++)
+      stats->thread_time_nano += u_thread_get_time_nano(queue->threads[i]);
+   mtx_unlock(&queue->lock);
 }
@@ -28,6 +28,9 @@
  *
  * Jobs can be added from any thread. After that, the wait call can be used
  * to wait for completion of the job.
+ *
+ * Jobs are started in the order they were added, except that queued jobs of
+ * a higher priority are all started before any of a lower priority.
  */
 
 #ifndef U_QUEUE_H
@@ -48,6 +51,18 @@ extern "C" {
 
 #define UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY      (1 << 0)
 #define UTIL_QUEUE_INIT_RESIZE_IF_FULL            (1 << 1)
+/* Start with one thread, and add more (up to the number of threads passed to
+ * util_queue_init) when jobs are added while all threads are busy.
+ */
+#define UTIL_QUEUE_INIT_SCALE_THREADS             (1 << 2)
+
+enum util_queue_priority {
+   /* The default, for jobs nothing is waiting for yet. */
+   UTIL_QUEUE_PRIORITY_NORMAL,
+   /* For jobs something will wait for soon, e.g. to draw. */
+   UTIL_QUEUE_PRIORITY_HIGH,
+   UTIL_QUEUE_NUM_PRIORITIES
+};
 
 #if defined(__GNUC__) && defined(HAVE_LINUX_FUTEX_H)
 #define UTIL_QUEUE_FENCE_FUTEX
@@ -197,25 +212,49 @@ struct util_queue_job {
    util_queue_execute_func cleanup;
 };
 
+/* The queued jobs of one priority. */
+struct util_queue_lane {
+   int num_queued;
+   int max_jobs;
+   int write_idx, read_idx; /* ring buffer pointers */
+   struct util_queue_job *jobs;
+};
+
 /* Put this into your context. */
 struct util_queue {
    const char *name;
    mtx_t lock;
+   mtx_t finish_lock; /* serializes finish and changes of the thread count */
    cnd_t has_queued_cond;
    cnd_t has_space_cond;
    thrd_t *threads;
    unsigned flags;
-   int num_queued;
+   int num_queued; /* in all lanes */
    unsigned num_threads;
+   unsigned max_threads;
+   unsigned num_idle_threads; /* waiting for has_queued_cond */
    int kill_threads;
-   int max_jobs;
-   int write_idx, read_idx; /* ring buffer pointers */
-   struct util_queue_job *jobs;
+   struct util_queue_lane lanes[UTIL_QUEUE_NUM_PRIORITIES];
+
+   /* statistics, protected by lock */
+   uint64_t num_added[UTIL_QUEUE_NUM_PRIORITIES];
+   uint64_t num_executed;
+   int max_queued;
+   int64_t exited_thread_time; /* CPU time of the threads which exited */
 
    /* for cleanup at exit(), protected by exit_mutex */
    struct list_head head;
 };
 
+/* Statistics of a queue since its creation. */
+struct util_queue_stats {
+   uint64_t num_added[UTIL_QUEUE_NUM_PRIORITIES];
+   uint64_t num_executed;
+   unsigned max_queued; /* the most jobs queued at the same time */
+   unsigned num_threads; /* current number of threads */
+   int64_t thread_time_nano; /* CPU time used by all threads */
+};
+
 bool util_queue_init(struct util_queue *queue,
                      const char *name,
                      unsigned max_jobs,
@@ -229,14 +268,30 @@ void util_queue_add_job(struct util_queue *queue,
                         struct util_queue_fence *fence,
                         util_queue_execute_func execute,
                         util_queue_execute_func cleanup);
+void util_queue_add_job_with_priority(struct util_queue *queue,
+                                      void *job,
+                                      struct util_queue_fence *fence,
+                                      util_queue_execute_func execute,
+                                      util_queue_execute_func cleanup,
+                                      enum util_queue_priority priority);
 void util_queue_drop_job(struct util_queue *queue,
                          struct util_queue_fence *fence);
 
 void util_queue_finish(struct util_queue *queue);
 
+/* Set the number of threads, between 1 and the number passed to
+ * util_queue_init.  Removed threads exit after their current job.  A job
+ * can't remove the thread running it.
+ */
+void util_queue_adjust_num_threads(struct util_queue *queue,
+                                   unsigned num_threads);
+
 int64_t util_queue_get_thread_time_nano(struct util_queue *queue,
                                         unsigned thread_index);
 
+void util_queue_get_stats(struct util_queue *queue,
+                          struct util_queue_stats *stats);
+
 /* util_queue needs to be cleared to zeroes for this to work */
 static inline bool
 util_queue_is_initialized(struct util_queue *queue)